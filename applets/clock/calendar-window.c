@@ -39,6 +39,7 @@
 #include "calendar-window.h"
 
 #include "clock.h"
+#include "clock-scheduler.h"
 #include "clock-utils.h"
 #include "clock-typebuiltins.h"
 
@@ -65,6 +66,9 @@ struct _CalendarWindowPrivate {
 	GtkWidget *locations_list;
 
 	GSettings  *settings;
+
+	guint       scheduler_id;
+	int         today;
 };
 
 G_DEFINE_TYPE (CalendarWindow, calendar_window, GTK_TYPE_WINDOW)
@@ -118,6 +122,36 @@ static void calendar_month_changed_cb(GtkCalendar *calendar, gpointer user_data)
 	g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, calendar_update, user_data, NULL);
 }
 
+static int
+calendar_window_get_today (time_t now)
+{
+	struct tm tm1;
+
+	localtime_r (&now, &tm1);
+
+	return (tm1.tm_year + 1900) * 1000 + tm1.tm_yday;
+}
+
+/* Move the mark when the day changes while the window is open */
+static void
+calendar_window_minute_tick (time_t   now,
+			     gpointer user_data)
+{
+	CalendarWindow *calwin = user_data;
+	int             today;
+
+	today = calendar_window_get_today (now);
+	if (today == calwin->priv->today)
+		return;
+
+	calwin->priv->today = today;
+
+	if (calwin->priv->calendar) {
+		gtk_calendar_clear_marks (GTK_CALENDAR (calwin->priv->calendar));
+		calendar_mark_today (GTK_CALENDAR (calwin->priv->calendar));
+	}
+}
+
 static GtkWidget *
 calendar_window_create_calendar (CalendarWindow *calwin)
 {
@@ -317,6 +351,11 @@ calendar_window_constructor (GType                  type,
 
 	calendar_window_fill (calwin);
 
+	calwin->priv->today = calendar_window_get_today (time (NULL));
+	calwin->priv->scheduler_id = clock_scheduler_add (CLOCK_SCHEDULER_MINUTE,
+							  calendar_window_minute_tick,
+							  calwin);
+
 	return obj;
 }
 
@@ -401,6 +440,10 @@ calendar_window_dispose (GObject *object)
 		g_object_unref (calwin->priv->settings);
 	calwin->priv->settings = NULL;
 
+	if (calwin->priv->scheduler_id)
+		clock_scheduler_remove (calwin->priv->scheduler_id);
+	calwin->priv->scheduler_id = 0;
+
 	G_OBJECT_CLASS (calendar_window_parent_class)->dispose (object);
 }
 
@@ -0,0 +1,333 @@
+/*
+ * clock-scheduler.c: wake up clock clients on second or minute boundaries
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * All the clocks, calendars and locations of the process share a single
+ * timer, armed at the next second boundary when a client needs seconds and
+ * at the next minute boundary otherwise. Minute clients are only called
+ * when the minute actually changed.
+ *
+ * With timerfd, the timer is an absolute CLOCK_REALTIME one, so it still
+ * fires on the boundary after a suspend, and TFD_TIMER_CANCEL_ON_SET makes
+ * it wake up as soon as the system time is set. Without it, we fall back
+ * to a relative timeout computed from the current time.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_SYS_TIMERFD_H
+#include <sys/timerfd.h>
+#include <glib-unix.h>
+#endif
+
+#include "clock-scheduler.h"
+
+#ifdef HAVE_SYS_TIMERFD_H
+#ifndef TFD_TIMER_CANCEL_ON_SET
+#define TFD_TIMER_CANCEL_ON_SET (1 << 1)
+#endif
+#endif
+
+typedef struct {
+	guint                      id;
+	ClockSchedulerGranularity  granularity;
+	ClockSchedulerFunc         func;
+	gpointer                   user_data;
+	time_t                     last_minute;
+} ClockSchedulerClient;
+
+static GSList   *clients = NULL;
+static guint     next_id = 1;
+
+static guint     timer_timeout = 0;
+#ifdef HAVE_SYS_TIMERFD_H
+static int       timer_fd = -1;
+static guint     timer_watch = 0;
+static gboolean  timer_was_set = FALSE;
+static gboolean  timerfd_unavailable = FALSE;
+#endif
+
+static void clock_scheduler_arm (void);
+
+static ClockSchedulerClient *
+clock_scheduler_find (guint id)
+{
+	GSList *l;
+
+	for (l = clients; l; l = l->next) {
+		ClockSchedulerClient *client = l->data;
+
+		if (client->id == id)
+			return client;
+	}
+
+	return NULL;
+}
+
+static ClockSchedulerGranularity
+clock_scheduler_get_granularity (void)
+{
+	GSList *l;
+
+	for (l = clients; l; l = l->next) {
+		ClockSchedulerClient *client = l->data;
+
+		if (client->granularity == CLOCK_SCHEDULER_SECOND)
+			return CLOCK_SCHEDULER_SECOND;
+	}
+
+	return CLOCK_SCHEDULER_MINUTE;
+}
+
+static void
+clock_scheduler_dispatch (gboolean time_was_set)
+{
+	GSList *ids = NULL;
+	GSList *l;
+	time_t  now;
+
+	time (&now);
+
+	/* Clients may add or remove clients from their callback */
+	for (l = clients; l; l = l->next) {
+		ClockSchedulerClient *client = l->data;
+
+		ids = g_slist_prepend (ids, GUINT_TO_POINTER (client->id));
+	}
+	ids = g_slist_reverse (ids);
+
+	for (l = ids; l; l = l->next) {
+		ClockSchedulerClient *client;
+
+		client = clock_scheduler_find (GPOINTER_TO_UINT (l->data));
+		if (!client)
+			continue;
+
+		if (client->granularity == CLOCK_SCHEDULER_MINUTE &&
+		    !time_was_set &&
+		    client->last_minute == now / 60)
+			continue;
+
+		client->last_minute = now / 60;
+		client->func (now, client->user_data);
+	}
+
+	g_slist_free (ids);
+}
+
+static void
+clock_scheduler_stop (void)
+{
+	if (timer_timeout)
+		g_source_remove (timer_timeout);
+	timer_timeout = 0;
+
+#ifdef HAVE_SYS_TIMERFD_H
+	if (timer_watch)
+		g_source_remove (timer_watch);
+	timer_watch = 0;
+
+	if (timer_fd != -1)
+		close (timer_fd);
+	timer_fd = -1;
+#endif
+}
+
+static gboolean
+clock_scheduler_timeout (gpointer data)
+{
+	timer_timeout = 0;
+
+	clock_scheduler_dispatch (FALSE);
+	clock_scheduler_arm ();
+
+	return FALSE;
+}
+
+#ifdef HAVE_SYS_TIMERFD_H
+static gboolean
+clock_scheduler_timer_fired (gint         fd,
+			     GIOCondition condition,
+			     gpointer     data)
+{
+	guint64  expirations;
+	gboolean time_was_set = timer_was_set;
+
+	timer_was_set = FALSE;
+
+	if (read (fd, &expirations, sizeof (expirations)) < 0) {
+		if (errno == ECANCELED)
+			time_was_set = TRUE;
+		else if (errno == EAGAIN || errno == EINTR)
+			return TRUE;
+	}
+
+	clock_scheduler_dispatch (time_was_set);
+
+	/* The dispatch may have removed the last client */
+	if (timer_fd != -1)
+		clock_scheduler_arm ();
+
+	return TRUE;
+}
+
+static gboolean
+clock_scheduler_arm_timerfd (ClockSchedulerGranularity granularity)
+{
+	struct itimerspec spec;
+	struct timespec   now;
+
+	if (timerfd_unavailable)
+		return FALSE;
+
+	if (timer_fd == -1) {
+		timer_fd = timerfd_create (CLOCK_REALTIME,
+					   TFD_NONBLOCK | TFD_CLOEXEC);
+		if (timer_fd == -1) {
+			timerfd_unavailable = TRUE;
+			return FALSE;
+		}
+
+		timer_watch = g_unix_fd_add (timer_fd, G_IO_IN,
+					     clock_scheduler_timer_fired,
+					     NULL);
+	}
+
+	clock_gettime (CLOCK_REALTIME, &now);
+
+	memset (&spec, 0, sizeof (spec));
+	if (granularity == CLOCK_SCHEDULER_SECOND)
+		spec.it_value.tv_sec = now.tv_sec + 1;
+	else
+		spec.it_value.tv_sec = (now.tv_sec / 60 + 1) * 60;
+
+	if (timerfd_settime (timer_fd,
+			     TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET,
+			     &spec, NULL) == 0)
+		return TRUE;
+
+	/* The time was set since our last read, and arming the timer
+	 * acknowledged it: fire right away as if the read had failed */
+	if (errno == ECANCELED) {
+		timer_was_set = TRUE;
+		spec.it_value.tv_sec = now.tv_sec;
+		spec.it_value.tv_nsec = now.tv_nsec;
+		if (timerfd_settime (timer_fd, TFD_TIMER_ABSTIME,
+				     &spec, NULL) == 0)
+			return TRUE;
+	}
+
+	clock_scheduler_stop ();
+	timerfd_unavailable = TRUE;
+
+	return FALSE;
+}
+#endif
+
+static void
+clock_scheduler_arm (void)
+{
+	ClockSchedulerGranularity granularity;
+	gint64                    now;
+	gint64                    period;
+	guint                     timeouttime;
+
+	if (!clients) {
+		clock_scheduler_stop ();
+		return;
+	}
+
+	granularity = clock_scheduler_get_granularity ();
+
+#ifdef HAVE_SYS_TIMERFD_H
+	if (clock_scheduler_arm_timerfd (granularity))
+		return;
+#endif
+
+	if (timer_timeout)
+		g_source_remove (timer_timeout);
+
+	now = g_get_real_time ();
+	period = granularity == CLOCK_SCHEDULER_SECOND ? 1 : 60;
+	period *= G_USEC_PER_SEC;
+
+	/* Overshoot a little so that time() is past the boundary */
+	timeouttime = (period - now % period) / 1000 + 20;
+
+	timer_timeout = g_timeout_add (timeouttime,
+				       clock_scheduler_timeout, NULL);
+}
+
+guint
+clock_scheduler_add (ClockSchedulerGranularity  granularity,
+		     ClockSchedulerFunc         func,
+		     gpointer                   user_data)
+{
+	ClockSchedulerClient *client;
+
+	g_return_val_if_fail (func != NULL, 0);
+
+	client = g_new0 (ClockSchedulerClient, 1);
+	client->id = next_id++;
+	client->granularity = granularity;
+	client->func = func;
+	client->user_data = user_data;
+	client->last_minute = time (NULL) / 60;
+
+	clients = g_slist_append (clients, client);
+
+	clock_scheduler_arm ();
+
+	return client->id;
+}
+
+void
+clock_scheduler_remove (guint id)
+{
+	ClockSchedulerClient *client;
+
+	client = clock_scheduler_find (id);
+	if (!client)
+		return;
+
+	clients = g_slist_remove (clients, client);
+	g_free (client);
+
+	clock_scheduler_arm ();
+}
+
+void
+clock_scheduler_set_granularity (guint                     id,
+				 ClockSchedulerGranularity granularity)
+{
+	ClockSchedulerClient *client;
+
+	client = clock_scheduler_find (id);
+	if (!client || client->granularity == granularity)
+		return;
+
+	client->granularity = granularity;
+	client->last_minute = time (NULL) / 60;
+
+	clock_scheduler_arm ();
+}
@@ -0,0 +1,51 @@
+/*
+ * clock-scheduler.h: wake up clock clients on second or minute boundaries
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __CLOCK_SCHEDULER_H__
+#define __CLOCK_SCHEDULER_H__
+
+#include <time.h>
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	CLOCK_SCHEDULER_SECOND,
+	CLOCK_SCHEDULER_MINUTE
+} ClockSchedulerGranularity;
+
+/* Called with the current time on each boundary of the client's
+ * granularity, and right away when the system time is set. */
+typedef void (*ClockSchedulerFunc) (time_t   now,
+				    gpointer user_data);
+
+guint clock_scheduler_add             (ClockSchedulerGranularity  granularity,
+				       ClockSchedulerFunc         func,
+				       gpointer                   user_data);
+void  clock_scheduler_remove          (guint                      id);
+void  clock_scheduler_set_granularity (guint                      id,
+				       ClockSchedulerGranularity  granularity);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CLOCK_SCHEDULER_H__ */
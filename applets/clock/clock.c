@@ -55,12 +55,15 @@
 #include <gdk/gdkx.h>
 #include <gio/gio.h>
 
+#include <libpanel-util/panel-stats.h>
+
 #include "clock.h"
 
 #include "calendar-window.h"
 #include "clock-location.h"
 #include "clock-location-tile.h"
 #include "clock-map.h"
+#include "clock-scheduler.h"
 #include "clock-utils.h"
 #include "set-timezone.h"
 #include "system-timezone.h"
@@ -152,6 +155,7 @@ struct _ClockData {
         time_t             current_time;
         char              *timeformat;
         guint              timeout;
+        guint              scheduler_id;
         MatePanelAppletOrient  orient;
         int                size;
         GtkAllocation      old_allocation;
@@ -161,6 +165,12 @@ struct _ClockData {
         int fixed_width;
         int fixed_height;
 
+        /* Label render cache: the text currently displayed, and the text
+         * with its digits masked, from which the label size was computed */
+        char        *clock_text;
+        char        *clock_skeleton;
+        PangoLayout *clock_layout;
+
         GtkWidget *showseconds_check;
         GtkWidget *showdate_check;
         GtkWidget *showweeks_check;
@@ -241,6 +251,14 @@ unfix_size (ClockData *cd)
 {
         cd->fixed_width = -1;
         cd->fixed_height = -1;
+
+        /* The font or the format may have changed */
+        g_free (cd->clock_skeleton);
+        cd->clock_skeleton = NULL;
+        if (cd->clock_layout)
+                g_object_unref (cd->clock_layout);
+        cd->clock_layout = NULL;
+
         gtk_widget_queue_resize (cd->panel_button);
 }
 
@@ -284,37 +302,25 @@ calculate_minimum_width (GtkWidget   *widget,
         return width;
 }
 
+/* Only used for the internet time, whose beats are not aligned on
+ * seconds; the other formats are driven by the clock scheduler */
 static void
 clock_set_timeout (ClockData *cd,
                    time_t     now)
 {
         int timeouttime;
+        int itime_ms;
 
-        if (cd->format == CLOCK_FORMAT_INTERNET) {
-                int itime_ms;
-
-                itime_ms = ((unsigned int) (get_itime (now) * 1000));
-
-                if (!cd->showseconds)
-                        timeouttime = (999 - itime_ms % 1000) * 86.4 + 1;
-                else {
-                        struct timeval tv;
-                        gettimeofday (&tv, NULL);
-                        itime_ms += (tv.tv_usec * 86.4) / 1000;
-                        timeouttime = ((999 - itime_ms % 1000) * 86.4) / 100 + 1;
-                }
-        } else {
-                 struct timeval tv;
+        itime_ms = ((unsigned int) (get_itime (now) * 1000));
 
+        if (!cd->showseconds)
+                timeouttime = (999 - itime_ms % 1000) * 86.4 + 1;
+        else {
+                struct timeval tv;
                 gettimeofday (&tv, NULL);
-                 timeouttime = (G_USEC_PER_SEC - tv.tv_usec)/1000+20;
-
-                /* timeout of one minute if we don't care about the seconds */
-                 if (cd->format != CLOCK_FORMAT_UNIX &&
-                    !cd->showseconds &&
-                    (!cd->set_time_window || !gtk_widget_get_visible (cd->set_time_window)))
-                         timeouttime += 1000 * (59 - now % 60);
-         }
+                itime_ms += (tv.tv_usec * 86.4) / 1000;
+                timeouttime = ((999 - itime_ms % 1000) * 86.4) / 100 + 1;
+        }
 
         cd->timeout = g_timeout_add (timeouttime,
                                      clock_timeout_callback,
@@ -329,28 +335,84 @@ clock_timeout_callback (gpointer data)
 
         time (&new_time);
 
-        if (!cd->showseconds &&
-            (!cd->set_time_window || !gtk_widget_get_visible (cd->set_time_window)) &&
-            cd->format != CLOCK_FORMAT_UNIX &&
-            cd->format != CLOCK_FORMAT_CUSTOM) {
-                if (cd->format == CLOCK_FORMAT_INTERNET &&
-                    (unsigned int)get_itime (new_time) !=
-                    (unsigned int)get_itime (cd->current_time)) {
-                        update_clock (cd);
-                } else if ((cd->format == CLOCK_FORMAT_12 ||
-                            cd->format == CLOCK_FORMAT_24) &&
-                           new_time / 60 != cd->current_time / 60) {
-                        update_clock (cd);
-                }
-        } else {
+        if (cd->showseconds ||
+            (cd->set_time_window && gtk_widget_get_visible (cd->set_time_window)) ||
+            (unsigned int)get_itime (new_time) !=
+            (unsigned int)get_itime (cd->current_time))
                 update_clock (cd);
-        }
 
         clock_set_timeout (cd, new_time);
 
         return FALSE;
 }
 
+static void
+clock_scheduler_tick (time_t    now,
+                      gpointer  data)
+{
+        update_clock ((ClockData *) data);
+}
+
+static gboolean
+clock_needs_seconds (ClockData *cd)
+{
+        if (cd->showseconds || cd->format == CLOCK_FORMAT_UNIX)
+                return TRUE;
+
+        if (cd->set_time_window && gtk_widget_get_visible (cd->set_time_window))
+                return TRUE;
+
+        if (cd->format == CLOCK_FORMAT_CUSTOM && cd->custom_format) {
+                const char *p;
+
+                for (p = cd->custom_format; *p; p++) {
+                        if (*p != '%' || !p[1])
+                                continue;
+                        p++;
+                        /* Skip the flags and width of the conversion */
+                        while (*p && strchr ("_-0^#EO123456789", *p))
+                                p++;
+                        if (*p && strchr ("sSTrXc+", *p))
+                                return TRUE;
+                        if (!*p)
+                                break;
+                }
+        }
+
+        return FALSE;
+}
+
+/* Make sure the clock gets updated as often as it needs to, and not
+ * more: only on minute boundaries unless seconds are displayed. */
+static void
+clock_update_schedule (ClockData *cd)
+{
+        ClockSchedulerGranularity granularity;
+
+        if (cd->timeout)
+                g_source_remove (cd->timeout);
+        cd->timeout = 0;
+
+        if (cd->format == CLOCK_FORMAT_INTERNET) {
+                if (cd->scheduler_id)
+                        clock_scheduler_remove (cd->scheduler_id);
+                cd->scheduler_id = 0;
+
+                clock_set_timeout (cd, cd->current_time);
+                return;
+        }
+
+        granularity = clock_needs_seconds (cd) ? CLOCK_SCHEDULER_SECOND
+                                               : CLOCK_SCHEDULER_MINUTE;
+
+        if (cd->scheduler_id)
+                clock_scheduler_set_granularity (cd->scheduler_id, granularity);
+        else
+                cd->scheduler_id = clock_scheduler_add (granularity,
+                                                        clock_scheduler_tick,
+                                                        cd);
+}
+
 static float
 get_itime (time_t current_time)
 {
@@ -583,35 +645,138 @@ format_time_24 (ClockData *cd)
         return g_locale_to_utf8 (buf, -1, NULL, NULL, NULL);
 }
 
+static char *
+clock_text_to_markup (const char *utf8)
+{
+        return g_markup_printf_escaped ("<span color=\"grey\"><b>%s</b></span>",
+                                        utf8);
+}
+
+static char *
+clock_text_get_skeleton (const char *utf8,
+                         char        digit)
+{
+        char *skeleton;
+        char *p;
+
+        skeleton = g_strdup (utf8);
+        for (p = skeleton; *p; p++) {
+                if (g_ascii_isdigit (*p))
+                        *p = digit;
+        }
+
+        return skeleton;
+}
+
+/* The widest rendering of the text with any digits, so that the label
+ * keeps the same size while the time changes */
+static int
+clock_text_get_max_width (ClockData  *cd,
+                          const char *utf8)
+{
+        int  max_width = 0;
+        char digit;
+
+        if (!cd->clock_layout) {
+                cd->clock_layout = gtk_widget_create_pango_layout (cd->clockw, NULL);
+                pango_layout_set_alignment (cd->clock_layout, PANGO_ALIGN_CENTER);
+        }
+
+        for (digit = '0'; digit <= '9'; digit++) {
+                char *text;
+                char *markup;
+                int   width;
+
+                text = clock_text_get_skeleton (utf8, digit);
+                markup = clock_text_to_markup (text);
+                pango_layout_set_markup (cd->clock_layout, markup, -1);
+                pango_layout_get_pixel_size (cd->clock_layout, &width, NULL);
+                g_free (markup);
+                g_free (text);
+
+                max_width = MAX (max_width, width);
+        }
+
+        return max_width;
+}
+
 static void
-update_clock (ClockData * cd)
+update_clock_label (ClockData  *cd,
+                    const char *utf8)
 {
-        //gboolean use_markup;
-        char *utf8;
+        char     *markup;
+        char     *skeleton;
+        gboolean  resize;
 
-        time (&cd->current_time);
-        utf8 = format_time (cd);
+        /* Most of the time, only the digits change: keep the size request
+         * of the label and only let it redraw */
+        skeleton = clock_text_get_skeleton (utf8, '0');
+        resize = g_strcmp0 (skeleton, cd->clock_skeleton) != 0;
 
-/*        use_markup = FALSE;
-        if (pango_parse_markup (utf8, -1, 0, NULL, NULL, NULL, NULL))
-                use_markup = TRUE;
+        markup = clock_text_to_markup (utf8);
+        gtk_label_set_markup (GTK_LABEL (cd->clockw), markup);
+        g_free (markup);
 
-        if (use_markup)
-                gtk_label_set_markup (GTK_LABEL (cd->clockw), utf8);
-        else
-                gtk_label_set_text (GTK_LABEL (cd->clockw), utf8); */
+        if (resize) {
+                GtkStyleContext *style_context;
+                GtkBorder        padding;
+                GtkBorder        border;
+                int              max_width;
 
-const char *format = "<span color=\"grey\"><b>\%s</b></span>";
-char *markup;
+                update_orient (cd);
 
-markup = g_markup_printf_escaped (format, utf8);
-		gtk_label_set_markup (GTK_LABEL (cd->clockw), markup);
-g_free (markup);
+                style_context = gtk_widget_get_style_context (cd->clockw);
+                gtk_style_context_get_padding (style_context,
+                                               gtk_widget_get_state_flags (cd->clockw),
+                                               &padding);
+                gtk_style_context_get_border (style_context,
+                                              gtk_widget_get_state_flags (cd->clockw),
+                                              &border);
 
-        g_free (utf8);
+                max_width = clock_text_get_max_width (cd, utf8);
+                if (gtk_label_get_angle (GTK_LABEL (cd->clockw)) == 0)
+                        gtk_widget_set_size_request (cd->clockw,
+                                                     max_width + padding.left + padding.right +
+                                                     border.left + border.right,
+                                                     -1);
+                else
+                        gtk_widget_set_size_request (cd->clockw,
+                                                     -1,
+                                                     max_width + padding.top + padding.bottom +
+                                                     border.top + border.bottom);
 
-        update_orient (cd);
-        gtk_widget_queue_resize (cd->panel_button);
+                g_free (cd->clock_skeleton);
+                cd->clock_skeleton = skeleton;
+
+                gtk_widget_queue_resize (cd->panel_button);
+                PANEL_STATS_COUNT ("clock-label-resize");
+        } else {
+                g_free (skeleton);
+        }
+
+        PANEL_STATS_COUNT ("clock-label-relayout");
+}
+
+static void
+update_clock (ClockData * cd)
+{
+        char *utf8;
+
+        time (&cd->current_time);
+        utf8 = format_time (cd);
+
+        if (g_strcmp0 (utf8, cd->clock_text) != 0) {
+                update_clock_label (cd, utf8);
+
+                g_free (cd->clock_text);
+                cd->clock_text = utf8;
+        } else if (!cd->clock_skeleton) {
+                /* Same text, but the size must be computed again */
+                update_clock_label (cd, utf8);
+                g_free (utf8);
+        } else {
+                g_free (utf8);
+        }
 
         update_tooltip (cd);
         update_location_tiles (cd);
@@ -704,12 +869,9 @@ refresh_clock_timeout(ClockData *cd)
 
         update_timeformat (cd);
 
-        if (cd->timeout)
-                g_source_remove (cd->timeout);
-
         update_clock (cd);
 
-        clock_set_timeout (cd, cd->current_time);
+        clock_update_schedule (cd);
 }
 
 /**
@@ -719,9 +881,8 @@ refresh_clock_timeout(ClockData *cd)
 static void
 refresh_click_timeout_time_only (ClockData *cd)
 {
-        if (cd->timeout)
-                g_source_remove (cd->timeout);
-        clock_timeout_callback (cd);
+        update_clock (cd);
+        clock_update_schedule (cd);
 }
 
 static void
@@ -749,6 +910,10 @@ destroy_clock (GtkWidget * widget, ClockData *cd)
                 g_source_remove (cd->timeout);
         cd->timeout = 0;
 
+        if (cd->scheduler_id)
+                clock_scheduler_remove (cd->scheduler_id);
+        cd->scheduler_id = 0;
+
         if (cd->props)
                 gtk_widget_destroy (cd->props);
         cd->props = NULL;
@@ -759,6 +924,10 @@ destroy_clock (GtkWidget * widget, ClockData *cd)
 
         g_free (cd->timeformat);
         g_free (cd->custom_format);
+        g_free (cd->clock_text);
+        g_free (cd->clock_skeleton);
+        if (cd->clock_layout)
+                g_object_unref (cd->clock_layout);
 
         free_locations (cd);
 
@@ -1660,6 +1829,8 @@ set_time_callback (ClockData *cd, GError *error)
 
         window = _clock_get_widget (cd, "set-time-window");
         gtk_widget_hide (window);
+
+        refresh_click_timeout_time_only (cd);
 }
 
 static void
@@ -2117,8 +2288,10 @@ custom_format_changed (GSettings    *settings,
         g_free (clock->custom_format);
         clock->custom_format = g_strdup (value);
 
-        if (clock->format == CLOCK_FORMAT_CUSTOM)
+        if (clock->format == CLOCK_FORMAT_CUSTOM) {
                 refresh_clock (clock);
+                clock_update_schedule (clock);
+        }
         g_free (value);
 }
 
@@ -2889,6 +3062,22 @@ clock_factory (MatePanelApplet *applet,
 {
         gboolean retval = FALSE;
 
+#ifndef CLOCK_INPROCESS
+        static gboolean stats_registered = FALSE;
+
+        /* In-process, the counters go to the panel's own statistics */
+        if (!stats_registered) {
+                GDBusConnection *connection;
+
+                connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, NULL);
+                if (connection) {
+                        panel_stats_register_object (connection);
+                        g_object_unref (connection);
+                }
+                stats_registered = TRUE;
+        }
+#endif
+
         if (!strcmp (iid, "ClockApplet"))
                 retval = fill_clock_applet (applet);
 
@@ -53,6 +53,7 @@
 #include <gio/gio.h>
 
 #include "system-timezone.h"
+#include "zoneinfo-index.h"
 
 /* Files that we look at and that should be monitored */
 #define CHECK_NB 5
@@ -656,84 +657,34 @@ system_timezone_read_etc_localtime_softlink (void)
         return tz;
 }
 
-typedef gboolean (*CompareFiles) (struct stat *a_stat,
-                                  struct stat *b_stat,
-                                  const char  *a_content,
-                                  gsize        a_content_len,
-                                  const char  *b_filename);
-
-static char *
-recursive_compare (struct stat  *localtime_stat,
-                   const char   *localtime_content,
-                   gsize         localtime_content_len,
-                   char         *file,
-                   CompareFiles  compare_func)
+/* The zoneinfo tree, indexed by inode and content to find which file
+ * /etc/localtime is a hard link to or a copy of */
+static ZoneinfoIndex *
+system_timezone_get_zoneinfo_index (void)
 {
-        struct stat file_stat;
-
-        if (g_stat (file, &file_stat) != 0)
-                return NULL;
-
-        if (S_ISREG (file_stat.st_mode)) {
-                if (compare_func (localtime_stat,
-                                  &file_stat,
-                                  localtime_content,
-                                  localtime_content_len,
-                                  file))
-                        return system_timezone_strip_path_if_valid (file);
-                else
-                        return NULL;
-        } else if (S_ISDIR (file_stat.st_mode)) {
-                GDir       *dir = NULL;
-                char       *ret = NULL;
-                const char *subfile = NULL;
-                char       *subpath = NULL;
-
-                dir = g_dir_open (file, 0, NULL);
-                if (dir == NULL)
-                        return NULL;
-
-                while ((subfile = g_dir_read_name (dir)) != NULL) {
-                        subpath = g_build_filename (file, subfile, NULL);
-
-                        ret = recursive_compare (localtime_stat,
-                                                 localtime_content,
-                                                 localtime_content_len,
-                                                 subpath,
-                                                 compare_func);
-
-                        g_free (subpath);
-
-                        if (ret != NULL)
-                                break;
-                }
-
-                g_dir_close (dir);
-
-                return ret;
-        }
+        static ZoneinfoIndex *index = NULL;
+        char                 *cache_file;
 
-        return NULL;
-}
+        if (index)
+                return index;
 
+        cache_file = g_build_filename (g_get_user_cache_dir (),
+                                       "mate-panel", "zoneinfo-index",
+                                       NULL);
+        index = zoneinfo_index_new (SYSTEM_ZONEINFODIR, cache_file);
+        g_free (cache_file);
 
-static gboolean
-files_are_identical_inode (struct stat *a_stat,
-                           struct stat *b_stat,
-                           const char  *a_content,
-                           gsize        a_content_len,
-                           const char  *b_filename)
-{
-        return (a_stat->st_ino == b_stat->st_ino);
+        return index;
 }
 
-
 /* Determine if /etc/localtime is a hard link to some file, by looking at
  * the inodes */
 static char *
 system_timezone_read_etc_localtime_hardlink (void)
 {
-        struct stat stat_localtime;
+        struct stat  stat_localtime;
+        char        *file;
+        char        *tz;
 
         if (g_stat (ETC_LOCALTIME, &stat_localtime) != 0)
                 return NULL;
@@ -741,40 +692,12 @@ system_timezone_read_etc_localtime_hardlink (void)
         if (!S_ISREG (stat_localtime.st_mode))
                 return NULL;
 
-        return recursive_compare (&stat_localtime,
-                                  NULL,
-                                  0,
-                                  SYSTEM_ZONEINFODIR,
-                                  files_are_identical_inode);
-}
-
-static gboolean
-files_are_identical_content (struct stat *a_stat,
-                             struct stat *b_stat,
-                             const char  *a_content,
-                             gsize        a_content_len,
-                             const char  *b_filename)
-{
-        char  *b_content = NULL;
-        gsize  b_content_len = -1;
-        int    cmp;
-
-        if (a_stat->st_size != b_stat->st_size)
-                return FALSE;
-
-        if (!g_file_get_contents (b_filename,
-                                  &b_content, &b_content_len, NULL))
-                return FALSE;
-
-        if (a_content_len != b_content_len) {
-                g_free (b_content);
-                return FALSE;
-        }
-
-        cmp = memcmp (a_content, b_content, a_content_len);
-        g_free (b_content);
+        file = zoneinfo_index_lookup_inode (system_timezone_get_zoneinfo_index (),
+                                            &stat_localtime);
+        tz = system_timezone_strip_path_if_valid (file);
+        g_free (file);
 
-        return (cmp == 0);
+        return tz;
 }
 
 /* Determine if /etc/localtime is a copy of a timezone file */
@@ -784,6 +707,7 @@ system_timezone_read_etc_localtime_content (void)
         struct stat  stat_localtime;
         char        *localtime_content = NULL;
         gsize        localtime_content_len = -1;
+        char        *file;
         char        *retval;
 
         if (g_stat (ETC_LOCALTIME, &stat_localtime) != 0)
@@ -798,12 +722,12 @@ system_timezone_read_etc_localtime_content (void)
                                   NULL))
                 return NULL;
 
-        retval = recursive_compare (&stat_localtime,
-                                   localtime_content,
-                                   localtime_content_len,
-                                   SYSTEM_ZONEINFODIR,
-                                   files_are_identical_content);
+        file = zoneinfo_index_lookup_content (system_timezone_get_zoneinfo_index (),
+                                              localtime_content,
+                                              localtime_content_len);
+        retval = system_timezone_strip_path_if_valid (file);
 
+        g_free (file);
         g_free (localtime_content);
 
         return retval;
@@ -823,8 +747,8 @@ static GetSystemTimezone get_system_timezone_methods[] = {
         system_timezone_read_etc_rc_conf,
         /* reading deprecated config files */
         system_timezone_read_etc_conf_d_clock,
-        /* reading /etc/timezone directly. Expensive since we have to stat
-         * many files */
+        /* reading /etc/localtime directly. Expensive the first time, since
+         * the zoneinfo tree has to be indexed */
         system_timezone_read_etc_localtime_hardlink,
         system_timezone_read_etc_localtime_content,
         NULL
@@ -0,0 +1,267 @@
+/* Test for the index of the timezone data files, on a fake zoneinfo tree
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include "config.h"
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "zoneinfo-index.h"
+
+static const char *zones[] = {
+        "America/New_York",
+        "Europe/London",
+        "Europe/Paris",
+        "Asia/Tokyo",
+        "UTC"
+};
+
+static char *tmp_dir;
+static char *zoneinfo_dir;
+static char *cache_file;
+
+/* Each zone gets different content of the same size, so that only the
+ * checksum tells them apart */
+static char *
+zone_content (const char *zone)
+{
+        return g_strdup_printf ("TZif2%-32s", zone);
+}
+
+static void
+write_file (const char *path,
+            const char *content)
+{
+        char *dir;
+
+        dir = g_path_get_dirname (path);
+        g_mkdir_with_parents (dir, 0755);
+        g_free (dir);
+
+        if (!g_file_set_contents (path, content, -1, NULL))
+                g_error ("Cannot write %s", path);
+}
+
+static void
+write_zone (const char *zone)
+{
+        char *path;
+        char *content;
+
+        path = g_build_filename (zoneinfo_dir, zone, NULL);
+        content = zone_content (zone);
+        write_file (path, content);
+        g_free (content);
+        g_free (path);
+}
+
+static void
+build_tree (void)
+{
+        char *path;
+        char *target;
+        guint i;
+
+        /* Asia/Tokyo comes later */
+        for (i = 0; i < G_N_ELEMENTS (zones) - 2; i++)
+                write_zone (zones[i]);
+        write_zone ("UTC");
+
+        /* An alias with the same content, sorted after the original */
+        path = g_build_filename (zoneinfo_dir, "GB", NULL);
+        target = zone_content ("Europe/London");
+        write_file (path, target);
+        g_free (target);
+        g_free (path);
+
+        /* Symbolic links are skipped, loops included */
+        path = g_build_filename (zoneinfo_dir, "posix", NULL);
+        if (symlink (".", path) != 0)
+                g_error ("Cannot create %s", path);
+        g_free (path);
+}
+
+/* Sets the modification time of a directory to the one it had, give or
+ * take a few nanoseconds: the kernel clock of the timestamps is coarse, so
+ * a change may not move it by itself. Without the nanoseconds in struct
+ * stat, the index only sees whole seconds, so @delta counts seconds. */
+static void
+set_dir_mtime (const char        *path,
+               const struct stat *buf,
+               long               delta)
+{
+        struct timespec times[2];
+
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+        times[0] = buf->st_mtim;
+        times[0].tv_nsec = (times[0].tv_nsec + delta) % 1000000000;
+#else
+        times[0].tv_sec = buf->st_mtime + delta;
+        times[0].tv_nsec = 0;
+#endif
+        times[1] = times[0];
+
+        if (utimensat (AT_FDCWD, path, times, 0) != 0)
+                g_error ("Cannot set the modification time of %s", path);
+}
+
+static gboolean
+check (const char *name,
+       char       *found,
+       const char *expected_zone,
+       gboolean    reused,
+       gboolean    expected_reused)
+{
+        char     *expected = NULL;
+        gboolean  ok;
+
+        if (expected_zone)
+                expected = g_build_filename (zoneinfo_dir, expected_zone, NULL);
+
+        ok = g_strcmp0 (found, expected) == 0 && reused == expected_reused;
+
+        g_print ("%s\n  found %s, index %s\n  %s\n",
+                 name, found ? found : "nothing",
+                 reused ? "reused" : "built",
+                 ok ? "PASS" : "FAIL");
+
+        g_free (expected);
+        g_free (found);
+
+        return ok;
+}
+
+static char *
+lookup_copy (ZoneinfoIndex *index,
+             const char    *zone)
+{
+        char *content;
+        char *found;
+
+        content = zone_content (zone);
+        found = zoneinfo_index_lookup_content (index, content, strlen (content));
+        g_free (content);
+
+        return found;
+}
+
+static void
+remove_tree (const char *path)
+{
+        GDir       *dir;
+        const char *name;
+
+        dir = g_dir_open (path, 0, NULL);
+        if (dir) {
+                while ((name = g_dir_read_name (dir)) != NULL) {
+                        char *child = g_build_filename (path, name, NULL);
+
+                        if (g_file_test (child, G_FILE_TEST_IS_DIR) &&
+                            !g_file_test (child, G_FILE_TEST_IS_SYMLINK))
+                                remove_tree (child);
+                        else
+                                g_unlink (child);
+                        g_free (child);
+                }
+                g_dir_close (dir);
+        }
+
+        g_rmdir (path);
+}
+
+int
+main (int argc, char **argv)
+{
+        ZoneinfoIndex *index;
+        struct stat    file_stat;
+        char          *path;
+        char          *link_path;
+        gboolean       ok = TRUE;
+
+        tmp_dir = g_dir_make_tmp ("test-zoneinfo-index-XXXXXX", NULL);
+        if (!tmp_dir)
+                g_error ("Cannot create a temporary directory");
+
+        zoneinfo_dir = g_build_filename (tmp_dir, "zoneinfo", NULL);
+        cache_file = g_build_filename (tmp_dir, "cache", "zoneinfo-index", NULL);
+        build_tree ();
+
+        /* A copy of a zone file, and the first of its aliases */
+        index = zoneinfo_index_new (zoneinfo_dir, cache_file);
+        ok &= check ("Copy of Europe/Paris, no saved index",
+                     lookup_copy (index, "Europe/Paris"), "Europe/Paris",
+                     zoneinfo_index_was_reused (index), FALSE);
+        ok &= check ("Copy of Europe/London, same content as GB",
+                     lookup_copy (index, "Europe/London"), "Europe/London",
+                     zoneinfo_index_was_reused (index), TRUE);
+        ok &= check ("Copy of a zone that is not in the tree",
+                     lookup_copy (index, "Asia/Tokyo"), NULL,
+                     zoneinfo_index_was_reused (index), TRUE);
+        zoneinfo_index_free (index);
+
+        /* A hard link, with the saved index */
+        path = g_build_filename (zoneinfo_dir, "America/New_York", NULL);
+        link_path = g_build_filename (tmp_dir, "localtime", NULL);
+        if (link (path, link_path) != 0 || g_stat (link_path, &file_stat) != 0)
+                g_error ("Cannot create %s", link_path);
+        g_free (path);
+
+        index = zoneinfo_index_new (zoneinfo_dir, cache_file);
+        ok &= check ("Hard link to America/New_York, saved index",
+                     zoneinfo_index_lookup_inode (index, &file_stat),
+                     "America/New_York",
+                     zoneinfo_index_was_reused (index), TRUE);
+
+        /* A zone added to the tree makes it build the index again */
+        if (g_stat (zoneinfo_dir, &file_stat) != 0)
+                g_error ("Cannot stat %s", zoneinfo_dir);
+        write_zone ("Asia/Tokyo");
+        set_dir_mtime (zoneinfo_dir, &file_stat, 1);
+        ok &= check ("Copy of Asia/Tokyo, added to the tree",
+                     lookup_copy (index, "Asia/Tokyo"), "Asia/Tokyo",
+                     zoneinfo_index_was_reused (index), FALSE);
+        zoneinfo_index_free (index);
+
+        /* A file replaced without the directory changing is caught by
+         * the check of the file that was found */
+        path = g_build_filename (zoneinfo_dir, "UTC", NULL);
+        if (g_stat (zoneinfo_dir, &file_stat) != 0)
+                g_error ("Cannot stat %s", zoneinfo_dir);
+        write_file (path, "TZif2 not UTC anymore, same size!!!!!");
+        set_dir_mtime (zoneinfo_dir, &file_stat, 0);
+        g_free (path);
+
+        index = zoneinfo_index_new (zoneinfo_dir, cache_file);
+        ok &= check ("Copy of UTC, replaced in the tree",
+                     lookup_copy (index, "UTC"), NULL,
+                     zoneinfo_index_was_reused (index), FALSE);
+        zoneinfo_index_free (index);
+
+        g_unlink (link_path);
+        g_free (link_path);
+        remove_tree (tmp_dir);
+        g_free (tmp_dir);
+        g_free (zoneinfo_dir);
+        g_free (cache_file);
+
+        return ok ? 0 : 1;
+}
@@ -0,0 +1,559 @@
+/* Index of the timezone data files
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* When /etc/localtime is a hard link to or a copy of a timezone file, the
+ * only way to know which timezone it is, is to find that file in the
+ * zoneinfo tree. Instead of comparing /etc/localtime with the ~1800 files
+ * there each time, the tree is indexed once by inode and by size and
+ * checksum of the content, and a lookup is a hash table lookup plus a
+ * check of the file that was found.
+ *
+ * The index is saved along with the modification time of each directory
+ * of the tree: as long as none changed, no file was added, removed or
+ * replaced, and the saved index can be used as is. Symbolic links are not
+ * indexed, they point to files that are. */
+
+#include "config.h"
+
+#include <string.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "zoneinfo-index.h"
+
+#define ZONEINFO_INDEX_HEADER "mate-panel zoneinfo index 2"
+
+/* Without the nanoseconds, changes are only seen to the second */
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+#define STAT_MTIME_NSEC(buf) ((buf).st_mtim.tv_nsec)
+#else
+#define STAT_MTIME_NSEC(buf) 0
+#endif
+
+typedef struct {
+        char    *path;
+        gint64   mtime;
+        glong    mtime_nsec;
+} ZoneinfoDir;
+
+typedef struct {
+        char    *path;
+        guint64  dev;
+        guint64  ino;
+        char    *content_key;
+} ZoneinfoFile;
+
+struct _ZoneinfoIndex {
+        char       *dir;
+        char       *cache_file;
+
+        gboolean    loaded;
+        guint       n_builds;
+        gboolean    reused;
+
+        /* Relative paths, "" being the top directory */
+        GPtrArray  *dirs;
+        GPtrArray  *files;
+
+        /* The first file found in the tree for each key */
+        GHashTable *by_inode;
+        GHashTable *by_content;
+};
+
+static void
+zoneinfo_dir_free (ZoneinfoDir *dir)
+{
+        g_free (dir->path);
+        g_slice_free (ZoneinfoDir, dir);
+}
+
+static void
+zoneinfo_file_free (ZoneinfoFile *file)
+{
+        g_free (file->path);
+        g_free (file->content_key);
+        g_slice_free (ZoneinfoFile, file);
+}
+
+static char *
+inode_key (guint64 dev,
+           guint64 ino)
+{
+        return g_strdup_printf ("%" G_GUINT64_FORMAT ":%" G_GUINT64_FORMAT,
+                                dev, ino);
+}
+
+static char *
+content_key (const char *content,
+             gsize       content_len)
+{
+        char *checksum;
+        char *key;
+
+        checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA256,
+                                                (const guchar *) content,
+                                                content_len);
+        key = g_strdup_printf ("%" G_GSIZE_FORMAT ":%s", content_len, checksum);
+        g_free (checksum);
+
+        return key;
+}
+
+ZoneinfoIndex *
+zoneinfo_index_new (const char *zoneinfo_dir,
+                    const char *cache_file)
+{
+        ZoneinfoIndex *index;
+
+        g_return_val_if_fail (zoneinfo_dir != NULL, NULL);
+
+        index = g_slice_new0 (ZoneinfoIndex);
+        index->dir        = g_strdup (zoneinfo_dir);
+        index->cache_file = g_strdup (cache_file);
+
+        index->dirs  = g_ptr_array_new_with_free_func ((GDestroyNotify) zoneinfo_dir_free);
+        index->files = g_ptr_array_new_with_free_func ((GDestroyNotify) zoneinfo_file_free);
+        index->by_inode   = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                   g_free, NULL);
+        index->by_content = g_hash_table_new (g_str_hash, g_str_equal);
+
+        return index;
+}
+
+static void
+zoneinfo_index_clear (ZoneinfoIndex *index)
+{
+        g_hash_table_remove_all (index->by_inode);
+        g_hash_table_remove_all (index->by_content);
+        g_ptr_array_set_size (index->files, 0);
+        g_ptr_array_set_size (index->dirs, 0);
+
+        index->loaded = FALSE;
+}
+
+void
+zoneinfo_index_free (ZoneinfoIndex *index)
+{
+        if (!index)
+                return;
+
+        zoneinfo_index_clear (index);
+
+        g_hash_table_destroy (index->by_inode);
+        g_hash_table_destroy (index->by_content);
+        g_ptr_array_free (index->files, TRUE);
+        g_ptr_array_free (index->dirs, TRUE);
+
+        g_free (index->dir);
+        g_free (index->cache_file);
+
+        g_slice_free (ZoneinfoIndex, index);
+}
+
+static void
+zoneinfo_index_add_dir (ZoneinfoIndex *index,
+                        const char    *path,
+                        gint64         mtime,
+                        glong          mtime_nsec)
+{
+        ZoneinfoDir *dir;
+
+        dir = g_slice_new (ZoneinfoDir);
+        dir->path       = g_strdup (path);
+        dir->mtime      = mtime;
+        dir->mtime_nsec = mtime_nsec;
+
+        g_ptr_array_add (index->dirs, dir);
+}
+
+static void
+zoneinfo_index_add_file (ZoneinfoIndex *index,
+                         const char    *path,
+                         guint64        dev,
+                         guint64        ino,
+                         char          *key)
+{
+        ZoneinfoFile *file;
+        char         *ikey;
+
+        file = g_slice_new (ZoneinfoFile);
+        file->path        = g_strdup (path);
+        file->dev         = dev;
+        file->ino         = ino;
+        file->content_key = key;
+
+        g_ptr_array_add (index->files, file);
+
+        ikey = inode_key (dev, ino);
+        if (!g_hash_table_contains (index->by_inode, ikey))
+                g_hash_table_insert (index->by_inode, ikey, file);
+        else
+                g_free (ikey);
+
+        if (!g_hash_table_contains (index->by_content, file->content_key))
+                g_hash_table_insert (index->by_content, file->content_key, file);
+}
+
+static int
+compare_names (gconstpointer a,
+               gconstpointer b)
+{
+        return strcmp (*(const char **) a, *(const char **) b);
+}
+
+static void
+zoneinfo_index_scan (ZoneinfoIndex *index,
+                     const char    *path)
+{
+        struct stat  file_stat;
+        char        *full_path;
+
+        full_path = g_build_filename (index->dir, path, NULL);
+
+        if (g_lstat (full_path, &file_stat) != 0) {
+                g_free (full_path);
+                return;
+        }
+
+        if (S_ISREG (file_stat.st_mode)) {
+                char  *content;
+                gsize  content_len;
+
+                if (g_file_get_contents (full_path, &content, &content_len, NULL)) {
+                        zoneinfo_index_add_file (index, path,
+                                                 file_stat.st_dev,
+                                                 file_stat.st_ino,
+                                                 content_key (content, content_len));
+                        g_free (content);
+                }
+        } else if (S_ISDIR (file_stat.st_mode)) {
+                GPtrArray  *names;
+                GDir       *dir;
+                const char *name;
+                guint       i;
+
+                dir = g_dir_open (full_path, 0, NULL);
+                if (dir == NULL) {
+                        g_free (full_path);
+                        return;
+                }
+
+                zoneinfo_index_add_dir (index, path,
+                                        file_stat.st_mtime,
+                                        STAT_MTIME_NSEC (file_stat));
+
+                /* Sorted, so that the same file wins when several have
+                 * the same content */
+                names = g_ptr_array_new_with_free_func (g_free);
+                while ((name = g_dir_read_name (dir)) != NULL)
+                        g_ptr_array_add (names, g_strdup (name));
+                g_dir_close (dir);
+
+                g_ptr_array_sort (names, compare_names);
+
+                for (i = 0; i < names->len; i++) {
+                        char *subpath;
+
+                        subpath = path[0] ? g_build_filename (path, names->pdata[i], NULL)
+                                          : g_strdup (names->pdata[i]);
+                        zoneinfo_index_scan (index, subpath);
+                        g_free (subpath);
+                }
+
+                g_ptr_array_free (names, TRUE);
+        }
+
+        g_free (full_path);
+}
+
+/* Whether a directory of the tree changed since the index was built */
+static gboolean
+zoneinfo_index_is_stale (ZoneinfoIndex *index)
+{
+        guint i;
+
+        for (i = 0; i < index->dirs->len; i++) {
+                ZoneinfoDir *dir = index->dirs->pdata[i];
+                struct stat  dir_stat;
+                char        *full_path;
+                int          result;
+
+                full_path = g_build_filename (index->dir, dir->path, NULL);
+                result = g_stat (full_path, &dir_stat);
+                g_free (full_path);
+
+                /* Down to the nanosecond: a file added in the second the
+                 * index was built must not go unnoticed */
+                if (result != 0 ||
+                    (gint64) dir_stat.st_mtime != dir->mtime ||
+                    STAT_MTIME_NSEC (dir_stat) != dir->mtime_nsec)
+                        return TRUE;
+        }
+
+        return FALSE;
+}
+
+/* The cache is a header line with the zoneinfo directory, then one line
+ * per directory and per file:
+ *   D <mtime> <mtime nanoseconds> <path>
+ *   F <dev> <ino> <size>:<checksum> <path>
+ * with tabs between the fields, the path coming last. */
+static gboolean
+zoneinfo_index_load (ZoneinfoIndex *index)
+{
+        char     *contents;
+        char    **lines;
+        char     *header;
+        gboolean  retval = FALSE;
+        int       i;
+
+        if (!g_file_get_contents (index->cache_file, &contents, NULL, NULL))
+                return FALSE;
+
+        lines = g_strsplit (contents, "\n", -1);
+        g_free (contents);
+
+        header = g_strconcat (ZONEINFO_INDEX_HEADER "\t", index->dir, NULL);
+        if (lines[0] == NULL || strcmp (lines[0], header) != 0)
+                goto out;
+
+        for (i = 1; lines[i] != NULL; i++) {
+                char **fields;
+
+                if (lines[i][0] == '\0')
+                        continue;
+
+                fields = g_strsplit (lines[i], "\t", 5);
+
+                if (strcmp (fields[0], "D") == 0 && g_strv_length (fields) == 4) {
+                        zoneinfo_index_add_dir (index, fields[3],
+                                                g_ascii_strtoll (fields[1], NULL, 10),
+                                                g_ascii_strtoll (fields[2], NULL, 10));
+                } else if (strcmp (fields[0], "F") == 0 && g_strv_length (fields) == 5) {
+                        zoneinfo_index_add_file (index, fields[4],
+                                                 g_ascii_strtoull (fields[1], NULL, 10),
+                                                 g_ascii_strtoull (fields[2], NULL, 10),
+                                                 g_strdup (fields[3]));
+                } else {
+                        g_strfreev (fields);
+                        goto out;
+                }
+
+                g_strfreev (fields);
+        }
+
+        retval = index->dirs->len > 0 && !zoneinfo_index_is_stale (index);
+
+out:
+        g_free (header);
+        g_strfreev (lines);
+
+        if (!retval)
+                zoneinfo_index_clear (index);
+
+        return retval;
+}
+
+static void
+zoneinfo_index_save (ZoneinfoIndex *index)
+{
+        GString *contents;
+        char    *cache_dir;
+        GError  *error = NULL;
+        guint    i;
+
+        cache_dir = g_path_get_dirname (index->cache_file);
+        g_mkdir_with_parents (cache_dir, 0700);
+        g_free (cache_dir);
+
+        contents = g_string_new (ZONEINFO_INDEX_HEADER "\t");
+        g_string_append (contents, index->dir);
+        g_string_append_c (contents, '\n');
+
+        for (i = 0; i < index->dirs->len; i++) {
+                ZoneinfoDir *dir = index->dirs->pdata[i];
+
+                g_string_append_printf (contents, "D\t%" G_GINT64_FORMAT "\t%ld\t%s\n",
+                                        dir->mtime, dir->mtime_nsec, dir->path);
+        }
+
+        for (i = 0; i < index->files->len; i++) {
+                ZoneinfoFile *file = index->files->pdata[i];
+
+                g_string_append_printf (contents,
+                                        "F\t%" G_GUINT64_FORMAT "\t%" G_GUINT64_FORMAT "\t%s\t%s\n",
+                                        file->dev, file->ino,
+                                        file->content_key, file->path);
+        }
+
+        if (!g_file_set_contents (index->cache_file,
+                                  contents->str, contents->len, &error)) {
+                g_warning ("Cannot save the timezone index to %s: %s",
+                           index->cache_file, error->message);
+                g_error_free (error);
+        }
+
+        g_string_free (contents, TRUE);
+}
+
+static void
+zoneinfo_index_ensure (ZoneinfoIndex *index,
+                       gboolean       rebuild)
+{
+        if (index->loaded && !rebuild)
+                return;
+
+        zoneinfo_index_clear (index);
+
+        if (!rebuild && index->cache_file && zoneinfo_index_load (index)) {
+                index->loaded = TRUE;
+                return;
+        }
+
+        zoneinfo_index_scan (index, "");
+        index->loaded = TRUE;
+        index->n_builds++;
+
+        if (index->cache_file && index->dirs->len > 0)
+                zoneinfo_index_save (index);
+}
+
+typedef gboolean (*ZoneinfoCheckFile) (const char *full_path,
+                                       gconstpointer data,
+                                       gsize         data_len);
+
+/* Looks the key up, building the index again if what it found is wrong
+ * or if it found nothing and the tree changed */
+static char *
+zoneinfo_index_lookup (ZoneinfoIndex     *index,
+                       GHashTable        *table,
+                       const char        *key,
+                       ZoneinfoCheckFile  check_file,
+                       gconstpointer      data,
+                       gsize              data_len)
+{
+        guint n_builds = index->n_builds;
+        int   attempt;
+        char *retval = NULL;
+
+        for (attempt = 0; attempt < 2 && !retval; attempt++) {
+                ZoneinfoFile *file;
+
+                zoneinfo_index_ensure (index, attempt > 0);
+
+                file = g_hash_table_lookup (table, key);
+                if (file) {
+                        char *full_path;
+
+                        full_path = g_build_filename (index->dir, file->path, NULL);
+                        if (check_file (full_path, data, data_len))
+                                retval = full_path;
+                        else
+                                g_free (full_path);
+                }
+
+                /* Built just now, or nothing changed: a miss is final */
+                if (index->n_builds != n_builds ||
+                    (!file && !zoneinfo_index_is_stale (index)))
+                        break;
+        }
+
+        index->reused = index->n_builds == n_builds;
+
+        return retval;
+}
+
+static gboolean
+check_file_inode (const char    *full_path,
+                  gconstpointer  data,
+                  gsize          data_len)
+{
+        const struct stat *a_stat = data;
+        struct stat        b_stat;
+
+        if (g_lstat (full_path, &b_stat) != 0)
+                return FALSE;
+
+        return a_stat->st_dev == b_stat.st_dev &&
+               a_stat->st_ino == b_stat.st_ino;
+}
+
+static gboolean
+check_file_content (const char    *full_path,
+                    gconstpointer  data,
+                    gsize          data_len)
+{
+        char     *content;
+        gsize     content_len;
+        gboolean  retval;
+
+        if (!g_file_get_contents (full_path, &content, &content_len, NULL))
+                return FALSE;
+
+        retval = content_len == data_len &&
+                 memcmp (content, data, data_len) == 0;
+        g_free (content);
+
+        return retval;
+}
+
+char *
+zoneinfo_index_lookup_inode (ZoneinfoIndex *index,
+                             struct stat   *file_stat)
+{
+        char *key;
+        char *retval;
+
+        g_return_val_if_fail (index != NULL, NULL);
+        g_return_val_if_fail (file_stat != NULL, NULL);
+
+        key = inode_key (file_stat->st_dev, file_stat->st_ino);
+        retval = zoneinfo_index_lookup (index, index->by_inode, key,
+                                        check_file_inode, file_stat, 0);
+        g_free (key);
+
+        return retval;
+}
+
+char *
+zoneinfo_index_lookup_content (ZoneinfoIndex *index,
+                               const char    *content,
+                               gsize          content_len)
+{
+        char *key;
+        char *retval;
+
+        g_return_val_if_fail (index != NULL, NULL);
+        g_return_val_if_fail (content != NULL, NULL);
+
+        key = content_key (content, content_len);
+        retval = zoneinfo_index_lookup (index, index->by_content, key,
+                                        check_file_content,
+                                        content, content_len);
+        g_free (key);
+
+        return retval;
+}
+
+gboolean
+zoneinfo_index_was_reused (ZoneinfoIndex *index)
+{
+        g_return_val_if_fail (index != NULL, FALSE);
+
+        return index->reused;
+}
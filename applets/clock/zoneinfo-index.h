@@ -0,0 +1,53 @@
+/* Index of the timezone data files
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __ZONEINFO_INDEX_H__
+#define __ZONEINFO_INDEX_H__
+
+#include <sys/stat.h>
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _ZoneinfoIndex ZoneinfoIndex;
+
+/* The index is built on the first lookup. If cache_file is not NULL, it
+ * is saved there and reused as long as none of the directories of the
+ * tree changed. */
+ZoneinfoIndex *zoneinfo_index_new            (const char    *zoneinfo_dir,
+                                              const char    *cache_file);
+void           zoneinfo_index_free           (ZoneinfoIndex *index);
+
+/* Return the path of the file of the tree that is the same file as,
+ * or has the same content as, the given one, or NULL */
+char          *zoneinfo_index_lookup_inode   (ZoneinfoIndex *index,
+                                              struct stat   *file_stat);
+char          *zoneinfo_index_lookup_content (ZoneinfoIndex *index,
+                                              const char    *content,
+                                              gsize          content_len);
+
+/* Whether the last lookup could use the index as it was, without
+ * building it again */
+gboolean       zoneinfo_index_was_reused     (ZoneinfoIndex *index);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ZONEINFO_INDEX_H__ */
@@ -0,0 +1,418 @@
+/*
+ * fish-fortune.c: run the fish's command with bounded output and runtime
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * The output of the command is read asynchronously into a fixed-size ring
+ * buffer. Reading pauses while the ring is full, until the consumer takes
+ * the pending output, so a command writing faster than it can be shown
+ * blocks on its pipe instead of growing our memory. The run is killed
+ * once it produced more than the byte cap or ran for longer than the
+ * timeout.
+ */
+
+#include <config.h>
+
+#include <signal.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <gio/gio.h>
+#include <gio/gunixinputstream.h>
+
+#include "fish-fortune.h"
+
+#define FISH_FORTUNE_RING_SIZE (64 * 1024)
+
+struct _FishFortune {
+	int                   ref_count;
+
+	FishFortuneReadyFunc  ready_func;
+	FishFortuneDoneFunc   done_func;
+	gpointer              user_data;
+
+	gsize                 max_bytes;
+	guint                 timeout_ms;
+
+	GPid                  pid;
+	GInputStream         *stream;
+	GCancellable         *cancellable;
+	guint                 timeout_id;
+	gboolean              running;
+	gboolean              reading;
+	gboolean              probing;
+	gsize                 total_bytes;
+
+	/* Output read but not taken yet */
+	gsize                 ring_start;
+	gsize                 ring_len;
+	guchar                probe;
+	guchar                ring [FISH_FORTUNE_RING_SIZE];
+};
+
+static void fish_fortune_read (FishFortune *fortune);
+
+static FishFortune *
+fish_fortune_ref (FishFortune *fortune)
+{
+	fortune->ref_count++;
+
+	return fortune;
+}
+
+static void
+fish_fortune_unref (FishFortune *fortune)
+{
+	if (--fortune->ref_count > 0)
+		return;
+
+	g_free (fortune);
+}
+
+FishFortune *
+fish_fortune_new (FishFortuneReadyFunc ready_func,
+		  FishFortuneDoneFunc  done_func,
+		  gpointer             user_data)
+{
+	FishFortune *fortune;
+
+	fortune = g_new0 (FishFortune, 1);
+	fortune->ref_count  = 1;
+	fortune->ready_func = ready_func;
+	fortune->done_func  = done_func;
+	fortune->user_data  = user_data;
+
+	return fortune;
+}
+
+void
+fish_fortune_free (FishFortune *fortune)
+{
+	if (!fortune)
+		return;
+
+	fish_fortune_stop (fortune);
+
+	fortune->ready_func = NULL;
+	fortune->done_func  = NULL;
+
+	fish_fortune_unref (fortune);
+}
+
+void
+fish_fortune_set_limits (FishFortune *fortune,
+			 gsize        max_bytes,
+			 guint        timeout_ms)
+{
+	fortune->max_bytes  = max_bytes;
+	fortune->timeout_ms = timeout_ms;
+}
+
+/* Ends the run: kills the command if it is still around and closes the
+ * pipe. The output already read stays available. */
+static void
+fish_fortune_end (FishFortune       *fortune,
+		  FishFortuneStatus  status,
+		  const GError      *error,
+		  gboolean           notify)
+{
+	if (!fortune->running)
+		return;
+
+	fortune->running = FALSE;
+
+	if (fortune->timeout_id)
+		g_source_remove (fortune->timeout_id);
+	fortune->timeout_id = 0;
+
+	/* Cancels a pending read, which drops its reference later on */
+	g_cancellable_cancel (fortune->cancellable);
+	g_object_unref (fortune->cancellable);
+	fortune->cancellable = NULL;
+
+	/* Otherwise, the pending read closes it when it drops the stream */
+	if (!fortune->reading)
+		g_input_stream_close (fortune->stream, NULL, NULL);
+	g_object_unref (fortune->stream);
+	fortune->stream = NULL;
+	fortune->reading = FALSE;
+
+	/* Reaped by the child watch */
+	if (fortune->pid)
+		kill (fortune->pid, SIGKILL);
+
+	if (notify && fortune->done_func)
+		fortune->done_func (fortune, status, error, fortune->user_data);
+}
+
+void
+fish_fortune_stop (FishFortune *fortune)
+{
+	fish_fortune_end (fortune, FISH_FORTUNE_FINISHED, NULL, FALSE);
+}
+
+static void
+fish_fortune_child_exited (GPid     pid,
+			   gint     status,
+			   gpointer data)
+{
+	FishFortune *fortune = data;
+
+	if (fortune->pid == pid)
+		fortune->pid = 0;
+
+	g_spawn_close_pid (pid);
+
+	fish_fortune_unref (fortune);
+}
+
+static gboolean
+fish_fortune_timeout (gpointer data)
+{
+	FishFortune *fortune = data;
+
+	fortune->timeout_id = 0;
+
+	fish_fortune_end (fortune, FISH_FORTUNE_TIMED_OUT, NULL, TRUE);
+
+	return FALSE;
+}
+
+static void
+fish_fortune_read_cb (GObject      *source,
+		      GAsyncResult *result,
+		      gpointer      data)
+{
+	FishFortune *fortune = data;
+	GError      *error = NULL;
+	gssize       n_read;
+	gboolean     was_empty;
+
+	n_read = g_input_stream_read_finish (G_INPUT_STREAM (source),
+					     result, &error);
+
+	/* A read of a run that ended, maybe followed by a new one */
+	if (G_INPUT_STREAM (source) != fortune->stream) {
+		g_clear_error (&error);
+		fish_fortune_unref (fortune);
+		return;
+	}
+
+	fortune->reading = FALSE;
+
+	if (n_read < 0) {
+		fish_fortune_end (fortune, FISH_FORTUNE_FAILED, error, TRUE);
+		g_error_free (error);
+	} else if (n_read == 0) {
+		fish_fortune_end (fortune, FISH_FORTUNE_FINISHED, NULL, TRUE);
+	} else if (fortune->probing) {
+		/* There was more than the cap allows */
+		fish_fortune_end (fortune, FISH_FORTUNE_TRUNCATED, NULL, TRUE);
+	} else {
+		was_empty = fortune->ring_len == 0;
+
+		fortune->ring_len += n_read;
+		fortune->total_bytes += n_read;
+
+		if (was_empty && fortune->ready_func)
+			fortune->ready_func (fortune, fortune->user_data);
+
+		fish_fortune_read (fortune);
+	}
+
+	fish_fortune_unref (fortune);
+}
+
+static void
+fish_fortune_read (FishFortune *fortune)
+{
+	gsize  end;
+	gsize  count;
+	void  *buffer;
+
+	if (!fortune->running || fortune->reading)
+		return;
+
+	end = (fortune->ring_start + fortune->ring_len) % FISH_FORTUNE_RING_SIZE;
+
+	if (fortune->ring_len == FISH_FORTUNE_RING_SIZE)
+		count = 0;
+	else if (end >= fortune->ring_start)
+		count = FISH_FORTUNE_RING_SIZE - end;
+	else
+		count = fortune->ring_start - end;
+
+	/* Wait for the consumer to make room */
+	if (count == 0)
+		return;
+
+	buffer = &fortune->ring [end];
+
+	if (fortune->max_bytes) {
+		if (fortune->total_bytes >= fortune->max_bytes) {
+			/* Only look for the end of the output */
+			fortune->probing = TRUE;
+			buffer = &fortune->probe;
+			count = 1;
+		} else {
+			count = MIN (count, fortune->max_bytes - fortune->total_bytes);
+		}
+	}
+
+	fortune->reading = TRUE;
+	g_input_stream_read_async (fortune->stream, buffer, count,
+				   G_PRIORITY_DEFAULT, fortune->cancellable,
+				   fish_fortune_read_cb,
+				   fish_fortune_ref (fortune));
+}
+
+gboolean
+fish_fortune_start (FishFortune           *fortune,
+		    char                 **argv,
+		    GSpawnChildSetupFunc   child_setup,
+		    gpointer               child_data,
+		    GError               **error)
+{
+	GPid pid;
+	int  output;
+
+	g_return_val_if_fail (fortune != NULL, FALSE);
+	g_return_val_if_fail (argv != NULL && argv[0] != NULL, FALSE);
+	g_return_val_if_fail (g_path_is_absolute (argv[0]), FALSE);
+
+	fish_fortune_stop (fortune);
+
+	fortune->ring_start  = 0;
+	fortune->ring_len    = 0;
+	fortune->total_bytes = 0;
+	fortune->probing     = FALSE;
+
+	if (!g_spawn_async_with_pipes (NULL, /* working directory */
+				       argv,
+				       NULL, /* envp */
+				       G_SPAWN_STDERR_TO_DEV_NULL |
+				       G_SPAWN_DO_NOT_REAP_CHILD,
+				       child_setup,
+				       child_data,
+				       &pid,
+				       NULL, /* stdin */
+				       &output,
+				       NULL, /* stderr */
+				       error))
+		return FALSE;
+
+	fortune->pid = pid;
+	g_child_watch_add (pid, fish_fortune_child_exited,
+			   fish_fortune_ref (fortune));
+
+	fortune->stream = g_unix_input_stream_new (output, TRUE);
+	fortune->cancellable = g_cancellable_new ();
+	fortune->running = TRUE;
+
+	if (fortune->timeout_ms)
+		fortune->timeout_id = g_timeout_add (fortune->timeout_ms,
+						     fish_fortune_timeout,
+						     fortune);
+
+	fish_fortune_read (fortune);
+
+	return TRUE;
+}
+
+gboolean
+fish_fortune_is_running (FishFortune *fortune)
+{
+	return fortune->running;
+}
+
+gsize
+fish_fortune_get_pending (FishFortune *fortune)
+{
+	return fortune->ring_len;
+}
+
+/* The output is not guaranteed to be in UTF-8: most likely it is just
+ * ASCII or in the user locale. Bytes that are neither come out as '?'. */
+static char *
+fish_fortune_to_utf8 (const char *text,
+		      gsize       len)
+{
+	GString    *string;
+	const char *p;
+	const char *end;
+	char       *converted;
+
+	if (g_utf8_validate (text, len, NULL))
+		return g_strndup (text, len);
+
+	converted = g_locale_to_utf8 (text, len, NULL, NULL, NULL);
+	if (converted)
+		return converted;
+
+	string = g_string_sized_new (len);
+
+	for (p = text; p < text + len; p = end + 1) {
+		g_utf8_validate (p, text + len - p, &end);
+		g_string_append_len (string, p, end - p);
+		if (end < text + len)
+			g_string_append_c (string, '?');
+		else
+			break;
+	}
+
+	return g_string_free (string, FALSE);
+}
+
+/* Returns all the pending output as UTF-8, or NULL if there is none. While
+ * the command runs, a character cut by the end of the output is left for
+ * the next call. */
+char *
+fish_fortune_take (FishFortune *fortune)
+{
+	char       *raw;
+	const char *end;
+	gsize       len;
+	gsize       first;
+	char       *text;
+
+	len = fortune->ring_len;
+	if (len == 0)
+		return NULL;
+
+	raw = g_malloc (len);
+
+	first = MIN (len, FISH_FORTUNE_RING_SIZE - fortune->ring_start);
+	memcpy (raw, &fortune->ring [fortune->ring_start], first);
+	memcpy (raw + first, fortune->ring, len - first);
+
+	if (fortune->running &&
+	    !g_utf8_validate (raw, len, &end) &&
+	    g_utf8_get_char_validated (end, raw + len - end) == (gunichar) -2)
+		len = end - raw;
+
+	fortune->ring_start = (fortune->ring_start + len) % FISH_FORTUNE_RING_SIZE;
+	fortune->ring_len -= len;
+
+	text = len > 0 ? fish_fortune_to_utf8 (raw, len) : NULL;
+	g_free (raw);
+
+	/* Resume reading if the ring was full */
+	fish_fortune_read (fortune);
+
+	return text;
+}
@@ -0,0 +1,76 @@
+/*
+ * fish-fortune.h: run the fish's command with bounded output and runtime
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __FISH_FORTUNE_H__
+#define __FISH_FORTUNE_H__
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _FishFortune FishFortune;
+
+typedef enum {
+	FISH_FORTUNE_FINISHED,
+	FISH_FORTUNE_TRUNCATED,
+	FISH_FORTUNE_TIMED_OUT,
+	FISH_FORTUNE_FAILED
+} FishFortuneStatus;
+
+/* Called when output becomes available after the pending output was
+ * taken: take it with fish_fortune_take(), at most once per frame. */
+typedef void (*FishFortuneReadyFunc) (FishFortune *fortune,
+				      gpointer     user_data);
+
+/* Called once per run, unless it is stopped. Output read before the end
+ * can still be taken. The error is only set for FISH_FORTUNE_FAILED. */
+typedef void (*FishFortuneDoneFunc)  (FishFortune       *fortune,
+				      FishFortuneStatus  status,
+				      const GError      *error,
+				      gpointer           user_data);
+
+FishFortune *fish_fortune_new         (FishFortuneReadyFunc   ready_func,
+				       FishFortuneDoneFunc    done_func,
+				       gpointer               user_data);
+void         fish_fortune_free        (FishFortune           *fortune);
+
+/* A max_bytes or timeout_ms of 0 means no limit */
+void         fish_fortune_set_limits  (FishFortune           *fortune,
+				       gsize                  max_bytes,
+				       guint                  timeout_ms);
+
+/* argv[0] must be an absolute path: the PATH is not searched */
+gboolean     fish_fortune_start       (FishFortune           *fortune,
+				       char                 **argv,
+				       GSpawnChildSetupFunc   child_setup,
+				       gpointer               child_data,
+				       GError               **error);
+void         fish_fortune_stop        (FishFortune           *fortune);
+
+gboolean     fish_fortune_is_running  (FishFortune           *fortune);
+gsize        fish_fortune_get_pending (FishFortune           *fortune);
+char        *fish_fortune_take        (FishFortune           *fortune);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __FISH_FORTUNE_H__ */
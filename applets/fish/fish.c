@@ -32,7 +32,6 @@
 #include <time.h>
 
 #include <cairo.h>
-#include <cairo-xlib.h>
 
 #include <glib/gi18n.h>
 #include <glib-object.h>
@@ -43,6 +42,9 @@
 #include <mate-panel-applet.h>
 #include <mate-panel-applet-gsettings.h>
 
+#include "clock-scheduler.h"
+#include "fish-fortune.h"
+
 #define FISH_APPLET(o) \
 	(G_TYPE_CHECK_INSTANCE_CAST((o), fish_applet_get_type(), FishApplet))
 #define FISH_IS_APPLET(o) \
@@ -57,6 +59,12 @@
 #define FISH_FRAMES_KEY  "frames"
 #define FISH_SPEED_KEY   "speed"
 #define FISH_ROTATE_KEY  "rotate"
+#define FISH_FORTUNE_TIMEOUT_KEY   "fortune-timeout"
+#define FISH_FORTUNE_MAX_BYTES_KEY "fortune-max-bytes"
+
+/* The fortune view only keeps the end of longer outputs, which can be
+ * endless when the output of the command is not limited */
+#define FISH_FORTUNE_VIEW_MAX_CHARS (512 * 1024)
 
 #define LOCKDOWN_SCHEMA                       "org.mate.lockdown"
 #define LOCKDOWN_DISABLE_COMMAND_LINE_KEY     "disable-command-line"
@@ -80,8 +88,13 @@ typedef struct {
 	GtkWidget         *drawing_area;
 	GtkRequisition     requisition;
 	GdkRectangle       prev_allocation;
-	cairo_surface_t   *surface;
+	cairo_surface_t  **frames;
+	int                n_rendered_frames;
 	guint              timeout;
+	guint              date_check_id;
+	GtkWidget         *toplevel;
+	gulong             window_state_id;
+	gboolean           visible;
 	int                current_frame;
 	gboolean           in_applet;
 
@@ -103,8 +116,12 @@ typedef struct {
 	GtkWidget         *fortune_cmd_label;
 	GtkTextBuffer	  *fortune_buffer;
 
-	unsigned int       source_id;
-	GIOChannel        *io_channel;
+	FishFortune       *fortune;
+	guint              fortune_tick_id;
+
+	/* The resolved command, NULL until the first run */
+	char             **fortune_argv;
+	gboolean           fortune_user_command;
 
 	gboolean           april_fools;
 } FishApplet;
@@ -119,6 +136,7 @@ static void     update_pixmap            (FishApplet *fish);
 static void     something_fishy_going_on (FishApplet *fish, const char *message);
 static void     display_fortune_dialog   (FishApplet *fish);
 static void     set_tooltip              (FishApplet *fish);
+static void     update_animation         (FishApplet *fish);
 
 static GType fish_applet_get_type (void);
 
@@ -623,15 +641,18 @@ static void something_fishy_going_on(FishApplet* fish, const char* message)
 	gtk_widget_show (dialog);
 }
 
-static gboolean locate_fortune_command (FishApplet* fish, int* argcp, char*** argvp)
+static gboolean resolve_fortune_command (FishApplet* fish, int* argcp, char*** argvp)
 {
 	char *prog = NULL;
 
+	/* argv[0] is the absolute path of the program, so that it is not
+	 * looked up in the PATH again for each fortune */
 	if (fish->command
 	    && g_shell_parse_argv (fish->command, argcp, argvp, NULL)) {
 		prog = g_find_program_in_path ((*argvp)[0]);
 		if (prog) {
-			g_free (prog);
+			g_free ((*argvp)[0]);
+			(*argvp)[0] = prog;
 			return TRUE;
 		}
 
@@ -639,30 +660,57 @@ static gboolean locate_fortune_command (FishApplet* fish, int* argcp, char*** ar
 	}
 
 	prog = g_find_program_in_path ("fortune");
-	if (prog) {
-		g_free (prog);
-		if (g_shell_parse_argv ("fortune", argcp, argvp, NULL))
-			return FALSE;
-	}
+	if (!prog && g_file_test ("/usr/games/fortune", G_FILE_TEST_IS_EXECUTABLE))
+		prog = g_strdup ("/usr/games/fortune");
 
-	if (g_file_test ("/usr/games/fortune", G_FILE_TEST_IS_EXECUTABLE)
-	    && g_shell_parse_argv ("/usr/games/fortune", argcp, argvp, NULL))
+	if (prog) {
+		*argcp = 1;
+		*argvp = g_new0 (char *, 2);
+		(*argvp)[0] = prog;
 		return FALSE;
+	}
 
-	something_fishy_going_on (fish,
-				  _("Unable to locate the command to execute"));
 	*argvp = NULL;
 	return FALSE;
 }
 
-#define FISH_RESPONSE_SPEAK 1
-static inline void fish_close_channel(FishApplet* fish)
+/* The command is only looked up in the PATH again when it changes */
+static gboolean locate_fortune_command (FishApplet* fish, char*** argvp)
 {
-	if (fish->io_channel) {
-		g_io_channel_shutdown (fish->io_channel, TRUE, NULL);
-		g_io_channel_unref (fish->io_channel);
+	int argc;
+
+	if (!fish->fortune_argv) {
+		fish->fortune_user_command = resolve_fortune_command (fish, &argc,
+								      &fish->fortune_argv);
+		if (!fish->fortune_argv) {
+			something_fishy_going_on (fish,
+						  _("Unable to locate the command to execute"));
+			*argvp = NULL;
+			return FALSE;
+		}
 	}
-	fish->io_channel = NULL;
+
+	*argvp = g_strdupv (fish->fortune_argv);
+
+	return fish->fortune_user_command;
+}
+
+static void forget_fortune_command (FishApplet* fish)
+{
+	g_strfreev (fish->fortune_argv);
+	fish->fortune_argv = NULL;
+}
+
+#define FISH_RESPONSE_SPEAK 1
+static void fish_stop_fortune(FishApplet* fish)
+{
+	if (fish->fortune)
+		fish_fortune_stop (fish->fortune);
+
+	if (fish->fortune_tick_id)
+		gtk_widget_remove_tick_callback (fish->fortune_view,
+						 fish->fortune_tick_id);
+	fish->fortune_tick_id = 0;
 }
 
 static void handle_fortune_response(GtkWidget* widget, int id, FishApplet* fish)
@@ -670,12 +718,9 @@ static void handle_fortune_response(GtkWidget* widget, int id, FishApplet* fish)
 	if (id == FISH_RESPONSE_SPEAK)
 		display_fortune_dialog (fish);
 	else {
-		/* if there is still a pipe, close it: if we hide the widget,
-		 * the * output can't be seen */
-		if (fish->source_id)
-			g_source_remove (fish->source_id);
-		fish->source_id = 0;
-		fish_close_channel (fish);
+		/* if the command still runs, kill it: if we hide the widget,
+		 * the output can't be seen */
+		fish_stop_fortune (fish);
 		gtk_widget_hide (fish->fortune_dialog);
 	}
 }
@@ -714,9 +759,6 @@ static void insert_fortune_text(FishApplet* fish, const char* text)
 	gtk_text_buffer_insert_with_tags_by_name (fish->fortune_buffer, &iter,
 						  text, -1, "monospace_tag",
 						  NULL);
-
-	while (gtk_events_pending ())
-	  gtk_main_iteration ();
 }
 
 static void clear_fortune_text(FishApplet* fish)
@@ -734,63 +776,76 @@ static void clear_fortune_text(FishApplet* fish)
 	insert_fortune_text (fish, "\n");
 }
 
-static gboolean fish_read_output(GIOChannel* source, GIOCondition condition, gpointer data)
+static void flush_fortune_text(FishApplet* fish)
 {
-	char        output[4096];
-	char       *utf8_output;
-	gsize       bytes_read;
-	GError     *error = NULL;
-	GIOStatus   status;
-	FishApplet *fish;
+	char *text;
+	int   n_chars;
+
+	text = fish_fortune_take (fish->fortune);
+	if (text)
+		insert_fortune_text (fish, text);
+	g_free (text);
 
-	fish = (FishApplet *) data;
+	n_chars = gtk_text_buffer_get_char_count (fish->fortune_buffer);
+	if (n_chars > FISH_FORTUNE_VIEW_MAX_CHARS) {
+		GtkTextIter begin, end;
 
-	if (!(condition & G_IO_IN)) {
-		fish->source_id = 0;
-		fish_close_channel (fish);
-		return FALSE;
+		/* keep the empty first line */
+		gtk_text_buffer_get_iter_at_offset (fish->fortune_buffer, &begin, 1);
+		gtk_text_buffer_get_iter_at_offset (fish->fortune_buffer, &end,
+						    n_chars - FISH_FORTUNE_VIEW_MAX_CHARS + 1);
+		gtk_text_buffer_delete (fish->fortune_buffer, &begin, &end);
 	}
+}
 
-	status = g_io_channel_read_chars (source, output, 4096, &bytes_read,
-					  &error);
+/* Inserts the output once per frame, however fast it comes */
+static gboolean fortune_tick(GtkWidget* widget, GdkFrameClock* frame_clock, gpointer data)
+{
+	FishApplet *fish = (FishApplet *) data;
 
-	if (error) {
-		char *message;
+	flush_fortune_text (fish);
 
-		message = g_strdup_printf (_("Unable to read output from command\n\nDetails: %s"),
-					   error->message);
-		something_fishy_going_on (fish, message);
-		g_free (message);
-		g_error_free (error);
-		fish->source_id = 0;
-		fish_close_channel (fish);
-		return FALSE;
-	}
+	if (fish_fortune_get_pending (fish->fortune) > 0)
+		return G_SOURCE_CONTINUE;
 
-	if (status == G_IO_STATUS_AGAIN)
-		return TRUE;
+	fish->fortune_tick_id = 0;
 
-	if (bytes_read > 0) {
-		/* The output is not guarantied to be in UTF-8 format, most
-		 * likely it's just in ASCII-7 or in the user locale
-		 */
-		if (!g_utf8_validate (output, -1, NULL))
-			utf8_output = g_locale_to_utf8 (output, bytes_read,
-							NULL, NULL, NULL);
-		else
-			utf8_output = g_strndup (output, bytes_read);
+	return G_SOURCE_REMOVE;
+}
 
-		if (utf8_output)
-			insert_fortune_text (fish, utf8_output);
+static void fortune_ready(FishFortune* fortune, gpointer data)
+{
+	FishApplet *fish = (FishApplet *) data;
 
-		g_free (utf8_output);
-	}
+	if (!fish->fortune_tick_id)
+		fish->fortune_tick_id = gtk_widget_add_tick_callback (fish->fortune_view,
+								      fortune_tick,
+								      fish, NULL);
+}
+
+static void fortune_done(FishFortune* fortune, FishFortuneStatus status, const GError* error, gpointer data)
+{
+	FishApplet *fish = (FishApplet *) data;
+	char       *message;
+
+	flush_fortune_text (fish);
 
-	if (status == G_IO_STATUS_EOF) {
-		fish->source_id = 0;
-		fish_close_channel (fish);
+	switch (status) {
+	case FISH_FORTUNE_FINISHED:
+		break;
+	case FISH_FORTUNE_TRUNCATED:
+		insert_fortune_text (fish, _("\n(The output of the command was too long and has been cut.)\n"));
+		break;
+	case FISH_FORTUNE_TIMED_OUT:
+		insert_fortune_text (fish, _("\n(The command took too long and has been stopped.)\n"));
+		break;
+	case FISH_FORTUNE_FAILED:
+		message = g_strdup_printf (_("Unable to read output from command\n\nDetails: %s"),
+					   error->message);
+		something_fishy_going_on (fish, message);
+		g_free (message);
+		break;
 	}
-	return (status != G_IO_STATUS_EOF);
 }
 
 /*
@@ -806,20 +861,16 @@ static void display_fortune_dialog(FishApplet* fish)
 {
 	GError      *error = NULL;
 	gboolean     user_command;
-	int          output;
-	const char  *charset;
-	int          argc;
 	char       **argv;
 	GdkScreen *screen;
 	char *display;
+	int          timeout;
+	int          max_bytes;
 
-	/* if there is still a pipe, close it */
-	if (fish->source_id)
-		g_source_remove (fish->source_id);
-	fish->source_id = 0;
-	fish_close_channel (fish);
+	/* if the command still runs, kill it */
+	fish_stop_fortune (fish);
 
-	user_command = locate_fortune_command (fish, &argc, &argv);
+	user_command = locate_fortune_command (fish, &argv);
 	if (!argv)
 		return;
 
@@ -934,19 +985,20 @@ static void display_fortune_dialog(FishApplet* fish)
 
 	clear_fortune_text (fish);
 
+	if (!fish->fortune)
+		fish->fortune = fish_fortune_new (fortune_ready, fortune_done, fish);
+
+	timeout = g_settings_get_int (fish->settings, FISH_FORTUNE_TIMEOUT_KEY);
+	max_bytes = g_settings_get_int (fish->settings, FISH_FORTUNE_MAX_BYTES_KEY);
+	fish_fortune_set_limits (fish->fortune,
+				 MAX (max_bytes, 0),
+				 MAX (timeout, 0) * 1000);
+
 	screen = gtk_widget_get_screen (GTK_WIDGET (fish));
 	display = gdk_screen_make_display_name (screen);
-	g_spawn_async_with_pipes (NULL, /* working directory */
-							  argv,
-							  NULL, /* envp */
-							  G_SPAWN_SEARCH_PATH|G_SPAWN_STDERR_TO_DEV_NULL,
-							  set_environment,
-							  &display,
-							  NULL, /* child pid */
-							  NULL, /* stdin */
-							  &output,
-							  NULL, /* stderr */
-							  &error);
+	fish_fortune_start (fish->fortune, argv,
+			    set_environment, display,
+			    &error);
 	g_free (display);
 
 	if (error) {
@@ -958,31 +1010,13 @@ static void display_fortune_dialog(FishApplet* fish)
 		g_free (message);
 		g_error_free (error);
 		g_strfreev (argv);
-		return;
-	}
-
-	fish->io_channel = g_io_channel_unix_new (output);
-	/* set the correct encoding if the locale is not using UTF-8 */
-	if (!g_get_charset (&charset))
-		g_io_channel_set_encoding(fish->io_channel, charset, &error);
-	if (error) {
-		char *message;
-
-		message = g_strdup_printf (_("Unable to read from '%s'\n\nDetails: %s"),
-					   argv[0], error->message);
-		something_fishy_going_on (fish, message);
-		g_free (message);
-		g_error_free (error);
-		g_strfreev (argv);
+		/* the program may have moved */
+		forget_fortune_command (fish);
 		return;
 	}
 
 	g_strfreev (argv);
 
-	fish->source_id = g_io_add_watch (fish->io_channel,
-					  G_IO_IN|G_IO_ERR|G_IO_HUP|G_IO_NVAL,
-					  fish_read_output, fish);
-
 	gtk_window_set_screen (GTK_WINDOW (fish->fortune_dialog),
 			       gtk_widget_get_screen (GTK_WIDGET (fish)));
 	gtk_window_present (GTK_WINDOW (fish->fortune_dialog));
@@ -1060,6 +1094,8 @@ static void command_changed_notify(GSettings* settings, gchar* key, FishApplet*
 		g_free (fish->command);
 	fish->command = g_strdup (value);
 
+	forget_fortune_command (fish);
+
 	if (fish->command_entry &&
 	    strcmp (gtk_entry_get_text (GTK_ENTRY (fish->command_entry)), fish->command))
 		gtk_entry_set_text (GTK_ENTRY (fish->command_entry), fish->command);
@@ -1083,6 +1119,7 @@ static void n_frames_changed_notify(GSettings* settings, gchar* key, FishApplet*
 		fish->n_frames = 1;
 
 	update_pixmap (fish);
+	update_animation (fish);
 
 	if (fish->frames_spin &&
 	    gtk_spin_button_get_value_as_int (GTK_SPIN_BUTTON (fish->frames_spin)) != fish->n_frames)
@@ -1166,51 +1203,153 @@ static void check_april_fools(FishApplet* fish)
 {
 	struct tm *tm;
 	time_t     now;
+	gboolean   april_fools;
 
 	time (&now);
 	tm = localtime (&now);
 
+	april_fools = fish->april_fools;
+
 	if (fish->april_fools &&
 	    (tm->tm_mon  != fools_month ||
 	     tm->tm_mday != fools_day   ||
-	     tm->tm_hour >= fools_hour_end)) {
-		fish->april_fools = FALSE;
-		update_pixmap (fish);
-	} else if (tm->tm_mon  == fools_month    &&
+	     tm->tm_hour >= fools_hour_end))
+		april_fools = FALSE;
+	else if (tm->tm_mon  == fools_month    &&
 		 tm->tm_mday == fools_day        &&
 		 tm->tm_hour >= fools_hour_start &&
-		 tm->tm_hour <= fools_hour_end) {
-		fish->april_fools = TRUE;
-		update_pixmap (fish);
-	}
+		 tm->tm_hour <  fools_hour_end)
+		april_fools = TRUE;
+
+	if (april_fools == fish->april_fools)
+		return;
+
+	fish->april_fools = april_fools;
+
+	update_pixmap (fish);
+	update_animation (fish);
 }
 
-static gboolean timeout_handler(gpointer data)
+static void fish_date_tick(time_t now, gpointer data)
 {
-	FishApplet *fish = (FishApplet *) data;
+	check_april_fools ((FishApplet *) data);
+}
 
-	check_april_fools (fish);
+static void queue_draw_frame(FishApplet* fish)
+{
+	/* Frames are drawn at the origin of the drawing area */
+	gtk_widget_queue_draw_area (fish->drawing_area, 0, 0,
+				    fish->requisition.width,
+				    fish->requisition.height);
+}
 
-	if (fish->april_fools)
-		return TRUE;
+static gboolean timeout_handler(gpointer data)
+{
+	FishApplet *fish = (FishApplet *) data;
 
 	fish->current_frame++;
 	if (fish->current_frame >= fish->n_frames)
 		fish->current_frame = 0;
 
-	gtk_widget_queue_draw (fish->drawing_area);
+	queue_draw_frame (fish);
 
 	return TRUE;
 }
 
+/* Only animate, and only look at the date, while the fish can be seen */
+static void update_animation(FishApplet* fish)
+{
+	gboolean animate;
+
+	if (fish->visible && !fish->date_check_id) {
+		fish->date_check_id = clock_scheduler_add (CLOCK_SCHEDULER_MINUTE,
+							   fish_date_tick, fish);
+		/* May call us back */
+		check_april_fools (fish);
+	} else if (!fish->visible && fish->date_check_id) {
+		clock_scheduler_remove (fish->date_check_id);
+		fish->date_check_id = 0;
+	}
+
+	animate = fish->visible && !fish->april_fools && fish->n_frames > 1;
+
+	if (animate && !fish->timeout)
+		fish->timeout = g_timeout_add (fish->speed * 1000,
+					       timeout_handler,
+					       fish);
+	else if (!animate && fish->timeout) {
+		g_source_remove (fish->timeout);
+		fish->timeout = 0;
+	}
+}
+
 static void setup_timeout(FishApplet *fish)
 {
 	if (fish->timeout)
 		g_source_remove (fish->timeout);
+	fish->timeout = 0;
+
+	update_animation (fish);
+}
 
-	fish->timeout = g_timeout_add (fish->speed * 1000,
-				       timeout_handler,
-				       fish);
+static void update_visible(FishApplet* fish)
+{
+	GdkWindow *window = NULL;
+
+	if (fish->toplevel)
+		window = gtk_widget_get_window (fish->toplevel);
+
+	/* Visibility notifies are never sent under a compositor, so only
+	 * rely on the map state, on the state of the toplevel window and on
+	 * the panel telling us it slid out of the screen */
+	fish->visible = gtk_widget_get_mapped (GTK_WIDGET (fish)) &&
+			!mate_panel_applet_get_panel_hidden (MATE_PANEL_APPLET (fish)) &&
+			(!window ||
+			 !(gdk_window_get_state (window) & (GDK_WINDOW_STATE_WITHDRAWN |
+							    GDK_WINDOW_STATE_ICONIFIED)));
+
+	update_animation (fish);
+}
+
+static gboolean fish_window_state_event(GtkWidget* widget, GdkEventWindowState* event, FishApplet* fish)
+{
+	if (event->changed_mask & (GDK_WINDOW_STATE_WITHDRAWN |
+				   GDK_WINDOW_STATE_ICONIFIED))
+		update_visible (fish);
+
+	return FALSE;
+}
+
+static void fish_disconnect_toplevel(FishApplet* fish)
+{
+	if (fish->window_state_id)
+		g_signal_handler_disconnect (fish->toplevel,
+					     fish->window_state_id);
+	fish->window_state_id = 0;
+	fish->toplevel = NULL;
+}
+
+static void fish_hierarchy_changed(GtkWidget* widget, GtkWidget* previous_toplevel, FishApplet* fish)
+{
+	GtkWidget *toplevel;
+
+	toplevel = gtk_widget_get_toplevel (widget);
+	if (!gtk_widget_is_toplevel (toplevel))
+		toplevel = NULL;
+
+	if (toplevel == fish->toplevel)
+		return;
+
+	fish_disconnect_toplevel (fish);
+
+	if (toplevel) {
+		fish->toplevel = toplevel;
+		fish->window_state_id =
+			g_signal_connect (toplevel, "window_state_event",
+					  G_CALLBACK (fish_window_state_event), fish);
+	}
+
+	update_visible (fish);
 }
 
 static void speed_changed_notify(GSettings* settings, gchar* key, FishApplet* fish)
@@ -1331,6 +1470,18 @@ static gboolean load_fish_image(FishApplet* fish)
 	return TRUE;
 }
 
+static void free_frames(FishApplet* fish)
+{
+	int i;
+
+	for (i = 0; i < fish->n_rendered_frames; i++)
+		cairo_surface_destroy (fish->frames [i]);
+	g_free (fish->frames);
+
+	fish->frames = NULL;
+	fish->n_rendered_frames = 0;
+}
+
 static void update_pixmap(FishApplet* fish)
 {
 	GtkWidget     *widget = fish->drawing_area;
@@ -1343,6 +1494,8 @@ static void update_pixmap(FishApplet* fish)
 	cairo_t       *cr;
 	cairo_matrix_t matrix;
 	cairo_pattern_t *pattern;
+	cairo_surface_t *strip;
+	int            i;
 
 	gtk_widget_get_allocation (widget, &allocation);
 
@@ -1388,20 +1541,20 @@ static void update_pixmap(FishApplet* fish)
 
 	g_assert (width != -1 && height != -1);
 
-	if (width == 0 || height == 0)
+	if (width == 0 || height == 0 ||
+	    fish->requisition.width <= 0 || fish->requisition.height <= 0)
 		return;
 
-	if (fish->surface)
-		cairo_surface_destroy (fish->surface);
-	fish->surface = gdk_window_create_similar_surface (gtk_widget_get_window (widget),
-													   CAIRO_CONTENT_COLOR_ALPHA,
-													   width, height);
-
 	gtk_widget_queue_resize (widget);
 
 	g_assert (pixbuf_width != -1 && pixbuf_height != -1);
 
-	cr = cairo_create (fish->surface);
+	/* The scaled and rotated strip is only needed to cut the frames out
+	 * of it: the expensive filtering is done once per size, orientation
+	 * or image, not on each frame */
+	strip = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, width, height);
+
+	cr = cairo_create (strip);
 
 	cairo_set_source_rgb (cr, 1, 1, 1);
 	cairo_paint (cr);
@@ -1446,34 +1599,51 @@ static void update_pixmap(FishApplet* fish)
 	}
 
 	cairo_destroy (cr);
+
+	free_frames (fish);
+
+	fish->frames = g_new0 (cairo_surface_t *, fish->n_frames);
+	fish->n_rendered_frames = fish->n_frames;
+
+	for (i = 0; i < fish->n_frames; i++) {
+		int src_x = 0;
+		int src_y = 0;
+
+		if (rotate) {
+			if (fish->orientation == MATE_PANEL_APPLET_ORIENT_RIGHT)
+				src_y = (height * (fish->n_frames - 1 - i)) / fish->n_frames;
+			else
+				src_y = (height * i) / fish->n_frames;
+		} else
+			src_x = (width * i) / fish->n_frames;
+
+		fish->frames [i] = gdk_window_create_similar_surface (gtk_widget_get_window (widget),
+								      CAIRO_CONTENT_COLOR_ALPHA,
+								      fish->requisition.width,
+								      fish->requisition.height);
+
+		cr = cairo_create (fish->frames [i]);
+		cairo_set_source_surface (cr, strip, -src_x, -src_y);
+		cairo_paint (cr);
+		cairo_destroy (cr);
+	}
+
+	cairo_surface_destroy (strip);
+
+	gtk_widget_queue_draw (widget);
 }
 
 static gboolean fish_applet_draw(GtkWidget* widget, cairo_t *cr, FishApplet* fish)
 {
-	int width, height;
-	int src_x, src_y;
+	int frame;
 
-	g_return_val_if_fail (fish->surface != NULL, FALSE);
-
-	g_assert (fish->n_frames > 0);
-
-	width = cairo_xlib_surface_get_width (fish->surface);
-	height = cairo_xlib_surface_get_height (fish->surface);
-	src_x = 0;
-	src_y = 0;
+	if (!fish->frames)
+		return FALSE;
 
-	if (fish->rotate) {
-		if (fish->orientation == MATE_PANEL_APPLET_ORIENT_RIGHT)
-			src_y += ((height * (fish->n_frames - 1 - fish->current_frame)) / fish->n_frames);
-		else if (fish->orientation == MATE_PANEL_APPLET_ORIENT_LEFT)
-			src_y += ((height * fish->current_frame) / fish->n_frames);
-		else
-			src_x += ((width * fish->current_frame) / fish->n_frames);
-	} else
-		src_x += ((width * fish->current_frame) / fish->n_frames);
+	frame = CLAMP (fish->current_frame, 0, fish->n_rendered_frames - 1);
 
 	cairo_save (cr);
-	cairo_set_source_surface (cr, fish->surface, -src_x, -src_y);
+	cairo_set_source_surface (cr, fish->frames [frame], 0, 0);
 	cairo_paint (cr);
 	cairo_restore (cr);
 
@@ -1495,15 +1665,13 @@ static void fish_applet_size_allocate(GtkWidget* widget, GtkAllocation* allocati
 
 static void fish_applet_realize(GtkWidget* widget, FishApplet* fish)
 {
-	if (!fish->surface)
+	if (!fish->frames)
 		update_pixmap (fish);
 }
 
 static void fish_applet_unrealize(GtkWidget* widget, FishApplet* fish)
 {
-	if (fish->surface)
-		cairo_surface_destroy (fish->surface);
-	fish->surface = NULL;
+	free_frames (fish);
 }
 
 static void fish_applet_change_orient(MatePanelApplet* applet, MatePanelAppletOrient orientation)
@@ -1515,7 +1683,7 @@ static void fish_applet_change_orient(MatePanelApplet* applet, MatePanelAppletOr
 
 	fish->orientation = orientation;
 
-	if (fish->surface)
+	if (fish->frames)
 		update_pixmap (fish);
 }
 
@@ -1650,6 +1818,17 @@ static void setup_fish_widget(FishApplet* fish)
 	g_signal_connect_swapped (widget, "button_release_event",
 				  G_CALLBACK (handle_button_release), fish);
 
+	g_signal_connect (widget, "hierarchy_changed",
+			  G_CALLBACK (fish_hierarchy_changed), fish);
+	fish_hierarchy_changed (widget, NULL, fish);
+	g_signal_connect_swapped (widget, "map",
+				  G_CALLBACK (update_visible), fish);
+	g_signal_connect_data (widget, "unmap",
+			       G_CALLBACK (update_visible), fish,
+			       NULL, G_CONNECT_SWAPPED | G_CONNECT_AFTER);
+	g_signal_connect_swapped (widget, "notify::panel-hidden",
+				  G_CALLBACK (update_visible), fish);
+
 	gtk_widget_add_events (fish->drawing_area, GDK_BUTTON_RELEASE_MASK);
 	g_signal_connect_swapped (fish->drawing_area, "button_release_event",
 				  G_CALLBACK (handle_button_release), fish);
@@ -1658,7 +1837,8 @@ static void setup_fish_widget(FishApplet* fish)
 
 	update_pixmap (fish);
 
-	setup_timeout (fish);
+	/* The animation starts once the applet is mapped */
+	update_visible (fish);
 
 	set_tooltip (fish);
 	set_ally_name_desc (GTK_WIDGET (fish), fish);
@@ -1764,6 +1944,12 @@ static void fish_applet_dispose (GObject *object)
 
 	fish->timeout = 0;
 
+	fish_disconnect_toplevel (fish);
+
+	if (fish->date_check_id)
+		clock_scheduler_remove (fish->date_check_id);
+	fish->date_check_id = 0;
+
 	if (fish->settings)
 		g_object_unref (fish->settings);
 	fish->settings = NULL;
@@ -1784,9 +1970,7 @@ static void fish_applet_dispose (GObject *object)
 		g_free (fish->command);
 	fish->command = NULL;
 
-	if (fish->surface)
-		cairo_surface_destroy (fish->surface);
-	fish->surface = NULL;
+	free_frames (fish);
 
 	if (fish->pixbuf)
 		g_object_unref (fish->pixbuf);
@@ -1796,16 +1980,17 @@ static void fish_applet_dispose (GObject *object)
 		gtk_widget_destroy (fish->preferences_dialog);
 	fish->preferences_dialog = NULL;
 
+	fish_stop_fortune (fish);
+
+	fish_fortune_free (fish->fortune);
+	fish->fortune = NULL;
+
+	forget_fortune_command (fish);
+
 	if (fish->fortune_dialog)
 		gtk_widget_destroy (fish->fortune_dialog);
 	fish->fortune_dialog = NULL;
 
-	if (fish->source_id)
-		g_source_remove (fish->source_id);
-	fish->source_id = 0;
-
-	fish_close_channel (fish);
-
 	G_OBJECT_CLASS (parent_class)->dispose (object);
 }
 
@@ -1822,8 +2007,13 @@ static void fish_applet_instance_init(FishApplet* fish, FishAppletClass* klass)
 
 	fish->frame         = NULL;
 	fish->drawing_area  = NULL;
-	fish->surface       = NULL;
+	fish->frames        = NULL;
+	fish->n_rendered_frames = 0;
 	fish->timeout       = 0;
+	fish->date_check_id = 0;
+	fish->toplevel      = NULL;
+	fish->window_state_id = 0;
+	fish->visible       = FALSE;
 	fish->current_frame = 0;
 	fish->in_applet     = FALSE;
 
@@ -1853,8 +2043,10 @@ static void fish_applet_instance_init(FishApplet* fish, FishAppletClass* klass)
 	fish->fortune_cmd_label = NULL;
 	fish->fortune_buffer = NULL;
 
-	fish->source_id  = 0;
-	fish->io_channel = NULL;
+	fish->fortune         = NULL;
+	fish->fortune_tick_id = 0;
+	fish->fortune_argv    = NULL;
+	fish->fortune_user_command = FALSE;
 
 	fish->april_fools = FALSE;
 
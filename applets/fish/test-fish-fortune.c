@@ -0,0 +1,174 @@
+/* Test for the bounded execution of the fish's command
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <glib.h>
+
+#include "fish-fortune.h"
+
+/* 100 MB of output */
+#define FLOOD_BYTES   (100 * 1024 * 1024)
+#define FLOOD_COMMAND "yes 'Something fishy is going on' | head -c 104857600"
+
+/* Like a frame clock, but as fast as the main loop goes */
+#define FRAME_MS 1
+
+typedef struct {
+	FishFortune       *fortune;
+	GMainLoop         *loop;
+	guint              frame_id;
+	gsize              received;
+	gsize              max_pending;
+	guint              n_frames;
+	gboolean           done;
+	FishFortuneStatus  status;
+} TestRun;
+
+static gboolean
+frame (gpointer data)
+{
+	TestRun *run = data;
+	char    *text;
+
+	run->max_pending = MAX (run->max_pending,
+				fish_fortune_get_pending (run->fortune));
+
+	text = fish_fortune_take (run->fortune);
+	if (text)
+		run->received += strlen (text);
+	g_free (text);
+
+	run->n_frames++;
+
+	if (fish_fortune_get_pending (run->fortune) > 0)
+		return TRUE;
+
+	run->frame_id = 0;
+
+	return FALSE;
+}
+
+static void
+ready (FishFortune *fortune,
+       gpointer     data)
+{
+	TestRun *run = data;
+
+	if (!run->frame_id)
+		run->frame_id = g_timeout_add (FRAME_MS, frame, run);
+}
+
+static void
+done (FishFortune       *fortune,
+      FishFortuneStatus  status,
+      const GError      *error,
+      gpointer           data)
+{
+	TestRun *run = data;
+
+	if (error)
+		g_printerr ("  error: %s\n", error->message);
+
+	run->done = TRUE;
+	run->status = status;
+
+	if (run->frame_id)
+		g_source_remove (run->frame_id);
+	run->frame_id = 0;
+
+	/* Take what was read before the end */
+	while (fish_fortune_get_pending (fortune) > 0)
+		frame (run);
+
+	g_main_loop_quit (run->loop);
+}
+
+static gboolean
+run_command (const char        *name,
+	     const char        *command,
+	     gsize              max_bytes,
+	     guint              timeout_ms,
+	     FishFortuneStatus  expected_status,
+	     gsize              expected_bytes)
+{
+	TestRun   run = { 0 };
+	char     *argv[] = { "/bin/sh", "-c", (char *) command, NULL };
+	GError   *error = NULL;
+	GTimer   *timer;
+	gboolean  ok;
+
+	g_print ("%s\n", name);
+
+	run.loop = g_main_loop_new (NULL, FALSE);
+	run.fortune = fish_fortune_new (ready, done, &run);
+	fish_fortune_set_limits (run.fortune, max_bytes, timeout_ms);
+
+	timer = g_timer_new ();
+
+	if (!fish_fortune_start (run.fortune, argv, NULL, NULL, &error)) {
+		g_printerr ("  cannot run the command: %s\n", error->message);
+		g_error_free (error);
+		return FALSE;
+	}
+
+	g_main_loop_run (run.loop);
+
+	g_print ("  status %d, %" G_GSIZE_FORMAT " bytes in %u frames, "
+		 "at most %" G_GSIZE_FORMAT " bytes pending, %.2f s\n",
+		 run.status, run.received, run.n_frames,
+		 run.max_pending, g_timer_elapsed (timer, NULL));
+
+	ok = run.done && run.status == expected_status &&
+	     run.received == expected_bytes;
+	g_print ("  %s\n", ok ? "PASS" : "FAIL");
+
+	if (run.frame_id)
+		g_source_remove (run.frame_id);
+	fish_fortune_free (run.fortune);
+	g_main_loop_unref (run.loop);
+	g_timer_destroy (timer);
+
+	return ok;
+}
+
+int
+main (int argc, char **argv)
+{
+	gboolean ok = TRUE;
+
+	/* The whole output streams through the ring buffer */
+	ok &= run_command ("Reading 100 MB of output",
+			   FLOOD_COMMAND, 0, 0,
+			   FISH_FORTUNE_FINISHED, FLOOD_BYTES);
+
+	/* The command is killed once it wrote more than the cap */
+	ok &= run_command ("Capping 100 MB of output to 256 kB",
+			   FLOOD_COMMAND, 256 * 1024, 0,
+			   FISH_FORTUNE_TRUNCATED, 256 * 1024);
+
+	/* Output right at the cap is complete */
+	ok &= run_command ("Reading output of exactly the cap",
+			   "head -c 4096 /dev/zero | tr '\\0' x", 4096, 0,
+			   FISH_FORTUNE_FINISHED, 4096);
+
+	/* A command that never ends is killed after the timeout */
+	ok &= run_command ("Stopping a command after 500 ms",
+			   "echo fish; exec sleep 60", 0, 500,
+			   FISH_FORTUNE_TIMED_OUT, 5);
+
+	return ok ? 0 : 1;
+}
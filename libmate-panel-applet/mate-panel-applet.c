@@ -83,6 +83,7 @@ struct _MatePanelAppletPrivate {
 
 	gboolean           locked;
 	gboolean           locked_down;
+	gboolean           panel_hidden;
 };
 
 enum {
@@ -107,7 +108,8 @@ enum {
 	PROP_FLAGS,
 	PROP_SIZE_HINTS,
 	PROP_LOCKED,
-	PROP_LOCKED_DOWN
+	PROP_LOCKED_DOWN,
+	PROP_PANEL_HIDDEN
 };
 
 static void       mate_panel_applet_handle_background   (MatePanelApplet       *applet);
@@ -442,6 +444,33 @@ mate_panel_applet_set_locked_down (MatePanelApplet *applet,
 	g_object_notify (G_OBJECT (applet), "locked-down");
 }
 
+/* Whether the panel of the applet is hidden, either automatically or with
+ * its hide buttons: the applet is then out of sight, even though it stays
+ * mapped. Listen to "notify::panel-hidden" for changes. */
+gboolean
+mate_panel_applet_get_panel_hidden (MatePanelApplet *applet)
+{
+	g_return_val_if_fail (PANEL_IS_APPLET (applet), FALSE);
+
+	return applet->priv->panel_hidden;
+}
+
+/* Only the panel knows when it hides, so API is not public. */
+static void
+mate_panel_applet_set_panel_hidden (MatePanelApplet *applet,
+				    gboolean         panel_hidden)
+{
+	g_return_if_fail (PANEL_IS_APPLET (applet));
+
+	panel_hidden = panel_hidden != FALSE;
+	if (applet->priv->panel_hidden == panel_hidden)
+		return;
+
+	applet->priv->panel_hidden = panel_hidden;
+
+	g_object_notify (G_OBJECT (applet), "panel-hidden");
+}
+
 static Atom _net_wm_window_type = None;
 static Atom _net_wm_window_type_dock = None;
 static Atom _net_active_window = None;
@@ -1633,6 +1662,9 @@ mate_panel_applet_get_property (GObject    *object,
 	case PROP_LOCKED_DOWN:
 		g_value_set_boolean (value, applet->priv->locked_down);
 		break;
+	case PROP_PANEL_HIDDEN:
+		g_value_set_boolean (value, applet->priv->panel_hidden);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 	}
@@ -1688,6 +1720,9 @@ mate_panel_applet_set_property (GObject      *object,
 	case PROP_LOCKED_DOWN:
 		mate_panel_applet_set_locked_down (applet, g_value_get_boolean (value));
 		break;
+	case PROP_PANEL_HIDDEN:
+		mate_panel_applet_set_panel_hidden (applet, g_value_get_boolean (value));
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 	}
@@ -1963,6 +1998,13 @@ mate_panel_applet_class_init (MatePanelAppletClass *klass)
 							       "Whether Panel Applet is locked down",
 							       FALSE,
 							       G_PARAM_READWRITE));
+	g_object_class_install_property (gobject_class,
+					 PROP_PANEL_HIDDEN,
+					 g_param_spec_boolean ("panel-hidden",
+							       "PanelHidden",
+							       "Whether the panel of Panel Applet is hidden",
+							       FALSE,
+							       G_PARAM_READWRITE));
 
 	mate_panel_applet_signals [CHANGE_ORIENT] =
                 g_signal_new ("change_orient",
@@ -2093,6 +2135,8 @@ get_property_cb (GDBusConnection *connection,
 		retval = g_variant_new_boolean (applet->priv->locked);
 	} else if (g_strcmp0 (property_name, "LockedDown") == 0) {
 		retval = g_variant_new_boolean (applet->priv->locked_down);
+	} else if (g_strcmp0 (property_name, "PanelHidden") == 0) {
+		retval = g_variant_new_boolean (applet->priv->panel_hidden);
 	}
 
 	return retval;
@@ -2130,6 +2174,8 @@ set_property_cb (GDBusConnection *connection,
 		mate_panel_applet_set_locked (applet, g_variant_get_boolean (value));
 	} else if (g_strcmp0 (property_name, "LockedDown") == 0) {
 		mate_panel_applet_set_locked_down (applet, g_variant_get_boolean (value));
+	} else if (g_strcmp0 (property_name, "PanelHidden") == 0) {
+		mate_panel_applet_set_panel_hidden (applet, g_variant_get_boolean (value));
 	}
 
 	return TRUE;
@@ -2150,6 +2196,7 @@ static const gchar introspection_xml[] =
 	    "<property name='SizeHints' type='ai' access='readwrite'/>"
 	    "<property name='Locked' type='b' access='readwrite'/>"
 	    "<property name='LockedDown' type='b' access='readwrite'/>"
+	    "<property name='PanelHidden' type='b' access='readwrite'/>"
 	    "<signal name='Move' />"
 	    "<signal name='RemoveFromPanel' />"
 	    "<signal name='Lock' />"
@@ -1,4 +1,5 @@
 #include <config.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "mate-panel-applet.h"
@@ -27,6 +28,40 @@ static const char test_applet_menu_xml[] =
 	"<menuitem name=\"Test Item 2\" action=\"TestAppletDo2\" />\n"
 	"<menuitem name=\"Test Item 3\" action=\"TestAppletDo3\" />\n";
 
+/* The crash test applet takes its whole factory down, either from its
+ * menu or, when TEST_APPLET_CRASH_DELAY is set, that many seconds after
+ * being loaded */
+static void
+test_applet_crash (void)
+{
+	g_message ("Crashing on purpose");
+	abort ();
+}
+
+static void
+test_applet_on_crash (GtkAction *action,
+		      gpointer   user_data)
+{
+	test_applet_crash ();
+}
+
+static gboolean
+test_applet_crash_timeout (gpointer user_data)
+{
+	test_applet_crash ();
+
+	return FALSE;
+}
+
+static const GtkActionEntry crash_test_applet_menu_actions[] = {
+	{ "CrashTestAppletCrash", NULL, "Crash Now",
+	  NULL, NULL,
+	  G_CALLBACK (test_applet_on_crash) }
+};
+
+static const char crash_test_applet_menu_xml[] =
+	"<menuitem name=\"Crash Now\" action=\"CrashTestAppletCrash\" />\n";
+
 typedef struct _TestApplet      TestApplet;
 typedef struct _TestAppletClass TestAppletClass;
 
@@ -189,6 +224,37 @@ test_applet_fill (TestApplet *applet)
 	return TRUE;
 }
 
+static gboolean
+crash_test_applet_fill (TestApplet *applet)
+{
+	GtkActionGroup *action_group;
+	const char     *delay;
+
+	applet->label = gtk_label_new ("Crash Me");
+
+	gtk_container_add (GTK_CONTAINER (applet), applet->label);
+
+	gtk_widget_show_all (GTK_WIDGET (applet));
+
+	action_group = gtk_action_group_new ("CrashTestAppletActions");
+	gtk_action_group_add_actions (action_group,
+				      crash_test_applet_menu_actions,
+				      G_N_ELEMENTS (crash_test_applet_menu_actions),
+				      applet);
+
+	mate_panel_applet_setup_menu (MATE_PANEL_APPLET (applet),
+				 crash_test_applet_menu_xml,
+				 action_group);
+	g_object_unref (action_group);
+
+	delay = g_getenv ("TEST_APPLET_CRASH_DELAY");
+	if (delay)
+		g_timeout_add_seconds (atoi (delay),
+				       test_applet_crash_timeout, NULL);
+
+	return TRUE;
+}
+
 static gboolean
 test_applet_factory (TestApplet  *applet,
 		     const gchar *iid,
@@ -198,6 +264,8 @@ test_applet_factory (TestApplet  *applet,
 
 	if (!strcmp (iid, "TestApplet"))
 		retval = test_applet_fill (applet);
+	else if (!strcmp (iid, "CrashTestApplet"))
+		retval = crash_test_applet_fill (applet);
 
 	return retval;
 }
@@ -880,6 +880,14 @@ mate_panel_applet_on_load_queue (const char *id)
 	return FALSE;
 }
 
+/* Whether all the queued applets were loaded, or failed to */
+gboolean
+mate_panel_applets_loaded (void)
+{
+	return mate_panel_applets_to_load == NULL &&
+	       mate_panel_applets_loading == NULL;
+}
+
 /* This doesn't do anything if the initial unhide already happened */
 static gboolean
 mate_panel_applet_queue_initial_unhide_toplevels (gpointer user_data)
@@ -1331,8 +1339,11 @@ mate_panel_applet_register (GtkWidget       *applet,
 	g_object_set_data (G_OBJECT (applet), "applet_info", info);
 
 	if (type != PANEL_OBJECT_APPLET)
-		panel_lockdown_notify_add (G_CALLBACK (mate_panel_applet_recreate_menu),
-					   info);
+		panel_lockdown_notify_add_keys (PANEL_LOCKDOWN_LOCKED_DOWN |
+						PANEL_LOCKDOWN_DISABLE_COMMAND_LINE |
+						PANEL_LOCKDOWN_DISABLE_LOCK_SCREEN,
+						G_CALLBACK (mate_panel_applet_recreate_menu),
+						info);
 
 	locked_changed = g_strdup_printf ("changed::%s", PANEL_OBJECT_LOCKED_KEY);
 	g_signal_connect (info->settings,
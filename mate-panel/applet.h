@@ -76,6 +76,7 @@ void mate_panel_applet_queue_applet_to_load (const char      *id,
 					gboolean         locked);
 void mate_panel_applet_load_queued_applets  (gboolean initial_load);
 gboolean mate_panel_applet_on_load_queue    (const char *id);
+gboolean mate_panel_applets_loaded          (void);
 
 
 void            mate_panel_applet_add_callback    (AppletInfo          *info,
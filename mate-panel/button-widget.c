@@ -24,6 +24,7 @@ struct _ButtonWidgetPrivate {
 	GtkIconTheme     *icon_theme;
 	GdkPixbuf        *pixbuf;
 	GdkPixbuf        *pixbuf_hc;
+	GCancellable     *icon_cancellable;
 
 	char             *filename;
 
@@ -154,34 +155,26 @@ button_widget_unset_pixbufs (ButtonWidget *button)
 }
 
 static void
-button_widget_reload_pixbuf (ButtonWidget *button)
+button_widget_icon_loaded (GdkPixbuf  *pixbuf,
+			   const char *error_msg,
+			   gpointer    user_data)
 {
-	button_widget_unset_pixbufs (button);
+	ButtonWidget *button = user_data;
 
-	if (button->priv->size <= 1 || button->priv->icon_theme == NULL)
-		return;
+	g_clear_object (&button->priv->icon_cancellable);
 
-	if (button->priv->filename != NULL &&
-	    button->priv->filename [0] != '\0') {
-		char *error = NULL;
-
-		button->priv->pixbuf =
-			panel_load_icon (button->priv->icon_theme,
-					 button->priv->filename,
-					 button->priv->size,
-					 button->priv->orientation & PANEL_VERTICAL_MASK   ? button->priv->size : -1,
-					 button->priv->orientation & PANEL_HORIZONTAL_MASK ? button->priv->size : -1,
-					 &error);
-		if (error) {
-			//FIXME: this is not rendered at button->priv->size
-			GtkIconTheme *icon_theme = gtk_icon_theme_get_default();
-			button->priv->pixbuf = gtk_icon_theme_load_icon (icon_theme,
-							       "image-missing",
-							       GTK_ICON_SIZE_BUTTON,
-							       GTK_ICON_LOOKUP_FORCE_SVG | GTK_ICON_LOOKUP_USE_BUILTIN,
-							       NULL);
-			g_free (error);
-		}
+	button_widget_unset_pixbufs (button);
+
+	if (pixbuf)
+		button->priv->pixbuf = g_object_ref (pixbuf);
+	else {
+		//FIXME: this is not rendered at button->priv->size
+		GtkIconTheme *icon_theme = gtk_icon_theme_get_default();
+		button->priv->pixbuf = gtk_icon_theme_load_icon (icon_theme,
+						       "image-missing",
+						       GTK_ICON_SIZE_BUTTON,
+						       GTK_ICON_LOOKUP_FORCE_SVG | GTK_ICON_LOOKUP_USE_BUILTIN,
+						       NULL);
 	}
 
 	button->priv->pixbuf_hc = make_hc_pixbuf (button->priv->pixbuf);
@@ -189,6 +182,44 @@ button_widget_reload_pixbuf (ButtonWidget *button)
 	gtk_widget_queue_resize (GTK_WIDGET (button));
 }
 
+static void
+button_widget_cancel_icon_load (ButtonWidget *button)
+{
+	if (button->priv->icon_cancellable) {
+		g_cancellable_cancel (button->priv->icon_cancellable);
+		g_clear_object (&button->priv->icon_cancellable);
+	}
+}
+
+static void
+button_widget_reload_pixbuf (ButtonWidget *button)
+{
+	button_widget_cancel_icon_load (button);
+
+	if (button->priv->size <= 1 || button->priv->icon_theme == NULL) {
+		button_widget_unset_pixbufs (button);
+		return;
+	}
+
+	if (button->priv->filename != NULL &&
+	    button->priv->filename [0] != '\0') {
+		/* The current icon stays until the new one is loaded, which
+		 * happens right away when it is in the icon cache */
+		button->priv->icon_cancellable = g_cancellable_new ();
+		panel_load_icon_async (button->priv->icon_theme,
+				       button->priv->filename,
+				       button->priv->size,
+				       button->priv->orientation & PANEL_VERTICAL_MASK   ? button->priv->size : -1,
+				       button->priv->orientation & PANEL_HORIZONTAL_MASK ? button->priv->size : -1,
+				       button->priv->icon_cancellable,
+				       button_widget_icon_loaded,
+				       button);
+	} else {
+		button_widget_unset_pixbufs (button);
+		gtk_widget_queue_resize (GTK_WIDGET (button));
+	}
+}
+
 static void
 button_widget_icon_theme_changed (ButtonWidget *button)
 {
@@ -201,6 +232,7 @@ button_widget_finalize (GObject *object)
 {
 	ButtonWidget *button = (ButtonWidget *) object;
 
+	button_widget_cancel_icon_load (button);
 	button_widget_unset_pixbufs (button);
 
 	g_free (button->priv->filename);
@@ -411,9 +411,23 @@ drawer_button_size_allocated (GtkWidget     *widget,
 	if (!gtk_widget_get_realized (widget))
 		return;
 
-	gtk_widget_queue_resize (GTK_WIDGET (drawer->toplevel));
+	/* Any relayout of the parent panel allocates the button again,
+	 * mostly at the same place */
+	if (drawer->button_allocated &&
+	    alloc->x      == drawer->button_allocation.x     &&
+	    alloc->y      == drawer->button_allocation.y     &&
+	    alloc->width  == drawer->button_allocation.width &&
+	    alloc->height == drawer->button_allocation.height)
+		return;
+
+	drawer->button_allocation = *alloc;
+	drawer->button_allocated  = TRUE;
 
-	g_object_set_data (G_OBJECT (widget), "allocated", GINT_TO_POINTER (TRUE));
+	/* A collapsed drawer is placed when it opens */
+	if (!gtk_widget_get_visible (GTK_WIDGET (drawer->toplevel)))
+		return;
+
+	gtk_widget_queue_resize (GTK_WIDGET (drawer->toplevel));
 }
 
 static void
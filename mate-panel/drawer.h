@@ -16,6 +16,10 @@ typedef struct {
 	gboolean       opened_for_drag;
 	guint          close_timeout_id;
 
+	/* Where the button was last allocated, in its panel */
+	GtkAllocation  button_allocation;
+	gboolean       button_allocated;
+
 	AppletInfo    *info;
 } Drawer;
 
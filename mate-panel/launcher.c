@@ -95,6 +95,37 @@ launcher_register_error_dialog (Launcher *launcher,
 			  launcher);
 }
 
+/* Drops the cached descriptor; it is rebuilt on the next launch */
+static void
+launcher_invalidate_launch (Launcher *launcher)
+{
+	char *type;
+
+	panel_launch_descriptor_free (launcher->launch_desc);
+	launcher->launch_desc = NULL;
+
+	type = panel_key_file_get_string (launcher->key_file, "Type");
+	launcher->is_link = type && !strcmp (type, "Link");
+	g_free (type);
+}
+
+static PanelLaunchDescriptor *
+launcher_get_launch_descriptor (Launcher *launcher)
+{
+	/* The resolved binary is stale once a PATH directory changed */
+	if (launcher->is_link)
+		return NULL;
+
+	if (!launcher->launch_desc ||
+	    launcher->launch_desc_serial != panel_program_in_path_get_serial ()) {
+		panel_launch_descriptor_free (launcher->launch_desc);
+		launcher->launch_desc = panel_launch_descriptor_new (launcher->key_file);
+		launcher->launch_desc_serial = panel_program_in_path_get_serial ();
+	}
+
+	return launcher->launch_desc;
+}
+
 static void
 launch_url (Launcher *launcher)
 {
@@ -130,8 +161,6 @@ void
 launcher_launch (Launcher  *launcher,
 		 GtkWidget *widget)
 {
-	char *type;
-
 	g_return_if_fail (launcher != NULL);
 	g_return_if_fail (launcher->key_file != NULL);
 
@@ -141,14 +170,18 @@ launcher_launch (Launcher  *launcher,
 				     button_widget_get_orientation (BUTTON_WIDGET (widget)),
 				     NULL);
 	
-	type = panel_key_file_get_string (launcher->key_file, "Type");
-	if (type && !strcmp (type, "Link"))
+	if (launcher->is_link)
 		launch_url (launcher);
 	else {
-		GError *error = NULL;
-
-		panel_launch_key_file (launcher->key_file, NULL,
-				       launcher_get_screen (launcher), &error);
+		PanelLaunchDescriptor *desc;
+		GError                *error = NULL;
+
+		desc = launcher_get_launch_descriptor (launcher);
+		if (desc)
+			panel_launch_descriptor_launch (desc, NULL,
+							launcher_get_screen (launcher),
+							gtk_get_current_event_time (),
+							&error);
 		if (error) {
 			GtkWidget *error_dialog;
 
@@ -163,7 +196,6 @@ launcher_launch (Launcher  *launcher,
 			g_clear_error (&error);
 		}
 	}
-	g_free (type);
 	
 	if (panel_global_config_get_drawer_auto_close ()) {
 		PanelToplevel *toplevel;
@@ -194,10 +226,11 @@ drag_data_received_cb (GtkWidget        *widget,
 		       guint             time,
 		       Launcher         *launcher)
 {
-	GError  *error = NULL;
-	char   **uris;
-	int      i;
-	GList   *file_list;
+	PanelLaunchDescriptor  *desc;
+	GError                 *error = NULL;
+	char                  **uris;
+	int                     i;
+	GList                  *file_list;
 
 	if (panel_global_config_get_enable_animations ())
 		xstuff_zoom_animate (widget,
@@ -211,8 +244,12 @@ drag_data_received_cb (GtkWidget        *widget,
 		file_list = g_list_prepend (file_list, uris[i]);
 	file_list = g_list_reverse (file_list);
 
-	panel_launch_key_file (launcher->key_file, file_list,
-			       launcher_get_screen (launcher), &error);
+	desc = launcher_get_launch_descriptor (launcher);
+	if (desc)
+		panel_launch_descriptor_launch (desc, file_list,
+						launcher_get_screen (launcher),
+						gtk_get_current_event_time (),
+						&error);
 
 	g_list_free (file_list);
 	g_strfreev (uris);
@@ -261,6 +298,9 @@ free_launcher (gpointer data)
 		g_key_file_free (launcher->key_file);
 	launcher->key_file = NULL;
 
+	panel_launch_descriptor_free (launcher->launch_desc);
+	launcher->launch_desc = NULL;
+
 	if (launcher->location != NULL)
 		g_free (launcher->location);
 	launcher->location = NULL;
@@ -482,6 +522,8 @@ create_launcher (const char *location)
 	launcher->prop_dialog = NULL;
 	launcher->destroy_handler = 0;
 
+	launcher_invalidate_launch (launcher);
+
 	/* Icon will be setup later */
 	launcher->button = button_widget_new (NULL /* icon */,
 					      FALSE,
@@ -613,6 +655,8 @@ launcher_changed (PanelDItemEditor *dialog,
 {
 	/* Setup the button look */
 	setup_button (launcher);
+
+	launcher_invalidate_launch (launcher);
 }
 
 static void
@@ -637,6 +681,8 @@ launcher_command_changed (PanelDItemEditor *dialog,
 		g_free (exec);
 		g_free (old_exec);
 	}
+
+	launcher_invalidate_launch (launcher);
 }
 
 static char *
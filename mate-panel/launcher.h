@@ -11,6 +11,8 @@
 #ifndef LAUNCHER_H
 #define LAUNCHER_H
 
+#include <libpanel-util/panel-launch.h>
+
 #include "applet.h"
 #include "panel-widget.h"
 
@@ -25,6 +27,11 @@ typedef struct {
 	char              *location;
 	GKeyFile          *key_file;
 
+	/* Prepared from key_file, rebuilt when it or PATH changes */
+	gboolean               is_link;
+	PanelLaunchDescriptor *launch_desc;
+	guint                  launch_desc_serial;
+
 	GtkWidget         *prop_dialog;
 	GSList            *error_dialogs;
 
@@ -62,7 +62,8 @@ static const AppletPropertyInfo applet_properties [] = {
 	{ "background",  "Background" },
 	{ "flags",       "Flags" },
 	{ "locked",      "Locked" },
-	{ "locked-down", "LockedDown" }
+	{ "locked-down", "LockedDown" },
+	{ "panel-hidden", "PanelHidden" }
 };
 
 #define MATE_PANEL_APPLET_CONTAINER_GET_PRIVATE(o) \
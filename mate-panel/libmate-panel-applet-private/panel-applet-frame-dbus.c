@@ -29,6 +29,8 @@
 
 #include <string.h>
 
+#include <libpanel-util/panel-stats.h>
+
 #include <panel-applet-frame.h>
 #include <panel-applets-manager.h>
 
@@ -145,6 +147,8 @@ mate_panel_applet_frame_dbus_init_properties (MatePanelAppletFrame *frame)
 {
 	MatePanelAppletFrameDBus *dbus_frame = MATE_PANEL_APPLET_FRAME_DBUS (frame);
 
+	PANEL_STATS_COUNT_N ("applet-property-get", 2);
+
 	mate_panel_applet_container_child_get (dbus_frame->priv->container, "flags", NULL,
 					  (GAsyncReadyCallback) mate_panel_applet_frame_dbus_get_flags_cb,
 					  frame);
@@ -163,6 +167,8 @@ mate_panel_applet_frame_dbus_sync_menu_state (MatePanelAppletFrame *frame,
 {
 	MatePanelAppletFrameDBus *dbus_frame = MATE_PANEL_APPLET_FRAME_DBUS (frame);
 
+	PANEL_STATS_COUNT_N ("applet-property-set", 2);
+
 	mate_panel_applet_container_child_set (dbus_frame->priv->container,
 					  "locked", g_variant_new_boolean (lockable && locked),
 					  NULL, NULL, NULL);
@@ -206,6 +212,8 @@ mate_panel_applet_frame_dbus_change_orientation (MatePanelAppletFrame *frame,
 {
 	MatePanelAppletFrameDBus *dbus_frame = MATE_PANEL_APPLET_FRAME_DBUS (frame);
 
+	PANEL_STATS_COUNT ("applet-property-set");
+
 	mate_panel_applet_container_child_set (dbus_frame->priv->container,
 					  "orient",
 					  g_variant_new_uint32 (get_mate_panel_applet_orient (orientation)),
@@ -220,11 +228,26 @@ mate_panel_applet_frame_dbus_change_size (MatePanelAppletFrame *frame,
 {
 	MatePanelAppletFrameDBus *dbus_frame = MATE_PANEL_APPLET_FRAME_DBUS (frame);
 
+	PANEL_STATS_COUNT ("applet-property-set");
+
 	mate_panel_applet_container_child_set (dbus_frame->priv->container,
 					  "size", g_variant_new_uint32 (size),
 					  NULL, NULL, NULL);
 }
 
+static void
+mate_panel_applet_frame_dbus_change_panel_hidden (MatePanelAppletFrame *frame,
+					     gboolean          hidden)
+{
+	MatePanelAppletFrameDBus *dbus_frame = MATE_PANEL_APPLET_FRAME_DBUS (frame);
+
+	PANEL_STATS_COUNT ("applet-property-set");
+
+	mate_panel_applet_container_child_set (dbus_frame->priv->container,
+					  "panel-hidden", g_variant_new_boolean (hidden),
+					  NULL, NULL, NULL);
+}
+
 static void
 container_child_background_set (GObject      *source_object,
 				GAsyncResult *res,
@@ -256,6 +279,9 @@ mate_panel_applet_frame_dbus_change_background (MatePanelAppletFrame    *frame,
 			g_cancellable_cancel (dbus_frame->priv->bg_cancellable);
 		dbus_frame->priv->bg_cancellable = g_cancellable_new ();
 
+		PANEL_STATS_COUNT ("applet-property-set");
+		PANEL_STATS_RECORD ("applet-background-string-length", strlen (bg_str));
+
 		mate_panel_applet_container_child_set (dbus_frame->priv->container,
 						  "background",
 						  g_variant_new_string (bg_str),
@@ -272,6 +298,8 @@ mate_panel_applet_frame_dbus_flags_changed (MatePanelAppletContainer *container,
 				       GVariant             *value,
 				       MatePanelAppletFrame     *frame)
 {
+	PANEL_STATS_COUNT ("applet-property-changed");
+
 	mate_panel_applet_frame_dbus_update_flags (frame, value);
 }
 
@@ -285,6 +313,8 @@ mate_panel_applet_frame_dbus_size_hints_changed (MatePanelAppletContainer *conta
 	gint       *size_hints = NULL;
 	gsize       n_elements;
 
+	PANEL_STATS_COUNT ("applet-property-changed");
+
 	sz = g_variant_get_fixed_array (value, &n_elements, sizeof (gint32));
 	if (n_elements > 0) {
 		size_hints = g_new (gint32, n_elements);
@@ -384,6 +414,7 @@ mate_panel_applet_frame_dbus_class_init (MatePanelAppletFrameDBusClass *class)
 	frame_class->change_orientation = mate_panel_applet_frame_dbus_change_orientation;
 	frame_class->change_size = mate_panel_applet_frame_dbus_change_size;
 	frame_class->change_background = mate_panel_applet_frame_dbus_change_background;
+	frame_class->change_panel_hidden = mate_panel_applet_frame_dbus_change_panel_hidden;
 
 #if GTK_CHECK_VERSION (3, 20, 0)
 	GtkWidgetClass *widget_class  = GTK_WIDGET_CLASS (class);
@@ -455,6 +486,9 @@ mate_panel_applet_frame_dbus_load (const gchar                 *iid,
 	g_variant_builder_add (&builder, "{sv}",
 			       "locked-down",
 			       g_variant_new_boolean (mate_panel_applet_frame_activating_get_locked_down (frame_act)));
+	g_variant_builder_add (&builder, "{sv}",
+			       "panel-hidden",
+			       g_variant_new_boolean (mate_panel_applet_frame_activating_get_panel_hidden (frame_act)));
 	if (background) {
 		g_variant_builder_add (&builder, "{sv}",
 				       "background",
@@ -22,7 +22,10 @@
 
 #include <config.h>
 
+#include <errno.h>
+
 #include <gio/gio.h>
+#include <glib/gstdio.h>
 #include <gmodule.h>
 #include <string.h>
 
@@ -42,6 +45,9 @@ G_DEFINE_TYPE_WITH_CODE (MatePanelAppletsManagerDBus,
 struct _MatePanelAppletsManagerDBusPrivate
 {
 	GHashTable *applet_factories;
+	GHashTable *applets;
+	GList      *applet_list;
+	gboolean    applet_list_valid;
 	GList      *monitors;
 };
 
@@ -59,11 +65,22 @@ typedef struct _MatePanelAppletFactoryInfo {
 
 	GList              *applet_list;
 	gboolean            has_old_ids;
+
+	/* Applets read from the cache, turned into applet_list on demand */
+	GVariant           *cached_applets;
 } MatePanelAppletFactoryInfo;
 
 #define MATE_PANEL_APPLET_FACTORY_GROUP "Applet Factory"
 #define MATE_PANEL_APPLETS_EXTENSION    ".mate-panel-applet"
 
+/* The applets cache is a serialized GVariant: a format version, the
+ * language names the strings were translated for, the mtime of every
+ * applets directory, the mtime and size of every applet file and the
+ * parsed factories. Bump the version whenever the layout changes. */
+#define MATE_PANEL_APPLETS_CACHE_VERSION 1
+#define MATE_PANEL_APPLETS_CACHE_TYPE    "(usa(sx)a(sxx)a(smsbsba(smsmsmsas)))"
+#define MATE_PANEL_APPLETS_CACHE_APPLET  "(smsmsmsas)"
+
 static void
 mate_panel_applet_factory_info_free (MatePanelAppletFactoryInfo *info)
 {
@@ -78,10 +95,40 @@ mate_panel_applet_factory_info_free (MatePanelAppletFactoryInfo *info)
 	g_list_free (info->applet_list);
 	info->applet_list = NULL;
 	g_free (info->srcdir);
+	if (info->cached_applets)
+		g_variant_unref (info->cached_applets);
 
 	g_slice_free (MatePanelAppletFactoryInfo, info);
 }
 
+static void
+mate_panel_applet_factory_info_ensure_applets (MatePanelAppletFactoryInfo *info)
+{
+	GVariantIter  iter;
+	const gchar  *iid;
+	const gchar  *name;
+	const gchar  *comment;
+	const gchar  *icon;
+	const gchar **old_ids;
+
+	if (!info->cached_applets)
+		return;
+
+	g_variant_iter_init (&iter, info->cached_applets);
+	while (g_variant_iter_next (&iter, "(&sm&sm&sm&s^a&s)",
+				    &iid, &name, &comment, &icon, &old_ids)) {
+		MatePanelAppletInfo *ainfo;
+
+		ainfo = mate_panel_applet_info_new (iid, name, comment, icon, old_ids);
+		info->applet_list = g_list_prepend (info->applet_list, ainfo);
+		g_free (old_ids);
+	}
+	info->applet_list = g_list_reverse (info->applet_list);
+
+	g_variant_unref (info->cached_applets);
+	info->cached_applets = NULL;
+}
+
 static MatePanelAppletInfo *
 _mate_panel_applets_manager_get_applet_info (GKeyFile    *applet_file,
 					const gchar *group,
@@ -215,6 +262,96 @@ mate_panel_applets_manager_get_applets_dirs (void)
 	return g_slist_reverse (retval);
 }
 
+static gchar *
+mate_panel_applets_manager_get_cache_filename (void)
+{
+	return g_build_filename (g_get_user_cache_dir (),
+				 "mate-panel", "applets.cache", NULL);
+}
+
+static gchar *
+mate_panel_applets_manager_get_cache_languages (void)
+{
+	return g_strjoinv (":", (gchar **) g_get_language_names ());
+}
+
+static gint64
+mate_panel_applets_manager_get_mtime (const gchar *path,
+				      gint64      *size)
+{
+	GStatBuf buf;
+
+	if (g_stat (path, &buf) != 0) {
+		if (size)
+			*size = -1;
+		return -1;
+	}
+
+	if (size)
+		*size = (gint64) buf.st_size;
+
+	return (gint64) buf.st_mtime;
+}
+
+static void
+mate_panel_applets_manager_dbus_invalidate_applet_list (MatePanelAppletsManagerDBus *manager)
+{
+	g_list_free (manager->priv->applet_list);
+	manager->priv->applet_list = NULL;
+	manager->priv->applet_list_valid = FALSE;
+}
+
+static gboolean
+applet_belongs_to_factory (gpointer key,
+			   gpointer value,
+			   gpointer user_data)
+{
+	return value == user_data;
+}
+
+/* Takes ownership of info, replacing any factory with the same id */
+static void
+mate_panel_applets_manager_dbus_add_factory (MatePanelAppletsManagerDBus *manager,
+					     MatePanelAppletFactoryInfo  *info)
+{
+	MatePanelAppletFactoryInfo *old_info;
+
+	old_info = g_hash_table_lookup (manager->priv->applet_factories, info->id);
+	if (old_info)
+		g_hash_table_foreach_remove (manager->priv->applets,
+					     applet_belongs_to_factory,
+					     old_info);
+
+	g_hash_table_replace (manager->priv->applet_factories, g_strdup (info->id), info);
+
+	if (info->cached_applets) {
+		gsize n_applets, i;
+
+		n_applets = g_variant_n_children (info->cached_applets);
+		for (i = 0; i < n_applets; i++) {
+			GVariant    *applet;
+			const gchar *iid;
+
+			applet = g_variant_get_child_value (info->cached_applets, i);
+			g_variant_get_child (applet, 0, "&s", &iid);
+			g_hash_table_replace (manager->priv->applets, g_strdup (iid), info);
+			g_variant_unref (applet);
+		}
+	} else {
+		GList *l;
+
+		for (l = info->applet_list; l; l = g_list_next (l)) {
+			MatePanelAppletInfo *ainfo = (MatePanelAppletInfo *) l->data;
+
+			g_hash_table_replace (manager->priv->applets,
+					      g_strdup (mate_panel_applet_info_get_iid (ainfo)),
+					      info);
+		}
+	}
+
+	mate_panel_applets_manager_dbus_invalidate_applet_list (manager);
+}
+
 static void
 applets_directory_changed (GFileMonitor     *monitor,
 			   GFile            *file,
@@ -247,7 +384,7 @@ applets_directory_changed (GFileMonitor     *monitor,
 		old_info = g_hash_table_lookup (manager->priv->applet_factories, info->id);
 		if (!old_info) {
 			/* New applet, just insert it */
-			g_hash_table_insert (manager->priv->applet_factories, g_strdup (info->id), info);
+			mate_panel_applets_manager_dbus_add_factory (manager, info);
 			return;
 		}
 
@@ -255,7 +392,7 @@ applets_directory_changed (GFileMonitor     *monitor,
 		 * another source dir unless it takes precedence over the
 		 * current one */
 		if (g_strcmp0 (info->srcdir, old_info->srcdir) == 0) {
-			g_hash_table_replace (manager->priv->applet_factories, g_strdup (info->id), info);
+			mate_panel_applets_manager_dbus_add_factory (manager, info);
 			return;
 		}
 
@@ -268,7 +405,7 @@ applets_directory_changed (GFileMonitor     *monitor,
 				mate_panel_applet_factory_info_free (info);
 				break;
 			} else if (g_strcmp0 (path, info->srcdir) == 0) {
-				g_hash_table_replace (manager->priv->applet_factories, g_strdup (info->id), info);
+				mate_panel_applets_manager_dbus_add_factory (manager, info);
 				break;
 			}
 		}
@@ -284,29 +421,19 @@ applets_directory_changed (GFileMonitor     *monitor,
 }
 
 static void
-mate_panel_applets_manager_dbus_load_applet_infos (MatePanelAppletsManagerDBus *manager)
+mate_panel_applets_manager_dbus_monitor_dirs (MatePanelAppletsManagerDBus *manager,
+					      GSList                      *dirs)
 {
-	GSList      *dirs, *d;
-	GDir        *dir;
-	const gchar *dirent;
-	GError      *error = NULL;
+	GSList *d;
 
-	dirs = mate_panel_applets_manager_get_applets_dirs ();
 	for (d = dirs; d; d = g_slist_next (d)) {
 		GFileMonitor *monitor;
 		GFile        *dir_file;
 		gchar        *path = (gchar *) d->data;
 
-		dir = g_dir_open (path, 0, &error);
-		if (!dir) {
-			g_warning ("%s", error->message);
-			g_error_free (error);
-			g_free (path);
-
+		if (!g_file_test (path, G_FILE_TEST_IS_DIR))
 			continue;
-		}
 
-		/* Monitor dir */
 		dir_file = g_file_new_for_path (path);
 		monitor = g_file_monitor_directory (dir_file,
 						    G_FILE_MONITOR_NONE,
@@ -318,15 +445,285 @@ mate_panel_applets_manager_dbus_load_applet_infos (MatePanelAppletsManagerDBus *
 			manager->priv->monitors = g_list_prepend (manager->priv->monitors, monitor);
 		}
 		g_object_unref (dir_file);
+	}
+}
+
+static gboolean
+mate_panel_applets_manager_dbus_cache_is_valid (GVariant *cache,
+						GSList   *dirs)
+{
+	GVariant     *dir_stamps;
+	GVariant     *file_stamps;
+	GVariantIter  iter;
+	const gchar  *path;
+	const gchar  *languages;
+	gchar        *current_languages;
+	gint64        mtime;
+	gint64        size;
+	guint32       version;
+	GSList       *d;
+	gboolean      retval = FALSE;
+
+	g_variant_get_child (cache, 0, "u", &version);
+	if (version != MATE_PANEL_APPLETS_CACHE_VERSION)
+		return FALSE;
+
+	/* Names and descriptions are stored already translated */
+	g_variant_get_child (cache, 1, "&s", &languages);
+	current_languages = mate_panel_applets_manager_get_cache_languages ();
+	if (g_strcmp0 (languages, current_languages) != 0) {
+		g_free (current_languages);
+		return FALSE;
+	}
+	g_free (current_languages);
+
+	/* Adding or removing an applet file bumps the directory mtime */
+	dir_stamps = g_variant_get_child_value (cache, 2);
+	if (g_variant_n_children (dir_stamps) != g_slist_length (dirs))
+		goto out;
+
+	d = dirs;
+	g_variant_iter_init (&iter, dir_stamps);
+	while (g_variant_iter_next (&iter, "(&sx)", &path, &mtime)) {
+		if (g_strcmp0 (path, d->data) != 0 ||
+		    mate_panel_applets_manager_get_mtime (path, NULL) != mtime)
+			goto out;
+		d = g_slist_next (d);
+	}
+
+	/* Editing an applet file in place does not */
+	file_stamps = g_variant_get_child_value (cache, 3);
+	g_variant_iter_init (&iter, file_stamps);
+	while (g_variant_iter_next (&iter, "(&sxx)", &path, &mtime, &size)) {
+		gint64 current_size;
+
+		if (mate_panel_applets_manager_get_mtime (path, &current_size) != mtime ||
+		    current_size != size) {
+			g_variant_unref (file_stamps);
+			goto out;
+		}
+	}
+	g_variant_unref (file_stamps);
+
+	retval = TRUE;
+
+out:
+	g_variant_unref (dir_stamps);
+
+	return retval;
+}
+
+static gboolean
+mate_panel_applets_manager_dbus_load_cache (MatePanelAppletsManagerDBus *manager,
+					    GSList                      *dirs)
+{
+	GMappedFile  *mapped;
+	GBytes       *bytes;
+	GVariant     *cache;
+	GVariant     *factories;
+	GVariantIter  iter;
+	GVariant     *child;
+	gchar        *filename;
+
+	filename = mate_panel_applets_manager_get_cache_filename ();
+	mapped = g_mapped_file_new (filename, FALSE, NULL);
+	g_free (filename);
+
+	if (!mapped)
+		return FALSE;
+
+	bytes = g_mapped_file_get_bytes (mapped);
+	g_mapped_file_unref (mapped);
+
+	/* Not trusted: a truncated or corrupt file reads as empty values */
+	cache = g_variant_new_from_bytes (G_VARIANT_TYPE (MATE_PANEL_APPLETS_CACHE_TYPE),
+					  bytes, FALSE);
+	g_variant_ref_sink (cache);
+	g_bytes_unref (bytes);
+
+	if (!mate_panel_applets_manager_dbus_cache_is_valid (cache, dirs)) {
+		g_variant_unref (cache);
+		return FALSE;
+	}
+
+	factories = g_variant_get_child_value (cache, 4);
+	g_variant_iter_init (&iter, factories);
+	while ((child = g_variant_iter_next_value (&iter))) {
+		MatePanelAppletFactoryInfo *info;
+		const gchar                *id;
+		const gchar                *location;
+		const gchar                *srcdir;
+		gboolean                    in_process;
+		gboolean                    has_old_ids;
+		GVariant                   *applets;
+
+		g_variant_get (child, "(&sm&sb&sb@a" MATE_PANEL_APPLETS_CACHE_APPLET ")",
+			       &id, &location, &in_process, &srcdir, &has_old_ids, &applets);
+
+		if (g_variant_n_children (applets) == 0 ||
+		    g_hash_table_lookup (manager->priv->applet_factories, id)) {
+			g_variant_unref (applets);
+			g_variant_unref (child);
+			continue;
+		}
+
+		info = g_slice_new0 (MatePanelAppletFactoryInfo);
+		info->id = g_strdup (id);
+		info->location = g_strdup (location);
+		info->in_process = in_process;
+		info->srcdir = g_strdup (srcdir);
+		info->has_old_ids = has_old_ids;
+		info->cached_applets = applets;
+
+		mate_panel_applets_manager_dbus_add_factory (manager, info);
+
+		g_variant_unref (child);
+	}
+
+	g_variant_unref (factories);
+	g_variant_unref (cache);
+
+	return TRUE;
+}
+
+static void
+mate_panel_applets_manager_dbus_save_cache (MatePanelAppletsManagerDBus *manager,
+					    GVariantBuilder             *dir_stamps,
+					    GVariantBuilder             *file_stamps)
+{
+	static const gchar * const no_old_ids[] = { NULL };
+
+	GVariantBuilder  factories;
+	GHashTableIter   iter;
+	gpointer         value;
+	GVariant        *cache;
+	gchar           *languages;
+	gchar           *filename;
+	gchar           *dirname;
+	GError          *error = NULL;
+
+	g_variant_builder_init (&factories, G_VARIANT_TYPE ("a(smsbsba" MATE_PANEL_APPLETS_CACHE_APPLET ")"));
+
+	g_hash_table_iter_init (&iter, manager->priv->applet_factories);
+	while (g_hash_table_iter_next (&iter, NULL, &value)) {
+		MatePanelAppletFactoryInfo *info = (MatePanelAppletFactoryInfo *) value;
+		GVariantBuilder             applets;
+		GList                      *l;
+
+		g_variant_builder_init (&applets, G_VARIANT_TYPE ("a" MATE_PANEL_APPLETS_CACHE_APPLET));
+		for (l = info->applet_list; l; l = g_list_next (l)) {
+			MatePanelAppletInfo *ainfo = (MatePanelAppletInfo *) l->data;
+			const gchar * const *old_ids;
+
+			old_ids = mate_panel_applet_info_get_old_ids (ainfo);
+			g_variant_builder_add (&applets, "(smsmsms^as)",
+					       mate_panel_applet_info_get_iid (ainfo),
+					       mate_panel_applet_info_get_name (ainfo),
+					       mate_panel_applet_info_get_description (ainfo),
+					       mate_panel_applet_info_get_icon (ainfo),
+					       old_ids ? old_ids : no_old_ids);
+		}
+
+		g_variant_builder_add (&factories, "(smsbsb@a" MATE_PANEL_APPLETS_CACHE_APPLET ")",
+				       info->id,
+				       info->location,
+				       info->in_process,
+				       info->srcdir,
+				       info->has_old_ids,
+				       g_variant_builder_end (&applets));
+	}
+
+	languages = mate_panel_applets_manager_get_cache_languages ();
+	cache = g_variant_new ("(usa(sx)a(sxx)@a(smsbsba" MATE_PANEL_APPLETS_CACHE_APPLET "))",
+			       MATE_PANEL_APPLETS_CACHE_VERSION,
+			       languages,
+			       dir_stamps,
+			       file_stamps,
+			       g_variant_builder_end (&factories));
+	g_variant_ref_sink (cache);
+	g_free (languages);
+
+	filename = mate_panel_applets_manager_get_cache_filename ();
+	dirname = g_path_get_dirname (filename);
+
+	if (g_mkdir_with_parents (dirname, 0700) != 0 ||
+	    !g_file_set_contents (filename,
+				  g_variant_get_data (cache),
+				  g_variant_get_size (cache),
+				  &error)) {
+		g_warning ("Cannot save the applets cache to %s: %s",
+			   filename, error ? error->message : g_strerror (errno));
+		g_clear_error (&error);
+	}
+
+	g_free (dirname);
+	g_free (filename);
+	g_variant_unref (cache);
+}
+
+static void
+mate_panel_applets_manager_dbus_load_applet_infos (MatePanelAppletsManagerDBus *manager)
+{
+	GSList          *dirs, *d;
+	GDir            *dir;
+	const gchar     *dirent;
+	GVariantBuilder  dir_stamps;
+	GVariantBuilder  file_stamps;
+	gint64           now;
+	gboolean         cacheable = TRUE;
+	GError          *error = NULL;
+
+	dirs = mate_panel_applets_manager_get_applets_dirs ();
+
+	mate_panel_applets_manager_dbus_monitor_dirs (manager, dirs);
+
+	if (mate_panel_applets_manager_dbus_load_cache (manager, dirs)) {
+		g_slist_foreach (dirs, (GFunc) g_free, NULL);
+		g_slist_free (dirs);
+		return;
+	}
+
+	/* A file modified within the current second could change again
+	 * without its mtime moving, so don't cache in that case */
+	now = g_get_real_time () / G_USEC_PER_SEC;
+
+	g_variant_builder_init (&dir_stamps, G_VARIANT_TYPE ("a(sx)"));
+	g_variant_builder_init (&file_stamps, G_VARIANT_TYPE ("a(sxx)"));
+
+	for (d = dirs; d; d = g_slist_next (d)) {
+		gchar  *path = (gchar *) d->data;
+		gint64  mtime;
+
+		mtime = mate_panel_applets_manager_get_mtime (path, NULL);
+		if (mtime >= now)
+			cacheable = FALSE;
+		g_variant_builder_add (&dir_stamps, "(sx)", path, mtime);
+
+		dir = g_dir_open (path, 0, &error);
+		if (!dir) {
+			g_warning ("%s", error->message);
+			g_error_free (error);
+			error = NULL;
+			g_free (path);
+
+			continue;
+		}
 
 		while ((dirent = g_dir_read_name (dir))) {
 			MatePanelAppletFactoryInfo *info;
 			gchar                  *file;
+			gint64                  size;
 
 			if (!g_str_has_suffix (dirent, MATE_PANEL_APPLETS_EXTENSION))
 				continue;
 
 			file = g_build_filename (path, dirent, NULL);
+
+			mtime = mate_panel_applets_manager_get_mtime (file, &size);
+			if (mtime >= now)
+				cacheable = FALSE;
+			g_variant_builder_add (&file_stamps, "(sxx)", file, mtime, size);
+
 			info = mate_panel_applets_manager_get_applet_factory_info_from_file (file);
 			g_free (file);
 
@@ -338,7 +735,7 @@ mate_panel_applets_manager_dbus_load_applet_infos (MatePanelAppletsManagerDBus *
 				continue;
 			}
 
-			g_hash_table_insert (manager->priv->applet_factories, g_strdup (info->id), info);
+			mate_panel_applets_manager_dbus_add_factory (manager, info);
 		}
 
 		g_dir_close (dir);
@@ -346,26 +743,40 @@ mate_panel_applets_manager_dbus_load_applet_infos (MatePanelAppletsManagerDBus *
 	}
 
 	g_slist_free (dirs);
+
+	if (cacheable)
+		mate_panel_applets_manager_dbus_save_cache (manager, &dir_stamps, &file_stamps);
+	else {
+		g_variant_builder_clear (&dir_stamps);
+		g_variant_builder_clear (&file_stamps);
+	}
 }
 
-static GList *
+static const GList *
 mate_panel_applets_manager_dbus_get_applets (MatePanelAppletsManager *manager)
 {
 	MatePanelAppletsManagerDBus *dbus_manager = MATE_PANEL_APPLETS_MANAGER_DBUS (manager);
 
 	GHashTableIter iter;
 	gpointer       key, value;
-	GList         *retval = NULL;
 
-	g_hash_table_iter_init (&iter, dbus_manager->priv->applet_factories);
-	while (g_hash_table_iter_next (&iter, &key, &value)) {
-		MatePanelAppletFactoryInfo *info;
+	if (!dbus_manager->priv->applet_list_valid) {
+		GList *retval = NULL;
 
-		info = (MatePanelAppletFactoryInfo *) value;
-		retval = g_list_concat (retval, g_list_copy (info->applet_list));
+		g_hash_table_iter_init (&iter, dbus_manager->priv->applet_factories);
+		while (g_hash_table_iter_next (&iter, &key, &value)) {
+			MatePanelAppletFactoryInfo *info;
+
+			info = (MatePanelAppletFactoryInfo *) value;
+			mate_panel_applet_factory_info_ensure_applets (info);
+			retval = g_list_concat (retval, g_list_copy (info->applet_list));
+		}
+
+		dbus_manager->priv->applet_list = retval;
+		dbus_manager->priv->applet_list_valid = TRUE;
 	}
 
-	return retval;
+	return dbus_manager->priv->applet_list;
 }
 
 static MatePanelAppletFactoryInfo *
@@ -378,6 +789,10 @@ get_applet_factory_info (MatePanelAppletsManager *manager,
 	const gchar            *sp;
 	gchar                  *factory_id;
 
+	info = g_hash_table_lookup (dbus_manager->priv->applets, iid);
+	if (info)
+		return info;
+
 	sp = g_strrstr (iid, "::");
 	if (!sp)
 		return NULL;
@@ -491,6 +906,8 @@ mate_panel_applets_manager_dbus_get_applet_info (MatePanelAppletsManager *manage
 	if (!info)
 		return NULL;
 
+	mate_panel_applet_factory_info_ensure_applets (info);
+
 	for (l = info->applet_list; l; l = g_list_next (l)) {
 		MatePanelAppletInfo *ainfo = (MatePanelAppletInfo *) l->data;
 
@@ -519,6 +936,8 @@ mate_panel_applets_manager_dbus_get_applet_info_from_old_id (MatePanelAppletsMan
 		if (!info->has_old_ids)
 			continue;
 
+		mate_panel_applet_factory_info_ensure_applets (info);
+
 		for (l = info->applet_list; l; l = g_list_next (l)) {
 			MatePanelAppletInfo *ainfo;
 			gint             i = 0;
@@ -561,6 +980,13 @@ mate_panel_applets_manager_dbus_finalize (GObject *object)
 		manager->priv->monitors = NULL;
 	}
 
+	mate_panel_applets_manager_dbus_invalidate_applet_list (manager);
+
+	if (manager->priv->applets) {
+		g_hash_table_destroy (manager->priv->applets);
+		manager->priv->applets = NULL;
+	}
+
 	if (manager->priv->applet_factories) {
 		g_hash_table_destroy (manager->priv->applet_factories);
 		manager->priv->applet_factories = NULL;
@@ -580,6 +1006,10 @@ mate_panel_applets_manager_dbus_init (MatePanelAppletsManagerDBus *manager)
 								 g_str_equal,
 								 (GDestroyNotify) g_free,
 								 (GDestroyNotify) mate_panel_applet_factory_info_free);
+	manager->priv->applets = g_hash_table_new_full (g_str_hash,
+							g_str_equal,
+							(GDestroyNotify) g_free,
+							NULL);
 
 	mate_panel_applets_manager_dbus_load_applet_infos (manager);
 }
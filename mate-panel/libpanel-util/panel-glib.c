@@ -162,3 +162,37 @@ panel_g_utf8_strstrcase (const char *haystack, const char *needle)
 
 	return NULL;
 }
+
+/* Returns a normalized and casefolded copy of str. Two keys made with this
+ * function can be compared byte by byte with panel_g_utf8_search_key_match(),
+ * which is a lot cheaper than panel_g_utf8_strstrcase() when the same
+ * haystack is searched many times. */
+char *
+panel_g_utf8_search_key_new (const char *str)
+{
+	char *normalized;
+	char *key;
+
+	if (str == NULL)
+		return NULL;
+
+	normalized = g_utf8_normalize (str, -1, G_NORMALIZE_ALL);
+	/* NULL means there was illegal utf-8 sequence */
+	if (normalized == NULL)
+		return NULL;
+
+	key = g_utf8_casefold (normalized, -1);
+	g_free (normalized);
+
+	return key;
+}
+
+gboolean
+panel_g_utf8_search_key_match (const char *key,
+			       const char *needle_key)
+{
+	if (key == NULL || needle_key == NULL)
+		return FALSE;
+
+	return strstr (key, needle_key) != NULL;
+}
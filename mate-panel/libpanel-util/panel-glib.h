@@ -39,6 +39,10 @@ char       *panel_g_lookup_in_applications_dirs (const char *basename);
 const char *panel_g_utf8_strstrcase             (const char *haystack,
 						 const char *needle);
 
+char       *panel_g_utf8_search_key_new         (const char *str);
+gboolean    panel_g_utf8_search_key_match       (const char *key,
+						 const char *needle_key);
+
 #ifdef __cplusplus
 }
 #endif
@@ -22,6 +22,8 @@
  *	Vincent Untz <vuntz@gnome.org>
  */
 
+#include <glib/gstdio.h>
+#include <gio/gio.h>
 #include <gtk/gtk.h>
 
 #include "panel-gtk.h"
@@ -32,31 +34,251 @@
  * Copyright (C) 2005 Vincent Untz <vuntz@gnome.org>
  */
 
+#define PANEL_GTK_PREVIEW_SIZE       128
+#define PANEL_GTK_PREVIEW_CHUNK_SIZE (64 * 1024)
+#define PANEL_GTK_PREVIEW_KEY        "panel-gtk-file-chooser-preview"
+
+typedef struct {
+	char   *uri;
+	char   *filename;
+	int     size;
+} PanelGtkPreviewLoad;
+
+static void
+panel_gtk_preview_load_free (PanelGtkPreviewLoad *load)
+{
+	g_free (load->uri);
+	g_free (load->filename);
+	g_slice_free (PanelGtkPreviewLoad, load);
+}
+
+/* Runs in the loading thread. Returns the thumbnail of the freedesktop.org
+ * thumbnail cache for the file, if there is one and it is up to date. */
+static GdkPixbuf *
+panel_gtk_preview_load_thumbnail (PanelGtkPreviewLoad *load,
+				  const char          *flavor)
+{
+	GdkPixbuf  *pixbuf;
+	GStatBuf    buf;
+	const char *thumb_uri;
+	const char *thumb_mtime;
+	char       *md5;
+	char       *basename;
+	char       *path;
+
+	md5 = g_compute_checksum_for_string (G_CHECKSUM_MD5, load->uri, -1);
+	basename = g_strconcat (md5, ".png", NULL);
+	path = g_build_filename (g_get_user_cache_dir (), "thumbnails",
+				 flavor, basename, NULL);
+	g_free (basename);
+	g_free (md5);
+
+	pixbuf = gdk_pixbuf_new_from_file (path, NULL);
+	g_free (path);
+
+	if (!pixbuf)
+		return NULL;
+
+	thumb_uri   = gdk_pixbuf_get_option (pixbuf, "tEXt::Thumb::URI");
+	thumb_mtime = gdk_pixbuf_get_option (pixbuf, "tEXt::Thumb::MTime");
+
+	if (g_strcmp0 (thumb_uri, load->uri) != 0 || !thumb_mtime ||
+	    g_stat (load->filename, &buf) != 0 ||
+	    g_ascii_strtoll (thumb_mtime, NULL, 10) != (gint64) buf.st_mtime) {
+		g_object_unref (pixbuf);
+		return NULL;
+	}
+
+	return pixbuf;
+}
+
+/* Runs in the loading thread */
+static void
+panel_gtk_preview_size_prepared (GdkPixbufLoader     *loader,
+				 int                  width,
+				 int                  height,
+				 PanelGtkPreviewLoad *load)
+{
+	/* Fit in the preview, keeping the aspect ratio */
+	if (width <= 0 || height <= 0)
+		return;
+
+	if (width > height) {
+		height = MAX (1, height * load->size / width);
+		width  = load->size;
+	} else {
+		width  = MAX (1, width * load->size / height);
+		height = load->size;
+	}
+
+	gdk_pixbuf_loader_set_size (loader, width, height);
+}
+
+/* Runs in the loading thread */
+static GdkPixbuf *
+panel_gtk_preview_load_file (PanelGtkPreviewLoad  *load,
+			     GCancellable         *cancellable,
+			     GError              **error)
+{
+	GdkPixbufLoader *loader;
+	GdkPixbuf       *pixbuf = NULL;
+	GInputStream    *stream;
+	GFile           *file;
+	guchar          *buffer;
+	gssize           n_read;
+	gboolean         loaded = TRUE;
+
+	file = g_file_new_for_path (load->filename);
+	stream = G_INPUT_STREAM (g_file_read (file, cancellable, error));
+	g_object_unref (file);
+
+	if (!stream)
+		return NULL;
+
+	loader = gdk_pixbuf_loader_new ();
+	g_signal_connect (loader, "size-prepared",
+			  G_CALLBACK (panel_gtk_preview_size_prepared), load);
+
+	buffer = g_malloc (PANEL_GTK_PREVIEW_CHUNK_SIZE);
+
+	/* Reading fails as soon as the preview is for another file */
+	while (loaded) {
+		n_read = g_input_stream_read (stream, buffer,
+					      PANEL_GTK_PREVIEW_CHUNK_SIZE,
+					      cancellable, error);
+		if (n_read <= 0) {
+			loaded = n_read == 0;
+			break;
+		}
+
+		loaded = gdk_pixbuf_loader_write (loader, buffer, n_read, error);
+	}
+
+	g_free (buffer);
+	g_object_unref (stream);
+
+	if (!gdk_pixbuf_loader_close (loader, loaded ? error : NULL))
+		loaded = FALSE;
+
+	if (loaded) {
+		pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+		if (pixbuf)
+			g_object_ref (pixbuf);
+	}
+
+	g_object_unref (loader);
+
+	return pixbuf;
+}
+
+/* Runs in the loading thread */
+static void
+panel_gtk_preview_load_thread (GTask        *task,
+			       gpointer      source_object,
+			       gpointer      task_data,
+			       GCancellable *cancellable)
+{
+	PanelGtkPreviewLoad *load = task_data;
+	GdkPixbuf           *pixbuf;
+	GError              *error = NULL;
+
+	pixbuf = panel_gtk_preview_load_thumbnail (load, "normal");
+
+	if (!pixbuf)
+		pixbuf = panel_gtk_preview_load_file (load, cancellable, &error);
+
+	if (pixbuf)
+		g_task_return_pointer (task, pixbuf, g_object_unref);
+	else if (error)
+		g_task_return_error (task, error);
+	else
+		g_task_return_new_error (task, GDK_PIXBUF_ERROR,
+					 GDK_PIXBUF_ERROR_CORRUPT_IMAGE,
+					 "No image could be decoded");
+}
+
+static void
+panel_gtk_preview_loaded (GObject      *source,
+			  GAsyncResult *result,
+			  gpointer      data)
+{
+	GtkFileChooser *chooser = GTK_FILE_CHOOSER (source);
+	GtkWidget      *preview;
+	GdkPixbuf      *pixbuf;
+	GError         *error = NULL;
+
+	/* A cancelled load returns an error even if it got to the end */
+	pixbuf = g_task_propagate_pointer (G_TASK (result), &error);
+
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+		g_error_free (error);
+		return;
+	}
+	g_clear_error (&error);
+
+	preview = gtk_file_chooser_get_preview_widget (chooser);
+	if (GTK_IS_IMAGE (preview))
+		gtk_image_set_from_pixbuf (GTK_IMAGE (preview), pixbuf);
+
+	gtk_file_chooser_set_preview_widget_active (chooser, pixbuf != NULL);
+
+	if (pixbuf)
+		g_object_unref (pixbuf);
+}
+
+static void
+panel_gtk_file_chooser_preview_cancel (GtkFileChooser *chooser)
+{
+	g_object_set_data (G_OBJECT (chooser), PANEL_GTK_PREVIEW_KEY, NULL);
+}
+
+static void
+panel_gtk_preview_cancellable_free (GCancellable *cancellable)
+{
+	g_cancellable_cancel (cancellable);
+	g_object_unref (cancellable);
+}
+
 static void
 panel_gtk_file_chooser_preview_update (GtkFileChooser *chooser,
 				       gpointer data)
 {
-	GtkWidget *preview;
-	char      *filename;
-	GdkPixbuf *pixbuf;
-	gboolean   have_preview;
+	PanelGtkPreviewLoad *load;
+	GCancellable        *cancellable;
+	GTask               *task;
+	char                *filename;
 
-	preview = GTK_WIDGET (data);
 	filename = gtk_file_chooser_get_preview_filename (chooser);
 
-	if (filename == NULL)
+	/* Nothing to preview anymore, for instance a folder got selected:
+	 * the load of the previous selection must not show up late */
+	if (filename == NULL) {
+		panel_gtk_file_chooser_preview_cancel (chooser);
+		gtk_file_chooser_set_preview_widget_active (chooser, FALSE);
 		return;
+	}
 
-	pixbuf = gdk_pixbuf_new_from_file_at_size (filename, 128, 128, NULL);
-	have_preview = (pixbuf != NULL);
-	g_free (filename);
+	/* Replacing the cancellable cancels the load of the previous
+	 * selection */
+	cancellable = g_cancellable_new ();
+	g_object_set_data_full (G_OBJECT (chooser), PANEL_GTK_PREVIEW_KEY,
+				cancellable,
+				(GDestroyNotify) panel_gtk_preview_cancellable_free);
 
-	gtk_image_set_from_pixbuf (GTK_IMAGE (preview), pixbuf);
-	if (pixbuf)
-		g_object_unref (pixbuf);
+	load = g_slice_new0 (PanelGtkPreviewLoad);
+	load->filename = filename;
+	load->uri      = g_filename_to_uri (filename, NULL, NULL);
+	load->size     = PANEL_GTK_PREVIEW_SIZE;
+
+	if (!load->uri)
+		load->uri = g_strdup ("");
 
-	gtk_file_chooser_set_preview_widget_active (chooser,
-						    have_preview);
+	task = g_task_new (chooser, cancellable,
+			   panel_gtk_preview_loaded, NULL);
+	g_task_set_task_data (task, load,
+			      (GDestroyNotify) panel_gtk_preview_load_free);
+	g_task_run_in_thread (task, panel_gtk_preview_load_thread);
+	g_object_unref (task);
 }
 
 void
@@ -76,6 +298,9 @@ panel_gtk_file_chooser_add_image_preview (GtkFileChooser *chooser)
 	g_signal_connect (chooser, "update-preview",
 			  G_CALLBACK (panel_gtk_file_chooser_preview_update),
 			  chooser_preview);
+	g_signal_connect (chooser, "destroy",
+			  G_CALLBACK (panel_gtk_file_chooser_preview_cancel),
+			  NULL);
 }
 
 /*
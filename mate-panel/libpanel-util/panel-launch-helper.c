@@ -0,0 +1,624 @@
+/*
+ * panel-launch-helper.c: spawn processes from a small pre-forked helper
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Forking the panel once it has loaded its backgrounds, icons and applets
+ * means copying a lot of page tables for every launcher click. Instead, the
+ * panel forks a helper as soon as it knows it is going to run, before it
+ * loads anything, and sends it the argv, environment and working directory
+ * of each process to launch over a socketpair. The helper forks and execs
+ * them, reaps them, and replies with the pid or the errno of the failure.
+ * The panel reads the replies from its main loop, in the order of the
+ * requests.
+ *
+ * A request is a guint32 payload size followed by the payload: guint32 argc,
+ * guint32 envc, then the working directory ("" for none), the argc argv
+ * strings and the envc environment strings, all NUL-terminated. The reply is
+ * a gint32 pid and a gint32 errno.
+ */
+
+#include <config.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <glib/gi18n.h>
+#include <glib-unix.h>
+#include <gio/gio.h>
+
+#include "panel-launch-helper.h"
+
+#define PANEL_LAUNCH_HELPER_MAX_REQUEST (1024 * 1024)
+#define PANEL_LAUNCH_HELPER_TIMEOUT     5
+
+typedef struct {
+	gint32 pid;
+	gint32 errnum;
+} PanelLaunchHelperReply;
+
+typedef struct {
+	PanelLaunchHelperCallback callback;
+	gpointer                  user_data;
+} PanelLaunchHelperRequest;
+
+static int    helper_fd         = -1;
+static GPid   helper_pid        = 0;
+static guint  helper_watch_id   = 0;
+static guint  helper_timeout_id = 0;
+static GQueue helper_requests   = G_QUEUE_INIT;
+
+static PanelLaunchHelperReply helper_reply;
+static gsize                  helper_reply_len = 0;
+
+static gboolean
+panel_launch_helper_read_all (int    fd,
+			      void  *buf,
+			      gsize  len)
+{
+	char *p = buf;
+
+	while (len > 0) {
+		ssize_t n;
+
+		n = read (fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return FALSE;
+
+		p += n;
+		len -= n;
+	}
+
+	return TRUE;
+}
+
+static gboolean
+panel_launch_helper_write_all (int         fd,
+			       const void *buf,
+			       gsize       len)
+{
+	const char *p = buf;
+
+	while (len > 0) {
+		ssize_t n;
+
+		n = send (fd, p, len, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return FALSE;
+
+		p += n;
+		len -= n;
+	}
+
+	return TRUE;
+}
+
+/* Helper process side: the panel may already have threads when it forks
+ * the helper, so this only uses plain libc calls */
+
+static int helper_socket = -1;
+
+static void
+panel_launch_helper_reap (int signum)
+{
+	int saved_errno = errno;
+
+	while (waitpid (-1, NULL, WNOHANG) > 0)
+		;
+
+	errno = saved_errno;
+}
+
+/* The helper inherits the X and session bus connections of the panel: it
+ * must neither keep them open nor pass them down */
+static void
+panel_launch_helper_close_fds (int keep_fd)
+{
+	DIR  *dir;
+	long  max_fd;
+	int   fd;
+
+	dir = opendir ("/proc/self/fd");
+	if (dir != NULL) {
+		struct dirent *entry;
+
+		while ((entry = readdir (dir)) != NULL) {
+			if (entry->d_name[0] == '.')
+				continue;
+
+			fd = atoi (entry->d_name);
+			if (fd > 2 && fd != keep_fd && fd != dirfd (dir))
+				close (fd);
+		}
+
+		closedir (dir);
+		return;
+	}
+
+	max_fd = sysconf (_SC_OPEN_MAX);
+	for (fd = 3; fd < max_fd; fd++) {
+		if (fd != keep_fd)
+			close (fd);
+	}
+}
+
+/* Returns a NULL-terminated array pointing into data, or NULL if the
+ * strings overflow the payload */
+static char **
+panel_launch_helper_parse_strings (char    *data,
+				   gsize    len,
+				   gsize   *offset,
+				   guint32  n_strings)
+{
+	char    **retval;
+	guint32   i;
+
+	if (n_strings > len)
+		return NULL;
+
+	retval = calloc (n_strings + 1, sizeof (char *));
+	if (retval == NULL)
+		return NULL;
+
+	for (i = 0; i < n_strings; i++) {
+		char *end;
+
+		end = memchr (data + *offset, '\0', len - *offset);
+		if (!end) {
+			free (retval);
+			return NULL;
+		}
+
+		retval[i] = data + *offset;
+		*offset = end - data + 1;
+	}
+
+	return retval;
+}
+
+static void G_GNUC_NORETURN
+panel_launch_helper_exec (const char  *working_directory,
+			  char       **argv,
+			  char       **envp,
+			  int          error_fd)
+{
+	char     pid_env[64];
+	sigset_t mask;
+	int      errnum;
+	int      i;
+
+	close (helper_socket);
+
+	signal (SIGCHLD, SIG_DFL);
+	signal (SIGPIPE, SIG_DFL);
+	sigemptyset (&mask);
+	sigprocmask (SIG_SETMASK, &mask, NULL);
+
+	/* Only the child knows its pid, as with GIO's own launches */
+	for (i = 0; envp[i]; i++) {
+		if (strcmp (envp[i], PANEL_LAUNCH_HELPER_PID_VARIABLE "=") == 0) {
+			snprintf (pid_env, sizeof (pid_env),
+				  PANEL_LAUNCH_HELPER_PID_VARIABLE "=%ld",
+				  (long) getpid ());
+			envp[i] = pid_env;
+		}
+	}
+
+	if (working_directory[0] == '\0' || chdir (working_directory) == 0)
+		execve (argv[0], argv, envp);
+
+	errnum = errno;
+	while (write (error_fd, &errnum, sizeof (errnum)) < 0 && errno == EINTR)
+		;
+
+	_exit (127);
+}
+
+/* Returns 0 or the errno of the failure */
+static int
+panel_launch_helper_do_spawn (const char  *working_directory,
+			      char       **argv,
+			      char       **envp,
+			      pid_t       *pid)
+{
+	int     error_pipe[2];
+	int     errnum;
+	ssize_t n;
+	pid_t   child;
+
+	if (argv[0] == NULL)
+		return EINVAL;
+
+	/* The write end is closed by a successful exec */
+	if (pipe (error_pipe) != 0)
+		return errno;
+	fcntl (error_pipe[0], F_SETFD, FD_CLOEXEC);
+	fcntl (error_pipe[1], F_SETFD, FD_CLOEXEC);
+
+	child = fork ();
+	if (child < 0) {
+		errnum = errno;
+		close (error_pipe[0]);
+		close (error_pipe[1]);
+		return errnum;
+	}
+
+	if (child == 0) {
+		close (error_pipe[0]);
+		panel_launch_helper_exec (working_directory, argv, envp,
+					  error_pipe[1]);
+	}
+
+	close (error_pipe[1]);
+
+	do
+		n = read (error_pipe[0], &errnum, sizeof (errnum));
+	while (n < 0 && errno == EINTR);
+
+	close (error_pipe[0]);
+
+	if (n == sizeof (errnum))
+		return errnum;
+
+	*pid = child;
+
+	return 0;
+}
+
+static void G_GNUC_NORETURN
+panel_launch_helper_main (int fd)
+{
+	struct sigaction sa;
+
+	helper_socket = fd;
+	panel_launch_helper_close_fds (fd);
+
+	memset (&sa, 0, sizeof (sa));
+	sa.sa_handler = panel_launch_helper_reap;
+	sa.sa_flags = SA_NOCLDSTOP | SA_RESTART;
+	sigemptyset (&sa.sa_mask);
+	sigaction (SIGCHLD, &sa, NULL);
+
+	signal (SIGPIPE, SIG_IGN);
+
+	for (;;) {
+		PanelLaunchHelperReply   reply;
+		guint32                  size;
+		guint32                  counts[2];
+		char                    *data;
+		char                   **argv;
+		char                   **envp;
+		gsize                    offset;
+		pid_t                    pid = 0;
+
+		/* The panel went away */
+		if (!panel_launch_helper_read_all (fd, &size, sizeof (size)))
+			_exit (0);
+
+		if (size < sizeof (counts) || size > PANEL_LAUNCH_HELPER_MAX_REQUEST)
+			_exit (1);
+
+		data = malloc (size);
+		if (data == NULL)
+			_exit (1);
+		if (!panel_launch_helper_read_all (fd, data, size))
+			_exit (0);
+
+		memcpy (counts, data, sizeof (counts));
+		offset = sizeof (counts);
+
+		argv = NULL;
+		envp = NULL;
+		reply.pid = -1;
+		reply.errnum = EINVAL;
+
+		if (memchr (data + offset, '\0', size - offset)) {
+			const char *working_directory = data + offset;
+
+			offset += strlen (working_directory) + 1;
+			argv = panel_launch_helper_parse_strings (data, size, &offset, counts[0]);
+			if (argv)
+				envp = panel_launch_helper_parse_strings (data, size, &offset, counts[1]);
+
+			if (argv && envp) {
+				reply.errnum = panel_launch_helper_do_spawn (working_directory,
+									     argv, envp, &pid);
+				reply.pid = reply.errnum == 0 ? pid : -1;
+			}
+		}
+
+		free (argv);
+		free (envp);
+		free (data);
+
+		if (!panel_launch_helper_write_all (fd, &reply, sizeof (reply)))
+			_exit (0);
+	}
+}
+
+/* Panel side */
+
+/* Fails the requests still waiting for a reply */
+static void
+panel_launch_helper_stop (void)
+{
+	PanelLaunchHelperRequest *request;
+	GError                   *error;
+
+	if (helper_fd == -1)
+		return;
+
+	if (helper_watch_id)
+		g_source_remove (helper_watch_id);
+	helper_watch_id = 0;
+
+	if (helper_timeout_id)
+		g_source_remove (helper_timeout_id);
+	helper_timeout_id = 0;
+
+	close (helper_fd);
+	helper_fd = -1;
+	helper_reply_len = 0;
+
+	error = g_error_new_literal (G_IO_ERROR, G_IO_ERROR_BROKEN_PIPE,
+				     "The launch helper went away");
+
+	while ((request = g_queue_pop_head (&helper_requests)) != NULL) {
+		request->callback (0, error, request->user_data);
+		g_slice_free (PanelLaunchHelperRequest, request);
+	}
+
+	g_error_free (error);
+}
+
+static gboolean
+panel_launch_helper_timed_out (gpointer user_data)
+{
+	helper_timeout_id = 0;
+
+	g_warning ("The launch helper did not answer, launching directly from now on");
+
+	if (helper_pid)
+		kill (helper_pid, SIGKILL);
+	panel_launch_helper_stop ();
+
+	return G_SOURCE_REMOVE;
+}
+
+/* The oldest request gets PANEL_LAUNCH_HELPER_TIMEOUT seconds */
+static void
+panel_launch_helper_reset_timeout (void)
+{
+	if (helper_timeout_id)
+		g_source_remove (helper_timeout_id);
+	helper_timeout_id = 0;
+
+	if (!g_queue_is_empty (&helper_requests))
+		helper_timeout_id = g_timeout_add_seconds (PANEL_LAUNCH_HELPER_TIMEOUT,
+							   panel_launch_helper_timed_out,
+							   NULL);
+}
+
+static gboolean
+panel_launch_helper_complete (const PanelLaunchHelperReply *reply)
+{
+	PanelLaunchHelperRequest *request;
+	GError                   *error = NULL;
+
+	request = g_queue_pop_head (&helper_requests);
+	if (request == NULL)
+		return FALSE;
+
+	panel_launch_helper_reset_timeout ();
+
+	if (reply->errnum != 0)
+		error = g_error_new (G_SPAWN_ERROR, G_SPAWN_ERROR_FAILED,
+				     _("Failed to execute child process (%s)"),
+				     g_strerror (reply->errnum));
+
+	request->callback (reply->pid, error, request->user_data);
+
+	if (error)
+		g_error_free (error);
+	g_slice_free (PanelLaunchHelperRequest, request);
+
+	return TRUE;
+}
+
+static gboolean
+panel_launch_helper_readable (gint         fd,
+			      GIOCondition condition,
+			      gpointer     user_data)
+{
+	for (;;) {
+		ssize_t n;
+
+		n = recv (fd, (char *) &helper_reply + helper_reply_len,
+			  sizeof (helper_reply) - helper_reply_len,
+			  MSG_DONTWAIT);
+
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return G_SOURCE_CONTINUE;
+		if (n <= 0)
+			break;
+
+		helper_reply_len += n;
+		if (helper_reply_len < sizeof (helper_reply))
+			continue;
+
+		helper_reply_len = 0;
+		if (!panel_launch_helper_complete (&helper_reply))
+			break;
+
+		/* A callback may have stopped the helper */
+		if (helper_fd == -1)
+			return G_SOURCE_REMOVE;
+	}
+
+	g_warning ("The launch helper exited unexpectedly, launching directly from now on");
+
+	helper_watch_id = 0;
+	panel_launch_helper_stop ();
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+panel_launch_helper_exited (GPid     pid,
+			    gint     status,
+			    gpointer user_data)
+{
+	if (pid != helper_pid)
+		return;
+
+	if (helper_fd != -1)
+		g_warning ("The launch helper exited unexpectedly, launching directly from now on");
+
+	g_spawn_close_pid (pid);
+	helper_pid = 0;
+	panel_launch_helper_stop ();
+}
+
+/* The helper keeps running on a copy of the process as it is at this
+ * point, so this should be called before the panel loads anything. */
+void
+panel_launch_helper_start (void)
+{
+	int   fds[2];
+	pid_t pid;
+
+	if (helper_fd != -1)
+		return;
+
+	if (socketpair (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) != 0) {
+		g_warning ("Could not create the launch helper socket: %s",
+			   g_strerror (errno));
+		return;
+	}
+
+	pid = fork ();
+	if (pid < 0) {
+		g_warning ("Could not start the launch helper: %s",
+			   g_strerror (errno));
+		close (fds[0]);
+		close (fds[1]);
+		return;
+	}
+
+	if (pid == 0) {
+		close (fds[0]);
+		panel_launch_helper_main (fds[1]);
+	}
+
+	close (fds[1]);
+	helper_fd = fds[0];
+	helper_pid = pid;
+
+	helper_watch_id = g_unix_fd_add (helper_fd, G_IO_IN | G_IO_HUP | G_IO_ERR,
+					 panel_launch_helper_readable, NULL);
+	g_child_watch_add (helper_pid, panel_launch_helper_exited, NULL);
+}
+
+gboolean
+panel_launch_helper_is_running (void)
+{
+	return helper_fd != -1;
+}
+
+/*
+ * Sends the launch to the helper. Returns FALSE when the helper is not
+ * available, in which case the caller should spawn the process itself.
+ * Otherwise @callback is called from the main loop once the helper has
+ * replied, with the pid of the child or the error. The helper does no
+ * PATH lookup: argv[0] must be a path to the program.
+ */
+gboolean
+panel_launch_helper_spawn (const char                 *working_directory,
+			   char                      **argv,
+			   char                      **envp,
+			   PanelLaunchHelperCallback   callback,
+			   gpointer                    user_data)
+{
+	PanelLaunchHelperRequest *request;
+	GString                  *buffer;
+	guint32                   counts[2];
+	guint32                   size;
+	gboolean                  sent;
+	int                       i;
+
+	g_return_val_if_fail (argv != NULL && argv[0] != NULL, FALSE);
+	g_return_val_if_fail (envp != NULL, FALSE);
+	g_return_val_if_fail (callback != NULL, FALSE);
+
+	if (helper_fd == -1)
+		return FALSE;
+
+	counts[0] = g_strv_length (argv);
+	counts[1] = g_strv_length (envp);
+
+	buffer = g_string_sized_new (1024);
+	g_string_append_len (buffer, (const char *) &size, sizeof (size));
+	g_string_append_len (buffer, (const char *) counts, sizeof (counts));
+	g_string_append_len (buffer, working_directory ? working_directory : "",
+			     working_directory ? strlen (working_directory) + 1 : 1);
+	for (i = 0; argv[i]; i++)
+		g_string_append_len (buffer, argv[i], strlen (argv[i]) + 1);
+	for (i = 0; envp[i]; i++)
+		g_string_append_len (buffer, envp[i], strlen (envp[i]) + 1);
+
+	if (buffer->len - sizeof (size) > PANEL_LAUNCH_HELPER_MAX_REQUEST) {
+		g_string_free (buffer, TRUE);
+		return FALSE;
+	}
+
+	size = buffer->len - sizeof (size);
+	memcpy (buffer->str, &size, sizeof (size));
+
+	sent = panel_launch_helper_write_all (helper_fd, buffer->str, buffer->len);
+	g_string_free (buffer, TRUE);
+
+	if (!sent) {
+		panel_launch_helper_stop ();
+		return FALSE;
+	}
+
+	request = g_slice_new (PanelLaunchHelperRequest);
+	request->callback = callback;
+	request->user_data = user_data;
+	g_queue_push_tail (&helper_requests, request);
+
+	if (!helper_timeout_id)
+		panel_launch_helper_reset_timeout ();
+
+	return TRUE;
+}
@@ -0,0 +1,51 @@
+/*
+ * panel-launch-helper.h: spawn processes from a small pre-forked helper
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef PANEL_LAUNCH_HELPER_H
+#define PANEL_LAUNCH_HELPER_H
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* An environment entry "GIO_LAUNCHED_DESKTOP_FILE_PID=" with no value is
+ * set to the pid of the child, which only the child knows */
+#define PANEL_LAUNCH_HELPER_PID_VARIABLE "GIO_LAUNCHED_DESKTOP_FILE_PID"
+
+/* @error is NULL on success */
+typedef void (*PanelLaunchHelperCallback) (GPid          pid,
+					   const GError *error,
+					   gpointer      user_data);
+
+void     panel_launch_helper_start      (void);
+gboolean panel_launch_helper_is_running (void);
+
+gboolean panel_launch_helper_spawn      (const char                 *working_directory,
+					 char                      **argv,
+					 char                      **envp,
+					 PanelLaunchHelperCallback   callback,
+					 gpointer                    user_data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PANEL_LAUNCH_HELPER_H */
@@ -22,6 +22,8 @@
  *	Vincent Untz <vuntz@gnome.org>
  */
 
+#include <string.h>
+
 #include <glib/gi18n.h>
 #include <gio/gio.h>
 #include <gio/gdesktopappinfo.h>
@@ -31,6 +33,8 @@
 
 #include "panel-error.h"
 #include "panel-glib.h"
+#include "panel-launch-helper.h"
+#include "panel-stats.h"
 
 #include "panel-launch.h"
 
@@ -94,42 +98,459 @@ gather_pid_callback (GDesktopAppInfo   *gapp,
 	g_child_watch_add (pid, dummy_child_watch, NULL);
 }
 
-gboolean
-panel_app_info_launch_uris (GAppInfo   *appinfo,
-			    GList      *uris,
-			    GdkScreen  *screen,
-			    guint32     timestamp,
-			    GError    **error)
+struct _PanelLaunchDescriptor {
+	GDesktopAppInfo  *appinfo;
+
+	/* Exec split in arguments, field codes not expanded yet */
+	char            **exec_args;
+	/* exec_args[0] resolved on PATH, NULL if it could not be */
+	char             *program;
+	char             *working_directory;
+	char             *icon;
+
+	gboolean          terminal;
+	gboolean          startup_notify;
+	gboolean          takes_list;
+	gboolean          dbus_activatable;
+};
+
+/* A launch sent to the launch helper, waiting for its reply */
+typedef struct {
+	GDesktopAppInfo   *appinfo;
+	GList             *uris;
+	GAppLaunchContext *context;
+	GdkScreen         *screen;
+	char              *startup_id;
+	gint64             start_time;
+} PanelLaunchPending;
+
+static PanelLaunchDescriptor *
+_panel_launch_descriptor_new_from_app_info (GDesktopAppInfo *appinfo)
+{
+	PanelLaunchDescriptor *desc;
+	const char            *exec;
+
+	desc = g_slice_new0 (PanelLaunchDescriptor);
+	desc->appinfo = g_object_ref (appinfo);
+
+	desc->terminal = g_desktop_app_info_get_boolean (appinfo, "Terminal");
+	desc->startup_notify = g_desktop_app_info_get_boolean (appinfo, "StartupNotify");
+	desc->dbus_activatable = g_desktop_app_info_get_boolean (appinfo, "DBusActivatable");
+	desc->working_directory = g_desktop_app_info_get_string (appinfo, "Path");
+	desc->icon = g_desktop_app_info_get_string (appinfo, "Icon");
+
+	exec = g_app_info_get_commandline (G_APP_INFO (appinfo));
+	if (exec && g_shell_parse_argv (exec, NULL, &desc->exec_args, NULL)) {
+		desc->takes_list = strstr (exec, "%F") != NULL || strstr (exec, "%U") != NULL;
+
+		/* The helper does not search PATH */
+		if (!strchr (desc->exec_args[0], '%'))
+			desc->program = g_find_program_in_path (desc->exec_args[0]);
+	}
+
+	return desc;
+}
+
+/**
+ * panel_launch_descriptor_new:
+ * @keyfile: a desktop entry of type Application
+ *
+ * Parses everything needed to launch the application described by @keyfile,
+ * so that launching it repeatedly does no key file parsing nor PATH lookup.
+ * The descriptor does not follow later changes to @keyfile or to PATH:
+ * callers have to create a new one then.
+ *
+ * Returns: a new descriptor, or %NULL if @keyfile can't be launched.
+ */
+PanelLaunchDescriptor *
+panel_launch_descriptor_new (GKeyFile *keyfile)
+{
+	PanelLaunchDescriptor *desc;
+	GDesktopAppInfo       *appinfo;
+
+	g_return_val_if_fail (keyfile != NULL, NULL);
+
+	appinfo = g_desktop_app_info_new_from_keyfile (keyfile);
+	if (appinfo == NULL)
+		return NULL;
+
+	desc = _panel_launch_descriptor_new_from_app_info (appinfo);
+	g_object_unref (appinfo);
+
+	return desc;
+}
+
+void
+panel_launch_descriptor_free (PanelLaunchDescriptor *desc)
+{
+	if (!desc)
+		return;
+
+	g_object_unref (desc->appinfo);
+	g_strfreev (desc->exec_args);
+	g_free (desc->program);
+	g_free (desc->working_directory);
+	g_free (desc->icon);
+
+	g_slice_free (PanelLaunchDescriptor, desc);
+}
+
+/* Expands the field codes of a single Exec argument, appending the
+ * result to argv. Returns FALSE if the launch has to be left to GIO. */
+static gboolean
+_panel_launch_expand_arg (PanelLaunchDescriptor *desc,
+			  const char            *arg,
+			  GList                 *uris,
+			  GPtrArray             *argv)
+{
+	GString    *expanded;
+	const char *p;
+	GList      *l;
+
+	/* %F and %U must be arguments of their own */
+	if (strcmp (arg, "%F") == 0 || strcmp (arg, "%U") == 0) {
+		for (l = uris; l; l = l->next) {
+			if (arg[1] == 'F') {
+				char *path;
+
+				path = g_filename_from_uri (l->data, NULL, NULL);
+				if (!path)
+					return FALSE;
+				g_ptr_array_add (argv, path);
+			} else
+				g_ptr_array_add (argv, g_strdup (l->data));
+		}
+
+		return TRUE;
+	}
+
+	expanded = g_string_new (NULL);
+
+	for (p = arg; *p; p++) {
+		if (*p != '%' || p[1] == '\0') {
+			g_string_append_c (expanded, *p);
+			continue;
+		}
+
+		p++;
+		switch (*p) {
+		case 'f':
+			if (uris) {
+				char *path;
+
+				path = g_filename_from_uri (uris->data, NULL, NULL);
+				if (!path) {
+					g_string_free (expanded, TRUE);
+					return FALSE;
+				}
+				g_string_append (expanded, path);
+				g_free (path);
+			}
+			break;
+		case 'u':
+			if (uris)
+				g_string_append (expanded, uris->data);
+			break;
+		case 'c':
+			g_string_append (expanded,
+					 g_app_info_get_name (G_APP_INFO (desc->appinfo)));
+			break;
+		case 'k':
+			if (g_desktop_app_info_get_filename (desc->appinfo))
+				g_string_append (expanded,
+						 g_desktop_app_info_get_filename (desc->appinfo));
+			break;
+		case 'i':
+			/* %i expands to two arguments, so it must be alone */
+			if (desc->icon && expanded->len == 0 && p[1] == '\0') {
+				g_ptr_array_add (argv, g_strdup ("--icon"));
+				g_ptr_array_add (argv, g_strdup (desc->icon));
+				g_string_free (expanded, TRUE);
+				return TRUE;
+			}
+			break;
+		case '%':
+			g_string_append_c (expanded, '%');
+			break;
+		default:
+			/* Deprecated field codes expand to nothing */
+			break;
+		}
+	}
+
+	/* An argument made only of an empty field code is dropped */
+	if (expanded->len == 0 && arg[0] == '%')
+		g_string_free (expanded, TRUE);
+	else
+		g_ptr_array_add (argv, g_string_free (expanded, FALSE));
+
+	return TRUE;
+}
+
+static char **
+_panel_launch_get_argv (PanelLaunchDescriptor *desc,
+			GList                 *uris)
+{
+	GPtrArray *argv;
+	int        i;
+
+	/* GIO activates the application over D-Bus instead of running Exec */
+	if (desc->terminal || desc->dbus_activatable || !desc->program)
+		return NULL;
+
+	/* GIO launches one process per URI in that case */
+	if (!desc->takes_list && uris && uris->next)
+		return NULL;
+
+	argv = g_ptr_array_new_with_free_func (g_free);
+	g_ptr_array_add (argv, g_strdup (desc->program));
+
+	for (i = 1; desc->exec_args[i]; i++) {
+		if (!_panel_launch_expand_arg (desc, desc->exec_args[i], uris, argv)) {
+			g_ptr_array_free (argv, TRUE);
+			return NULL;
+		}
+	}
+
+	g_ptr_array_set_free_func (argv, NULL);
+	g_ptr_array_add (argv, NULL);
+
+	return (char **) g_ptr_array_free (argv, FALSE);
+}
+
+static gboolean
+_panel_launch_with_gio (GDesktopAppInfo    *appinfo,
+			GList              *uris,
+			GAppLaunchContext  *context,
+			gint64              start_time,
+			GError            **error)
+{
+	if (!g_desktop_app_info_launch_uris_as_manager (appinfo, uris, context,
+							G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
+							NULL, NULL, gather_pid_callback, appinfo,
+							error))
+		return FALSE;
+
+	g_debug ("Launched %s in %.2f ms",
+		 g_app_info_get_name (G_APP_INFO (appinfo)),
+		 (g_get_monotonic_time () - start_time) / 1000.0);
+	PANEL_STATS_RECORD ("launch-latency-us",
+			    g_get_monotonic_time () - start_time);
+
+	return TRUE;
+}
+
+static void
+_panel_launch_pending_free (PanelLaunchPending *pending)
+{
+	g_object_unref (pending->appinfo);
+	g_list_free_full (pending->uris, g_free);
+	g_object_unref (pending->context);
+	g_object_unref (pending->screen);
+	g_free (pending->startup_id);
+
+	g_slice_free (PanelLaunchPending, pending);
+}
+
+static void
+_panel_launch_helper_done (GPid          pid,
+			   const GError *error,
+			   gpointer      user_data)
+{
+	PanelLaunchPending *pending = user_data;
+	GError             *local_error;
+
+	if (error == NULL) {
+		g_debug ("Launched %s (pid %d) through the launch helper in %.2f ms",
+			 g_app_info_get_name (G_APP_INFO (pending->appinfo)), pid,
+			 (g_get_monotonic_time () - pending->start_time) / 1000.0);
+		PANEL_STATS_RECORD ("launch-latency-us",
+				    g_get_monotonic_time () - pending->start_time);
+
+		_panel_launch_pending_free (pending);
+		return;
+	}
+
+	if (pending->startup_id)
+		g_app_launch_context_launch_failed (pending->context,
+						    pending->startup_id);
+
+	/* Let GIO try again, it reports the error if it fails too */
+	local_error = NULL;
+	if (!_panel_launch_with_gio (pending->appinfo, pending->uris,
+				     pending->context, pending->start_time,
+				     &local_error))
+		_panel_launch_handle_error (g_app_info_get_name (G_APP_INFO (pending->appinfo)),
+					    pending->screen, local_error, NULL);
+
+	_panel_launch_pending_free (pending);
+}
+
+/* Sends the launch to the launch helper. Returns FALSE if that is not
+ * possible for this application; otherwise the launch completes, or
+ * falls back to GIO, from the main loop. */
+static gboolean
+_panel_launch_with_helper (PanelLaunchDescriptor  *desc,
+			   GList                  *uris,
+			   GAppLaunchContext      *context,
+			   GdkScreen              *screen,
+			   gint64                  start_time)
+{
+	GAppInfo            *appinfo = G_APP_INFO (desc->appinfo);
+	PanelLaunchPending  *pending;
+	const char          *filename;
+	char               **argv;
+	char               **envp;
+	char                *display;
+	char                *startup_id = NULL;
+	GList               *files = NULL;
+	GList               *l;
+	gboolean             retval;
+
+	if (!panel_launch_helper_is_running ())
+		return FALSE;
+
+	argv = _panel_launch_get_argv (desc, uris);
+	if (!argv)
+		return FALSE;
+
+	for (l = uris; l; l = l->next)
+		files = g_list_prepend (files, g_file_new_for_uri (l->data));
+	files = g_list_reverse (files);
+
+	envp = g_app_launch_context_get_environment (context);
+
+	display = g_app_launch_context_get_display (context, appinfo, files);
+	if (display) {
+		envp = g_environ_setenv (envp, "DISPLAY", display, TRUE);
+		g_free (display);
+	}
+
+	if (desc->startup_notify) {
+		startup_id = g_app_launch_context_get_startup_notify_id (context,
+									 appinfo,
+									 files);
+		if (startup_id)
+			envp = g_environ_setenv (envp, "DESKTOP_STARTUP_ID", startup_id, TRUE);
+	}
+
+	/* As GIO does; the helper fills the pid in */
+	filename = g_desktop_app_info_get_filename (desc->appinfo);
+	if (filename) {
+		envp = g_environ_setenv (envp, "GIO_LAUNCHED_DESKTOP_FILE",
+					 filename, TRUE);
+		envp = g_environ_setenv (envp, PANEL_LAUNCH_HELPER_PID_VARIABLE,
+					 "", TRUE);
+	}
+
+	pending = g_slice_new0 (PanelLaunchPending);
+	pending->appinfo    = g_object_ref (desc->appinfo);
+	for (l = uris; l; l = l->next)
+		pending->uris = g_list_prepend (pending->uris, g_strdup (l->data));
+	pending->uris       = g_list_reverse (pending->uris);
+	pending->context    = g_object_ref (context);
+	pending->screen     = g_object_ref (screen);
+	pending->startup_id = startup_id;
+	pending->start_time = start_time;
+
+	retval = panel_launch_helper_spawn (desc->working_directory,
+					    argv, envp,
+					    _panel_launch_helper_done, pending);
+
+	if (!retval) {
+		if (startup_id)
+			g_app_launch_context_launch_failed (context, startup_id);
+		_panel_launch_pending_free (pending);
+	}
+
+	g_list_free_full (files, g_object_unref);
+	g_strfreev (envp);
+	g_strfreev (argv);
+
+	return retval;
+}
+
+/* Errors of launches through the launch helper are only known later: they
+ * are never returned in @error, and reported in a dialog. */
+static gboolean
+_panel_launch_descriptor_launch (PanelLaunchDescriptor  *desc,
+				 GList                  *uris,
+				 GdkScreen              *screen,
+				 guint32                 timestamp,
+				 gint64                  start_time,
+				 GError                **error)
 {
+	GAppInfo            *appinfo = G_APP_INFO (desc->appinfo);
 	GdkAppLaunchContext *context;
 	GError              *local_error;
 	gboolean             retval;
 
-	g_return_val_if_fail (G_IS_DESKTOP_APP_INFO (appinfo), FALSE);
-	g_return_val_if_fail (GDK_IS_SCREEN (screen), FALSE);
-	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
-
 	GdkDisplay *display = gdk_display_get_default ();
 	context = gdk_display_get_app_launch_context (display);
 	gdk_app_launch_context_set_screen (context, screen);
 	gdk_app_launch_context_set_timestamp (context, timestamp);
 
+	if (_panel_launch_with_helper (desc, uris,
+				       (GAppLaunchContext *) context,
+				       screen, start_time)) {
+		g_object_unref (context);
+		return TRUE;
+	}
+
 	local_error = NULL;
-	retval = g_desktop_app_info_launch_uris_as_manager ((GDesktopAppInfo*)appinfo, uris,
-						   (GAppLaunchContext *) context,
-						   G_SPAWN_SEARCH_PATH | G_SPAWN_DO_NOT_REAP_CHILD,
-						   NULL, NULL, gather_pid_callback, appinfo,
-						   &local_error);
+	retval = _panel_launch_with_gio (desc->appinfo, uris,
+					 (GAppLaunchContext *) context,
+					 start_time, &local_error);
 
 	g_object_unref (context);
 
 	if ((local_error == NULL) && (retval == TRUE))
 		return TRUE;
 
-	return _panel_launch_handle_error (g_app_info_get_name ((GAppInfo*) appinfo),
+	return _panel_launch_handle_error (g_app_info_get_name (appinfo),
 					   screen, local_error, error);
 }
 
+gboolean
+panel_launch_descriptor_launch (PanelLaunchDescriptor  *desc,
+				GList                  *uris,
+				GdkScreen              *screen,
+				guint32                 timestamp,
+				GError                **error)
+{
+	g_return_val_if_fail (desc != NULL, FALSE);
+	g_return_val_if_fail (GDK_IS_SCREEN (screen), FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	return _panel_launch_descriptor_launch (desc, uris, screen, timestamp,
+						g_get_monotonic_time (), error);
+}
+
+gboolean
+panel_app_info_launch_uris (GAppInfo   *appinfo,
+			    GList      *uris,
+			    GdkScreen  *screen,
+			    guint32     timestamp,
+			    GError    **error)
+{
+	PanelLaunchDescriptor *desc;
+	gboolean               retval;
+	gint64                 start_time;
+
+	g_return_val_if_fail (G_IS_DESKTOP_APP_INFO (appinfo), FALSE);
+	g_return_val_if_fail (GDK_IS_SCREEN (screen), FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	start_time = g_get_monotonic_time ();
+
+	desc = _panel_launch_descriptor_new_from_app_info (G_DESKTOP_APP_INFO (appinfo));
+	retval = _panel_launch_descriptor_launch (desc, uris, screen, timestamp,
+						  start_time, error);
+	panel_launch_descriptor_free (desc);
+
+	return retval;
+}
+
 gboolean
 panel_app_info_launch_uri (GAppInfo     *appinfo,
 			   const gchar  *uri,
@@ -162,24 +583,26 @@ panel_launch_key_file (GKeyFile   *keyfile,
 		       GdkScreen  *screen,
 		       GError    **error)
 {
-	GDesktopAppInfo *appinfo;
-	gboolean         retval;
+	PanelLaunchDescriptor *desc;
+	gboolean               retval;
+	gint64                 start_time;
 
 	g_return_val_if_fail (keyfile != NULL, FALSE);
 	g_return_val_if_fail (GDK_IS_SCREEN (screen), FALSE);
 	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
-	appinfo = g_desktop_app_info_new_from_keyfile (keyfile);
+	start_time = g_get_monotonic_time ();
 
-	if (appinfo == NULL)
+	desc = panel_launch_descriptor_new (keyfile);
+
+	if (desc == NULL)
 		return FALSE;
 
-	retval = panel_app_info_launch_uris (G_APP_INFO (appinfo),
-					     uri_list, screen,
-					     gtk_get_current_event_time (),
-					     error);
+	retval = _panel_launch_descriptor_launch (desc, uri_list, screen,
+						  gtk_get_current_event_time (),
+						  start_time, error);
 
-	g_object_unref (appinfo);
+	panel_launch_descriptor_free (desc);
 
 	return retval;
 }
@@ -189,13 +612,16 @@ panel_launch_desktop_file (const char  *desktop_file,
 			   GdkScreen   *screen,
 			   GError     **error)
 {
-	GDesktopAppInfo *appinfo;
-	gboolean         retval;
+	PanelLaunchDescriptor *desc;
+	GDesktopAppInfo       *appinfo;
+	gboolean               retval;
+	gint64                 start_time;
 
 	g_return_val_if_fail (desktop_file != NULL, FALSE);
 	g_return_val_if_fail (GDK_IS_SCREEN (screen), FALSE);
 	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
+	start_time = g_get_monotonic_time ();
 	appinfo = NULL;
 
 	if (g_path_is_absolute (desktop_file))
@@ -213,12 +639,15 @@ panel_launch_desktop_file (const char  *desktop_file,
 	if (appinfo == NULL)
 		return FALSE;
 
-	retval = panel_app_info_launch_uris (G_APP_INFO (appinfo), NULL, screen,
-					     gtk_get_current_event_time (),
-					     error);
-
+	desc = _panel_launch_descriptor_new_from_app_info (appinfo);
 	g_object_unref (appinfo);
 
+	retval = _panel_launch_descriptor_launch (desc, NULL, screen,
+						  gtk_get_current_event_time (),
+						  start_time, error);
+
+	panel_launch_descriptor_free (desc);
+
 	return retval;
 }
 
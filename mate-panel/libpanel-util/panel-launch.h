@@ -32,6 +32,8 @@
 extern "C" {
 #endif
 
+typedef struct _PanelLaunchDescriptor PanelLaunchDescriptor;
+
 gboolean panel_app_info_launch_uris (GAppInfo   *appinfo,
 				     GList      *uris,
 				     GdkScreen  *screen,
@@ -49,6 +51,14 @@ gboolean panel_launch_key_file (GKeyFile   *keyfile,
 				GdkScreen  *screen,
 				GError    **error);
 
+PanelLaunchDescriptor *panel_launch_descriptor_new    (GKeyFile               *keyfile);
+void                   panel_launch_descriptor_free   (PanelLaunchDescriptor  *desc);
+gboolean               panel_launch_descriptor_launch (PanelLaunchDescriptor  *desc,
+						       GList                  *uris,
+						       GdkScreen              *screen,
+						       guint32                 timestamp,
+						       GError                **error);
+
 gboolean panel_launch_desktop_file (const char  *desktop_file,
 				    GdkScreen   *screen,
 				    GError     **error);
@@ -0,0 +1,432 @@
+/*
+ * panel-stats.c: lightweight performance counters and tracing
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Stats are named counters and histograms. Counters add up a value (most
+ * of the time 1 per event), histograms record values in log2 buckets,
+ * along with their count, sum, minimum and maximum. Timers are histograms
+ * of durations in nanoseconds.
+ *
+ * Nothing is recorded until the stats are enabled, from the command line
+ * or over D-Bus. When a trace file is set, each timed section is also
+ * written there as a complete event of the Chrome trace event format,
+ * which chrome://tracing and Perfetto can load.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "panel-cleanup.h"
+#include "panel-stats.h"
+
+typedef enum {
+	PANEL_STAT_COUNTER,
+	PANEL_STAT_HISTOGRAM,
+	PANEL_STAT_TIMER
+} PanelStatKind;
+
+typedef struct {
+	PanelStatKind kind;
+	guint64       count;
+	gint64        sum;
+	gint64        min;
+	gint64        max;
+	guint64       buckets[PANEL_STATS_N_BUCKETS];
+} PanelStat;
+
+gboolean panel_stats_enabled = FALSE;
+
+G_LOCK_DEFINE_STATIC (panel_stats);
+
+static GHashTable *panel_stats       = NULL;
+static FILE       *panel_stats_trace = NULL;
+static gint64      panel_stats_epoch = 0;
+static gboolean    panel_stats_trace_first = TRUE;
+
+gint64
+panel_stats_now (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+
+	return (gint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static const char *
+panel_stats_kind_to_string (PanelStatKind kind)
+{
+	switch (kind) {
+	case PANEL_STAT_COUNTER:
+		return "counter";
+	case PANEL_STAT_HISTOGRAM:
+		return "histogram";
+	case PANEL_STAT_TIMER:
+		return "timer";
+	default:
+		g_assert_not_reached ();
+		return NULL;
+	}
+}
+
+/* Must be called with the lock held. Returns NULL if @name was first
+ * recorded as another kind of stat. */
+static PanelStat *
+panel_stats_lookup (const char    *name,
+		    PanelStatKind  kind)
+{
+	PanelStat *stat;
+
+	if (!panel_stats)
+		panel_stats = g_hash_table_new_full (g_str_hash, g_str_equal,
+						     g_free, g_free);
+
+	stat = g_hash_table_lookup (panel_stats, name);
+	if (!stat) {
+		stat = g_new0 (PanelStat, 1);
+		stat->kind = kind;
+		stat->min = G_MAXINT64;
+		stat->max = G_MININT64;
+		g_hash_table_insert (panel_stats, g_strdup (name), stat);
+	} else if (stat->kind != kind) {
+		g_warning ("Stat '%s' is a %s, not a %s", name,
+			   panel_stats_kind_to_string (stat->kind),
+			   panel_stats_kind_to_string (kind));
+		return NULL;
+	}
+
+	return stat;
+}
+
+static int
+panel_stats_get_bucket (gint64 value)
+{
+	int bucket = 0;
+
+	if (value <= 1)
+		return 0;
+
+	bucket = g_bit_storage ((gulong) value) - 1;
+
+	return MIN (bucket, PANEL_STATS_N_BUCKETS - 1);
+}
+
+/* Must be called with the lock held */
+static void
+panel_stats_add_value (PanelStat *stat,
+		       gint64     value)
+{
+	stat->count++;
+	stat->sum += value;
+	stat->min = MIN (stat->min, value);
+	stat->max = MAX (stat->max, value);
+	stat->buckets[panel_stats_get_bucket (value)]++;
+}
+
+void
+panel_stats_count (const char *name,
+		   gint64      delta)
+{
+	PanelStat *stat;
+
+	g_return_if_fail (name != NULL);
+
+	if (!panel_stats_enabled)
+		return;
+
+	G_LOCK (panel_stats);
+	stat = panel_stats_lookup (name, PANEL_STAT_COUNTER);
+	if (stat) {
+		stat->count++;
+		stat->sum += delta;
+	}
+	G_UNLOCK (panel_stats);
+}
+
+void
+panel_stats_record (const char *name,
+		    gint64      value)
+{
+	PanelStat *stat;
+
+	g_return_if_fail (name != NULL);
+
+	if (!panel_stats_enabled)
+		return;
+
+	G_LOCK (panel_stats);
+	stat = panel_stats_lookup (name, PANEL_STAT_HISTOGRAM);
+	if (stat)
+		panel_stats_add_value (stat, value);
+	G_UNLOCK (panel_stats);
+}
+
+static int
+panel_stats_get_tid (void)
+{
+#ifdef SYS_gettid
+	return (int) syscall (SYS_gettid);
+#else
+	return (int) getpid ();
+#endif
+}
+
+/* Must be called with the lock held */
+static void
+panel_stats_trace_event (const char *name,
+			 gint64      start,
+			 gint64      duration)
+{
+	const char *p;
+
+	fputs (panel_stats_trace_first ? "[\n" : ",\n", panel_stats_trace);
+	panel_stats_trace_first = FALSE;
+
+	/* Names are identifiers from the code, but keep the JSON valid */
+	fputs ("{\"name\":\"", panel_stats_trace);
+	for (p = name; *p; p++) {
+		if (*p == '"' || *p == '\\')
+			fputc ('\\', panel_stats_trace);
+		if ((guchar) *p >= 0x20)
+			fputc (*p, panel_stats_trace);
+	}
+
+	fprintf (panel_stats_trace,
+		 "\",\"cat\":\"panel\",\"ph\":\"X\","
+		 "\"ts\":%" G_GINT64_FORMAT ".%03d,"
+		 "\"dur\":%" G_GINT64_FORMAT ".%03d,"
+		 "\"pid\":%d,\"tid\":%d}",
+		 (start - panel_stats_epoch) / 1000,
+		 (int) ((start - panel_stats_epoch) % 1000),
+		 duration / 1000, (int) (duration % 1000),
+		 (int) getpid (), panel_stats_get_tid ());
+}
+
+void
+panel_stats_timer_stop (const char *name,
+			gint64      start)
+{
+	PanelStat *stat;
+	gint64     now;
+
+	g_return_if_fail (name != NULL);
+
+	if (!panel_stats_enabled || start == 0)
+		return;
+
+	now = panel_stats_now ();
+
+	G_LOCK (panel_stats);
+	stat = panel_stats_lookup (name, PANEL_STAT_TIMER);
+	if (stat)
+		panel_stats_add_value (stat, now - start);
+	if (stat && panel_stats_trace && start >= panel_stats_epoch)
+		panel_stats_trace_event (name, start, now - start);
+	G_UNLOCK (panel_stats);
+}
+
+void
+panel_stats_set_enabled (gboolean enabled)
+{
+	panel_stats_enabled = enabled != FALSE;
+}
+
+static void
+panel_stats_close_trace (gpointer data)
+{
+	G_LOCK (panel_stats);
+	if (panel_stats_trace) {
+		fputs (panel_stats_trace_first ? "[]\n" : "\n]\n",
+		       panel_stats_trace);
+		fclose (panel_stats_trace);
+		panel_stats_trace = NULL;
+	}
+	G_UNLOCK (panel_stats);
+}
+
+/* Also enables the stats. The file is completed when the panel exits, but
+ * the trace viewers accept a file without its final bracket. */
+gboolean
+panel_stats_set_trace_file (const char  *filename,
+			    GError     **error)
+{
+	FILE *file;
+
+	g_return_val_if_fail (filename != NULL, FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	file = fopen (filename, "w");
+	if (!file) {
+		int errsv = errno;
+
+		g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+			     "Cannot open '%s': %s", filename, g_strerror (errsv));
+		return FALSE;
+	}
+
+	panel_stats_close_trace (NULL);
+
+	G_LOCK (panel_stats);
+	panel_stats_trace = file;
+	panel_stats_trace_first = TRUE;
+	panel_stats_epoch = panel_stats_now ();
+	G_UNLOCK (panel_stats);
+
+	panel_cleanup_unregister (panel_stats_close_trace, NULL);
+	panel_cleanup_register (panel_stats_close_trace, NULL);
+
+	panel_stats_set_enabled (TRUE);
+
+	return TRUE;
+}
+
+/* Returns a floating a{s(stxxxat)} variant: for each stat, its kind, its
+ * count, sum, minimum and maximum, and its histogram buckets. Counters
+ * have no minimum, maximum nor buckets. */
+GVariant *
+panel_stats_get_stats (void)
+{
+	GVariantBuilder builder;
+	GHashTableIter  iter;
+	gpointer        key;
+	gpointer        value;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{s(stxxxat)}"));
+
+	G_LOCK (panel_stats);
+
+	if (panel_stats) {
+		g_hash_table_iter_init (&iter, panel_stats);
+		while (g_hash_table_iter_next (&iter, &key, &value)) {
+			PanelStat *stat = value;
+			gsize      n_buckets;
+
+			n_buckets = stat->kind == PANEL_STAT_COUNTER ? 0 : PANEL_STATS_N_BUCKETS;
+
+			g_variant_builder_add (&builder, "{s(stxxx@at)}",
+					       key,
+					       panel_stats_kind_to_string (stat->kind),
+					       stat->count,
+					       stat->sum,
+					       stat->count && n_buckets ? stat->min : 0,
+					       stat->count && n_buckets ? stat->max : 0,
+					       g_variant_new_fixed_array (G_VARIANT_TYPE_UINT64,
+									  stat->buckets,
+									  n_buckets,
+									  sizeof (guint64)));
+		}
+	}
+
+	G_UNLOCK (panel_stats);
+
+	return g_variant_builder_end (&builder);
+}
+
+void
+panel_stats_reset (void)
+{
+	G_LOCK (panel_stats);
+	if (panel_stats)
+		g_hash_table_remove_all (panel_stats);
+	G_UNLOCK (panel_stats);
+}
+
+/* D-Bus interface */
+
+static const gchar panel_stats_introspection_xml[] =
+	"<node>"
+	    "<interface name='" PANEL_STATS_DBUS_INTERFACE "'>"
+	      "<method name='GetStats'>"
+	        "<arg name='enabled' type='b' direction='out'/>"
+	        "<arg name='stats' type='a{s(stxxxat)}' direction='out'/>"
+	      "</method>"
+	      "<method name='ResetStats'/>"
+	      "<method name='SetEnabled'>"
+	        "<arg name='enabled' type='b' direction='in'/>"
+	      "</method>"
+	    "</interface>"
+	  "</node>";
+
+static void
+panel_stats_method_call (GDBusConnection       *connection,
+			 const gchar           *sender,
+			 const gchar           *object_path,
+			 const gchar           *interface_name,
+			 const gchar           *method_name,
+			 GVariant              *parameters,
+			 GDBusMethodInvocation *invocation,
+			 gpointer               user_data)
+{
+	if (g_strcmp0 (method_name, "GetStats") == 0) {
+		g_dbus_method_invocation_return_value (invocation,
+						       g_variant_new ("(b@a{s(stxxxat)})",
+								      panel_stats_enabled,
+								      panel_stats_get_stats ()));
+	} else if (g_strcmp0 (method_name, "ResetStats") == 0) {
+		panel_stats_reset ();
+		g_dbus_method_invocation_return_value (invocation, NULL);
+	} else if (g_strcmp0 (method_name, "SetEnabled") == 0) {
+		gboolean enabled;
+
+		g_variant_get (parameters, "(b)", &enabled);
+		panel_stats_set_enabled (enabled);
+		g_dbus_method_invocation_return_value (invocation, NULL);
+	} else {
+		g_dbus_method_invocation_return_error (invocation,
+						       G_DBUS_ERROR,
+						       G_DBUS_ERROR_UNKNOWN_METHOD,
+						       "Unknown method %s.%s",
+						       interface_name,
+						       method_name);
+	}
+}
+
+static const GDBusInterfaceVTable panel_stats_interface_vtable = {
+	panel_stats_method_call,
+	NULL,
+	NULL
+};
+
+void
+panel_stats_register_object (GDBusConnection *connection)
+{
+	static GDBusNodeInfo *introspection_data = NULL;
+	GError               *error = NULL;
+
+	g_return_if_fail (G_IS_DBUS_CONNECTION (connection));
+
+	if (!introspection_data)
+		introspection_data = g_dbus_node_info_new_for_xml (panel_stats_introspection_xml, NULL);
+
+	g_dbus_connection_register_object (connection,
+					   PANEL_STATS_DBUS_PATH,
+					   introspection_data->interfaces[0],
+					   &panel_stats_interface_vtable,
+					   NULL, NULL,
+					   &error);
+	if (error) {
+		g_warning ("Failed to register object %s: %s",
+			   PANEL_STATS_DBUS_PATH, error->message);
+		g_error_free (error);
+	}
+}
@@ -0,0 +1,90 @@
+/*
+ * panel-stats.h: lightweight performance counters and tracing
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef PANEL_STATS_H
+#define PANEL_STATS_H
+
+#include <gio/gio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PANEL_STATS_DBUS_PATH      "/org/mate/panel/Debug"
+#define PANEL_STATS_DBUS_INTERFACE "org.mate.panel.Debug"
+
+/* Number of log2 buckets of the histograms: the last one collects all the
+ * values of 2^(PANEL_STATS_N_BUCKETS - 1) and more */
+#define PANEL_STATS_N_BUCKETS 40
+
+/* Only read through the macros below, so that disabled stats cost a
+ * single test of a global */
+extern gboolean panel_stats_enabled;
+
+#define PANEL_STATS_COUNT(name)						\
+	G_STMT_START {							\
+		if (G_UNLIKELY (panel_stats_enabled))			\
+			panel_stats_count ((name), 1);			\
+	} G_STMT_END
+
+#define PANEL_STATS_COUNT_N(name, n)					\
+	G_STMT_START {							\
+		if (G_UNLIKELY (panel_stats_enabled))			\
+			panel_stats_count ((name), (n));		\
+	} G_STMT_END
+
+#define PANEL_STATS_RECORD(name, value)					\
+	G_STMT_START {							\
+		if (G_UNLIKELY (panel_stats_enabled))			\
+			panel_stats_record ((name), (value));		\
+	} G_STMT_END
+
+/* Evaluates to 0 when the stats are disabled */
+#define PANEL_STATS_TIMER_START()					\
+	(G_UNLIKELY (panel_stats_enabled) ? panel_stats_now () : 0)
+
+#define PANEL_STATS_TIMER_STOP(name, start)				\
+	G_STMT_START {							\
+		if (G_UNLIKELY ((start) != 0))				\
+			panel_stats_timer_stop ((name), (start));	\
+	} G_STMT_END
+
+gint64    panel_stats_now             (void);
+
+void      panel_stats_set_enabled     (gboolean         enabled);
+gboolean  panel_stats_set_trace_file  (const char      *filename,
+				       GError         **error);
+
+void      panel_stats_count           (const char      *name,
+				       gint64           delta);
+void      panel_stats_record          (const char      *name,
+				       gint64           value);
+void      panel_stats_timer_stop      (const char      *name,
+				       gint64           start);
+
+GVariant *panel_stats_get_stats       (void);
+void      panel_stats_reset           (void);
+
+void      panel_stats_register_object (GDBusConnection *connection);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PANEL_STATS_H */
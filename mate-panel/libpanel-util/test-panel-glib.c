@@ -0,0 +1,176 @@
+/*
+ * test-panel-glib.c: checks the search keys of panel-glib.c
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "panel-glib.h"
+
+typedef struct {
+	char  *name;
+	char  *description;
+	char  *name_key;
+	char  *description_key;
+} TestItem;
+
+static const char *words[] = {
+	"Clock", "Weather", "Workspace", "Switcher", "Window", "List",
+	"Notification", "Area", "Fish", "Wanda", "Show", "Desktop",
+	"Lock", "Screen", "Log", "Out", "Énergie", "Überwachung",
+	"Système", "Çà", "Menu", "Bar", "Drawer", "Separator"
+};
+
+/* Each prefix of these is searched, as when they are typed in the search
+ * entry of the Add to Panel dialog */
+static const char *queries[] = {
+	"workspace sw",
+	"LOG OUT",
+	"énergie",
+	"ÜBER",
+	"the çà",
+	"xyz"
+};
+
+static TestItem *
+make_items (int n_items)
+{
+	TestItem *items;
+	GRand    *rand;
+	int       i;
+
+	items = g_new0 (TestItem, n_items);
+	rand = g_rand_new_with_seed (42);
+
+	for (i = 0; i < n_items; i++) {
+		items[i].name = g_strdup_printf ("%s %s %d",
+						 words[g_rand_int_range (rand, 0, G_N_ELEMENTS (words))],
+						 words[g_rand_int_range (rand, 0, G_N_ELEMENTS (words))],
+						 i);
+		items[i].description = g_strdup_printf ("Shows the %s %s of the %s",
+							words[g_rand_int_range (rand, 0, G_N_ELEMENTS (words))],
+							words[g_rand_int_range (rand, 0, G_N_ELEMENTS (words))],
+							words[g_rand_int_range (rand, 0, G_N_ELEMENTS (words))]);
+		items[i].name_key = panel_g_utf8_search_key_new (items[i].name);
+		items[i].description_key = panel_g_utf8_search_key_new (items[i].description);
+	}
+
+	g_rand_free (rand);
+
+	return items;
+}
+
+static void
+free_items (TestItem *items,
+	    int       n_items)
+{
+	int i;
+
+	for (i = 0; i < n_items; i++) {
+		g_free (items[i].name);
+		g_free (items[i].description);
+		g_free (items[i].name_key);
+		g_free (items[i].description_key);
+	}
+
+	g_free (items);
+}
+
+/* Matches every item against the text with the search keys and with
+ * panel_g_utf8_strstrcase(); returns the number of items on which they
+ * disagree */
+static int
+check_text (TestItem   *items,
+	    int         n_items,
+	    const char *text,
+	    int        *n_matches)
+{
+	char *key;
+	int   n_errors = 0;
+	int   i;
+
+	key = panel_g_utf8_search_key_new (text);
+	*n_matches = 0;
+
+	for (i = 0; i < n_items; i++) {
+		gboolean expected;
+		gboolean matched;
+
+		expected = (panel_g_utf8_strstrcase (items[i].name, text) != NULL ||
+			    panel_g_utf8_strstrcase (items[i].description, text) != NULL);
+		matched = (panel_g_utf8_search_key_match (items[i].name_key, key) ||
+			   panel_g_utf8_search_key_match (items[i].description_key, key));
+
+		if (matched)
+			(*n_matches)++;
+
+		if (matched != expected) {
+			n_errors++;
+			g_print ("  \"%s\" / \"%s\" %s \"%s\"\n",
+				 items[i].name, items[i].description,
+				 matched ? "matched" : "did not match", text);
+		}
+	}
+
+	g_free (key);
+
+	return n_errors;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+	TestItem *items;
+	int       n_items = 500;
+	int       n_errors = 0;
+	int       i;
+
+	items = make_items (n_items);
+
+	for (i = 0; i < G_N_ELEMENTS (queries); i++) {
+		const char *end;
+
+		/* Every prefix, cut on character boundaries */
+		for (end = g_utf8_next_char (queries[i]);
+		     ;
+		     end = g_utf8_next_char (end)) {
+			char *text;
+			int   n_matches;
+			int   errors;
+
+			text = g_strndup (queries[i], end - queries[i]);
+			errors = check_text (items, n_items, text, &n_matches);
+			n_errors += errors;
+
+			g_print ("%-14s %4d items match%s\n",
+				 text, n_matches, errors ? ", wrong" : "");
+			g_free (text);
+
+			if (*end == '\0')
+				break;
+		}
+	}
+
+	free_items (items, n_items);
+
+	g_print ("%s\n", n_errors == 0 ? "PASS" : "FAIL");
+
+	return n_errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,167 @@
+/*
+ * test-panel-launch.c: benchmark for launching desktop entries from a
+ * button, the way panel launchers do
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <gtk/gtk.h>
+
+#include "panel-keyfile.h"
+#include "panel-launch.h"
+#include "panel-launch-helper.h"
+
+typedef struct {
+	GKeyFile              *key_file;
+	PanelLaunchDescriptor *desc;
+	gboolean               use_desc;
+	gint64                 clicked_time;
+	gint64                 total_time;
+	int                    failures;
+} TestLauncher;
+
+/* Same as launcher_launch(): from the "clicked" emission to the spawn */
+static void
+button_clicked (GtkButton    *button,
+		TestLauncher *launcher)
+{
+	GError   *error = NULL;
+	gboolean  launched;
+
+	if (launcher->use_desc)
+		launched = panel_launch_descriptor_launch (launcher->desc, NULL,
+							   gtk_widget_get_screen (GTK_WIDGET (button)),
+							   GDK_CURRENT_TIME, &error);
+	else
+		launched = panel_launch_key_file (launcher->key_file, NULL,
+						  gtk_widget_get_screen (GTK_WIDGET (button)),
+						  &error);
+
+	launcher->total_time += g_get_monotonic_time () - launcher->clicked_time;
+
+	if (!launched) {
+		if (error)
+			g_printerr ("%s\n", error->message);
+		g_clear_error (&error);
+		launcher->failures++;
+	}
+}
+
+static gint64
+bench_clicks (GtkWidget    *button,
+	      TestLauncher *launcher,
+	      int           n_clicks)
+{
+	int i;
+
+	launcher->total_time = 0;
+
+	for (i = 0; i < n_clicks; i++) {
+		launcher->clicked_time = g_get_monotonic_time ();
+		gtk_button_clicked (GTK_BUTTON (button));
+
+		/* let the child watches reap what was spawned directly */
+		while (g_main_context_iteration (NULL, FALSE))
+			;
+	}
+
+	return launcher->total_time / n_clicks;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+	TestLauncher  launcher = { NULL, };
+	GtkWidget    *button;
+	gint64        key_file_time;
+	gint64        desc_time;
+	int           n_clicks = 100;
+	char         *exec = NULL;
+	gboolean      no_helper = FALSE;
+	int           i;
+
+	GError         *error;
+	GOptionContext *context;
+	GOptionEntry options[] = {
+		{ "clicks", 'n', 0, G_OPTION_ARG_INT, &n_clicks, "Number of clicks per launch path", "N" },
+		{ "exec", 'e', 0, G_OPTION_ARG_STRING, &exec, "Command to launch (default: true)", "COMMAND" },
+		{ "no-helper", 0, 0, G_OPTION_ARG_NONE, &no_helper, "Spawn from this process instead of the launch helper", NULL },
+		{ NULL, 0, 0, 0, NULL, NULL, NULL }
+	};
+
+	/* Like the panel, before anything else */
+	for (i = 1; i < argc; i++) {
+		if (g_strcmp0 (argv[i], "--no-helper") == 0)
+			break;
+	}
+	if (i == argc)
+		panel_launch_helper_start ();
+
+	context = g_option_context_new ("");
+	g_option_context_add_main_entries (context, options, NULL);
+	g_option_context_add_group (context, gtk_get_option_group (TRUE));
+
+	error = NULL;
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		g_option_context_free (context);
+
+		return 1;
+	}
+
+	g_option_context_free (context);
+
+	if (n_clicks <= 0)
+		n_clicks = 1;
+
+	launcher.key_file = panel_key_file_new_desktop ();
+	panel_key_file_set_string (launcher.key_file, "Type", "Application");
+	panel_key_file_set_string (launcher.key_file, "Name", "Benchmark");
+	panel_key_file_set_string (launcher.key_file, "Exec", exec ? exec : "true");
+	panel_key_file_set_boolean (launcher.key_file, "StartupNotify", FALSE);
+
+	launcher.desc = panel_launch_descriptor_new (launcher.key_file);
+	if (!launcher.desc) {
+		g_printerr ("Cannot launch '%s'\n", exec ? exec : "true");
+		return 1;
+	}
+
+	button = gtk_button_new ();
+	g_signal_connect (button, "clicked",
+			  G_CALLBACK (button_clicked), &launcher);
+
+	launcher.use_desc = FALSE;
+	key_file_time = bench_clicks (button, &launcher, n_clicks);
+
+	launcher.use_desc = TRUE;
+	desc_time = bench_clicks (button, &launcher, n_clicks);
+
+	g_print ("%d clicks per path, %s\n", n_clicks,
+		 panel_launch_helper_is_running () ? "through the launch helper" : "spawning directly");
+	g_print ("panel_launch_key_file:          %6" G_GINT64_FORMAT " us per click\n",
+		 key_file_time);
+	g_print ("panel_launch_descriptor_launch: %6" G_GINT64_FORMAT " us per click\n",
+		 desc_time);
+
+	gtk_widget_destroy (button);
+	panel_launch_descriptor_free (launcher.desc);
+	g_key_file_free (launcher.key_file);
+	g_free (exec);
+
+	return launcher.failures > 0 ? 1 : 0;
+}
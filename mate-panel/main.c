@@ -22,6 +22,8 @@
 
 #include <libpanel-util/panel-cleanup.h>
 #include <libpanel-util/panel-glib.h>
+#include <libpanel-util/panel-launch-helper.h>
+#include <libpanel-util/panel-stats.h>
 
 #include "panel-profile.h"
 #include "panel-config-global.h"
@@ -45,6 +47,8 @@ static char*    layout;
 static gboolean replace = FALSE;
 static gboolean reset = FALSE;
 static gboolean run_dialog = FALSE;
+static gboolean stats = FALSE;
+static char*    trace_file = NULL;
 
 static const GOptionEntry options[] = {
   { "replace", 0, 0, G_OPTION_ARG_NONE, &replace, N_("Replace a currently running panel"), NULL },
@@ -54,6 +58,9 @@ static const GOptionEntry options[] = {
   { "run-dialog", 0, 0, G_OPTION_ARG_NONE, &run_dialog, N_("Execute the run dialog"), NULL },
   /* default panels layout */
   { "layout", 0, 0, G_OPTION_ARG_STRING, &layout, N_("Set the default panel layout"), NULL },
+  /* performance statistics, see org.mate.panel.Debug */
+  { "stats", 0, 0, G_OPTION_ARG_NONE, &stats, N_("Collect performance statistics"), NULL },
+  { "trace-file", 0, 0, G_OPTION_ARG_FILENAME, &trace_file, N_("Write a trace of the timed sections to FILE"), N_("FILE") },
   { NULL }
 };
 
@@ -135,6 +142,18 @@ main (int argc, char **argv)
 		return 0;
 	}
 
+	if (trace_file != NULL) {
+		error = NULL;
+		if (!panel_stats_set_trace_file (trace_file, &error)) {
+			g_warning ("%s", error->message);
+			g_error_free (error);
+		}
+		g_free (trace_file);
+	}
+
+	if (stats)
+		panel_stats_set_enabled (TRUE);
+
 	if (!egg_get_desktop_file ()) {
 		g_set_application_name (_("Panel"));
 		gtk_window_set_default_icon_name (PANEL_ICON_PANEL);
@@ -146,6 +165,10 @@ main (int argc, char **argv)
 g_warning("DBUS error :(");
 	}
 
+	/* Fork the launch helper while the process is still small: only
+	 * a panel that is going to run needs one */
+	panel_launch_helper_start ();
+
 	panel_action_protocol_init ();
 	panel_multiscreen_init ();
 	panel_init_stock_icons_and_items ();
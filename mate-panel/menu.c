@@ -34,6 +34,8 @@
 #include <gdk/gdkkeysyms.h>
 
 #include <libpanel-util/panel-keyfile.h>
+#include <libpanel-util/panel-launch.h>
+#include <libpanel-util/panel-stats.h>
 #include <libpanel-util/panel-xdg.h>
 
 #include "launcher.h"
@@ -56,7 +58,6 @@ typedef struct {
     gchar *name;
     gchar *icon;
     gchar *local_name;
-    GtkWidget *menu;
 } cat_info;
 
 static cat_info main_cats[] = {
@@ -1298,11 +1299,16 @@ remove_matemenu_tree_monitor (GtkWidget *menu,
 }
 
 */
+/* Through panel-launch.c, which expands the field codes of Exec and
+ * launches from the launch helper */
 static void
-spawn_app(GtkWidget *widget, gpointer data)
+launch_app(GtkWidget *widget, gpointer data)
 {
-    if (data) {
-        g_spawn_command_line_async(data, NULL);
+    const char *path;
+
+    path = g_object_get_data (G_OBJECT (widget), "panel-menu-desktop-file");
+    if (path) {
+        panel_launch_desktop_file (path, gtk_widget_get_screen (widget), NULL);
     }
 }
 
@@ -1321,310 +1327,583 @@ static char * g_strchr(char *str, int ch)
 	return (NULL);
 }
 
-/* Inserts menu item into menu sorted by name */
+/* Inserts menu item into menu sorted by name, before the items that end
+ * the menu */
 static gint
 _menu_shell_insert_sorted(GtkMenuShell *menu_shell, GtkWidget *mi, const gchar *name)
 {
-    GList *items;
+    GList *items, *l;
     gint i;
     gchar *cmpname;
 
-    //TRACE("dummy");
-
     items = gtk_container_get_children(GTK_CONTAINER(menu_shell));
-    for(i=0; items; items=items->next, i++)  {
-        cmpname = (gchar *)g_object_get_data(G_OBJECT(items->data), "item-name");
+    for(i=0, l=items; l; l=l->next, i++)  {
+        if (g_object_get_data(G_OBJECT(l->data), "panel-menu-tail"))
+            break;
+        cmpname = (gchar *)g_object_get_data(G_OBJECT(l->data), "item-name");
         if(cmpname && g_ascii_strcasecmp(name, cmpname) < 0)
             break;
     }
+    g_list_free(items);
     gtk_menu_shell_insert(menu_shell, mi, i);
     return i;
 }
 
-/* Scans directory 'path' for application files and builds corresponding entries
- * in category menus. If application belongs to several categories, first one
- * is used.
+/*
+ * The applications menus are built from the desktop files of the
+ * applications directories, one file at a time, so that the loading can
+ * be spread over idle slices with panel_menu_load(). A menu shown before
+ * it is complete finishes loading first.
+ *
+ * The directories read are monitored, and a change to a desktop file
+ * only replaces the items of that file.
  */
+
+/* Files without categories are only listed from there */
+#define PANEL_MENU_DIRECT_DIR           "/usr/share/applications"
+#define PANEL_MENU_SKIPPED_DIR          "/usr/local/share/applications"
+
+#define PANEL_MENU_PREWARM_DELAY_SECONDS 2
+#define PANEL_MENU_PREWARM_SLICE_US      (4 * 1000)
+
+typedef struct {
+	char         *path;
+	GFileMonitor *monitor;
+
+	guint         categories : 1; /* files with categories go to the category submenus */
+	guint         direct : 1;     /* files without categories go to the top level */
+	guint         scanned : 1;
+} PanelMenuDir;
+
+typedef struct {
+	GtkWidget  *menu;
+	GKeyFile   *keyfile;
+
+	/* PanelMenuDir, in loading order */
+	GPtrArray  *dirs;
+	guint       next_dir;
+	GDir       *gdir;
+
+	GtkWidget  *category_items [G_N_ELEMENTS (main_cats)];
+	GtkWidget  *category_menus [G_N_ELEMENTS (main_cats)];
+
+	guint       prewarm_id;
+	gint64      busy;
+	gboolean    loaded;
+} PanelMenuLoader;
+
 static void
-do_app_dir(GHashTable *ht, GtkWidget *menu, const gchar *path)
-{
-    GDir* dir;
-    const gchar* name;
-    gchar *cwd, **cats, **tmp, *exec, *title, *icon, *dot, *srt;
-    GKeyFile*  file;
-
-    // skip already proceeded dirs to prevent duplicate entries
-    if (g_hash_table_lookup(ht, path))
-        return;
-    g_hash_table_insert(ht, (void *)path, menu);
-    dir = g_dir_open(path, 0, NULL);
-    if (!dir)
-        return;
-    cwd = g_get_current_dir();
-    g_chdir(path);
-    file = g_key_file_new();
-    while ((name = g_dir_read_name(dir))) {
-        if (g_file_test(name, G_FILE_TEST_IS_DIR)) {
-			g_warning("do_app_dir3 %s", name);
-            do_app_dir(ht, menu, name);
-            continue;
-        }
-        if (!g_str_has_suffix(name, ".desktop"))
-            continue;
-        if (!g_key_file_load_from_file(file, name, 0, NULL))
-            continue;
-        if (g_key_file_get_boolean(file, desktop_ent, "NoDisplay", NULL))
-            continue;
-        if (g_key_file_has_key(file, desktop_ent, "OnlyShowIn", NULL))
-            continue;
-        if (!(cats = g_key_file_get_string_list(file, desktop_ent, "Categories", NULL, NULL)))
-            continue;
-        srt = g_key_file_get_string(file, desktop_ent, "Sort", NULL);
-        if (!(exec = g_key_file_get_string(file, desktop_ent, "Exec", NULL)))
-            goto free_cats;
-
-        /* ignore program arguments */
-        while ((dot = g_strchr(exec, '%'))) {
-            if (dot[1] != '\0')
-                dot[0] = dot[1] = ' ';
-        }
-        if (!(title = g_key_file_get_locale_string(file, desktop_ent, "Name", NULL, NULL)))
-            goto free_exec;
-        icon = g_key_file_get_string(file, desktop_ent, "Icon", NULL);
-        if (icon) {
-            /* if icon is not a absolute path, drop an extenstion (if any)
-             * to allow to load it as themable icon */
-            dot = g_strchr( icon, '.' ); // FIXME: get last dot not first
-            if(icon[0] !='/' && dot )
-                *dot = '\0';
-        }
-if (cats != NULL) {
-        for (tmp = cats; *tmp; tmp++) {
-            GtkWidget **menu, *mi, *img;
-
-            if (!(menu = g_hash_table_lookup( ht, tmp[0])))
-                continue;
-
-            mi = gtk_image_menu_item_new_with_label(title);
-            /* menu_item_set_image(mi, icon, icon, 22, 22); */
-            
-            img = gtk_image_new_from_icon_name(icon, GTK_ICON_SIZE_MENU);
-			gtk_image_menu_item_set_image(GTK_IMAGE_MENU_ITEM(mi), img);
-			gtk_image_menu_item_set_always_show_image(GTK_IMAGE_MENU_ITEM(mi),TRUE);
-
-            /* exec str is referenced as mi's object data and will be automatically fried 
-             * upon mi's destruction. it was allocated by g_key_get_string */
-            g_signal_connect(G_OBJECT(mi), "activate", (GCallback)spawn_app, exec);
-            g_object_set_data_full(G_OBJECT(mi), "exec", exec, g_free);
-
-            if (!(*menu))
-                *menu = gtk_menu_new();
-            g_object_set_data_full(G_OBJECT(mi), "item-name", title, g_free);
-if (srt == NULL)
-            _menu_shell_insert_sorted(GTK_MENU_SHELL(*menu), mi, title);
-else
-            _menu_shell_insert_sorted(GTK_MENU_SHELL(*menu), mi, srt);
-            //gtk_menu_shell_prepend(GTK_MENU_SHELL(*menu), mi);
-            gtk_widget_show_all(mi);
-            break;
-        }
+panel_menu_dir_free (PanelMenuDir *dir)
+{
+	if (dir->monitor) {
+		g_file_monitor_cancel (dir->monitor);
+		g_object_unref (dir->monitor);
+	}
+	dir->monitor = NULL;
+
+	g_free (dir->path);
+	g_slice_free (PanelMenuDir, dir);
 }
-        g_free(icon);
-    free_exec:
-    free_cats:
-        g_strfreev(cats);
-    }
-    g_key_file_free(file);
-    g_dir_close(dir);
-    g_chdir(cwd);
-    g_free(cwd);
+
+static void
+panel_menu_loader_free (PanelMenuLoader *loader)
+{
+	guint i;
+
+	if (loader->prewarm_id)
+		g_source_remove (loader->prewarm_id);
+	loader->prewarm_id = 0;
+
+	for (i = 0; i < loader->dirs->len; i++) {
+		PanelMenuDir *dir = g_ptr_array_index (loader->dirs, i);
+
+		if (dir->monitor)
+			g_signal_handlers_disconnect_matched (dir->monitor,
+							      G_SIGNAL_MATCH_DATA,
+							      0, 0, NULL, NULL,
+							      loader);
+	}
+	g_ptr_array_free (loader->dirs, TRUE);
+
+	if (loader->gdir)
+		g_dir_close (loader->gdir);
+	loader->gdir = NULL;
+
+	g_key_file_free (loader->keyfile);
+
+	g_slice_free (PanelMenuLoader, loader);
 }
 
 static void
-do_app_direct(GHashTable *ht, GtkWidget *menu, const gchar *path)
-{
-    GDir* dir;
-    const gchar* name;
-    gchar *cwd, **cats, *exec, *title, *icon, *dot, *srt;
-    GKeyFile*  file;
-
-    dir = g_dir_open(path, 0, NULL);
-    if (!dir)
-        return;
-    cwd = g_get_current_dir();
-    g_chdir(path);
-    file = g_key_file_new();
-    while ((name = g_dir_read_name(dir))) {
-        if (g_file_test(name, G_FILE_TEST_IS_DIR)) {
-//            do_app_dir(m, name);
-            continue;
-        }
-        if (!g_str_has_suffix(name, ".desktop"))
-            continue;
-        if (!g_key_file_load_from_file(file, name, 0, NULL))
-            continue;
-        if (g_key_file_get_boolean(file, desktop_ent, "NoDisplay", NULL))
-            continue;
-        if (g_key_file_has_key(file, desktop_ent, "OnlyShowIn", NULL))
-            continue;
-        if (!(cats = g_key_file_get_string_list(file, desktop_ent, "Categories", NULL, NULL)))
-			;
-			else
-            continue;
-        srt = g_key_file_get_string(file, desktop_ent, "Sort", NULL);
-        if (!(exec = g_key_file_get_string(file, desktop_ent, "Exec", NULL)))
-            goto free_cats;
-
-        /* ignore program arguments */
-        while ((dot = g_strchr(exec, '%'))) {
-            if (dot[1] != '\0')
-                dot[0] = dot[1] = ' ';
-        }
-        if (!(title = g_key_file_get_locale_string(file, desktop_ent, "Name", NULL, NULL)))
-            goto free_exec;
-        if ((exec[0] == '-') && (exec[1] == '\0')){
-    GtkWidget *mi;
-	mi = gtk_separator_menu_item_new();
-//    gtk_menu_shell_append (GTK_MENU_SHELL (m->menu), mi);
-if (srt == NULL)
-            _menu_shell_insert_sorted(GTK_MENU_SHELL(menu), mi, title);
-else
-            _menu_shell_insert_sorted(GTK_MENU_SHELL(menu), mi, srt);
-    gtk_widget_show_all(mi);
-			goto free_exec;
+panel_menu_loader_add_dir (PanelMenuLoader *loader,
+			   const char      *path,
+			   gboolean         categories,
+			   gboolean         direct)
+{
+	PanelMenuDir *dir;
+	guint         i;
+
+	for (i = 0; i < loader->dirs->len; i++) {
+		dir = g_ptr_array_index (loader->dirs, i);
+
+		if (strcmp (dir->path, path) == 0) {
+			dir->categories |= categories != FALSE;
+			dir->direct     |= direct != FALSE;
+			return;
 		}
-        icon = g_key_file_get_string(file, desktop_ent, "Icon", NULL);
-        if (icon) {
-            /* if icon is not a absolute path, drop an extenstion (if any)
-             * to allow to load it as themable icon */
-            dot = g_strchr( icon, '.' ); // FIXME: get last dot not first
-            if(icon[0] !='/' && dot )
-                *dot = '\0';
-        }
-if (cats == NULL) {
-//            GtkWidget **menu, *mi, *img;
-          GtkWidget *mi, *img;
- //           if (!(menu = g_hash_table_lookup( m->ht, "-")))
-//                continue;
-
-            mi = gtk_image_menu_item_new_with_label(title);
-            /* menu_item_set_image(mi, icon, icon, 22, 22); */
-            
-            img = gtk_image_new_from_icon_name(icon, GTK_ICON_SIZE_MENU);
-			gtk_image_menu_item_set_image(GTK_IMAGE_MENU_ITEM(mi), img);
-			gtk_image_menu_item_set_always_show_image(GTK_IMAGE_MENU_ITEM(mi),TRUE);
-
-            /* exec str is referenced as mi's object data and will be automatically fried 
-             * upon mi's destruction. it was allocated by g_key_get_string */
-            g_signal_connect(G_OBJECT(mi), "activate", (GCallback)spawn_app, exec);
-            g_object_set_data_full(G_OBJECT(mi), "exec", exec, g_free);
-
-  //          if (!(*menu))
- //               *menu = gtk_menu_new();
-            g_object_set_data_full(G_OBJECT(mi), "item-name", title, g_free);
-//            _menu_shell_insert_sorted(GTK_MENU_SHELL(*menu), mi, title);
-            //gtk_menu_shell_prepend(GTK_MENU_SHELL(*menu), mi);
-
-if (srt == NULL)
-            _menu_shell_insert_sorted(GTK_MENU_SHELL(menu), mi, title);
-else
-            _menu_shell_insert_sorted(GTK_MENU_SHELL(menu), mi, srt);
-//    gtk_menu_shell_append (GTK_MENU_SHELL (m->menu), mi);
-
-            gtk_widget_show_all(mi);
-        }
-        g_free(icon);
-    free_exec:
-    free_cats:
-        g_strfreev(cats);
-    }
-    g_key_file_free(file);
-    g_dir_close(dir);
-    g_chdir(cwd);
-    g_free(cwd);
+	}
+
+	dir = g_slice_new0 (PanelMenuDir);
+	dir->path       = g_strdup (path);
+	dir->categories = categories != FALSE;
+	dir->direct     = direct != FALSE;
+
+	g_ptr_array_add (loader->dirs, dir);
+}
+
+static int
+panel_menu_category_lookup (const char *name)
+{
+	int i;
+
+	for (i = 0; i < G_N_ELEMENTS (main_cats); i++) {
+		if (strcmp (main_cats [i].name, name) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+static GtkWidget *
+panel_menu_loader_get_category_menu (PanelMenuLoader *loader,
+				     int              category)
+{
+	GtkWidget  *item;
+	GtkWidget  *image;
+	const char *name;
+	int         position;
+	int         i;
+
+	if (loader->category_menus [category])
+		return loader->category_menus [category];
+
+	name = main_cats [category].local_name ? main_cats [category].local_name
+					       : main_cats [category].name;
+
+	item = gtk_image_menu_item_new_with_label (name);
+	image = gtk_image_new_from_icon_name (main_cats [category].icon, GTK_ICON_SIZE_MENU);
+	gtk_image_menu_item_set_image (GTK_IMAGE_MENU_ITEM (item), image);
+	gtk_image_menu_item_set_always_show_image (GTK_IMAGE_MENU_ITEM (item), TRUE);
+
+	loader->category_items [category] = item;
+	loader->category_menus [category] = gtk_menu_new ();
+	gtk_menu_item_set_submenu (GTK_MENU_ITEM (item),
+				   loader->category_menus [category]);
+
+	/* The categories come first, in the order of main_cats */
+	position = 0;
+	for (i = 0; i < category; i++) {
+		if (loader->category_items [i])
+			position++;
+	}
+
+	gtk_menu_shell_insert (GTK_MENU_SHELL (loader->menu), item, position);
+	gtk_widget_show_all (item);
+
+	return loader->category_menus [category];
+}
+
+static void
+panel_menu_loader_add_file (PanelMenuLoader *loader,
+			    PanelMenuDir    *dir,
+			    const char      *path)
+{
+	GKeyFile   *file = loader->keyfile;
+	GtkWidget  *menu;
+	GtkWidget  *mi;
+	GtkWidget  *img;
+	char      **cats;
+	char       *exec;
+	char       *title;
+	char       *icon;
+	char       *srt;
+	char       *dot;
+	int         category = -1;
+	int         i;
+
+	if (!g_str_has_suffix (path, ".desktop"))
+		return;
+	if (!g_key_file_load_from_file (file, path, 0, NULL))
+		return;
+	if (g_key_file_get_boolean (file, desktop_ent, "NoDisplay", NULL))
+		return;
+	if (g_key_file_has_key (file, desktop_ent, "OnlyShowIn", NULL))
+		return;
+
+	cats = g_key_file_get_string_list (file, desktop_ent, "Categories", NULL, NULL);
+	if (cats) {
+		/* The first category known is used */
+		for (i = 0; dir->categories && cats [i] && category < 0; i++)
+			category = panel_menu_category_lookup (cats [i]);
+		g_strfreev (cats);
+
+		if (category < 0)
+			return;
+	} else if (!dir->direct) {
+		return;
+	}
+
+	if (!(exec = g_key_file_get_string (file, desktop_ent, "Exec", NULL)))
+		return;
+
+	if (!(title = g_key_file_get_locale_string (file, desktop_ent, "Name", NULL, NULL))) {
+		g_free (exec);
+		return;
+	}
+
+	srt = g_key_file_get_string (file, desktop_ent, "Sort", NULL);
+
+	if (category >= 0)
+		menu = panel_menu_loader_get_category_menu (loader, category);
+	else
+		menu = loader->menu;
+
+	if (category < 0 && strcmp (exec, "-") == 0) {
+		mi = gtk_separator_menu_item_new ();
+		g_free (exec);
+	} else {
+		icon = g_key_file_get_string (file, desktop_ent, "Icon", NULL);
+		if (icon) {
+			/* if icon is not a absolute path, drop an extenstion (if any)
+			 * to allow to load it as themable icon */
+			dot = g_strchr (icon, '.'); // FIXME: get last dot not first
+			if (icon[0] != '/' && dot)
+				*dot = '\0';
+		}
+
+		mi = gtk_image_menu_item_new_with_label (title);
+		img = gtk_image_new_from_icon_name (icon, GTK_ICON_SIZE_MENU);
+		gtk_image_menu_item_set_image (GTK_IMAGE_MENU_ITEM (mi), img);
+		gtk_image_menu_item_set_always_show_image (GTK_IMAGE_MENU_ITEM (mi), TRUE);
+		g_free (icon);
+
+		g_signal_connect (G_OBJECT (mi), "activate", G_CALLBACK (launch_app), NULL);
+		g_free (exec);
+		g_object_set_data_full (G_OBJECT (mi), "item-name", g_strdup (title), g_free);
+	}
+
+	g_object_set_data_full (G_OBJECT (mi), "panel-menu-desktop-file",
+				g_strdup (path), g_free);
+
+	_menu_shell_insert_sorted (GTK_MENU_SHELL (menu), mi, srt ? srt : title);
+	gtk_widget_show_all (mi);
+
+	g_free (title);
+	g_free (srt);
+}
+
+static void
+panel_menu_remove_desktop_file (GtkWidget  *menu,
+				const char *path)
+{
+	GList *children;
+	GList *l;
+
+	children = gtk_container_get_children (GTK_CONTAINER (menu));
+	for (l = children; l; l = l->next) {
+		if (g_strcmp0 (g_object_get_data (l->data, "panel-menu-desktop-file"), path) == 0)
+			gtk_widget_destroy (l->data);
+	}
+	g_list_free (children);
+}
+
+static void
+panel_menu_loader_remove_file (PanelMenuLoader *loader,
+			       const char      *path)
+{
+	GList *children;
+	int    i;
+
+	panel_menu_remove_desktop_file (loader->menu, path);
+
+	for (i = 0; i < G_N_ELEMENTS (main_cats); i++) {
+		if (!loader->category_menus [i])
+			continue;
+
+		panel_menu_remove_desktop_file (loader->category_menus [i], path);
+
+		children = gtk_container_get_children (GTK_CONTAINER (loader->category_menus [i]));
+		if (!children) {
+			/* Destroys the submenu too */
+			gtk_widget_destroy (loader->category_items [i]);
+			loader->category_items [i] = NULL;
+			loader->category_menus [i] = NULL;
+		}
+		g_list_free (children);
+	}
+}
+
+static void
+panel_menu_loader_dir_changed (GFileMonitor      *monitor,
+			       GFile             *file,
+			       GFile             *other_file,
+			       GFileMonitorEvent  event,
+			       PanelMenuLoader   *loader)
+{
+	PanelMenuDir *dir = NULL;
+	char         *path;
+	guint         i;
+
+	if (event != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT &&
+	    event != G_FILE_MONITOR_EVENT_CREATED &&
+	    event != G_FILE_MONITOR_EVENT_DELETED)
+		return;
+
+	for (i = 0; i < loader->dirs->len && !dir; i++) {
+		if (((PanelMenuDir *) g_ptr_array_index (loader->dirs, i))->monitor == monitor)
+			dir = g_ptr_array_index (loader->dirs, i);
+	}
+
+	/* The directory being read picks its changes up by itself */
+	if (!dir || !dir->scanned)
+		return;
+
+	path = g_file_get_path (file);
+
+	if (path && g_str_has_suffix (path, ".desktop")) {
+		panel_menu_loader_remove_file (loader, path);
+		panel_menu_loader_add_file (loader, dir, path);
+
+		PANEL_STATS_COUNT ("menu-desktop-file-reload");
+	}
+
+	g_free (path);
+}
+
+static void
+panel_menu_loader_finish (PanelMenuLoader *loader)
+{
+	GtkWidget *mi;
+	GtkWidget *img;
+	GtkWidget *sep;
+
+	loader->loaded = TRUE;
+
+	if (!g_file_test (DEFAULT_QUIT_COMMAND, G_FILE_TEST_EXISTS))
+		return;
+
+	/* The items added later are inserted before those */
+	sep = gtk_separator_menu_item_new ();
+	g_object_set_data (G_OBJECT (sep), "panel-menu-tail", GINT_TO_POINTER (TRUE));
+	gtk_menu_shell_append (GTK_MENU_SHELL (loader->menu), sep);
+	gtk_widget_show_all (sep);
+
+	mi = gtk_image_menu_item_new_with_label ("Quit");
+	img = gtk_image_new_from_icon_name ("system-shutdown", GTK_ICON_SIZE_MENU);
+	gtk_image_menu_item_set_image (GTK_IMAGE_MENU_ITEM (mi), img);
+	gtk_image_menu_item_set_always_show_image (GTK_IMAGE_MENU_ITEM (mi), TRUE);
+	g_object_set_data (G_OBJECT (mi), "panel-menu-tail", GINT_TO_POINTER (TRUE));
+
+	g_signal_connect (G_OBJECT (mi), "activate", G_CALLBACK (quit_app), NULL);
+
+	gtk_menu_shell_append (GTK_MENU_SHELL (loader->menu), mi);
+	gtk_widget_show_all (mi);
+}
+
+/* Reads one entry of the current directory, or moves to the next one */
+static void
+panel_menu_loader_step (PanelMenuLoader *loader)
+{
+	PanelMenuDir *dir;
+	GFile        *file;
+	const char   *name;
+	char         *path;
+
+	if (loader->next_dir >= loader->dirs->len) {
+		panel_menu_loader_finish (loader);
+		return;
+	}
+
+	dir = g_ptr_array_index (loader->dirs, loader->next_dir);
+
+	if (!loader->gdir) {
+		/* Watched even if missing, the user directory may come later */
+		file = g_file_new_for_path (dir->path);
+		dir->monitor = g_file_monitor_directory (file, G_FILE_MONITOR_NONE,
+							 NULL, NULL);
+		g_object_unref (file);
+
+		if (dir->monitor)
+			g_signal_connect (dir->monitor, "changed",
+					  G_CALLBACK (panel_menu_loader_dir_changed),
+					  loader);
+
+		loader->gdir = g_dir_open (dir->path, 0, NULL);
+		if (!loader->gdir) {
+			dir->scanned = TRUE;
+			loader->next_dir++;
+		}
+		return;
+	}
+
+	if (!(name = g_dir_read_name (loader->gdir))) {
+		g_dir_close (loader->gdir);
+		loader->gdir = NULL;
+
+		dir->scanned = TRUE;
+		loader->next_dir++;
+		return;
+	}
+
+	path = g_build_filename (dir->path, name, NULL);
+
+	if (g_file_test (path, G_FILE_TEST_IS_DIR)) {
+		if (dir->categories)
+			panel_menu_loader_add_dir (loader, path, TRUE, FALSE);
+	} else {
+		panel_menu_loader_add_file (loader, dir, path);
+	}
+
+	g_free (path);
+}
+
+static PanelMenuLoader *
+panel_menu_loader_new (GtkWidget *menu)
+{
+	PanelMenuLoader     *loader;
+	const char * const  *sys_dirs;
+	char                *path;
+	int                  i;
+
+	loader = g_slice_new0 (PanelMenuLoader);
+	loader->menu    = menu;
+	loader->keyfile = g_key_file_new ();
+	loader->dirs    = g_ptr_array_new_with_free_func ((GDestroyNotify) panel_menu_dir_free);
+
+	sys_dirs = g_get_system_data_dirs ();
+	for (i = 0; sys_dirs [i]; i++) {
+		path = g_build_filename (sys_dirs [i], app_dir_name, NULL);
+		if (strcmp (path, PANEL_MENU_SKIPPED_DIR) != 0)
+			panel_menu_loader_add_dir (loader, path, TRUE, FALSE);
+		g_free (path);
+	}
+
+	path = g_build_filename (g_get_user_data_dir (), app_dir_name, NULL);
+	panel_menu_loader_add_dir (loader, path, TRUE, FALSE);
+	g_free (path);
+
+	panel_menu_loader_add_dir (loader, PANEL_MENU_DIRECT_DIR, FALSE, TRUE);
+
+	return loader;
+}
+
+/* Loads the menu for about budget microseconds, or completely if budget
+ * is negative. Returns TRUE once the menu is complete. */
+gboolean
+panel_menu_load (GtkWidget *menu,
+		 gint64     budget)
+{
+	PanelMenuLoader *loader;
+	gint64           start;
+	gint64           now;
+
+	g_return_val_if_fail (GTK_IS_MENU (menu), TRUE);
+
+	loader = g_object_get_data (G_OBJECT (menu), "panel-menu-loader");
+	if (!loader || loader->loaded)
+		return TRUE;
+
+	start = now = g_get_monotonic_time ();
+
+	while (!loader->loaded && (budget < 0 || now - start < budget)) {
+		panel_menu_loader_step (loader);
+		now = g_get_monotonic_time ();
+	}
+
+	loader->busy += now - start;
+	PANEL_STATS_COUNT ("menu-load-slice");
+
+	if (loader->loaded)
+		PANEL_STATS_RECORD ("menu-load-us", loader->busy);
+
+	return loader->loaded;
 }
 
+static gboolean
+panel_menu_prewarm_slice (PanelMenuLoader *loader)
+{
+	if (!panel_menu_load (loader->menu, PANEL_MENU_PREWARM_SLICE_US))
+		return TRUE;
+
+	loader->prewarm_id = 0;
+	PANEL_STATS_COUNT ("menu-prewarmed");
+
+	return FALSE;
+}
+
+static gboolean
+panel_menu_prewarm_wait (PanelMenuLoader *loader)
+{
+	if (!mate_panel_applets_loaded ())
+		return TRUE;
+
+	/* Low priority slices leave the way to anything else going on */
+	loader->prewarm_id = g_idle_add_full (G_PRIORITY_LOW,
+					      (GSourceFunc) panel_menu_prewarm_slice,
+					      loader, NULL);
+
+	return FALSE;
+}
+
+/* Loads the menu in the background, once the applets are loaded and the
+ * panel has nothing else to do */
 void
-make_fdo_menu(GHashTable *ht, GtkWidget *menu)
-{
-    const char** sys_dirs = (const char**)g_get_system_data_dirs();
-    int i; int j; int f = -1;
-    gchar *path; gchar *paths;
-
-    ht = g_hash_table_new(g_str_hash, g_str_equal);
-    for (i = 0; i < G_N_ELEMENTS(main_cats); i++) {
-        g_hash_table_insert(ht, main_cats[i].name, &main_cats[i].menu);
-        main_cats[i].menu = NULL;
-/*        if (g_hash_table_lookup(m->ht, &main_cats[i].name))
-            g_print("%s not found\n", main_cats[i].name);
-*/    }
-
-    for (i = 0; i < g_strv_length((gchar **)sys_dirs); ++i)    {
-        path = g_build_filename(sys_dirs[i], app_dir_name, NULL );
-			f = -1;
-    for (j = 0; j < g_strv_length((gchar **)sys_dirs); ++j)    {
-			if (i != j){
-        paths = g_build_filename(sys_dirs[j], app_dir_name, NULL );
-					if (g_ascii_strcasecmp(path,paths)==0){
-	//					        g_print("DUP!: %s\n", paths);
-					f = j;
-				}
-        g_free(paths);}
-    }
-		if (f > i )
-			;
-//			g_print("nop %s\n", path);
-		else {
-			if (g_ascii_strcasecmp(path,"/usr/local/share/applications")==0){
-				//g_warning("do_app_dir1 skip %s", path);
-			} else {
-				//g_warning("do_app_dir1 %s", path);
-				do_app_dir(ht, menu, path);
-			}
-			}
-        g_free(path);
-    }
+panel_menu_prewarm (GtkWidget *menu)
+{
+	PanelMenuLoader *loader;
 
+	g_return_if_fail (GTK_IS_MENU (menu));
 
-    path = g_build_filename(g_get_user_data_dir(), app_dir_name, NULL);
-//g_warning("do_app_dir2 %s", path);
-    do_app_dir(ht, menu, path);
-    g_free(path);
-    //build menu
-    for (i = 0; i < G_N_ELEMENTS(main_cats); i++) {
-        GtkWidget *mi, *img;
-        gchar *name;
-
-        if (main_cats[i].menu) {
-            name = main_cats[i].local_name ? main_cats[i].local_name : main_cats[i].name;
-            mi = gtk_image_menu_item_new_with_label(name);
-            /* menu_item_set_image(mi, main_cats[i].icon, NULL, 22, 22); */
-            
-            img = gtk_image_new_from_icon_name(main_cats[i].icon, GTK_ICON_SIZE_MENU);
-			gtk_image_menu_item_set_image(GTK_IMAGE_MENU_ITEM(mi), img);
-			gtk_image_menu_item_set_always_show_image(GTK_IMAGE_MENU_ITEM(mi),TRUE);
-
-            gtk_menu_item_set_submenu (GTK_MENU_ITEM (mi), main_cats[i].menu);
-            gtk_menu_shell_append (GTK_MENU_SHELL (menu), mi);
-            gtk_widget_show_all(mi);
-            gtk_widget_show_all(main_cats[i].menu);
-        }
-    }
-    g_hash_table_destroy(ht);
-		//g_warning("do_app_direct /usr/share/applications");
-        do_app_direct(ht, menu, "/usr/share/applications");
+	loader = g_object_get_data (G_OBJECT (menu), "panel-menu-loader");
+	if (!loader || loader->loaded || loader->prewarm_id)
+		return;
+
+	loader->prewarm_id = g_timeout_add_seconds_full (G_PRIORITY_LOW,
+							 PANEL_MENU_PREWARM_DELAY_SECONDS,
+							 (GSourceFunc) panel_menu_prewarm_wait,
+							 loader, NULL);
+}
+
+static void
+panel_menu_load_on_show (GtkWidget *menu)
+{
+	PanelMenuLoader *loader;
+
+	loader = g_object_get_data (G_OBJECT (menu), "panel-menu-loader");
+	if (!loader || loader->loaded)
+		return;
+
+	PANEL_STATS_COUNT ("menu-load-on-show");
+	panel_menu_load (menu, -1);
 }
 
+static void
+panel_menu_loader_destroy (GtkWidget *menu)
+{
+	/* Stops the monitors and the prewarm along with the items */
+	g_object_set_data (G_OBJECT (menu), "panel-menu-loader", NULL);
+}
 
+/* The menu is empty until it is shown or loaded with panel_menu_load() */
 GtkWidget *
 create_applications_menu (const char *menu_file,
 			  const char *menu_path,
 			  gboolean    always_show_image)
 {
-//	MateMenuTree *tree;
-    GHashTable *ht;
 	GtkWidget *menu;
-	guint      idle_id;
+	gint64     start;
+
+	start = PANEL_STATS_TIMER_START ();
 
 	menu = create_empty_menu ();
 
@@ -1632,76 +1911,26 @@ create_applications_menu (const char *menu_file,
 		g_object_set_data (G_OBJECT (menu),
 				   "panel-menu-force-icon-for-categories",
 				   GINT_TO_POINTER (TRUE));
-	//g_warning("- create_applications_menu !!!");
-    gtk_container_set_border_width(GTK_CONTAINER(menu), 0);
-    make_fdo_menu(ht, menu);
-
-if (g_file_test (DEFAULT_QUIT_COMMAND, G_FILE_TEST_EXISTS )) {
-//if (1 == 1){
-        GtkWidget *mi, *img, *sep;
-			sep = gtk_separator_menu_item_new();
-			gtk_menu_shell_append (GTK_MENU_SHELL (menu), sep);
-			gtk_widget_show_all(sep);
-
-            mi = gtk_image_menu_item_new_with_label("Quit");
-            img = gtk_image_new_from_icon_name("system-shutdown", GTK_ICON_SIZE_MENU);
-			gtk_image_menu_item_set_image(GTK_IMAGE_MENU_ITEM(mi), img);
-			gtk_image_menu_item_set_always_show_image(GTK_IMAGE_MENU_ITEM(mi),TRUE);
-			
-			g_signal_connect(G_OBJECT(mi), "activate", G_CALLBACK(quit_app), NULL);
-
-//            gtk_menu_item_set_submenu (GTK_MENU_ITEM (mi), main_cats[i].menu);
-            gtk_menu_shell_append (GTK_MENU_SHELL (menu), mi);
-            gtk_widget_show_all(mi);
-//            gtk_widget_show_all(main_cats[i].menu);	
-	
-}
-
-/*	tree = matemenu_tree_lookup (menu_file, MATEMENU_TREE_FLAGS_NONE);
-	matemenu_tree_set_sort_key (tree, MATEMENU_TREE_SORT_DISPLAY_NAME);
 
-	g_object_set_data_full (G_OBJECT (menu),
-				"panel-menu-tree",
-				matemenu_tree_ref (tree),
-				(GDestroyNotify) matemenu_tree_unref);
+	gtk_container_set_border_width (GTK_CONTAINER (menu), 0);
 
 	g_object_set_data_full (G_OBJECT (menu),
-				"panel-menu-tree-path",
-				g_strdup (menu_path ? menu_path : "/"),
-				(GDestroyNotify) g_free);
-
-	g_object_set_data (G_OBJECT (menu),
-			   "panel-menu-needs-loading",
-			   GUINT_TO_POINTER (TRUE));
+				"panel-menu-loader",
+				panel_menu_loader_new (menu),
+				(GDestroyNotify) panel_menu_loader_free);
 
 	g_signal_connect (menu, "show",
-			  G_CALLBACK (submenu_to_display), NULL);
-
-	idle_id = g_idle_add_full (G_PRIORITY_LOW,
-				   submenu_to_display_in_idle,
-				   menu,
-				   NULL);
-	g_object_set_data_full (G_OBJECT (menu),
-				"panel-menu-idle-id",
-				GUINT_TO_POINTER (idle_id),
-				remove_submenu_to_display_idle);
-
-	g_signal_connect (menu, "button_press_event",
-			  G_CALLBACK (menu_dummy_button_press_event), NULL);
-
-	matemenu_tree_add_monitor (tree,
-			       (MateMenuTreeChangedFunc) handle_matemenu_tree_changed,
-			       menu);
+			  G_CALLBACK (panel_menu_load_on_show), NULL);
 	g_signal_connect (menu, "destroy",
-			  G_CALLBACK (remove_matemenu_tree_monitor), tree);
+			  G_CALLBACK (panel_menu_loader_destroy), NULL);
 
-	matemenu_tree_unref (tree); */
-	
 	GtkWidget *toplevel = gtk_widget_get_toplevel (menu);
 	GdkScreen *screen = gtk_widget_get_screen(GTK_WIDGET(toplevel));
 	GdkVisual *visual = gdk_screen_get_rgba_visual(screen);
 	gtk_widget_set_visual(GTK_WIDGET(toplevel), visual); 
 
+	PANEL_STATS_TIMER_STOP ("menu-create-applications", start);
+
 	return menu;
 }
 
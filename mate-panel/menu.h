@@ -47,6 +47,10 @@ GtkWidget      *create_applications_menu  (const char  *menu_file,
 					   gboolean    always_show_image);
 GtkWidget      *create_main_menu          (PanelWidget *panel);
 
+gboolean        panel_menu_load           (GtkWidget   *menu,
+					   gint64       budget);
+void            panel_menu_prewarm        (GtkWidget   *menu);
+
 void		setup_internal_applet_drag (GtkWidget             *menuitem,
 					    PanelActionButtonType  type);
 void            setup_uri_drag             (GtkWidget  *menuitem,
@@ -296,11 +296,8 @@ panel_action_connect_server (GtkWidget *widget)
 	screen = gtk_widget_get_screen (GTK_WIDGET (widget));
 	error = NULL;
 
-	if (panel_is_program_in_path ("caja-connect-server"))
-		command = g_strdup ("caja-connect-server");
-	else if (panel_is_program_in_path ("nautilus-connect-server"))
-		command = g_strdup ("nautilus-connect-server");
-	else
+	command = g_strdup (panel_capability_get_program (PANEL_CAPABILITY_CONNECT_SERVER));
+	if (!command)
 		command = g_strdup ("nemo-connect-server");
 
 //	mate_gdk_spawn_command_line_on_screen (screen, command, &error);
@@ -688,8 +685,13 @@ panel_action_button_connect_to_gsettings (PanelActionButton *button)
 	g_free (signal_name);
 	g_free (settings_path);
 
-	panel_lockdown_notify_add (G_CALLBACK (panel_action_button_update_sensitivity),
-				   button);
+	/* The keys the is_disabled functions of the actions look at */
+	panel_lockdown_notify_add_keys (PANEL_LOCKDOWN_DISABLE_COMMAND_LINE |
+					PANEL_LOCKDOWN_DISABLE_LOCK_SCREEN |
+					PANEL_LOCKDOWN_DISABLE_LOG_OUT |
+					PANEL_LOCKDOWN_DISABLE_FORCE_QUIT,
+					G_CALLBACK (panel_action_button_update_sensitivity),
+					button);
 }
 
 static void
@@ -0,0 +1,114 @@
+/*
+ * panel-addto-private.h: internals of the Add to Panel dialog, for its test
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __PANEL_ADDTO_PRIVATE_H__
+#define __PANEL_ADDTO_PRIVATE_H__
+
+#include <gtk/gtk.h>
+#include "panel-widget.h"
+#include "panel-action-button.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	PANEL_ADDTO_APPLET,
+	PANEL_ADDTO_ACTION,
+	PANEL_ADDTO_LAUNCHER_MENU,
+	PANEL_ADDTO_LAUNCHER,
+	PANEL_ADDTO_LAUNCHER_NEW,
+	PANEL_ADDTO_MENU,
+	PANEL_ADDTO_MENUBAR,
+	PANEL_ADDTO_SEPARATOR,
+	PANEL_ADDTO_DRAWER
+} PanelAddtoItemType;
+
+typedef struct {
+	PanelAddtoItemType     type;
+	char                  *name;
+	char                  *description;
+	char                  *icon;
+	PanelActionButtonType  action_type;
+	char                  *launcher_path;
+	char                  *menu_filename;
+	char                  *menu_path;
+	char                  *iid;
+	gboolean               static_data;
+
+	/* see panel_g_utf8_search_key_new() */
+	char                  *name_key;
+	char                  *description_key;
+} PanelAddtoItemInfo;
+
+typedef struct {
+	PanelWidget *panel_widget;
+
+	GtkWidget    *addto_dialog;
+	GtkWidget    *label;
+	GtkWidget    *search_entry;
+	GtkWidget    *back_button;
+	GtkWidget    *add_button;
+	GtkWidget    *tree_view;
+	GtkTreeModel *applet_model;
+	GtkTreeModel *filter_applet_model;
+	GtkTreeModel *application_model;
+	GtkTreeModel *filter_application_model;
+
+	GSList       *applet_list;
+	GSList       *application_list;
+	GSList       *settings_list;
+
+	gchar        *search_text;
+	gchar        *search_key;
+	gchar        *applet_search_text;
+
+	/* Serial of the last search key each item matched. Some items are
+	 * static and shared with the dialogs of other panels, so this
+	 * cannot be kept in the items. */
+	GHashTable   *match_serials;
+	guint         search_serial;
+	guint         previous_search_serial;
+	gboolean      search_narrowing;
+
+	int           insertion_position;
+} PanelAddtoDialog;
+
+enum {
+	COLUMN_ICON_NAME,
+	COLUMN_TEXT,
+	COLUMN_DATA,
+	COLUMN_SEARCH,
+	NUMBER_COLUMNS
+};
+
+void     panel_addto_item_info_make_search_keys (PanelAddtoItemInfo *item_info);
+void     panel_addto_dialog_free_item_info      (PanelAddtoItemInfo *item_info);
+
+gboolean panel_addto_set_search_text            (PanelAddtoDialog   *dialog,
+						 const char         *text);
+gboolean panel_addto_filter_func                (GtkTreeModel       *model,
+						 GtkTreeIter        *iter,
+						 gpointer            userdata);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PANEL_ADDTO_PRIVATE_H__ */
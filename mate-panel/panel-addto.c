@@ -49,61 +49,13 @@
 #include "panel-util.h"
 #include "panel-profile.h"
 #include "panel-addto.h"
+#include "panel-addto-private.h"
 #include "panel-icon-names.h"
 #include "panel-schemas.h"
 #include "panel-stock-icons.h"
 
-typedef struct {
-	PanelWidget *panel_widget;
-
-	GtkWidget    *addto_dialog;
-	GtkWidget    *label;
-	GtkWidget    *search_entry;
-	GtkWidget    *back_button;
-	GtkWidget    *add_button;
-	GtkWidget    *tree_view;
-	GtkTreeModel *applet_model;
-	GtkTreeModel *filter_applet_model;
-	GtkTreeModel *application_model;
-	GtkTreeModel *filter_application_model;
-
-	GSList       *applet_list;
-	GSList       *application_list;
-	GSList       *settings_list;
-
-	gchar        *search_text;
-	gchar        *applet_search_text;
-
-	int           insertion_position;
-} PanelAddtoDialog;
-
 static GQuark panel_addto_dialog_quark = 0;
 
-typedef enum {
-	PANEL_ADDTO_APPLET,
-	PANEL_ADDTO_ACTION,
-	PANEL_ADDTO_LAUNCHER_MENU,
-	PANEL_ADDTO_LAUNCHER,
-	PANEL_ADDTO_LAUNCHER_NEW,
-	PANEL_ADDTO_MENU,
-	PANEL_ADDTO_MENUBAR,
-	PANEL_ADDTO_SEPARATOR,
-	PANEL_ADDTO_DRAWER
-} PanelAddtoItemType;
-
-typedef struct {
-	PanelAddtoItemType     type;
-	char                  *name;
-	char                  *description;
-	char                  *icon;
-	PanelActionButtonType  action_type;
-	char                  *launcher_path;
-	char                  *menu_filename;
-	char                  *menu_path;
-	char                  *iid;
-	gboolean               static_data;
-} PanelAddtoItemInfo;
-
 typedef struct {
 	GSList             *children;
 	PanelAddtoItemInfo  item_info;
@@ -182,14 +134,6 @@ static PanelAddtoItemInfo internal_addto_items [] = {
 	  TRUE }
 };
 
-enum {
-	COLUMN_ICON_NAME,
-	COLUMN_TEXT,
-	COLUMN_DATA,
-	COLUMN_SEARCH,
-	NUMBER_COLUMNS
-};
-
 enum {
 	PANEL_ADDTO_RESPONSE_BACK,
 	PANEL_ADDTO_RESPONSE_ADD
@@ -197,9 +141,15 @@ enum {
 
 static void panel_addto_present_applications (PanelAddtoDialog *dialog);
 static void panel_addto_present_applets      (PanelAddtoDialog *dialog);
-static gboolean panel_addto_filter_func (GtkTreeModel *model,
-					 GtkTreeIter  *iter,
-					 gpointer      data);
+
+void
+panel_addto_item_info_make_search_keys (PanelAddtoItemInfo *item_info)
+{
+	if (item_info->name_key == NULL)
+		item_info->name_key = panel_g_utf8_search_key_new (item_info->name);
+	if (item_info->description_key == NULL)
+		item_info->description_key = panel_g_utf8_search_key_new (item_info->description);
+}
 
 static int
 panel_addto_applet_info_sort_func (PanelAddtoItemInfo *a,
@@ -427,6 +377,8 @@ panel_addto_append_item (PanelAddtoDialog *dialog,
 	} else {
 		gtk_list_store_append (model, &iter);
 
+		panel_addto_item_info_make_search_keys (applet);
+
 		text = panel_addto_make_text (applet->name,
 					      applet->description);
 
@@ -629,6 +581,8 @@ panel_addto_populate_application_model (GtkTreeStore *store,
 		data = app->data;
 		gtk_tree_store_append (store, &iter, parent);
 
+		panel_addto_item_info_make_search_keys (&data->item_info);
+
 		text = panel_addto_make_text (data->item_info.name,
 					      data->item_info.description);
 		gtk_tree_store_set (store, &iter,
@@ -832,6 +786,8 @@ panel_addto_present_applets (PanelAddtoDialog *dialog)
 {
 	if (dialog->filter_applet_model == NULL)
 		panel_addto_make_applet_model (dialog);
+	/* The new model was not filtered with the previous search text */
+	dialog->search_narrowing = FALSE;
 	gtk_tree_view_set_model (GTK_TREE_VIEW (dialog->tree_view),
 				 dialog->filter_applet_model);
 	gtk_window_set_focus (GTK_WINDOW (dialog->addto_dialog),
@@ -849,7 +805,7 @@ panel_addto_present_applets (PanelAddtoDialog *dialog)
 	}
 }
 
-static void
+void
 panel_addto_dialog_free_item_info (PanelAddtoItemInfo *item_info)
 {
 	if (item_info == NULL || item_info->static_data)
@@ -882,6 +838,12 @@ panel_addto_dialog_free_item_info (PanelAddtoItemInfo *item_info)
 	if (item_info->menu_path != NULL)
 		g_free (item_info->menu_path);
 	item_info->menu_path = NULL;
+
+	g_free (item_info->name_key);
+	item_info->name_key = NULL;
+
+	g_free (item_info->description_key);
+	item_info->description_key = NULL;
 }
 
 static void
@@ -922,6 +884,11 @@ panel_addto_dialog_free (PanelAddtoDialog *dialog)
 		g_free (dialog->search_text);
 	dialog->search_text = NULL;
 
+	g_free (dialog->search_key);
+	dialog->search_key = NULL;
+
+	g_hash_table_destroy (dialog->match_serials);
+
 	if (dialog->applet_search_text)
 		g_free (dialog->applet_search_text);
 	dialog->applet_search_text = NULL;
@@ -1007,17 +974,18 @@ panel_addto_name_notify (GSettings        *settings,
 	g_free (name);
 }
 
-static gboolean
+gboolean
 panel_addto_filter_func (GtkTreeModel *model,
 			 GtkTreeIter  *iter,
 			 gpointer      userdata)
 {
 	PanelAddtoDialog   *dialog;
 	PanelAddtoItemInfo *data;
+	guint               match_serial;
 
 	dialog = (PanelAddtoDialog *) userdata;
 
-	if (!dialog->search_text || !dialog->search_text[0])
+	if (!dialog->search_key || !dialog->search_key[0])
 		return TRUE;
 
 	gtk_tree_model_get (model, iter, COLUMN_DATA, &data, -1);
@@ -1031,34 +999,78 @@ panel_addto_filter_func (GtkTreeModel *model,
 	    gtk_tree_store_iter_depth (GTK_TREE_STORE (model), iter) == 0)
 		return TRUE;
 
-	return (panel_g_utf8_strstrcase (data->name,
-					 dialog->search_text) != NULL ||
-	        panel_g_utf8_strstrcase (data->description,
-					 dialog->search_text) != NULL);
+	match_serial = GPOINTER_TO_UINT (g_hash_table_lookup (dialog->match_serials,
+							      data));
+	if (match_serial == dialog->search_serial)
+		return TRUE;
+
+	/* The search only got more specific: what did not match the
+	 * previous text cannot match this one. Rows of a tree store are
+	 * filtered lazily, so only trust this for flat lists. */
+	if (dialog->search_narrowing && GTK_IS_LIST_STORE (model) &&
+	    match_serial != dialog->previous_search_serial)
+		return FALSE;
+
+	if (panel_g_utf8_search_key_match (data->name_key,
+					   dialog->search_key) ||
+	    panel_g_utf8_search_key_match (data->description_key,
+					   dialog->search_key)) {
+		g_hash_table_insert (dialog->match_serials, data,
+				     GUINT_TO_POINTER (dialog->search_serial));
+		return TRUE;
+	}
+
+	return FALSE;
 }
 
-static void
-panel_addto_search_entry_changed (GtkWidget        *entry,
-				  PanelAddtoDialog *dialog)
+/* Returns FALSE if the search did not change */
+gboolean
+panel_addto_set_search_text (PanelAddtoDialog *dialog,
+			     const char       *text)
 {
-	GtkTreeModel *model;
-	char         *new_text;
-	GtkTreeIter   iter;
-	GtkTreePath  *path;
+	char *new_text;
+	char *new_key;
 
-	new_text = g_strdup (gtk_entry_get_text (GTK_ENTRY (dialog->search_entry)));
+	new_text = g_strdup (text);
 	g_strchomp (new_text);
 
 	if (dialog->search_text &&
 	    g_utf8_collate (new_text, dialog->search_text) == 0) {
 		g_free (new_text);
-		return;
+		return FALSE;
 	}
 
+	new_key = panel_g_utf8_search_key_new (new_text);
+
+	dialog->search_narrowing = (!PANEL_GLIB_STR_EMPTY (dialog->search_key) &&
+				    new_key != NULL &&
+				    g_str_has_prefix (new_key, dialog->search_key));
+	/* Serials start at 1: 0 is for the items that never matched */
+	dialog->previous_search_serial = dialog->search_serial;
+	dialog->search_serial++;
+
 	if (dialog->search_text)
 		g_free (dialog->search_text);
 	dialog->search_text = new_text;
 
+	g_free (dialog->search_key);
+	dialog->search_key = new_key;
+
+	return TRUE;
+}
+
+static void
+panel_addto_search_entry_changed (GtkWidget        *entry,
+				  PanelAddtoDialog *dialog)
+{
+	GtkTreeModel *model;
+	GtkTreeIter   iter;
+	GtkTreePath  *path;
+
+	if (!panel_addto_set_search_text (dialog,
+					  gtk_entry_get_text (GTK_ENTRY (dialog->search_entry))))
+		return;
+
 	model = gtk_tree_view_get_model (GTK_TREE_VIEW (dialog->tree_view));
 	gtk_tree_model_filter_refilter (GTK_TREE_MODEL_FILTER (model));
 
@@ -1199,6 +1211,7 @@ panel_addto_dialog_new (PanelWidget *panel_widget)
 	GtkTreeViewColumn *column;
 
 	dialog = g_new0 (PanelAddtoDialog, 1);
+	dialog->match_serials = g_hash_table_new (g_direct_hash, g_direct_equal);
 
 	g_object_set_qdata_full (G_OBJECT (panel_widget->toplevel),
 				 panel_addto_dialog_quark,
@@ -33,7 +33,10 @@
 #include <gdk/gdk.h>
 #include <gdk/gdkx.h>
 
+#include <libpanel-util/panel-stats.h>
+
 #include "panel-applets-manager.h"
+#include "panel-applet-supervisor.h"
 #include "panel-profile.h"
 #include "panel.h"
 #include "applet.h"
@@ -69,6 +72,7 @@ struct _MatePanelAppletFrameActivating {
 	int          position;
 	gboolean     exactpos;
 	char        *id;
+	gint64       load_start;
 };
 
 /* MatePanelAppletFrame implementation */
@@ -85,6 +89,7 @@ struct _MatePanelAppletFramePrivate {
 	AppletInfo      *applet_info;
 
 	PanelOrientation orientation;
+	gboolean         panel_hidden;
 
 	gchar           *iid;
 
@@ -536,6 +541,18 @@ mate_panel_applet_frame_change_size (MatePanelAppletFrame *frame,
 	MATE_PANEL_APPLET_FRAME_GET_CLASS (frame)->change_size (frame, size);
 }
 
+void
+mate_panel_applet_frame_change_panel_hidden (MatePanelAppletFrame *frame,
+					gboolean          hidden)
+{
+	hidden = hidden != FALSE;
+	if (hidden == frame->priv->panel_hidden)
+		return;
+
+	frame->priv->panel_hidden = hidden;
+	MATE_PANEL_APPLET_FRAME_GET_CLASS (frame)->change_panel_hidden (frame, hidden);
+}
+
 void
 mate_panel_applet_frame_change_background (MatePanelAppletFrame    *frame,
 				      PanelBackgroundType  type)
@@ -592,8 +609,12 @@ _mate_panel_applet_frame_activated (MatePanelAppletFrame           *frame,
 	if (error != NULL) {
 		g_warning ("Failed to load applet %s:\n%s",
 			   frame->priv->iid, error->message);
+		panel_applet_supervisor_applet_failed (frame->priv->iid,
+						       error->message);
 		g_error_free (error);
 
+		PANEL_STATS_COUNT ("applet-load-failed");
+
 		mate_panel_applet_frame_loading_failed (frame->priv->iid,
 						   frame_act->panel,
 						   frame_act->id);
@@ -619,8 +640,11 @@ _mate_panel_applet_frame_activated (MatePanelAppletFrame           *frame,
 	mate_panel_applet_frame_sync_menu_state (frame);
 	mate_panel_applet_frame_init_properties (frame);
 
-	panel_lockdown_notify_add (G_CALLBACK (mate_panel_applet_frame_sync_menu_state),
-				   frame);
+	panel_lockdown_notify_add_keys (PANEL_LOCKDOWN_LOCKED_DOWN,
+					G_CALLBACK (mate_panel_applet_frame_sync_menu_state),
+					frame);
+
+	PANEL_STATS_TIMER_STOP ("applet-load", frame_act->load_start);
 
 	mate_panel_applet_stop_loading (frame_act->id);
 	mate_panel_applet_frame_activating_free (frame_act);
@@ -712,6 +736,36 @@ _mate_panel_applet_frame_get_background_string (MatePanelAppletFrame    *frame,
 #endif
 }
 
+/* Replaces the frame of a broken applet by a new instance, at the same
+ * place */
+static void
+mate_panel_applet_frame_reload (MatePanelAppletFrame *frame)
+{
+	AppletInfo  *info;
+	PanelWidget *panel;
+	char        *iid;
+	char        *id = NULL;
+	int          position = -1;
+	gboolean     locked = FALSE;
+
+	info  = frame->priv->applet_info;
+	panel = frame->priv->panel;
+	iid   = g_strdup (frame->priv->iid);
+
+	if (info) {
+		id = g_strdup (info->id);
+		position  = mate_panel_applet_get_position (info);
+		locked = panel_widget_get_applet_locked (panel, info->widget);
+		mate_panel_applet_clean (info);
+	}
+
+	mate_panel_applet_frame_load (iid, panel, locked,
+				 position, TRUE, id);
+
+	g_free (iid);
+	g_free (id);
+}
+
 static void
 mate_panel_applet_frame_reload_response (GtkWidget        *dialog,
 				    int               response,
@@ -730,27 +784,9 @@ mate_panel_applet_frame_reload_response (GtkWidget        *dialog,
 	info = frame->priv->applet_info;
 
 	if (response == PANEL_RESPONSE_RELOAD) {
-		PanelWidget *panel;
-		char        *iid;
-		char        *id = NULL;
-		int          position = -1;
-		gboolean     locked = FALSE;
-
-		panel = frame->priv->panel;
-		iid   = g_strdup (frame->priv->iid);
-
-		if (info) {
-			id = g_strdup (info->id);
-			position  = mate_panel_applet_get_position (info);
-			locked = panel_widget_get_applet_locked (panel, info->widget);
-			mate_panel_applet_clean (info);
-		}
-
-		mate_panel_applet_frame_load (iid, panel, locked,
-					 position, TRUE, id);
-
-		g_free (iid);
-		g_free (id);
+		/* The user gives it another chance */
+		panel_applet_supervisor_release (frame->priv->iid);
+		mate_panel_applet_frame_reload (frame);
 
 	} else if (response == PANEL_RESPONSE_DELETE) {
 		/* if we can't write to applets list we can't really delete
@@ -764,6 +800,47 @@ mate_panel_applet_frame_reload_response (GtkWidget        *dialog,
 	gtk_widget_destroy (dialog);
 }
 
+static gboolean
+mate_panel_applet_frame_restart_timeout (MatePanelAppletFrame *frame)
+{
+	/* Unless it was removed from the panel in the meantime */
+	if (frame->priv->iid && frame->priv->panel &&
+	    gtk_widget_get_parent (GTK_WIDGET (frame))) {
+		panel_applet_supervisor_applet_restarted (frame->priv->iid);
+		mate_panel_applet_frame_reload (frame);
+	}
+
+	return FALSE;
+}
+
+static PanelAppletSupervisorAction
+mate_panel_applet_frame_supervise (MatePanelAppletFrame *frame)
+{
+	PanelAppletSupervisorAction  action;
+	GSettings                   *settings;
+	guint                        delay;
+
+	if (!frame->priv->iid || !frame->priv->panel)
+		return PANEL_APPLET_SUPERVISOR_ASK;
+
+	settings = g_settings_new (PANEL_SCHEMA);
+	panel_applet_supervisor_set_policy (
+		MAX (g_settings_get_int (settings, PANEL_APPLET_RESTART_MAX_KEY), 0),
+		MAX (g_settings_get_int (settings, PANEL_APPLET_RESTART_WINDOW_KEY), 1));
+	g_object_unref (settings);
+
+	action = panel_applet_supervisor_applet_exited (frame->priv->iid,
+							&delay);
+
+	if (action == PANEL_APPLET_SUPERVISOR_RESTART)
+		g_timeout_add_full (G_PRIORITY_DEFAULT, delay,
+				    (GSourceFunc) mate_panel_applet_frame_restart_timeout,
+				    g_object_ref (frame),
+				    g_object_unref);
+
+	return action;
+}
+
 void
 _mate_panel_applet_frame_applet_broken (MatePanelAppletFrame *frame)
 {
@@ -771,12 +848,17 @@ _mate_panel_applet_frame_applet_broken (MatePanelAppletFrame *frame)
 	GdkScreen  *screen;
 	const char *applet_name = NULL;
 	char       *dialog_txt;
+	PanelAppletSupervisorAction action;
 
 	screen = gtk_widget_get_screen (GTK_WIDGET (frame));
 
 	if (xstuff_is_display_dead ())
 		return;
 
+	action = mate_panel_applet_frame_supervise (frame);
+	if (action == PANEL_APPLET_SUPERVISOR_RESTART)
+		return;
+
 	if (frame->priv->iid) {
 		MatePanelAppletInfo *info;
 
@@ -793,9 +875,15 @@ _mate_panel_applet_frame_applet_broken (MatePanelAppletFrame *frame)
 					 GTK_MESSAGE_WARNING, GTK_BUTTONS_NONE,
 					 dialog_txt, applet_name ? applet_name : NULL);
 
-	gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (dialog),
-						  _("If you reload a panel object, it will automatically "
-						    "be added back to the panel."));
+	if (action == PANEL_APPLET_SUPERVISOR_QUARANTINE)
+		gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (dialog),
+							  _("It quit repeatedly and will not be reloaded "
+							    "automatically anymore. If you reload it, it will "
+							    "be added back to the panel."));
+	else
+		gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (dialog),
+							  _("If you reload a panel object, it will automatically "
+							    "be added back to the panel."));
 
 	gtk_container_set_border_width (GTK_CONTAINER (dialog), 6);
 
@@ -917,6 +1005,12 @@ mate_panel_applet_frame_activating_get_locked_down (MatePanelAppletFrameActivati
 	return panel_lockdown_get_locked_down ();
 }
 
+gboolean
+mate_panel_applet_frame_activating_get_panel_hidden (MatePanelAppletFrameActivating *frame_act)
+{
+	return panel_toplevel_get_state (frame_act->panel->toplevel) != PANEL_STATE_NORMAL;
+}
+
 gchar *
 mate_panel_applet_frame_activating_get_conf_path (MatePanelAppletFrameActivating *frame_act)
 {
@@ -1040,6 +1134,7 @@ mate_panel_applet_frame_load (const gchar *iid,
 	frame_act->position = position;
 	frame_act->exactpos = exactpos;
 	frame_act->id       = g_strdup (id);
+	frame_act->load_start = PANEL_STATS_TIMER_START ();
 
 	if (!mate_panel_applets_manager_load_applet (iid, frame_act)) {
 		mate_panel_applet_frame_loading_failed (iid, panel, id);
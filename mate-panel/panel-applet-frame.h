@@ -68,6 +68,9 @@ struct _MatePanelAppletFrameClass {
 
 	void     (*change_background)     (MatePanelAppletFrame    *frame,
 					   PanelBackgroundType  type);
+
+	void     (*change_panel_hidden)   (MatePanelAppletFrame    *frame,
+					   gboolean             hidden);
 };
 
 struct _MatePanelAppletFrame {
@@ -98,6 +101,9 @@ void  mate_panel_applet_frame_change_size        (MatePanelAppletFrame    *frame
 void  mate_panel_applet_frame_change_background  (MatePanelAppletFrame    *frame,
 					     PanelBackgroundType  type);
 
+void  mate_panel_applet_frame_change_panel_hidden (MatePanelAppletFrame    *frame,
+					      gboolean             hidden);
+
 void  mate_panel_applet_frame_set_panel          (MatePanelAppletFrame    *frame,
 					     PanelWidget         *panel);
 
@@ -111,6 +117,7 @@ PanelOrientation  mate_panel_applet_frame_activating_get_orientation (MatePanelA
 guint32           mate_panel_applet_frame_activating_get_size        (MatePanelAppletFrameActivating *frame_act);
 gboolean          mate_panel_applet_frame_activating_get_locked      (MatePanelAppletFrameActivating *frame_act);
 gboolean          mate_panel_applet_frame_activating_get_locked_down (MatePanelAppletFrameActivating *frame_act);
+gboolean          mate_panel_applet_frame_activating_get_panel_hidden (MatePanelAppletFrameActivating *frame_act);
 gchar            *mate_panel_applet_frame_activating_get_conf_path   (MatePanelAppletFrameActivating *frame_act);
 
 void  _mate_panel_applet_frame_set_iid               (MatePanelAppletFrame           *frame,
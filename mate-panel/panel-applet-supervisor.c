@@ -0,0 +1,367 @@
+/*
+ * panel-applet-supervisor.c: restart policy for out-of-process applets
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * An applet that quits unexpectedly is restarted after a delay that
+ * doubles with each of its recent crashes. Crashes are counted per IID
+ * over a sliding window: once an IID crashed more often than the budget
+ * allows, it is quarantined and left to the user.
+ *
+ * All the instances of an IID live in the same factory process, so they
+ * all break at once when it dies: the crashes of an IID that happen
+ * within a second of each other count as one.
+ */
+
+#include <config.h>
+
+#include <libpanel-util/panel-cleanup.h>
+#include <libpanel-util/panel-stats.h>
+
+#include "panel-applet-supervisor.h"
+
+#define PANEL_APPLET_SUPERVISOR_SAME_CRASH_US (1 * G_USEC_PER_SEC)
+#define PANEL_APPLET_SUPERVISOR_MIN_DELAY_MS  1000
+#define PANEL_APPLET_SUPERVISOR_MAX_DELAY_MS  (60 * 1000)
+
+typedef struct {
+	guint    n_crashes;
+	guint    n_restarts;
+	char    *last_error;      /* of the last load, if it failed */
+	gint64   last_exit;       /* wall clock, in seconds */
+	gboolean quarantined;
+
+	/* Monotonic times of the crashes within the window, oldest first */
+	GQueue   recent;
+	guint    delay_ms;
+} PanelAppletRecord;
+
+static GHashTable *records        = NULL;
+static guint       max_crashes    = 5;
+static guint       window_seconds = 600;
+
+static void
+panel_applet_record_forget_crashes (PanelAppletRecord *record)
+{
+	while (!g_queue_is_empty (&record->recent))
+		g_slice_free (gint64, g_queue_pop_head (&record->recent));
+}
+
+static void
+panel_applet_record_free (PanelAppletRecord *record)
+{
+	g_free (record->last_error);
+	panel_applet_record_forget_crashes (record);
+	g_slice_free (PanelAppletRecord, record);
+}
+
+static void
+panel_applet_supervisor_cleanup (gpointer data)
+{
+	g_hash_table_destroy (records);
+	records = NULL;
+}
+
+static PanelAppletRecord *
+panel_applet_supervisor_lookup (const char *iid,
+				gboolean    create)
+{
+	PanelAppletRecord *record;
+
+	if (!records) {
+		if (!create)
+			return NULL;
+
+		records = g_hash_table_new_full (g_str_hash, g_str_equal,
+						 g_free,
+						 (GDestroyNotify) panel_applet_record_free);
+		panel_cleanup_register (panel_applet_supervisor_cleanup, NULL);
+	}
+
+	record = g_hash_table_lookup (records, iid);
+	if (!record && create) {
+		record = g_slice_new0 (PanelAppletRecord);
+		g_queue_init (&record->recent);
+		g_hash_table_insert (records, g_strdup (iid), record);
+	}
+
+	return record;
+}
+
+static void
+panel_applet_record_set_error (PanelAppletRecord *record,
+			       const char        *error)
+{
+	g_free (record->last_error);
+	record->last_error = g_strdup (error ? error : "");
+}
+
+static void
+panel_applet_record_set_exit (PanelAppletRecord *record)
+{
+	record->last_exit = g_get_real_time () / G_USEC_PER_SEC;
+}
+
+/* Forgets the crashes that fell out of the window */
+static void
+panel_applet_record_expire (PanelAppletRecord *record,
+			    gint64             now)
+{
+	gint64 window = (gint64) window_seconds * G_USEC_PER_SEC;
+
+	while (!g_queue_is_empty (&record->recent)) {
+		gint64 *time = g_queue_peek_head (&record->recent);
+
+		if (now - *time < window)
+			break;
+
+		g_slice_free (gint64, g_queue_pop_head (&record->recent));
+	}
+}
+
+void
+panel_applet_supervisor_set_policy (guint max,
+				    guint window)
+{
+	max_crashes    = max;
+	window_seconds = MAX (window, 1);
+}
+
+PanelAppletSupervisorAction
+panel_applet_supervisor_applet_exited (const char *iid,
+				       guint      *delay_ms)
+{
+	PanelAppletRecord *record;
+	gint64            *time;
+	gint64             now;
+	guint              i;
+
+	g_return_val_if_fail (iid != NULL, PANEL_APPLET_SUPERVISOR_ASK);
+
+	record = panel_applet_supervisor_lookup (iid, TRUE);
+	now = g_get_monotonic_time ();
+
+	panel_applet_record_set_error (record, NULL);
+	panel_applet_record_set_exit (record);
+
+	if (delay_ms)
+		*delay_ms = 0;
+
+	if (record->quarantined)
+		return PANEL_APPLET_SUPERVISOR_QUARANTINE;
+
+	panel_applet_record_expire (record, now);
+
+	/* Another instance going down with the same factory */
+	time = g_queue_peek_tail (&record->recent);
+	if (time && now - *time < PANEL_APPLET_SUPERVISOR_SAME_CRASH_US) {
+		if (max_crashes == 0)
+			return PANEL_APPLET_SUPERVISOR_ASK;
+
+		if (delay_ms)
+			*delay_ms = record->delay_ms;
+		return PANEL_APPLET_SUPERVISOR_RESTART;
+	}
+
+	record->n_crashes++;
+	PANEL_STATS_COUNT ("applet-crash");
+
+	time = g_slice_new (gint64);
+	*time = now;
+	g_queue_push_tail (&record->recent, time);
+
+	if (max_crashes == 0)
+		return PANEL_APPLET_SUPERVISOR_ASK;
+
+	if (g_queue_get_length (&record->recent) > max_crashes) {
+		record->quarantined = TRUE;
+		PANEL_STATS_COUNT ("applet-quarantine");
+		g_warning ("Applet %s crashed %u times in %u seconds, it will "
+			   "not be restarted automatically anymore",
+			   iid, g_queue_get_length (&record->recent),
+			   window_seconds);
+		return PANEL_APPLET_SUPERVISOR_QUARANTINE;
+	}
+
+	/* 1, 2, 4... seconds for the crashes within the window */
+	record->delay_ms = PANEL_APPLET_SUPERVISOR_MIN_DELAY_MS;
+	for (i = 1; i < g_queue_get_length (&record->recent); i++) {
+		record->delay_ms *= 2;
+		if (record->delay_ms >= PANEL_APPLET_SUPERVISOR_MAX_DELAY_MS) {
+			record->delay_ms = PANEL_APPLET_SUPERVISOR_MAX_DELAY_MS;
+			break;
+		}
+	}
+
+	if (delay_ms)
+		*delay_ms = record->delay_ms;
+
+	return PANEL_APPLET_SUPERVISOR_RESTART;
+}
+
+/* Loading failures are not restarted, but they are worth reporting */
+void
+panel_applet_supervisor_applet_failed (const char *iid,
+				       const char *error)
+{
+	PanelAppletRecord *record;
+
+	g_return_if_fail (iid != NULL);
+
+	record = panel_applet_supervisor_lookup (iid, TRUE);
+	panel_applet_record_set_error (record, error);
+}
+
+void
+panel_applet_supervisor_applet_restarted (const char *iid)
+{
+	PanelAppletRecord *record;
+
+	g_return_if_fail (iid != NULL);
+
+	record = panel_applet_supervisor_lookup (iid, TRUE);
+	record->n_restarts++;
+
+	PANEL_STATS_COUNT ("applet-restart");
+}
+
+gboolean
+panel_applet_supervisor_is_quarantined (const char *iid)
+{
+	PanelAppletRecord *record;
+
+	g_return_val_if_fail (iid != NULL, FALSE);
+
+	record = panel_applet_supervisor_lookup (iid, FALSE);
+
+	return record && record->quarantined;
+}
+
+/* Gives the applet a new crash budget, when the user asked for it to be
+ * reloaded */
+void
+panel_applet_supervisor_release (const char *iid)
+{
+	PanelAppletRecord *record;
+
+	g_return_if_fail (iid != NULL);
+
+	record = panel_applet_supervisor_lookup (iid, FALSE);
+	if (!record)
+		return;
+
+	record->quarantined = FALSE;
+	record->delay_ms = 0;
+	panel_applet_record_forget_crashes (record);
+}
+
+/* Returns a{s(uuusxb)}: for each IID that ever quit, its number of
+ * crashes, of restarts and of crashes within the window, the error of
+ * its last load if that failed and the time it last quit, and whether
+ * it is quarantined */
+GVariant *
+panel_applet_supervisor_get_status (void)
+{
+	GVariantBuilder builder;
+	GHashTableIter  iter;
+	gpointer        key, value;
+	gint64          now;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{s(uuusxb)}"));
+
+	if (!records)
+		return g_variant_builder_end (&builder);
+
+	now = g_get_monotonic_time ();
+
+	g_hash_table_iter_init (&iter, records);
+	while (g_hash_table_iter_next (&iter, &key, &value)) {
+		PanelAppletRecord *record = value;
+
+		panel_applet_record_expire (record, now);
+
+		g_variant_builder_add (&builder, "{s(uuusxb)}",
+				       key,
+				       record->n_crashes,
+				       record->n_restarts,
+				       g_queue_get_length (&record->recent),
+				       record->last_error,
+				       record->last_exit,
+				       record->quarantined);
+	}
+
+	return g_variant_builder_end (&builder);
+}
+
+/* D-Bus interface */
+
+static const gchar panel_applet_supervisor_introspection_xml[] =
+	"<node>"
+	    "<interface name='" PANEL_APPLET_SUPERVISOR_DBUS_INTERFACE "'>"
+	      "<method name='GetStatus'>"
+	        "<arg name='applets' type='a{s(uuusxb)}' direction='out'/>"
+	      "</method>"
+	    "</interface>"
+	  "</node>";
+
+static void
+panel_applet_supervisor_method_call (GDBusConnection       *connection,
+				     const gchar           *sender,
+				     const gchar           *object_path,
+				     const gchar           *interface_name,
+				     const gchar           *method_name,
+				     GVariant              *parameters,
+				     GDBusMethodInvocation *invocation,
+				     gpointer               user_data)
+{
+	if (g_strcmp0 (method_name, "GetStatus") == 0) {
+		g_dbus_method_invocation_return_value (invocation,
+						       g_variant_new ("(@a{s(uuusxb)})",
+								      panel_applet_supervisor_get_status ()));
+	}
+}
+
+static const GDBusInterfaceVTable panel_applet_supervisor_interface_vtable = {
+	panel_applet_supervisor_method_call,
+	NULL,
+	NULL
+};
+
+void
+panel_applet_supervisor_register_object (GDBusConnection *connection)
+{
+	static GDBusNodeInfo *introspection_data = NULL;
+	GError               *error = NULL;
+
+	g_return_if_fail (G_IS_DBUS_CONNECTION (connection));
+
+	if (!introspection_data)
+		introspection_data = g_dbus_node_info_new_for_xml (panel_applet_supervisor_introspection_xml, NULL);
+
+	g_dbus_connection_register_object (connection,
+					   PANEL_APPLET_SUPERVISOR_DBUS_PATH,
+					   introspection_data->interfaces[0],
+					   &panel_applet_supervisor_interface_vtable,
+					   NULL, NULL,
+					   &error);
+	if (error) {
+		g_warning ("Failed to register object %s: %s",
+			   PANEL_APPLET_SUPERVISOR_DBUS_PATH, error->message);
+		g_error_free (error);
+	}
+}
@@ -0,0 +1,65 @@
+/*
+ * panel-applet-supervisor.h: restart policy for out-of-process applets
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __PANEL_APPLET_SUPERVISOR_H__
+#define __PANEL_APPLET_SUPERVISOR_H__
+
+#include <gio/gio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PANEL_APPLET_SUPERVISOR_DBUS_PATH      "/org/mate/panel/Applets"
+#define PANEL_APPLET_SUPERVISOR_DBUS_INTERFACE "org.mate.panel.Applets"
+
+typedef enum {
+	PANEL_APPLET_SUPERVISOR_RESTART,
+	PANEL_APPLET_SUPERVISOR_QUARANTINE,
+	PANEL_APPLET_SUPERVISOR_ASK
+} PanelAppletSupervisorAction;
+
+/* At most max_crashes crashes of an applet within window_seconds are
+ * restarted automatically, the next one quarantines it. A max_crashes of
+ * 0 disables the automatic restarts. */
+void      panel_applet_supervisor_set_policy      (guint       max_crashes,
+						   guint       window_seconds);
+
+/* Records the end of an applet and returns what to do about it. The
+ * delay to wait before a restart is returned in delay_ms. Out-of-process
+ * applets are not children of the panel, so why they exited is unknown. */
+PanelAppletSupervisorAction
+          panel_applet_supervisor_applet_exited   (const char *iid,
+						   guint      *delay_ms);
+void      panel_applet_supervisor_applet_failed   (const char *iid,
+						   const char *error);
+void      panel_applet_supervisor_applet_restarted (const char *iid);
+
+gboolean  panel_applet_supervisor_is_quarantined  (const char *iid);
+void      panel_applet_supervisor_release         (const char *iid);
+
+GVariant *panel_applet_supervisor_get_status      (void);
+
+void      panel_applet_supervisor_register_object (GDBusConnection *connection);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PANEL_APPLET_SUPERVISOR_H__ */
@@ -88,6 +88,8 @@ _mate_panel_applets_managers_ensure_loaded (void)
 	mate_panel_applets_managers = g_slist_reverse (mate_panel_applets_managers);
 }
 
+/* The applets of all the managers: free the list with g_list_free(), the
+ * infos belong to the managers */
 GList *
 mate_panel_applets_manager_get_applets (void)
 {
@@ -97,15 +99,15 @@ mate_panel_applets_manager_get_applets (void)
 	_mate_panel_applets_managers_ensure_loaded ();
 
 	for (l = mate_panel_applets_managers; l != NULL; l = l->next) {
-		GList *applets;
+		const GList *applets;
 		MatePanelAppletsManager *manager = MATE_PANEL_APPLETS_MANAGER (l->data);
 
 		applets = MATE_PANEL_APPLETS_MANAGER_GET_CLASS (manager)->get_applets (manager);
-		if (applets)
-			retval = g_list_concat (retval, applets);
+		for (; applets; applets = applets->next)
+			retval = g_list_prepend (retval, applets->data);
 	}
 
-	return retval;
+	return g_list_reverse (retval);
 }
 
 gboolean
@@ -52,7 +52,8 @@ typedef struct _MatePanelAppletsManagerClass	MatePanelAppletsManagerClass;
 struct _MatePanelAppletsManagerClass {
 	GObjectClass parent_class;
 
-	GList *            (*get_applets)           (MatePanelAppletsManager  *manager);
+	/* The list is owned by the manager, and valid until its applets change */
+	const GList *      (*get_applets)           (MatePanelAppletsManager  *manager);
 
 	gboolean           (*factory_activate)      (MatePanelAppletsManager  *manager,
 						     const gchar          *iid);
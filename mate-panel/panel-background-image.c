@@ -0,0 +1,431 @@
+/*
+ * panel-background-image.c: shared decoding of background image files
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * All the panels using the same file share one decoded image, keyed by
+ * the path and modification time of the file. The file is decoded in a
+ * thread, directly at the smallest size that covers what the panels
+ * asked for: a 6000x4000 photo behind a 24 pixels high panel that fits
+ * the image only needs a few hundred kilobytes of pixels, and the JPEG
+ * loader does most of that reduction while decoding.
+ *
+ * Lookups made during the same main loop iteration are merged into a
+ * single decode. Once it is done, "changed" is emitted and the panels
+ * look the image up again; a panel asking for more than what was decoded
+ * makes the image decoded again, larger.
+ */
+
+#include <config.h>
+
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include <libpanel-util/panel-stats.h>
+
+#include "panel-background-image.h"
+
+#define PANEL_BACKGROUND_IMAGE_CHUNK_SIZE (64 * 1024)
+
+/* Not every system has the nanoseconds of the timestamps */
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+#define STAT_MTIME_NSEC(buf) ((buf).st_mtim.tv_nsec)
+#else
+#define STAT_MTIME_NSEC(buf) 0
+#endif
+
+enum {
+	CHANGED,
+	LAST_SIGNAL
+};
+
+struct _PanelBackgroundImageClass {
+	GObjectClass   parent_class;
+	void         (*changed) (PanelBackgroundImage *image);
+};
+
+struct _PanelBackgroundImage {
+	GObject       parent_instance;
+
+	char         *filename;
+
+	/* Identifies the version of the file that was loaded */
+	gint64        mtime;
+	glong         mtime_nsec;
+	goffset       size;
+	guint64       inode;
+
+	/* The best decode so far */
+	GdkPixbuf    *pixbuf;
+	gboolean      original_size;
+	gboolean      failed;
+
+	/* What the lookups asked for and the pixbuf does not cover */
+	int           want_width;
+	int           want_height;
+	gboolean      want_original_size;
+
+	guint         decode_idle_id;
+	gboolean      decoding;
+};
+
+typedef struct {
+	char      *filename;
+	int        width;
+	int        height;
+	gboolean   original_size;
+	gint64     start;
+	GdkPixbuf *pixbuf;
+} PanelBackgroundImageDecode;
+
+G_DEFINE_TYPE (PanelBackgroundImage, panel_background_image, G_TYPE_OBJECT)
+
+static guint signals [LAST_SIGNAL] = { 0 };
+
+/* filename => the image of the current version of the file, not owned */
+static GHashTable *images = NULL;
+
+static void panel_background_image_schedule_decode (PanelBackgroundImage *image);
+
+static void
+panel_background_image_finalize (GObject *object)
+{
+	PanelBackgroundImage *image = PANEL_BACKGROUND_IMAGE (object);
+
+	if (images && g_hash_table_lookup (images, image->filename) == image)
+		g_hash_table_remove (images, image->filename);
+
+	if (image->decode_idle_id)
+		g_source_remove (image->decode_idle_id);
+	image->decode_idle_id = 0;
+
+	if (image->pixbuf)
+		g_object_unref (image->pixbuf);
+	image->pixbuf = NULL;
+
+	g_free (image->filename);
+	image->filename = NULL;
+
+	G_OBJECT_CLASS (panel_background_image_parent_class)->finalize (object);
+}
+
+static void
+panel_background_image_class_init (PanelBackgroundImageClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	signals [CHANGED] =
+		g_signal_new ("changed",
+			      G_OBJECT_CLASS_TYPE (object_class),
+			      G_SIGNAL_RUN_LAST,
+			      G_STRUCT_OFFSET (PanelBackgroundImageClass, changed),
+			      NULL, NULL,
+			      g_cclosure_marshal_VOID__VOID,
+			      G_TYPE_NONE, 0);
+
+	object_class->finalize = panel_background_image_finalize;
+}
+
+static void
+panel_background_image_init (PanelBackgroundImage *image)
+{
+}
+
+/* Returns a new reference to the shared image of the file, or NULL if it
+ * is not a regular file */
+PanelBackgroundImage *
+panel_background_image_get_for_file (const char *filename)
+{
+	PanelBackgroundImage *image;
+	GStatBuf              buf;
+
+	g_return_val_if_fail (filename != NULL, NULL);
+
+	if (g_stat (filename, &buf) != 0 || !S_ISREG (buf.st_mode))
+		return NULL;
+
+	if (!images)
+		images = g_hash_table_new_full (g_str_hash, g_str_equal,
+						g_free, NULL);
+
+	image = g_hash_table_lookup (images, filename);
+	/* An image saved twice within a second has the same mtime, and
+	 * one saved to a new file and renamed can even keep it */
+	if (image &&
+	    image->mtime      == (gint64) buf.st_mtime &&
+	    image->mtime_nsec == STAT_MTIME_NSEC (buf) &&
+	    image->size       == (goffset) buf.st_size &&
+	    image->inode      == (guint64) buf.st_ino)
+		return g_object_ref (image);
+
+	/* The users of the previous version keep it until they look the
+	 * file up again */
+	image = g_object_new (PANEL_TYPE_BACKGROUND_IMAGE, NULL);
+	image->filename   = g_strdup (filename);
+	image->mtime      = buf.st_mtime;
+	image->mtime_nsec = STAT_MTIME_NSEC (buf);
+	image->size       = buf.st_size;
+	image->inode      = buf.st_ino;
+
+	g_hash_table_replace (images, g_strdup (filename), image);
+
+	return image;
+}
+
+static gboolean
+panel_background_image_covers (PanelBackgroundImage *image,
+			       int                   width,
+			       int                   height)
+{
+	if (!image->pixbuf)
+		return FALSE;
+
+	if (image->original_size)
+		return TRUE;
+
+	if (width < 0 || height < 0)
+		return FALSE;
+
+	return gdk_pixbuf_get_width  (image->pixbuf) >= width &&
+	       gdk_pixbuf_get_height (image->pixbuf) >= height;
+}
+
+/* Returns the image decoded at a size covering width x height, or NULL
+ * if it is not available yet: "changed" is emitted once it is. The
+ * pixbuf is owned by the image. */
+GdkPixbuf *
+panel_background_image_lookup (PanelBackgroundImage *image,
+			       int                   width,
+			       int                   height)
+{
+	g_return_val_if_fail (PANEL_IS_BACKGROUND_IMAGE (image), NULL);
+
+	if (panel_background_image_covers (image, width, height))
+		return image->pixbuf;
+
+	if (image->failed)
+		return NULL;
+
+	if (width < 0 || height < 0) {
+		image->want_original_size = TRUE;
+	} else {
+		image->want_width  = MAX (image->want_width, width);
+		image->want_height = MAX (image->want_height, height);
+	}
+
+	panel_background_image_schedule_decode (image);
+
+	return NULL;
+}
+
+gboolean
+panel_background_image_has_failed (PanelBackgroundImage *image)
+{
+	g_return_val_if_fail (PANEL_IS_BACKGROUND_IMAGE (image), FALSE);
+
+	return image->failed;
+}
+
+static void
+panel_background_image_decode_free (PanelBackgroundImageDecode *decode)
+{
+	g_free (decode->filename);
+	if (decode->pixbuf)
+		g_object_unref (decode->pixbuf);
+	g_slice_free (PanelBackgroundImageDecode, decode);
+}
+
+/* Runs in the decoding thread */
+static void
+panel_background_image_size_prepared (GdkPixbufLoader            *loader,
+				      int                         width,
+				      int                         height,
+				      PanelBackgroundImageDecode *decode)
+{
+	double scale;
+
+	if (!decode->original_size && width > 0 && height > 0) {
+		scale = MAX ((double) decode->width  / width,
+			     (double) decode->height / height);
+
+		if (scale < 1.0) {
+			gdk_pixbuf_loader_set_size (loader,
+						    MAX (1, (int) (width  * scale + 0.999)),
+						    MAX (1, (int) (height * scale + 0.999)));
+			return;
+		}
+	}
+
+	decode->original_size = TRUE;
+}
+
+/* Runs in the decoding thread */
+static void
+panel_background_image_decode_thread (GTask        *task,
+				      gpointer      source_object,
+				      gpointer      task_data,
+				      GCancellable *cancellable)
+{
+	PanelBackgroundImageDecode *decode = task_data;
+	GdkPixbufLoader            *loader;
+	GFile                      *file;
+	GInputStream               *stream;
+	guchar                     *buffer;
+	gssize                      n_read;
+	gboolean                    loaded = TRUE;
+	GError                     *error = NULL;
+
+	file = g_file_new_for_path (decode->filename);
+	stream = G_INPUT_STREAM (g_file_read (file, cancellable, &error));
+	g_object_unref (file);
+
+	if (!stream) {
+		g_task_return_error (task, error);
+		return;
+	}
+
+	loader = gdk_pixbuf_loader_new ();
+	g_signal_connect (loader, "size-prepared",
+			  G_CALLBACK (panel_background_image_size_prepared),
+			  decode);
+
+	buffer = g_malloc (PANEL_BACKGROUND_IMAGE_CHUNK_SIZE);
+
+	while (loaded) {
+		n_read = g_input_stream_read (stream, buffer,
+					      PANEL_BACKGROUND_IMAGE_CHUNK_SIZE,
+					      cancellable, &error);
+		if (n_read <= 0) {
+			loaded = n_read == 0;
+			break;
+		}
+
+		loaded = gdk_pixbuf_loader_write (loader, buffer, n_read, &error);
+	}
+
+	g_free (buffer);
+	g_object_unref (stream);
+
+	/* Closing reports truncated files, but must happen anyway */
+	if (!gdk_pixbuf_loader_close (loader, loaded ? &error : NULL))
+		loaded = FALSE;
+
+	if (loaded) {
+		decode->pixbuf = gdk_pixbuf_loader_get_pixbuf (loader);
+		if (decode->pixbuf)
+			g_object_ref (decode->pixbuf);
+	}
+
+	g_object_unref (loader);
+
+	if (!decode->pixbuf) {
+		if (!error)
+			error = g_error_new (GDK_PIXBUF_ERROR,
+					     GDK_PIXBUF_ERROR_CORRUPT_IMAGE,
+					     "No image could be decoded");
+		g_task_return_error (task, error);
+		return;
+	}
+
+	PANEL_STATS_TIMER_STOP ("background-image-decode", decode->start);
+	PANEL_STATS_COUNT_N ("background-image-decoded-bytes",
+			     (gint64) gdk_pixbuf_get_rowstride (decode->pixbuf) *
+			     gdk_pixbuf_get_height (decode->pixbuf));
+
+	g_task_return_boolean (task, TRUE);
+}
+
+static void
+panel_background_image_decoded (GObject      *source,
+				 GAsyncResult *result,
+				 gpointer      data)
+{
+	PanelBackgroundImage       *image = PANEL_BACKGROUND_IMAGE (source);
+	PanelBackgroundImageDecode *decode;
+	GError                     *error = NULL;
+
+	decode = g_task_get_task_data (G_TASK (result));
+
+	image->decoding = FALSE;
+
+	if (!g_task_propagate_boolean (G_TASK (result), &error)) {
+		g_warning (G_STRLOC ": unable to open '%s': %s",
+			   image->filename, error->message);
+		g_error_free (error);
+
+		image->failed = TRUE;
+		g_signal_emit (image, signals [CHANGED], 0);
+		return;
+	}
+
+	if (image->pixbuf)
+		g_object_unref (image->pixbuf);
+	image->pixbuf = g_object_ref (decode->pixbuf);
+	image->original_size = decode->original_size;
+
+	/* Lookups made during the decode might want more */
+	if (panel_background_image_covers (image, image->want_width, image->want_height) &&
+	    (!image->want_original_size || image->original_size)) {
+		image->want_width  = 0;
+		image->want_height = 0;
+		image->want_original_size = FALSE;
+	} else {
+		panel_background_image_schedule_decode (image);
+	}
+
+	g_signal_emit (image, signals [CHANGED], 0);
+}
+
+static gboolean
+panel_background_image_decode (PanelBackgroundImage *image)
+{
+	PanelBackgroundImageDecode *decode;
+	GTask                      *task;
+
+	image->decode_idle_id = 0;
+
+	decode = g_slice_new0 (PanelBackgroundImageDecode);
+	decode->filename      = g_strdup (image->filename);
+	decode->width         = image->want_width;
+	decode->height        = image->want_height;
+	decode->original_size = image->want_original_size;
+	decode->start         = PANEL_STATS_TIMER_START ();
+
+	image->decoding = TRUE;
+
+	/* The task keeps the image alive until the decode is done */
+	task = g_task_new (image, NULL,
+			   panel_background_image_decoded, NULL);
+	g_task_set_task_data (task, decode,
+			      (GDestroyNotify) panel_background_image_decode_free);
+	g_task_run_in_thread (task, panel_background_image_decode_thread);
+	g_object_unref (task);
+
+	return FALSE;
+}
+
+static void
+panel_background_image_schedule_decode (PanelBackgroundImage *image)
+{
+	/* The next one is scheduled when the current one is done */
+	if (image->decode_idle_id || image->decoding)
+		return;
+
+	image->decode_idle_id = g_idle_add ((GSourceFunc) panel_background_image_decode,
+					    image);
+}
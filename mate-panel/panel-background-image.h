@@ -0,0 +1,54 @@
+/*
+ * panel-background-image.h: shared decoding of background image files
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __PANEL_BACKGROUND_IMAGE_H__
+#define __PANEL_BACKGROUND_IMAGE_H__
+
+#include <glib-object.h>
+#include <gdk-pixbuf/gdk-pixbuf.h>
+
+#define PANEL_TYPE_BACKGROUND_IMAGE         (panel_background_image_get_type ())
+#define PANEL_BACKGROUND_IMAGE(o)           (G_TYPE_CHECK_INSTANCE_CAST ((o),      \
+					     PANEL_TYPE_BACKGROUND_IMAGE,          \
+					     PanelBackgroundImage))
+#define PANEL_BACKGROUND_IMAGE_CLASS(k)     (G_TYPE_CHECK_CLASS_CAST ((k),         \
+					     PANEL_TYPE_BACKGROUND_IMAGE,          \
+					     PanelBackgroundImageClass))
+#define PANEL_IS_BACKGROUND_IMAGE(o)        (G_TYPE_CHECK_INSTANCE_TYPE ((o),      \
+					     PANEL_TYPE_BACKGROUND_IMAGE))
+#define PANEL_IS_BACKGROUND_IMAGE_CLASS(k)  (G_TYPE_CHECK_CLASS_TYPE ((k),         \
+					     PANEL_TYPE_BACKGROUND_IMAGE))
+#define PANEL_BACKGROUND_IMAGE_GET_CLASS(o) (G_TYPE_INSTANCE_GET_CLASS ((o),       \
+					     PANEL_TYPE_BACKGROUND_IMAGE,          \
+					     PanelBackgroundImageClass))
+
+/* A width and height of -1 ask for the image at its original size */
+#define PANEL_BACKGROUND_IMAGE_ORIGINAL_SIZE -1
+
+typedef struct _PanelBackgroundImageClass PanelBackgroundImageClass;
+typedef struct _PanelBackgroundImage      PanelBackgroundImage;
+
+GType                 panel_background_image_get_type     (void);
+PanelBackgroundImage *panel_background_image_get_for_file (const char           *filename);
+GdkPixbuf            *panel_background_image_lookup       (PanelBackgroundImage *image,
+							   int                   width,
+							   int                   height);
+gboolean              panel_background_image_has_failed   (PanelBackgroundImage *image);
+
+#endif /* __PANEL_BACKGROUND_IMAGE_H__ */
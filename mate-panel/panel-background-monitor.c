@@ -27,6 +27,21 @@
  * 		Vitaliy Kopylov
  */
 
+/*
+ * The root background is read from the _XROOTPMAP_ID pixmap. Only the
+ * rectangles under the panels are fetched, through a shared memory
+ * segment (MIT-SHM) reused across fetches when the server supports it,
+ * and without grabbing the server: if the pixmap goes away in the
+ * meantime, the fetch fails and the PropertyNotify that follows triggers
+ * a new one.
+ *
+ * Fetched rectangles are cached and tagged with the generation of the
+ * background, which is bumped each time the root pixmap changes, so that
+ * all the panels of the screen share them.
+ */
+
+#include <config.h>
+
 #include <glib.h>
 #include <glib-object.h>
 #include <gdk/gdk.h>
@@ -35,14 +50,36 @@
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
 
+#ifdef HAVE_XSHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+#endif
+
+#include <libpanel-util/panel-stats.h>
+
 #include "panel-background-monitor.h"
 #include "panel-util.h"
 
+/* Number of fetched rectangles kept around: one per panel is the usual
+ * need, plus the tile of a small root pixmap */
+#define PANEL_BACKGROUND_MONITOR_MAX_REGIONS 8
+
 enum {
 	CHANGED,
 	LAST_SIGNAL
 };
 
+typedef struct {
+	guint      generation;
+	gboolean   is_tile;
+	int        x;
+	int        y;
+	int        width;
+	int        height;
+	GdkPixbuf *pixbuf;
+} PanelBackgroundRegion;
+
 static void panel_background_monitor_changed (PanelBackgroundMonitor *monitor);
 
 static GdkFilterReturn panel_background_monitor_xevent_filter (GdkXEvent *xevent,
@@ -65,13 +102,25 @@ struct _PanelBackgroundMonitor {
 	Atom       xatom;
 	GdkAtom    gdkatom;
 
-	cairo_surface_t *surface;
-	GdkPixbuf *gdkpixbuf;
-
-	int        width;
-	int        height;
-
-	gboolean   display_grabbed;
+	/* Bumped each time the root pixmap changes */
+	guint      generation;
+
+	/* The root pixmap of the current generation */
+	gboolean   pixmap_valid;
+	Pixmap     pixmap;
+	int        pixmap_width;
+	int        pixmap_height;
+	int        pixmap_depth;
+
+	/* Most recently used first */
+	GSList    *regions;
+
+#ifdef HAVE_XSHM
+	gboolean         shm_checked;
+	gboolean         shm_available;
+	XShmSegmentInfo  shminfo;
+	gsize            shm_size;
+#endif
 };
 
 G_DEFINE_TYPE (PanelBackgroundMonitor, panel_background_monitor, G_TYPE_OBJECT)
@@ -85,6 +134,43 @@ gboolean gdk_window_check_composited_wm(GdkWindow* window)
 	return gdk_screen_is_composited(gdk_window_get_screen(window));
 }
 
+static void
+panel_background_region_free (PanelBackgroundRegion *region)
+{
+	g_object_unref (region->pixbuf);
+	g_free (region);
+}
+
+static void
+panel_background_monitor_free_regions (PanelBackgroundMonitor *monitor)
+{
+	g_slist_free_full (monitor->regions,
+			   (GDestroyNotify) panel_background_region_free);
+	monitor->regions = NULL;
+}
+
+#ifdef HAVE_XSHM
+static void
+panel_background_monitor_free_shm (PanelBackgroundMonitor *monitor)
+{
+	GdkDisplay *display;
+
+	if (monitor->shm_size == 0)
+		return;
+
+	display = gdk_screen_get_display (monitor->screen);
+
+	gdk_x11_display_error_trap_push (display);
+	XShmDetach (GDK_DISPLAY_XDISPLAY (display), &monitor->shminfo);
+	gdk_x11_display_error_trap_pop_ignored (display);
+
+	shmdt (monitor->shminfo.shmaddr);
+
+	monitor->shminfo.shmaddr = NULL;
+	monitor->shm_size = 0;
+}
+#endif
+
 static void
 panel_background_monitor_finalize (GObject *object)
 {
@@ -97,13 +183,11 @@ panel_background_monitor_finalize (GObject *object)
 	g_signal_handlers_disconnect_by_func (monitor->screen,
 		panel_background_monitor_changed, monitor);
 
-	if (monitor->surface)
-		cairo_surface_destroy (monitor->surface);
-	monitor->surface= NULL;
+	panel_background_monitor_free_regions (monitor);
 
-	if (monitor->gdkpixbuf)
-		g_object_unref (monitor->gdkpixbuf);
-	monitor->gdkpixbuf = NULL;
+#ifdef HAVE_XSHM
+	panel_background_monitor_free_shm (monitor);
+#endif
 
 	G_OBJECT_CLASS (panel_background_monitor_parent_class)->finalize (object);
 }
@@ -136,10 +220,10 @@ panel_background_monitor_init (PanelBackgroundMonitor *monitor)
 	monitor->gdkatom = gdk_atom_intern_static_string ("_XROOTPMAP_ID");
 	monitor->xatom   = gdk_x11_atom_to_xatom (monitor->gdkatom);
 
-	monitor->surface = NULL;
-	monitor->gdkpixbuf = NULL;
-
-	monitor->display_grabbed = FALSE;
+	monitor->generation   = 1;
+	monitor->pixmap_valid = FALSE;
+	monitor->pixmap       = None;
+	monitor->regions      = NULL;
 }
 
 static void
@@ -197,13 +281,11 @@ panel_background_monitor_get_for_screen (GdkScreen *screen)
 static void
 panel_background_monitor_changed (PanelBackgroundMonitor *monitor)
 {
-	if (monitor->surface)
-		cairo_surface_destroy (monitor->surface);
-	monitor->surface = NULL;
+	monitor->generation++;
+	monitor->pixmap_valid = FALSE;
+	monitor->pixmap = None;
 
-	if (monitor->gdkpixbuf)
-		g_object_unref (monitor->gdkpixbuf);
-	monitor->gdkpixbuf = NULL;
+	panel_background_monitor_free_regions (monitor);
 
 	g_signal_emit (monitor, signals [CHANGED], 0);
 }
@@ -229,26 +311,331 @@ panel_background_monitor_xevent_filter (GdkXEvent *xevent,
 	return GDK_FILTER_CONTINUE;
 }
 
+/* Reads the root pixmap and its geometry, once per generation */
+static gboolean
+panel_background_monitor_ensure_pixmap (PanelBackgroundMonitor *monitor)
+{
+	GdkDisplay    *display;
+	Display       *xdisplay;
+	Atom           type;
+	int            format;
+	unsigned long  nitems;
+	unsigned long  bytes_after;
+	unsigned char *data = NULL;
+	Window         root;
+	int            x, y;
+	unsigned int   width, height, border, depth;
+	Status         status;
+	int            result;
+
+	if (monitor->pixmap_valid)
+		return monitor->pixmap != None;
+
+	monitor->pixmap_valid = TRUE;
+	monitor->pixmap = None;
+
+	display  = gdk_screen_get_display (monitor->screen);
+	xdisplay = GDK_DISPLAY_XDISPLAY (display);
+
+	gdk_x11_display_error_trap_push (display);
+
+	result = XGetWindowProperty (xdisplay, monitor->xwindow, monitor->xatom,
+				     0, 1, False, XA_PIXMAP,
+				     &type, &format, &nitems, &bytes_after,
+				     &data);
+
+	if (result == Success && type == XA_PIXMAP && format == 32 && nitems == 1) {
+		Pixmap pixmap = *(Pixmap *) data;
+
+		status = XGetGeometry (xdisplay, pixmap, &root, &x, &y,
+				       &width, &height, &border, &depth);
+		if (status && width > 0 && height > 0) {
+			monitor->pixmap        = pixmap;
+			monitor->pixmap_width  = width;
+			monitor->pixmap_height = height;
+			monitor->pixmap_depth  = depth;
+		}
+	}
+
+	if (data)
+		XFree (data);
+
+	if (gdk_x11_display_error_trap_pop (display))
+		monitor->pixmap = None;
+
+	if (monitor->pixmap == None)
+		g_warning ("couldn't get background pixmap\n");
+
+	return monitor->pixmap != None;
+}
+
+#ifdef HAVE_XSHM
+/* Makes sure the shared segment holds at least size bytes. It is only
+ * grown, so that fetches for panels of different sizes reuse it. */
+static gboolean
+panel_background_monitor_ensure_shm (PanelBackgroundMonitor *monitor,
+				     gsize                   size)
+{
+	GdkDisplay *display;
+	Display    *xdisplay;
+
+	display  = gdk_screen_get_display (monitor->screen);
+	xdisplay = GDK_DISPLAY_XDISPLAY (display);
+
+	if (!monitor->shm_checked) {
+		monitor->shm_checked = TRUE;
+		monitor->shm_available = XShmQueryExtension (xdisplay);
+	}
+
+	if (!monitor->shm_available)
+		return FALSE;
+
+	if (monitor->shm_size >= size)
+		return TRUE;
+
+	panel_background_monitor_free_shm (monitor);
+
+	monitor->shminfo.shmid = shmget (IPC_PRIVATE, size, IPC_CREAT | 0600);
+	if (monitor->shminfo.shmid < 0)
+		return FALSE;
+
+	monitor->shminfo.shmaddr = shmat (monitor->shminfo.shmid, NULL, 0);
+	if (monitor->shminfo.shmaddr == (char *) -1) {
+		shmctl (monitor->shminfo.shmid, IPC_RMID, NULL);
+		monitor->shminfo.shmaddr = NULL;
+		return FALSE;
+	}
+	monitor->shminfo.readOnly = False;
+
+	gdk_x11_display_error_trap_push (display);
+	XShmAttach (xdisplay, &monitor->shminfo);
+	XSync (xdisplay, False);
+
+	/* The segment goes away once both sides detached from it */
+	shmctl (monitor->shminfo.shmid, IPC_RMID, NULL);
+
+	if (gdk_x11_display_error_trap_pop (display)) {
+		/* Most likely a remote display */
+		shmdt (monitor->shminfo.shmaddr);
+		monitor->shminfo.shmaddr = NULL;
+		monitor->shm_available = FALSE;
+		return FALSE;
+	}
+
+	monitor->shm_size = size;
+
+	return TRUE;
+}
+
+static GdkPixbuf *
+panel_background_monitor_fetch_shm (PanelBackgroundMonitor *monitor,
+				    GdkVisual              *visual,
+				    int                     x,
+				    int                     y,
+				    int                     width,
+				    int                     height)
+{
+	GdkDisplay      *display;
+	Display         *xdisplay;
+	XImage          *image;
+	cairo_surface_t *surface;
+	GdkPixbuf       *pixbuf = NULL;
+	gsize            size;
+	gboolean         fetched;
+
+	display  = gdk_screen_get_display (monitor->screen);
+	xdisplay = GDK_DISPLAY_XDISPLAY (display);
+
+	/* The image header points into the shared segment, which is only
+	 * (re)allocated once the size of the data is known */
+	image = XShmCreateImage (xdisplay, GDK_VISUAL_XVISUAL (visual),
+				 monitor->pixmap_depth, ZPixmap, NULL,
+				 &monitor->shminfo, width, height);
+	if (!image)
+		return NULL;
+
+	/* Only plain xRGB data can be handed to cairo as is */
+	if (image->bits_per_pixel != 32 ||
+	    image->red_mask   != 0xff0000 ||
+	    image->green_mask != 0x00ff00 ||
+	    image->blue_mask  != 0x0000ff ||
+	    image->byte_order != (G_BYTE_ORDER == G_LITTLE_ENDIAN ? LSBFirst : MSBFirst)) {
+		XDestroyImage (image);
+		return NULL;
+	}
+
+	size = (gsize) image->bytes_per_line * image->height;
+	if (!panel_background_monitor_ensure_shm (monitor, size)) {
+		XDestroyImage (image);
+		return NULL;
+	}
+
+	image->data = monitor->shminfo.shmaddr;
+
+	gdk_x11_display_error_trap_push (display);
+	fetched = XShmGetImage (xdisplay, monitor->pixmap, image, x, y, AllPlanes);
+	if (gdk_x11_display_error_trap_pop (display))
+		fetched = FALSE;
+
+	if (fetched) {
+		surface = cairo_image_surface_create_for_data ((unsigned char *) image->data,
+							       CAIRO_FORMAT_RGB24,
+							       width, height,
+							       image->bytes_per_line);
+		pixbuf = gdk_pixbuf_get_from_surface (surface, 0, 0, width, height);
+		cairo_surface_destroy (surface);
+
+		PANEL_STATS_COUNT_N ("background-fetch-bytes", size);
+	}
+
+	/* Does not free the data, which belongs to the segment */
+	image->data = NULL;
+	XDestroyImage (image);
+
+	return pixbuf;
+}
+#endif
+
+/* Fetches a rectangle of the root pixmap, which must be within its
+ * bounds */
+static GdkPixbuf *
+panel_background_monitor_fetch (PanelBackgroundMonitor *monitor,
+				int                     x,
+				int                     y,
+				int                     width,
+				int                     height)
+{
+	GdkDisplay      *display;
+	GdkVisual       *visual;
+	cairo_surface_t *surface;
+	GdkPixbuf       *pixbuf;
+
+	visual = gdk_screen_get_system_visual (monitor->screen);
+	if (gdk_visual_get_depth (visual) != monitor->pixmap_depth)
+		return NULL;
+
+#ifdef HAVE_XSHM
+	pixbuf = panel_background_monitor_fetch_shm (monitor, visual,
+						     x, y, width, height);
+	if (pixbuf)
+		return pixbuf;
+#endif
+
+	display = gdk_screen_get_display (monitor->screen);
+
+	gdk_x11_display_error_trap_push (display);
+
+	surface = cairo_xlib_surface_create (GDK_DISPLAY_XDISPLAY (display),
+					     monitor->pixmap,
+					     GDK_VISUAL_XVISUAL (visual),
+					     monitor->pixmap_width,
+					     monitor->pixmap_height);
+	pixbuf = gdk_pixbuf_get_from_surface (surface, x, y, width, height);
+	cairo_surface_destroy (surface);
+
+	if (gdk_x11_display_error_trap_pop (display) && pixbuf) {
+		g_object_unref (pixbuf);
+		pixbuf = NULL;
+	}
+
+	if (pixbuf)
+		PANEL_STATS_COUNT_N ("background-fetch-bytes", (gint64) width * height * 4);
+
+	return pixbuf;
+}
+
+static PanelBackgroundRegion *
+panel_background_monitor_lookup_region (PanelBackgroundMonitor *monitor,
+					gboolean                is_tile,
+					int                     x,
+					int                     y,
+					int                     width,
+					int                     height)
+{
+	GSList *l;
+
+	for (l = monitor->regions; l; l = l->next) {
+		PanelBackgroundRegion *region = l->data;
+
+		if (region->generation != monitor->generation ||
+		    region->is_tile != is_tile)
+			continue;
+
+		if (x >= region->x && y >= region->y &&
+		    x + width  <= region->x + region->width &&
+		    y + height <= region->y + region->height) {
+			monitor->regions = g_slist_delete_link (monitor->regions, l);
+			monitor->regions = g_slist_prepend (monitor->regions, region);
+			PANEL_STATS_COUNT ("background-cache-hit");
+			return region;
+		}
+	}
+
+	PANEL_STATS_COUNT ("background-cache-miss");
+
+	return NULL;
+}
+
+static PanelBackgroundRegion *
+panel_background_monitor_add_region (PanelBackgroundMonitor *monitor,
+				     gboolean                is_tile,
+				     int                     x,
+				     int                     y,
+				     int                     width,
+				     int                     height)
+{
+	PanelBackgroundRegion *region;
+	GdkPixbuf             *pixbuf;
+	GSList                *last;
+
+	pixbuf = panel_background_monitor_fetch (monitor, x, y, width, height);
+	if (!pixbuf)
+		return NULL;
+
+	region = g_new0 (PanelBackgroundRegion, 1);
+	region->generation = monitor->generation;
+	region->is_tile    = is_tile;
+	region->x          = x;
+	region->y          = y;
+	region->width      = width;
+	region->height     = height;
+	region->pixbuf     = pixbuf;
+
+	monitor->regions = g_slist_prepend (monitor->regions, region);
+
+	if (g_slist_length (monitor->regions) > PANEL_BACKGROUND_MONITOR_MAX_REGIONS) {
+		last = g_slist_last (monitor->regions);
+		panel_background_region_free (last->data);
+		monitor->regions = g_slist_delete_link (monitor->regions, last);
+	}
+
+	return region;
+}
+
+/* Tiles a root pixmap smaller than the root window over the given
+ * rectangle of the root window */
 static GdkPixbuf *
-panel_background_monitor_tile_background (PanelBackgroundMonitor *monitor,
-					  int                     width,
-					  int                     height)
+panel_background_monitor_tile_background (GdkPixbuf *tile,
+					  int        x,
+					  int        y,
+					  int        width,
+					  int        height)
 {
 	GdkPixbuf *retval;
 	int        tilewidth, tileheight;
 
-	retval = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, width, height);
-
-	tilewidth  = gdk_pixbuf_get_width (monitor->gdkpixbuf);
-	tileheight = gdk_pixbuf_get_height (monitor->gdkpixbuf);
+	tilewidth  = gdk_pixbuf_get_width (tile);
+	tileheight = gdk_pixbuf_get_height (tile);
 
 	if (tilewidth == 1 && tileheight == 1) {
 		guchar  *pixels;
 		int      n_channels;
 		guint32  pixel = 0;
 
-		n_channels = gdk_pixbuf_get_n_channels (monitor->gdkpixbuf);
-		pixels     = gdk_pixbuf_get_pixels (monitor->gdkpixbuf);
+		retval = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8, width, height);
+
+		n_channels = gdk_pixbuf_get_n_channels (tile);
+		pixels     = gdk_pixbuf_get_pixels (tile);
 
 		if (pixels) {
 			if (n_channels == 4)
@@ -276,7 +663,8 @@ panel_background_monitor_tile_background (PanelBackgroundMonitor *monitor,
 		cairo_set_source_rgb (cr, 1, 1, 1);
 		cairo_paint (cr);
 
-		gdk_cairo_set_source_pixbuf (cr, monitor->gdkpixbuf, 0, 0);
+		gdk_cairo_set_source_pixbuf (cr, tile,
+					     -(x % tilewidth), -(y % tileheight));
 		pattern = cairo_get_source (cr);
 		cairo_pattern_set_extend (pattern, CAIRO_EXTEND_REPEAT);
 		cairo_rectangle (cr, 0, 0, width, height);
@@ -294,60 +682,48 @@ panel_background_monitor_tile_background (PanelBackgroundMonitor *monitor,
 	return retval;
 }
 
-static void
-panel_background_monitor_setup_pixbuf (PanelBackgroundMonitor *monitor)
+static GdkPixbuf *
+panel_background_monitor_get_subregion (PanelBackgroundMonitor *monitor,
+					int                     rwidth,
+					int                     rheight,
+					int                     x,
+					int                     y,
+					int                     width,
+					int                     height)
 {
-	GdkDisplay  *display;
-	int          rwidth, rheight;
-	int          pwidth, pheight;
-
-	display = gdk_screen_get_display (monitor->screen);
-
-	gdk_x11_display_grab (display);
-	monitor->display_grabbed = TRUE;
-
-//	if (!monitor->surface)
-//		monitor->surface = mate_bg_get_surface_from_root (monitor->screen);
+	PanelBackgroundRegion *region;
+	int                    tilewidth, tileheight;
+
+	if (x + width <= monitor->pixmap_width &&
+	    y + height <= monitor->pixmap_height) {
+		region = panel_background_monitor_lookup_region (monitor, FALSE,
+								 x, y, width, height);
+		if (!region)
+			region = panel_background_monitor_add_region (monitor, FALSE,
+								      x, y, width, height);
+		if (!region)
+			return NULL;
 
-	if (!monitor->surface)
-	{
-		g_warning ("couldn't get background pixmap\n");
-		gdk_x11_display_ungrab (display);
-		monitor->display_grabbed = FALSE;
-		return;
+		return gdk_pixbuf_new_subpixbuf (region->pixbuf,
+						 x - region->x, y - region->y,
+						 width, height);
 	}
 
-	pwidth = cairo_xlib_surface_get_width (monitor->surface);
-	pheight = cairo_xlib_surface_get_height (monitor->surface);
-
-	gdk_window_get_geometry (monitor->gdkwindow,
-				 NULL, NULL, &rwidth, &rheight);
-
-	monitor->width  = MIN (pwidth,  rwidth);
-	monitor->height = MIN (pheight, rheight);
-
-	g_assert (monitor->gdkpixbuf == NULL);
-	monitor->gdkpixbuf = gdk_pixbuf_get_from_surface (monitor->surface,
-													  0, 0,
-													  monitor->width, monitor->height);
-
-	gdk_x11_display_ungrab (display);
-	monitor->display_grabbed = FALSE;
-
-	if (monitor->gdkpixbuf == NULL)
-		return;
-
-	if ((monitor->width < rwidth || monitor->height < rheight)) {
-		GdkPixbuf *tiled;
-
-		tiled = panel_background_monitor_tile_background (
-						monitor, rwidth, rheight);
-		g_object_unref (monitor->gdkpixbuf);
-		monitor->gdkpixbuf = tiled;
+	/* The root pixmap is smaller than the root window: fetch it whole,
+	 * once, and only tile the requested rectangle */
+	tilewidth  = MIN (monitor->pixmap_width,  rwidth);
+	tileheight = MIN (monitor->pixmap_height, rheight);
+
+	region = panel_background_monitor_lookup_region (monitor, TRUE,
+							 0, 0, tilewidth, tileheight);
+	if (!region)
+		region = panel_background_monitor_add_region (monitor, TRUE,
+							      0, 0, tilewidth, tileheight);
+	if (!region)
+		return NULL;
 
-		monitor->width  = rwidth;
-		monitor->height = rheight;
-	}
+	return panel_background_monitor_tile_background (region->pixbuf,
+							 x, y, width, height);
 }
 
 GdkPixbuf *
@@ -358,17 +734,18 @@ panel_background_monitor_get_region (PanelBackgroundMonitor *monitor,
 				     int                     height)
 {
 	GdkPixbuf *pixbuf, *tmpbuf;
+	int        rwidth, rheight;
 	int        subwidth, subheight;
 	int        subx, suby;
 
-	if (!monitor->gdkpixbuf)
-		panel_background_monitor_setup_pixbuf (monitor);
-
-	if (!monitor->gdkpixbuf)
+	if (!panel_background_monitor_ensure_pixmap (monitor))
 		return NULL;
 
-	subwidth  = MIN (width,  monitor->width - x);
-	subheight = MIN (height, monitor->height - y);
+	gdk_window_get_geometry (monitor->gdkwindow,
+				 NULL, NULL, &rwidth, &rheight);
+
+	subwidth  = MIN (width,  rwidth - x);
+	subheight = MIN (height, rheight - y);
 	/* if x or y are negative numbers */
 	subwidth  = MIN (subwidth, width + x);
 	subheight  = MIN (subheight, height + y);
@@ -377,13 +754,16 @@ panel_background_monitor_get_region (PanelBackgroundMonitor *monitor,
 	suby = MAX (y, 0);
 
 	if ((subwidth <= 0) || (subheight <= 0) ||
-	    (monitor->width-x < 0) || (monitor->height-y < 0) )
+	    (rwidth-x < 0) || (rheight-y < 0) )
 		/* region is completely offscreen */
 		return gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
 				       width, height);
 
-	pixbuf = gdk_pixbuf_new_subpixbuf (
-			monitor->gdkpixbuf, subx, suby, subwidth, subheight);
+	pixbuf = panel_background_monitor_get_subregion (monitor, rwidth, rheight,
+							 subx, suby,
+							 subwidth, subheight);
+	if (!pixbuf)
+		return NULL;
 
 	if ((subwidth < width) || (subheight < height)) {
 		tmpbuf = gdk_pixbuf_new (GDK_COLORSPACE_RGB, FALSE, 8,
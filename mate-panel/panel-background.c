@@ -33,6 +33,8 @@
 #include <cairo.h>
 #include <cairo-xlib.h>
 
+#include <libpanel-util/panel-stats.h>
+
 #include "panel-background-monitor.h"
 #include "panel-util.h"
 
@@ -341,9 +343,13 @@ get_composited_pattern (PanelBackground *background)
 static gboolean
 panel_background_composite (PanelBackground *background)
 {
+	gint64 start;
+
 	if (!background->transformed)
 		return FALSE;
 
+	start = PANEL_STATS_TIMER_START ();
+
 	free_composited_resources (background);
 
 	switch (background->type) {
@@ -370,6 +376,8 @@ panel_background_composite (PanelBackground *background)
 
 	panel_background_prepare (background);
 
+	PANEL_STATS_TIMER_STOP ("panel-background-composite", start);
+
 	return TRUE;
 }
 
@@ -564,24 +572,99 @@ panel_background_update_has_alpha (PanelBackground *background)
 		disconnect_background_monitor (background);
 }
 
+/* The size the loaded image must at least have for the transformation
+ * to only scale it down, in the orientation of the file */
 static void
-load_background_file (PanelBackground *background)
+get_needed_image_size (PanelBackground *background,
+		       int             *width,
+		       int             *height)
 {
-	GError *error = NULL;
+	gboolean rotated;
+
+	rotated = background->orientation == GTK_ORIENTATION_VERTICAL &&
+		  background->rotate_image;
 
-	if (!g_file_test (background->image, G_FILE_TEST_IS_REGULAR))
+	if (background->fit_image) {
+		*width  = 1;
+		*height = 1;
+
+		if (background->orientation == GTK_ORIENTATION_HORIZONTAL)
+			*height = background->region.height;
+		else if (rotated)
+			*height = background->region.width;
+		else
+			*width  = background->region.width;
+	} else if (background->stretch_image) {
+		*width  = rotated ? background->region.height : background->region.width;
+		*height = rotated ? background->region.width  : background->region.height;
+	} else {
+		/* Tiled as is */
+		*width  = PANEL_BACKGROUND_IMAGE_ORIGINAL_SIZE;
+		*height = PANEL_BACKGROUND_IMAGE_ORIGINAL_SIZE;
+	}
+}
+
+static void
+background_image_changed (PanelBackgroundImage *image,
+			  PanelBackground      *background)
+{
+	if (!background->image_pending)
 		return;
 
-	//FIXME add a monitor on the file so that we reload the background
-	//when it changes
-	background->loaded_image = 
-		gdk_pixbuf_new_from_file (background->image, &error);
-	if (!background->loaded_image) {
-		g_assert (error != NULL);
-		g_warning (G_STRLOC ": unable to open '%s': %s",
-			   background->image, error->message);
-		g_error_free (error);
+	free_transformed_resources (background);
+	panel_background_transform (background);
+}
+
+static void
+release_background_file (PanelBackground *background)
+{
+	if (background->shared_image) {
+		g_signal_handler_disconnect (background->shared_image,
+					     background->shared_image_signal);
+		g_object_unref (background->shared_image);
 	}
+	background->shared_image = NULL;
+	background->shared_image_signal = 0;
+	background->image_pending = FALSE;
+
+	if (background->loaded_image)
+		g_object_unref (background->loaded_image);
+	background->loaded_image = NULL;
+}
+
+/* Takes the image from the shared decodes, at the size needed for the
+ * current region. Until it is decoded, the previous decode of the image
+ * is kept, if any, or the color is shown. */
+static void
+load_background_file (PanelBackground *background)
+{
+	GdkPixbuf *pixbuf;
+	int        width, height;
+
+	if (!background->shared_image) {
+		background->shared_image =
+			panel_background_image_get_for_file (background->image);
+		if (!background->shared_image)
+			return;
+
+		background->shared_image_signal =
+			g_signal_connect (background->shared_image, "changed",
+					  G_CALLBACK (background_image_changed),
+					  background);
+	}
+
+	get_needed_image_size (background, &width, &height);
+
+	pixbuf = panel_background_image_lookup (background->shared_image,
+						width, height);
+	if (pixbuf && pixbuf != background->loaded_image) {
+		if (background->loaded_image)
+			g_object_unref (background->loaded_image);
+		background->loaded_image = g_object_ref (pixbuf);
+	}
+
+	background->image_pending =
+		!pixbuf && !panel_background_image_has_failed (background->shared_image);
 
 	panel_background_update_has_alpha (background);
 }
@@ -653,9 +736,20 @@ static void
 panel_background_set_image_no_update (PanelBackground *background,
 				      const char      *image)
 {
-	if (background->loaded_image)
-		g_object_unref (background->loaded_image);
-	background->loaded_image = NULL;
+	/* Keep the decoded image when the profile sets the same file again,
+	 * unless the file changed since */
+	if (image && background->image && !strcmp (background->image, image)) {
+		PanelBackgroundImage *current;
+
+		current = panel_background_image_get_for_file (image);
+		if (current)
+			g_object_unref (current);
+
+		if (current == background->shared_image)
+			return;
+	}
+
+	release_background_file (background);
 
 	if (background->image)
 		g_free (background->image);
@@ -891,6 +985,9 @@ panel_background_init (PanelBackground              *background,
 
 	background->image        = NULL;
 	background->loaded_image = NULL;
+	background->shared_image = NULL;
+	background->shared_image_signal = 0;
+	background->image_pending = FALSE;
 
 	background->orientation       = GTK_ORIENTATION_HORIZONTAL;
 	background->region.x          = -1;
@@ -930,14 +1027,12 @@ panel_background_free (PanelBackground *background)
 
 	free_transformed_resources (background);
 
+	release_background_file (background);
+
 	if (background->image)
 		g_free (background->image);
 	background->image = NULL;
 
-	if (background->loaded_image)
-		g_object_unref (background->loaded_image);
-	background->loaded_image = NULL;
-
 	if (background->monitor)
 		g_object_unref (background->monitor);
 	background->monitor = NULL;
@@ -1013,7 +1108,7 @@ panel_background_effective_type (PanelBackground *background)
 
 	retval = background->type;
 	if (background->type == PANEL_BACK_IMAGE && !background->composited_pattern)
-		retval = PANEL_BACK_NONE;
+		retval = background->image_pending ? PANEL_BACK_COLOR : PANEL_BACK_NONE;
 
 	return retval;
 }
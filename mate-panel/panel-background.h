@@ -31,6 +31,7 @@
 #include "panel-enums.h"
 #include "panel-types.h"
 #include "panel-background-monitor.h"
+#include "panel-background-image.h"
 
 typedef struct _PanelBackground PanelBackground;
 
@@ -48,6 +49,8 @@ struct _PanelBackground {
 
 	char                   *image;
 	GdkPixbuf              *loaded_image; 
+	PanelBackgroundImage   *shared_image;
+	gulong                  shared_image_signal;
 
 	GtkOrientation          orientation;
 	GdkRectangle            region;
@@ -68,6 +71,9 @@ struct _PanelBackground {
 
 	guint                   has_alpha : 1;
 
+	/* The image is being decoded, the color is shown meanwhile */
+	guint                   image_pending : 1;
+
 	guint                   loaded : 1;
 	guint                   transformed : 1;
 	guint                   composited : 1;
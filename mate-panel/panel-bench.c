@@ -0,0 +1,691 @@
+/*
+ * panel-bench.c: headless layout and startup benchmark
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Generates a layout of N panel toplevels, each holding M launchers and a
+ * set of applets, and loads it with the same code as the panel itself:
+ * PanelToplevel, PanelWidget, ButtonWidget, Launcher and applet frames. It
+ * then measures:
+ *
+ *  - the time until every toplevel painted once,
+ *  - the time until every object is loaded and mapped,
+ *  - the time for all the panels to settle after a size change,
+ *  - the CPU used by the process while the layout is idle.
+ *
+ * The results are printed as JSON, so that runs can be compared.
+ *
+ * The layout only lives in the memory GSettings backend, and the benchmark
+ * runs on its own session bus: the out-of-process applets are activated
+ * by that bus, inherit the memory backend, and none of them touches the
+ * user's dconf database or running panel. An X server is still needed:
+ * "make bench" runs the benchmark under xvfb-run when there is none.
+ */
+
+#include <config.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <glib/gi18n.h>
+#include <glib/gstdio.h>
+#include <gtk/gtk.h>
+#include <gio/gio.h>
+
+#include <libpanel-util/panel-cleanup.h>
+
+#include "applet.h"
+#include "panel-config-global.h"
+#include "panel-globals.h"
+#include "panel-lockdown.h"
+#include "panel-multiscreen.h"
+#include "panel-profile.h"
+#include "panel-schemas.h"
+#include "panel-stock-icons.h"
+#include "panel-toplevel.h"
+#include "panel-widget.h"
+
+/* globals, normally defined in main.c */
+GSList *panels = NULL;
+GSList *panel_list = NULL;
+
+#define BENCH_LAUNCHER_ICON "application-x-executable"
+#define BENCH_POLL_INTERVAL 5
+
+static int     n_toplevels = 2;
+static int     n_launchers = 10;
+static int     applet_copies = 1;
+static int     panel_size = 24;
+static int     idle_seconds = 5;
+static int     timeout_seconds = 30;
+static char  **in_process_iids = NULL;
+static char  **out_of_process_iids = NULL;
+static char   *output_file = NULL;
+
+static const GOptionEntry options [] = {
+	{ "toplevels", 'n', 0, G_OPTION_ARG_INT, &n_toplevels, "Number of panel toplevels", "N" },
+	{ "launchers", 'm', 0, G_OPTION_ARG_INT, &n_launchers, "Number of launchers per toplevel", "M" },
+	{ "in-process-applet", 0, 0, G_OPTION_ARG_STRING_ARRAY, &in_process_iids, "IID of an in-process applet to load on each toplevel (can be repeated)", "IID" },
+	{ "out-of-process-applet", 0, 0, G_OPTION_ARG_STRING_ARRAY, &out_of_process_iids, "IID of an out-of-process applet to load on each toplevel (can be repeated)", "IID" },
+	{ "applet-copies", 'k', 0, G_OPTION_ARG_INT, &applet_copies, "Number of instances of each applet per toplevel", "K" },
+	{ "size", 's', 0, G_OPTION_ARG_INT, &panel_size, "Initial size of the panels", "SIZE" },
+	{ "idle-seconds", 0, 0, G_OPTION_ARG_INT, &idle_seconds, "Duration of the idle CPU measurement", "SECONDS" },
+	{ "timeout", 0, 0, G_OPTION_ARG_INT, &timeout_seconds, "Give up on a phase after this many seconds", "SECONDS" },
+	{ "output", 'o', 0, G_OPTION_ARG_FILENAME, &output_file, "Write the results to FILE instead of the standard output", "FILE" },
+	{ NULL }
+};
+
+typedef struct {
+	PanelToplevel *toplevel;
+	int            height;
+	gboolean       painted;
+} BenchToplevel;
+
+typedef struct {
+	GSList     *toplevels;
+
+	int         n_painted;
+	int         n_launchers;
+	int         n_applets;
+
+	GMainLoop  *loop;
+	gboolean  (*done) (void);
+	gboolean    timed_out;
+} Bench;
+
+static Bench bench;
+
+/* Phases */
+
+static gboolean
+bench_phase_timeout (gpointer data)
+{
+	bench.timed_out = TRUE;
+	g_main_loop_quit (bench.loop);
+
+	return FALSE;
+}
+
+static void
+bench_check_done (void)
+{
+	if (bench.done && bench.done ())
+		g_main_loop_quit (bench.loop);
+}
+
+/* The end of the applet loading queue is not signalled, so the phases also
+ * poll their condition */
+static gboolean
+bench_poll (gpointer data)
+{
+	bench_check_done ();
+
+	return TRUE;
+}
+
+/* Runs the main loop until done() returns TRUE; returns the elapsed time in
+ * microseconds, or -1 if the phase timed out */
+static gint64
+bench_run_phase (gboolean (*done) (void),
+		 gint64     start)
+{
+	guint timeout_id;
+	guint poll_id;
+
+	bench.done = done;
+	bench.timed_out = FALSE;
+
+	if (!done ()) {
+		timeout_id = g_timeout_add_seconds (timeout_seconds,
+						    bench_phase_timeout, NULL);
+		poll_id = g_timeout_add (BENCH_POLL_INTERVAL, bench_poll, NULL);
+		g_main_loop_run (bench.loop);
+		g_source_remove (poll_id);
+		if (!bench.timed_out)
+			g_source_remove (timeout_id);
+	}
+
+	bench.done = NULL;
+
+	if (bench.timed_out)
+		return -1;
+
+	return g_get_monotonic_time () - start;
+}
+
+static gboolean
+bench_all_painted (void)
+{
+	return bench.n_painted == g_slist_length (bench.toplevels);
+}
+
+static gboolean
+bench_all_objects_mapped (void)
+{
+	GSList *l;
+
+	if (!mate_panel_applets_loaded ())
+		return FALSE;
+
+	for (l = mate_panel_applet_list_applets (); l; l = l->next) {
+		AppletInfo *info = l->data;
+
+		if (!gtk_widget_get_mapped (info->widget))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static gboolean
+bench_never_done (void)
+{
+	return FALSE;
+}
+
+/* Layout */
+
+static void
+bench_set_toplevel (const char *id,
+		    int         index)
+{
+	GSettings *settings;
+	char      *path;
+
+	path = g_strdup_printf (PANEL_TOPLEVEL_PATH "%s/", id);
+	settings = g_settings_new_with_path (PANEL_TOPLEVEL_SCHEMA, path);
+
+	g_settings_set_int (settings, PANEL_TOPLEVEL_SCREEN_KEY, 0);
+	g_settings_set_int (settings, PANEL_TOPLEVEL_MONITOR_KEY, 0);
+	g_settings_set_enum (settings, PANEL_TOPLEVEL_ORIENTATION_KEY,
+			     PANEL_ORIENTATION_TOP);
+	g_settings_set_boolean (settings, PANEL_TOPLEVEL_EXPAND_KEY, TRUE);
+	g_settings_set_int (settings, PANEL_TOPLEVEL_SIZE_KEY, panel_size);
+	g_settings_set_int (settings, PANEL_TOPLEVEL_Y_KEY, index * panel_size);
+	/* The hide animations are not what is measured */
+	g_settings_set_boolean (settings, PANEL_TOPLEVEL_ENABLE_ANIMATIONS_KEY, FALSE);
+
+	g_object_unref (settings);
+	g_free (path);
+}
+
+static GSettings *
+bench_set_object (const char      *id,
+		  PanelObjectType  type,
+		  const char      *toplevel_id,
+		  int              position)
+{
+	GSettings *settings;
+	char      *path;
+
+	path = g_strdup_printf (PANEL_OBJECT_PATH "%s/", id);
+	settings = g_settings_new_with_path (PANEL_OBJECT_SCHEMA, path);
+
+	g_settings_set_enum (settings, PANEL_OBJECT_TYPE_KEY, type);
+	g_settings_set_string (settings, PANEL_OBJECT_TOPLEVEL_ID_KEY, toplevel_id);
+	g_settings_set_int (settings, PANEL_OBJECT_POSITION_KEY, position);
+
+	g_free (path);
+
+	return settings;
+}
+
+static void
+bench_add_applets (GPtrArray   *objects,
+		   const char  *toplevel_id,
+		   char       **iids,
+		   int         *position)
+{
+	int i, k;
+
+	for (i = 0; iids && iids[i]; i++) {
+		for (k = 0; k < applet_copies; k++) {
+			GSettings *settings;
+			char      *id;
+
+			id = g_strdup_printf ("%s-applet-%d", toplevel_id, *position);
+			settings = bench_set_object (id, PANEL_OBJECT_APPLET,
+						     toplevel_id, (*position)++);
+			g_settings_set_string (settings, PANEL_OBJECT_APPLET_IID_KEY,
+					       iids[i]);
+			g_object_unref (settings);
+
+			g_ptr_array_add (objects, id);
+			bench.n_applets++;
+		}
+	}
+}
+
+/* Writes the layout to the panel settings, as panel_profile_load() expects
+ * to find it */
+static void
+bench_write_layout (const char *launcher_location)
+{
+	GSettings *settings;
+	GPtrArray *toplevels;
+	GPtrArray *objects;
+	int        i, j;
+
+	toplevels = g_ptr_array_new_with_free_func (g_free);
+	objects = g_ptr_array_new_with_free_func (g_free);
+
+	for (i = 0; i < n_toplevels; i++) {
+		char *toplevel_id;
+		int   position = 0;
+
+		toplevel_id = g_strdup_printf ("bench-toplevel-%d", i);
+		bench_set_toplevel (toplevel_id, i);
+		g_ptr_array_add (toplevels, toplevel_id);
+
+		for (j = 0; j < n_launchers; j++) {
+			GSettings *object;
+			char      *id;
+
+			id = g_strdup_printf ("%s-launcher-%d", toplevel_id, position);
+			object = bench_set_object (id, PANEL_OBJECT_LAUNCHER,
+						   toplevel_id, position++);
+			g_settings_set_string (object, PANEL_OBJECT_LAUNCHER_LOCATION_KEY,
+					       launcher_location);
+			g_object_unref (object);
+
+			g_ptr_array_add (objects, id);
+			bench.n_launchers++;
+		}
+
+		bench_add_applets (objects, toplevel_id, in_process_iids, &position);
+		bench_add_applets (objects, toplevel_id, out_of_process_iids, &position);
+	}
+
+	g_ptr_array_add (toplevels, NULL);
+	g_ptr_array_add (objects, NULL);
+
+	settings = g_settings_new (PANEL_SCHEMA);
+	g_settings_set_strv (settings, PANEL_TOPLEVEL_ID_LIST_KEY,
+			     (const char * const *) toplevels->pdata);
+	g_settings_set_strv (settings, PANEL_OBJECT_ID_LIST_KEY,
+			     (const char * const *) objects->pdata);
+	g_object_unref (settings);
+
+	g_ptr_array_free (toplevels, TRUE);
+	g_ptr_array_free (objects, TRUE);
+}
+
+static char *
+bench_write_launcher (const char *dir)
+{
+	GKeyFile *key_file;
+	char     *path;
+	char     *data;
+	gsize     length;
+	GError   *error = NULL;
+
+	key_file = g_key_file_new ();
+	g_key_file_set_string (key_file, G_KEY_FILE_DESKTOP_GROUP,
+			       G_KEY_FILE_DESKTOP_KEY_TYPE,
+			       G_KEY_FILE_DESKTOP_TYPE_APPLICATION);
+	g_key_file_set_string (key_file, G_KEY_FILE_DESKTOP_GROUP,
+			       G_KEY_FILE_DESKTOP_KEY_NAME, "Bench");
+	g_key_file_set_string (key_file, G_KEY_FILE_DESKTOP_GROUP,
+			       G_KEY_FILE_DESKTOP_KEY_EXEC, "true");
+	g_key_file_set_string (key_file, G_KEY_FILE_DESKTOP_GROUP,
+			       G_KEY_FILE_DESKTOP_KEY_ICON, BENCH_LAUNCHER_ICON);
+
+	data = g_key_file_to_data (key_file, &length, NULL);
+	g_key_file_free (key_file);
+
+	path = g_build_filename (dir, "bench.desktop", NULL);
+	if (!g_file_set_contents (path, data, length, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		g_free (path);
+		path = NULL;
+	}
+
+	g_free (data);
+
+	return path;
+}
+
+static gboolean
+toplevel_draw (GtkWidget     *widget,
+	       cairo_t       *cr,
+	       BenchToplevel *toplevel)
+{
+	/* After a size change, only a paint at the new size counts */
+	if (!toplevel->painted &&
+	    gtk_widget_get_allocated_height (widget) != toplevel->height) {
+		toplevel->painted = TRUE;
+		bench.n_painted++;
+		bench_check_done ();
+	}
+
+	return FALSE;
+}
+
+static void
+bench_watch_toplevels (void)
+{
+	GSList *l;
+
+	for (l = panel_toplevel_list_toplevels (); l; l = l->next) {
+		BenchToplevel *toplevel;
+
+		toplevel = g_new0 (BenchToplevel, 1);
+		toplevel->toplevel = l->data;
+		toplevel->height = -1;
+
+		g_signal_connect_after (toplevel->toplevel, "draw",
+					G_CALLBACK (toplevel_draw), toplevel);
+
+		bench.toplevels = g_slist_append (bench.toplevels, toplevel);
+	}
+}
+
+/* Size change */
+
+static void
+bench_set_size (int size)
+{
+	GSList *l;
+
+	bench.n_painted = 0;
+
+	for (l = bench.toplevels; l; l = l->next) {
+		BenchToplevel *toplevel = l->data;
+
+		toplevel->painted = FALSE;
+		toplevel->height = gtk_widget_get_allocated_height (GTK_WIDGET (toplevel->toplevel));
+
+		/* Goes through the same path as the properties dialog */
+		g_settings_set_int (toplevel->toplevel->settings,
+				    PANEL_TOPLEVEL_SIZE_KEY, size);
+	}
+}
+
+/* Session bus */
+
+static GTestDBus *
+bench_bus_up (void)
+{
+	GTestDBus          *bus;
+	const char * const *dirs;
+	char               *display;
+	char               *dir;
+	int                 i;
+
+	bus = g_test_dbus_new (G_TEST_DBUS_NONE);
+
+	/* Activate the installed out-of-process applets on our bus */
+	dir = g_build_filename (g_get_user_data_dir (), "dbus-1", "services", NULL);
+	g_test_dbus_add_service_dir (bus, dir);
+	g_free (dir);
+
+	dirs = g_get_system_data_dirs ();
+	for (i = 0; dirs[i]; i++) {
+		dir = g_build_filename (dirs[i], "dbus-1", "services", NULL);
+		g_test_dbus_add_service_dir (bus, dir);
+		g_free (dir);
+	}
+
+	/* g_test_dbus_up() unsets DISPLAY, which whatever the panel code
+	 * spawns still needs */
+	display = g_strdup (g_getenv ("DISPLAY"));
+	g_test_dbus_up (bus);
+	if (display)
+		g_setenv ("DISPLAY", display, TRUE);
+	g_free (display);
+
+	return bus;
+}
+
+static void
+bench_bus_down (GTestDBus *bus)
+{
+	GDBusConnection *connection;
+
+	/* The panel code still holds the connection: don't let its closing
+	 * terminate us */
+	connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, NULL);
+	if (connection) {
+		g_dbus_connection_set_exit_on_close (connection, FALSE);
+		g_object_unref (connection);
+	}
+
+	g_test_dbus_stop (bus);
+	g_object_unref (bus);
+}
+
+/* Results */
+
+static double
+bench_cpu_seconds (void)
+{
+	struct rusage usage;
+
+	getrusage (RUSAGE_SELF, &usage);
+
+	return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+	       usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static void
+print_ms (FILE       *out,
+	  const char *name,
+	  gint64      usec)
+{
+	if (usec < 0)
+		fprintf (out, "  \"%s\": null,\n", name);
+	else
+		fprintf (out, "  \"%s\": %.3f,\n", name, usec / 1000.0);
+}
+
+static void
+print_iids (FILE        *out,
+	    const char  *name,
+	    char       **iids)
+{
+	int i;
+
+	fprintf (out, "  \"%s\": [", name);
+	/* IIDs are plain identifiers */
+	for (i = 0; iids && iids[i]; i++)
+		fprintf (out, "%s\"%s\"", i ? ", " : "", iids[i]);
+	fprintf (out, "],\n");
+}
+
+static void
+count_objects (int *n_launchers,
+	       int *n_applets)
+{
+	GSList *l;
+
+	*n_launchers = 0;
+	*n_applets = 0;
+
+	for (l = mate_panel_applet_list_applets (); l; l = l->next) {
+		AppletInfo *info = l->data;
+
+		if (info->type == PANEL_OBJECT_LAUNCHER)
+			(*n_launchers)++;
+		else if (info->type == PANEL_OBJECT_APPLET)
+			(*n_applets)++;
+	}
+}
+
+int
+main (int argc, char **argv)
+{
+	FILE      *out;
+	GSList    *l;
+	GTestDBus *bus;
+	char      *applets_dir;
+	char      *launcher_dir;
+	char      *launcher_location;
+	gint64     start;
+	gint64     first_paint;
+	gint64     objects_mapped;
+	gint64     size_change;
+	double     cpu_start;
+	double     idle_cpu;
+	int        n_launchers_loaded;
+	int        n_applets_loaded;
+	GError    *error = NULL;
+
+	start = g_get_monotonic_time ();
+
+	/* Must be set before anything creates a GSettings or talks to a
+	 * session bus */
+	g_setenv ("GSETTINGS_BACKEND", "memory", TRUE);
+	g_setenv ("NO_AT_BRIDGE", "1", TRUE);
+
+	if (!gtk_init_with_args (&argc, &argv,
+				 "- benchmark the panel layout and startup",
+				 (GOptionEntry *) options, GETTEXT_PACKAGE,
+				 &error)) {
+		if (error) {
+			g_printerr ("%s\n", error->message);
+			g_error_free (error);
+		} else
+			g_printerr ("Cannot initialize GTK+.\n");
+
+		return 1;
+	}
+
+	if (n_toplevels < 1 || n_launchers < 0 || applet_copies < 0 ||
+	    panel_size < 1 || idle_seconds < 0 || timeout_seconds < 1) {
+		g_printerr ("Invalid layout parameters\n");
+		return 1;
+	}
+
+	if (g_file_test ("../libmate-panel-applet", G_FILE_TEST_IS_DIR)) {
+		applets_dir = g_strdup_printf ("%s:../libmate-panel-applet", MATE_PANEL_APPLETS_DIR);
+		g_setenv ("MATE_PANEL_APPLETS_DIR", applets_dir, FALSE);
+		g_free (applets_dir);
+	}
+
+	launcher_dir = g_dir_make_tmp ("latte-panel-bench-XXXXXX", &error);
+	if (!launcher_dir) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+
+	launcher_location = bench_write_launcher (launcher_dir);
+	if (!launcher_location) {
+		g_rmdir (launcher_dir);
+		return 1;
+	}
+
+	bus = bench_bus_up ();
+
+	bench.loop = g_main_loop_new (NULL, FALSE);
+
+	bench_write_layout (launcher_location);
+
+	/* Same initialization as main.c, minus the session, the shell and the
+	 * action protocol */
+	panel_multiscreen_init ();
+	panel_init_stock_icons_and_items ();
+	panel_global_config_load ();
+	panel_lockdown_init ();
+	panel_profile_load ();
+
+	g_slist_foreach (panels,
+			 (GFunc) panel_widget_add_forbidden,
+			 NULL);
+
+	bench_watch_toplevels ();
+
+	first_paint = bench_run_phase (bench_all_painted, start);
+	objects_mapped = bench_run_phase (bench_all_objects_mapped, start);
+
+	/* Let the applets settle before changing the size */
+	while (gtk_events_pending ())
+		gtk_main_iteration ();
+
+	size_change = g_get_monotonic_time ();
+	bench_set_size (panel_size * 2);
+	size_change = bench_run_phase (bench_all_painted, size_change);
+
+	cpu_start = bench_cpu_seconds ();
+	g_timeout_add_seconds (idle_seconds, bench_phase_timeout, NULL);
+	bench.done = bench_never_done;
+	g_main_loop_run (bench.loop);
+	bench.done = NULL;
+	idle_cpu = bench_cpu_seconds () - cpu_start;
+
+	count_objects (&n_launchers_loaded, &n_applets_loaded);
+
+	if (output_file) {
+		out = fopen (output_file, "w");
+		if (!out) {
+			g_printerr ("Cannot open '%s': %s\n",
+				    output_file, g_strerror (errno));
+			return 1;
+		}
+	} else {
+		out = stdout;
+	}
+
+	fprintf (out, "{\n");
+	fprintf (out, "  \"toplevels\": %d,\n", n_toplevels);
+	fprintf (out, "  \"launchers_per_toplevel\": %d,\n", n_launchers);
+	fprintf (out, "  \"applet_copies\": %d,\n", applet_copies);
+	print_iids (out, "in_process_applets", in_process_iids);
+	print_iids (out, "out_of_process_applets", out_of_process_iids);
+	fprintf (out, "  \"launchers_loaded\": %d,\n", n_launchers_loaded);
+	fprintf (out, "  \"applets_loaded\": %d,\n", n_applets_loaded);
+	fprintf (out, "  \"applets_failed\": %d,\n", bench.n_applets - n_applets_loaded);
+	print_ms (out, "first_paint_ms", first_paint);
+	print_ms (out, "objects_mapped_ms", objects_mapped);
+	print_ms (out, "size_change_ms", size_change);
+	fprintf (out, "  \"idle_seconds\": %d,\n", idle_seconds);
+	/* Only counts this process: out-of-process applets are not included */
+	fprintf (out, "  \"idle_cpu_percent\": %.2f\n",
+		 idle_seconds ? 100.0 * idle_cpu / idle_seconds : 0.0);
+	fprintf (out, "}\n");
+
+	if (out != stdout)
+		fclose (out);
+
+	for (l = bench.toplevels; l; l = l->next) {
+		BenchToplevel *toplevel = l->data;
+
+		g_signal_handlers_disconnect_by_func (toplevel->toplevel,
+						      toplevel_draw, toplevel);
+		g_free (toplevel);
+	}
+	g_slist_free (bench.toplevels);
+	g_main_loop_unref (bench.loop);
+
+	panel_lockdown_finalize ();
+	panel_cleanup_do ();
+
+	bench_bus_down (bus);
+
+	g_unlink (launcher_location);
+	g_rmdir (launcher_dir);
+	g_free (launcher_location);
+	g_free (launcher_dir);
+
+	return n_applets_loaded < bench.n_applets ||
+	       n_launchers_loaded < bench.n_launchers ? 2 : 0;
+}
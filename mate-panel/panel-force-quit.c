@@ -36,12 +36,13 @@
 
 #include "panel-icon-names.h"
 #include "panel-stock-icons.h"
+#include "panel-window-lookup.h"
 
 static GdkFilterReturn popup_filter (GdkXEvent *gdk_xevent,
 				     GdkEvent  *event,
 				     GtkWidget *popup);
 
-static Atom wm_state_atom = None;
+#define PANEL_FORCE_QUIT_LOOKUP_KEY "panel-force-quit-lookup"
 
 static GtkWidget *
 display_popup_window (GdkScreen *screen)
@@ -133,75 +134,6 @@ remove_popup (GtkWidget *popup)
 #endif
 }
 
-static gboolean
-wm_state_set (Display *display,
-	      Window   window)
-{
-	gulong  nitems;
-	gulong  bytes_after;
-	gulong *prop;
-	Atom    ret_type = None;
-	int     ret_format;
-	int     result;
-
-	gdk_error_trap_push ();
-	result = XGetWindowProperty (display, window, wm_state_atom,
-				     0, G_MAXLONG, False, wm_state_atom,
-				     &ret_type, &ret_format, &nitems,
-				     &bytes_after, (gpointer) &prop);
-
-	if (gdk_error_trap_pop ())
-		return FALSE;
-
-	if (result != Success)
-		return FALSE;
-
-	XFree (prop);
-
-	if (ret_type != wm_state_atom)
-		return FALSE;
-
-	return TRUE;
-}
-
-static Window 
-find_managed_window (Display *display,
-		     Window   window)
-{
-	Window  root;
-	Window  parent;
-	Window *kids = NULL;
-	Window  retval;
-	guint   nkids;
-	int     i, result;
-
-	if (wm_state_set (display, window))
-		return window;
-
-	gdk_error_trap_push ();
-	result = XQueryTree (display, window, &root, &parent, &kids, &nkids);
-	if (gdk_error_trap_pop () || !result)
-		return None;
-
-	retval = None;
-
-	for (i = 0; i < nkids; i++) {
-		if (wm_state_set (display, kids [i])) {
-			retval = kids [i];
-			break;
-		}
-
-		retval = find_managed_window (display, kids [i]);
-		if (retval != None)
-			break;
-	}
-
-	if (kids)
-		XFree (kids);
-
-	return retval;
-}
-
 static void
 kill_window_response (GtkDialog *dialog,
 		      gint       response_id,
@@ -261,17 +193,23 @@ handle_button_press_event (GtkWidget *popup,
 			   Display *display,
 			   Window subwindow)
 {
-	Window window;
+	PanelWindowLookup *lookup;
+	Window window = None;
+
+	lookup = g_object_steal_data (G_OBJECT (popup),
+				      PANEL_FORCE_QUIT_LOOKUP_KEY);
 
 	remove_popup (popup);
 
+	if (subwindow != None && lookup)
+		window = panel_window_lookup_at (lookup, subwindow);
+	panel_window_lookup_free (lookup);
+
 	if (subwindow == None)
 		return;
 
-	if (wm_state_atom == None)
-		wm_state_atom = XInternAtom (display, "WM_STATE", FALSE);
-
-	window = find_managed_window (display, subwindow);
+	if (window == None)
+		window = panel_window_lookup_find_managed (display, subwindow);
 
 	if (window != None) {
 		if (!gdk_x11_window_lookup_for_display (gdk_x11_lookup_xdisplay (display), window))
@@ -373,4 +311,11 @@ panel_force_quit (GdkScreen *screen,
 	}
 
 	gdk_flush ();
+
+	/* While the user picks a window, so that the click is handled
+	 * without walking the whole window tree */
+	g_object_set_data_full (G_OBJECT (popup), PANEL_FORCE_QUIT_LOOKUP_KEY,
+				panel_window_lookup_new (GDK_DISPLAY_XDISPLAY (display),
+							 GDK_WINDOW_XID (root)),
+				(GDestroyNotify) panel_window_lookup_free);
 }
@@ -30,6 +30,8 @@
 #include <gio/gio.h>
 #include "panel-schemas.h"
 
+#define PANEL_LOCKDOWN_N_KEYS 6
+
 typedef struct {
         guint   initialized : 1;
 
@@ -41,7 +43,13 @@ typedef struct {
 
         gchar **disabled_applets;
 
-        GSList *closures;
+        /* The closures interested in each key, and user_data => the
+         * closures created for it, which own the references */
+        GHashTable *key_closures [PANEL_LOCKDOWN_N_KEYS];
+        GHashTable *data_closures;
+
+        PanelLockdownKeys changed_keys;
+        guint             dispatch_id;
 
         GSettings *panel_settings;
         GSettings *lockdown_settings;
@@ -50,13 +58,64 @@ typedef struct {
 static PanelLockdown panel_lockdown = { 0, };
 
 
-static inline void
-panel_lockdown_invoke_closures (PanelLockdown *lockdown)
+/* Calls each closure interested in one of the keys that changed since the
+ * last dispatch, once, however many of its keys changed */
+static gboolean
+panel_lockdown_dispatch (PanelLockdown *lockdown)
 {
-        GSList *l;
+        PanelLockdownKeys  keys;
+        GHashTable        *seen;
+        GSList            *closures = NULL;
+        GSList            *l;
+        int                i;
+
+        keys = lockdown->changed_keys;
+        lockdown->changed_keys = 0;
+        lockdown->dispatch_id = 0;
+
+        seen = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+        for (i = 0; i < PANEL_LOCKDOWN_N_KEYS; i++) {
+                GHashTableIter iter;
+                gpointer       closure;
+
+                if (!(keys & (1 << i)) || !lockdown->key_closures [i])
+                        continue;
+
+                g_hash_table_iter_init (&iter, lockdown->key_closures [i]);
+                while (g_hash_table_iter_next (&iter, &closure, NULL)) {
+                        if (g_hash_table_contains (seen, closure))
+                                continue;
+
+                        g_hash_table_add (seen, closure);
+                        closures = g_slist_prepend (closures,
+                                                    g_closure_ref (closure));
+                }
+        }
 
-        for (l = lockdown->closures; l; l = l->next)
+        g_hash_table_destroy (seen);
+
+        /* A callback can remove other closures: they are invalidated
+         * then, which makes invoking them a no-op */
+        for (l = closures; l; l = l->next) {
                 g_closure_invoke (l->data, NULL, 0, NULL, NULL);
+                g_closure_unref (l->data);
+        }
+        g_slist_free (closures);
+
+        return FALSE;
+}
+
+static void
+panel_lockdown_queue_notify (PanelLockdown     *lockdown,
+                             PanelLockdownKeys  key)
+{
+        lockdown->changed_keys |= key;
+
+        if (!lockdown->dispatch_id)
+                lockdown->dispatch_id =
+                        g_idle_add ((GSourceFunc) panel_lockdown_dispatch,
+                                    lockdown);
 }
 
 static void
@@ -65,7 +124,7 @@ locked_down_notify (GSettings     *settings,
                     PanelLockdown *lockdown)
 {
         lockdown->locked_down = g_settings_get_boolean (settings, key);
-        panel_lockdown_invoke_closures (lockdown);
+        panel_lockdown_queue_notify (lockdown, PANEL_LOCKDOWN_LOCKED_DOWN);
 }
 
 static void
@@ -74,7 +133,7 @@ disable_command_line_notify (GSettings     *settings,
                              PanelLockdown *lockdown)
 {
         lockdown->disable_command_line = g_settings_get_boolean (settings, key);
-        panel_lockdown_invoke_closures (lockdown);
+        panel_lockdown_queue_notify (lockdown, PANEL_LOCKDOWN_DISABLE_COMMAND_LINE);
 }
 
 static void
@@ -83,7 +142,7 @@ disable_lock_screen_notify (GSettings     *settings,
                             PanelLockdown *lockdown)
 {
         lockdown->disable_lock_screen = g_settings_get_boolean (settings, key);
-        panel_lockdown_invoke_closures (lockdown);
+        panel_lockdown_queue_notify (lockdown, PANEL_LOCKDOWN_DISABLE_LOCK_SCREEN);
 }
 
 static void
@@ -92,7 +151,7 @@ disable_log_out_notify (GSettings     *settings,
                         PanelLockdown *lockdown)
 {
         lockdown->disable_log_out = g_settings_get_boolean (settings, key);
-        panel_lockdown_invoke_closures (lockdown);
+        panel_lockdown_queue_notify (lockdown, PANEL_LOCKDOWN_DISABLE_LOG_OUT);
 }
 
 static void
@@ -101,7 +160,7 @@ disable_force_quit_notify (GSettings     *settings,
                            PanelLockdown *lockdown)
 {
         lockdown->disable_force_quit = g_settings_get_boolean (settings, key);
-        panel_lockdown_invoke_closures (lockdown);
+        panel_lockdown_queue_notify (lockdown, PANEL_LOCKDOWN_DISABLE_FORCE_QUIT);
 }
 
 static void
@@ -109,8 +168,9 @@ disabled_applets_notify (GSettings     *settings,
                          gchar         *key,
                          PanelLockdown *lockdown)
 {
+        g_strfreev (lockdown->disabled_applets);
         lockdown->disabled_applets = g_settings_get_strv (settings, key);
-        panel_lockdown_invoke_closures (lockdown);
+        panel_lockdown_queue_notify (lockdown, PANEL_LOCKDOWN_DISABLED_APPLETS);
 }
 
 static gboolean
@@ -196,10 +256,17 @@ panel_lockdown_init (void)
         panel_lockdown.initialized = TRUE;
 }
 
+static void
+panel_lockdown_free_closures (gpointer  user_data,
+                              GSList   *closures)
+{
+        g_slist_free_full (closures, (GDestroyNotify) g_closure_unref);
+}
+
 void
 panel_lockdown_finalize (void)
 {
-        GSList *l;
+        int i;
 
         g_assert (panel_lockdown.initialized != FALSE);
 
@@ -217,10 +284,24 @@ panel_lockdown_finalize (void)
                 panel_lockdown.lockdown_settings = NULL;
         }
 
-        for (l = panel_lockdown.closures; l; l = l->next)
-                g_closure_unref (l->data);
-        g_slist_free (panel_lockdown.closures);
-        panel_lockdown.closures = NULL;
+        if (panel_lockdown.dispatch_id)
+                g_source_remove (panel_lockdown.dispatch_id);
+        panel_lockdown.dispatch_id = 0;
+        panel_lockdown.changed_keys = 0;
+
+        for (i = 0; i < PANEL_LOCKDOWN_N_KEYS; i++) {
+                if (panel_lockdown.key_closures [i])
+                        g_hash_table_destroy (panel_lockdown.key_closures [i]);
+                panel_lockdown.key_closures [i] = NULL;
+        }
+
+        if (panel_lockdown.data_closures) {
+                g_hash_table_foreach (panel_lockdown.data_closures,
+                                      (GHFunc) panel_lockdown_free_closures,
+                                      NULL);
+                g_hash_table_destroy (panel_lockdown.data_closures);
+                panel_lockdown.data_closures = NULL;
+        }
 
         panel_lockdown.initialized = FALSE;
 }
@@ -281,19 +362,21 @@ panel_lockdown_is_applet_disabled (const char *iid)
 }
 
 static GClosure *
-panel_lockdown_notify_find (GSList    *closures,
-                            GCallback  callback_func,
-                            gpointer   user_data)
+panel_lockdown_notify_find (PanelLockdown *lockdown,
+                            GCallback      callback_func,
+                            gpointer       user_data)
 {
         GSList *l;
 
-        for (l = closures; l; l = l->next) {
+        if (!lockdown->data_closures)
+                return NULL;
+
+        for (l = g_hash_table_lookup (lockdown->data_closures, user_data);
+             l; l = l->next) {
                 GCClosure *cclosure = l->data;
-                GClosure  *closure  = l->data;
 
-                if (closure->data == user_data &&
-                    cclosure->callback == callback_func)
-                        return closure;
+                if (cclosure->callback == callback_func)
+                        return l->data;
         }
 
         return NULL;
@@ -318,18 +401,47 @@ marshal_user_data (GClosure     *closure,
 void
 panel_lockdown_notify_add (GCallback callback_func,
                            gpointer  user_data)
+{
+        panel_lockdown_notify_add_keys (PANEL_LOCKDOWN_ALL,
+                                        callback_func, user_data);
+}
+
+void
+panel_lockdown_notify_add_keys (PanelLockdownKeys keys,
+                                GCallback         callback_func,
+                                gpointer          user_data)
 {
         GClosure *closure;
+        GSList   *closures;
+        int       i;
 
-        g_assert (panel_lockdown_notify_find (panel_lockdown.closures,
+        g_assert (panel_lockdown_notify_find (&panel_lockdown,
                                               callback_func,
                                               user_data) == NULL);
 
         closure = g_cclosure_new (callback_func, user_data, NULL);
         g_closure_set_marshal (closure, marshal_user_data);
 
-        panel_lockdown.closures = g_slist_append (panel_lockdown.closures,
-                                                  closure);
+        if (!panel_lockdown.data_closures)
+                panel_lockdown.data_closures =
+                        g_hash_table_new (g_direct_hash, g_direct_equal);
+
+        closures = g_hash_table_lookup (panel_lockdown.data_closures,
+                                        user_data);
+        g_hash_table_insert (panel_lockdown.data_closures, user_data,
+                             g_slist_prepend (closures, closure));
+
+        for (i = 0; i < PANEL_LOCKDOWN_N_KEYS; i++) {
+                if (!(keys & (1 << i)))
+                        continue;
+
+                if (!panel_lockdown.key_closures [i])
+                        panel_lockdown.key_closures [i] =
+                                g_hash_table_new (g_direct_hash,
+                                                  g_direct_equal);
+
+                g_hash_table_add (panel_lockdown.key_closures [i], closure);
+        }
 }
 
 void
@@ -337,15 +449,31 @@ panel_lockdown_notify_remove (GCallback callback_func,
                               gpointer  user_data)
 {
         GClosure *closure;
+        GSList   *closures;
+        int       i;
 
-        closure = panel_lockdown_notify_find (panel_lockdown.closures,
+        closure = panel_lockdown_notify_find (&panel_lockdown,
                                               callback_func,
                                               user_data);
 
         g_assert (closure != NULL);
 
-        panel_lockdown.closures = g_slist_remove (panel_lockdown.closures,
-                                                  closure);
-
+        for (i = 0; i < PANEL_LOCKDOWN_N_KEYS; i++)
+                if (panel_lockdown.key_closures [i])
+                        g_hash_table_remove (panel_lockdown.key_closures [i],
+                                             closure);
+
+        closures = g_hash_table_lookup (panel_lockdown.data_closures,
+                                        user_data);
+        closures = g_slist_remove (closures, closure);
+        if (closures)
+                g_hash_table_insert (panel_lockdown.data_closures,
+                                     user_data, closures);
+        else
+                g_hash_table_remove (panel_lockdown.data_closures,
+                                     user_data);
+
+        /* It might be about to be dispatched */
+        g_closure_invalidate (closure);
         g_closure_unref (closure);
 }
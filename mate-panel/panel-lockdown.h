@@ -32,6 +32,17 @@
 extern "C" {
 #endif
 
+/* The lockdown settings a notification can be about */
+typedef enum {
+        PANEL_LOCKDOWN_LOCKED_DOWN          = 1 << 0,
+        PANEL_LOCKDOWN_DISABLE_COMMAND_LINE = 1 << 1,
+        PANEL_LOCKDOWN_DISABLE_LOCK_SCREEN  = 1 << 2,
+        PANEL_LOCKDOWN_DISABLE_LOG_OUT      = 1 << 3,
+        PANEL_LOCKDOWN_DISABLE_FORCE_QUIT   = 1 << 4,
+        PANEL_LOCKDOWN_DISABLED_APPLETS     = 1 << 5,
+        PANEL_LOCKDOWN_ALL                  = (1 << 6) - 1
+} PanelLockdownKeys;
+
 void panel_lockdown_init     (void);
 void panel_lockdown_finalize (void);
 
@@ -43,10 +54,15 @@ gboolean panel_lockdown_get_disable_force_quit   (void);
 
 gboolean panel_lockdown_is_applet_disabled (const char *iid);
 
-void panel_lockdown_notify_add    (GCallback callback_func,
-                                   gpointer  user_data);
-void panel_lockdown_notify_remove (GCallback callback_func,
-                                   gpointer  user_data);
+/* The callbacks are called once per main loop iteration in which one of
+ * their keys changed, with user_data as only argument */
+void panel_lockdown_notify_add      (GCallback          callback_func,
+                                     gpointer           user_data);
+void panel_lockdown_notify_add_keys (PanelLockdownKeys  keys,
+                                     GCallback          callback_func,
+                                     gpointer           user_data);
+void panel_lockdown_notify_remove   (GCallback          callback_func,
+                                     gpointer           user_data);
 
 #ifdef __cplusplus
 }
@@ -163,6 +163,7 @@ static void panel_menu_bar_init(PanelMenuBar* menubar)
 	menubar->priv->settings = g_settings_new (PANEL_MENU_BAR_SCHEMA);
 
 	menubar->priv->applications_menu = create_applications_menu("mate-applications.menu", NULL, TRUE);
+	panel_menu_prewarm(menubar->priv->applications_menu);
 
 	menubar->priv->applications_item = panel_image_menu_item_new();
 	gtk_menu_item_set_label(GTK_MENU_ITEM(menubar->priv->applications_item), _("Applications"));
@@ -355,7 +356,7 @@ static void panel_menu_bar_load(PanelWidget* panel, gboolean locked, int positio
 	mate_panel_applet_add_callback(menubar->priv->info, "help", GTK_STOCK_HELP, _("_Help"), NULL);
 
 	/* Menu editors */
-	if (!panel_lockdown_get_locked_down () && (panel_is_program_in_path("mozo") || panel_is_program_in_path("matemenu-simple-editor")))
+	if (!panel_lockdown_get_locked_down () && panel_capability_available (PANEL_CAPABILITY_MENU_EDITOR))
 	{
 		mate_panel_applet_add_callback (menubar->priv->info, "edit", NULL, _("_Edit Menus"), NULL);
 	}
@@ -36,6 +36,7 @@
 #include <libpanel-util/panel-error.h>
 #include <libpanel-util/panel-launch.h>
 #include <libpanel-util/panel-show.h>
+#include <libpanel-util/panel-stats.h>
 
 #include "applet.h"
 #include "panel-widget.h"
@@ -98,10 +99,10 @@ struct _PanelMenuButtonPrivate {
 	guint                  use_custom_icon : 1;
 	guint                  has_arrow : 1;
 	guint                  dnd_enabled : 1;
+	guint                  popped_up : 1;
 };
 
 static void panel_menu_button_disconnect_from_gsettings (PanelMenuButton *button);
-static void panel_menu_button_recreate_menu         (PanelMenuButton *button);
 static void panel_menu_button_set_icon              (PanelMenuButton *button);
 
 static AtkObject *panel_menu_button_get_accessible  (GtkWidget       *widget);
@@ -193,9 +194,6 @@ panel_menu_button_finalize (GObject *object)
 {
 	PanelMenuButton *button = PANEL_MENU_BUTTON (object);
 
-	panel_lockdown_notify_remove (G_CALLBACK (panel_menu_button_recreate_menu),
-				      button);
-
 	panel_menu_button_disconnect_from_gsettings (button);
 
 	if (button->priv->menu) {
@@ -415,15 +413,9 @@ panel_menu_button_create_menu (PanelMenuButton *button)
 				  G_CALLBACK (panel_menu_button_menu_deactivated),
 				  button);
 
-	return button->priv->menu;
-}
+	panel_menu_prewarm (button->priv->menu);
 
-static void
-panel_menu_button_recreate_menu (PanelMenuButton *button)
-{
-	if (button->priv->menu)
-		gtk_widget_destroy (button->priv->menu);
-	button->priv->menu = NULL;
+	return button->priv->menu;
 }
 
 void
@@ -432,10 +424,14 @@ panel_menu_button_popup_menu (PanelMenuButton *button,
 			      guint32          activate_time)
 {
 	GdkScreen *screen;
+	gint64     start;
 
 	g_return_if_fail (PANEL_IS_MENU_BUTTON (button));
 
+	start = PANEL_STATS_TIMER_START ();
+
 	panel_menu_button_create_menu (button);
+	panel_menu_load (button->priv->menu, -1);
 
 	panel_toplevel_push_autohide_disabler (button->priv->toplevel);
 
@@ -452,6 +448,13 @@ panel_menu_button_popup_menu (PanelMenuButton *button,
 			GTK_WIDGET (button),
 			n_button,
 			activate_time);
+
+	/* The first one is where a missing prewarm shows */
+	if (!button->priv->popped_up)
+		PANEL_STATS_TIMER_STOP ("menu-button-first-popup", start);
+	else
+		PANEL_STATS_TIMER_STOP ("menu-button-popup", start);
+	button->priv->popped_up = TRUE;
 }
 
 static void
@@ -669,8 +672,7 @@ panel_menu_button_load (const char  *menu_path,
 	mate_panel_applet_add_callback (info, "help", GTK_STOCK_HELP, _("_Help"), NULL);
 
         if (!panel_lockdown_get_locked_down () &&
-            (panel_is_program_in_path ("mozo") ||
-	    panel_is_program_in_path ("matemenu-simple-editor")))
+            panel_capability_available (PANEL_CAPABILITY_MENU_EDITOR))
 		mate_panel_applet_add_callback (info, "edit", NULL,
 					   _("_Edit Menus"), NULL);
 
@@ -679,8 +681,8 @@ panel_menu_button_load (const char  *menu_path,
 
 	panel_menu_button_connect_to_gsettings (button);
 
-	panel_lockdown_notify_add (G_CALLBACK (panel_menu_button_recreate_menu),
-				   button);
+	/* Built empty, filled in the background */
+	panel_menu_button_create_menu (button);
 }
 
 static char *
@@ -31,8 +31,6 @@
  *   + drag and drop loses icon for URIs
  *   + drag and drop of bookmarks/network places/removable media should create
  *     a menu button
- *   + if a menu is open and gets updated, it should reappear and not just
- *     disappear
  */
 
 #include <config.h>
@@ -70,6 +68,35 @@ G_DEFINE_TYPE(PanelDesktopMenuItem, panel_desktop_menu_item, GTK_TYPE_IMAGE_MENU
 #define PANEL_DESKTOP_MENU_ITEM_GET_PRIVATE(o) \
 	(G_TYPE_INSTANCE_GET_PRIVATE((o), PANEL_TYPE_DESKTOP_MENU_ITEM, PanelDesktopMenuItemPrivate))
 
+/* The parts of the places menu that can change at runtime. Each of them is
+ * rebuilt on its own, in place, the next time the menu is shown. */
+typedef enum {
+	PANEL_PLACE_SECTION_BOOKMARKS,
+	PANEL_PLACE_SECTION_LOCAL,
+	PANEL_PLACE_SECTION_REMOTE,
+	PANEL_PLACE_N_SECTIONS
+} PanelPlaceSection;
+
+#define PANEL_PLACE_DIRTY_SECTION(s) (1 << (s))
+#define PANEL_PLACE_DIRTY_ALL        (1 << PANEL_PLACE_N_SECTIONS)
+
+typedef enum {
+	PANEL_PLACE_MOUNT_ADDED,
+	PANEL_PLACE_MOUNT_CHANGED,
+	PANEL_PLACE_MOUNT_REMOVED
+} PanelPlaceMountOpType;
+
+typedef struct {
+	PanelPlaceMountOpType  type;
+	GMount                *mount;
+} PanelPlaceMountOp;
+
+/* Menu item shown for a drive, volume or mount */
+typedef struct {
+	GtkWidget         *item;
+	PanelPlaceSection  section;
+} PanelPlaceGioEntry;
+
 struct _PanelPlaceMenuItemPrivate {
 	GtkWidget   *menu;
 	PanelWidget *panel;
@@ -80,8 +107,6 @@ struct _PanelPlaceMenuItemPrivate {
 
 	GtkRecentManager *recent_manager;
 
-	GFileMonitor *bookmarks_monitor;
-
 	GVolumeMonitor *volume_monitor;
 	gulong       drive_changed_id;
 	gulong       drive_connected_id;
@@ -93,6 +118,23 @@ struct _PanelPlaceMenuItemPrivate {
 	gulong       mount_changed_id;
 	gulong       mount_removed_id;
 
+	/* Changes recorded while the menu is not visible */
+	guint        dirty;
+	GQueue      *pending_mounts;
+
+	/* Top-level items of each section, and the item they follow */
+	GList       *section_items[PANEL_PLACE_N_SECTIONS];
+	GtkWidget   *section_anchor[PANEL_PLACE_N_SECTIONS];
+	GtkWidget   *section_submenu[PANEL_PLACE_N_SECTIONS];
+	guint        section_count[PANEL_PLACE_N_SECTIONS];
+
+	/* GDrive/GVolume/GMount -> PanelPlaceGioEntry */
+	GHashTable  *gio_items;
+
+	/* Which bookmarks existed when the section was built, one '0' or
+	 * '1' per bookmark */
+	char        *bookmarks_existing;
+
 	guint        use_image : 1;
 };
 
@@ -213,12 +255,12 @@ panel_menu_items_append_from_desktop (GtkWidget *menu,
 	if (is_application) {
 		tryexec = panel_key_file_get_string (key_file, "TryExec");
 		if (tryexec) {
-			char *prog;
+			gboolean found;
 
-			prog = g_find_program_in_path (tryexec);
+			found = panel_is_program_in_path (tryexec);
 			g_free (tryexec);
 
-			if (!prog) {
+			if (!found) {
 				/* FIXME: we could add some file monitor magic,
 				 * so that the menu items appears when the
 				 * program appears, but that's really complex
@@ -228,8 +270,6 @@ panel_menu_items_append_from_desktop (GtkWidget *menu,
 					g_free (path_freeme);
 				return;
 			}
-
-			g_free (prog);
 		}
 	}
 
@@ -281,7 +321,7 @@ panel_menu_items_append_from_desktop (GtkWidget *menu,
 		g_free (path_freeme);
 }
 
-static void
+static GtkWidget *
 panel_menu_items_append_place_item (const char *icon_name,
 				    GIcon      *gicon,
 				    const char *title,
@@ -312,6 +352,8 @@ panel_menu_items_append_place_item (const char *icon_name,
 
 	if (g_str_has_prefix (uri, "file:")) /*Links only work for local files*/
 		setup_uri_drag (item, uri, icon_name, GDK_ACTION_LINK);
+
+	return item;
 }
 
 static GtkWidget *
@@ -352,119 +394,427 @@ panel_menu_items_create_action_item (PanelActionButtonType action_type)
 							 NULL, NULL);
 }
 
+/* Bookmarks are shared by all the places menus of the panel. The file is read
+ * asynchronously, and parsed again only when its mtime or size changed; menu
+ * construction only ever looks at the last parsed array. Whether a local
+ * bookmark still exists is not part of the cache: it is checked each time
+ * the menu is shown. */
+typedef struct {
+	char     *uri;
+	char     *label;
+	char     *tooltip;
+	char     *icon;
+	gboolean  check_exists;
+} PanelBookmark;
+
+typedef struct {
+	GFile        *file;
+	GCancellable *cancellable;
+	guint64       mtime;
+	guint32       mtime_usec;
+	goffset       size;
+} PanelBookmarksLoad;
+
+static struct {
+	GPtrArray    *bookmarks;
+	guint64       mtime;
+	guint32       mtime_usec;
+	goffset       size;
+
+	GFileMonitor *monitor;
+	GCancellable *cancellable;
+	GSList       *listeners;
+} panel_bookmarks = { NULL, 0, 0, -1, NULL, NULL, NULL };
+
+static void panel_place_menu_item_queue_update (GtkWidget *widget,
+						guint      dirty);
+
+static void
+panel_bookmark_free (PanelBookmark *bookmark)
+{
+	g_free (bookmark->uri);
+	g_free (bookmark->label);
+	g_free (bookmark->tooltip);
+	g_free (bookmark->icon);
+	g_slice_free (PanelBookmark, bookmark);
+}
+
 static void
-panel_place_menu_item_append_gtk_bookmarks (GtkWidget *menu, guint max_items_or_submenu)
+panel_bookmarks_load_free (PanelBookmarksLoad *load)
 {
-	typedef struct {
-		char *full_uri;
-		char *label;
-	} PanelBookmark;
+	g_object_unref (load->file);
+	g_object_unref (load->cancellable);
+	g_slice_free (PanelBookmarksLoad, load);
+}
 
-	GtkWidget   *add_menu;
-	char        *filename;
-	GIOChannel  *io_channel;
-	GHashTable  *table;
-	int          i;
-	GSList      *lines = NULL;
-	GSList      *add_bookmarks, *l;
-	PanelBookmark *bookmark;
+static void
+panel_bookmarks_set (GPtrArray *bookmarks,
+		     guint64    mtime,
+		     guint32    mtime_usec,
+		     goffset    size)
+{
+	GSList *l;
 
-	filename = g_build_filename (g_get_home_dir (),
-				     BOOKMARKS_FILENAME, NULL);
+	if (panel_bookmarks.bookmarks)
+		g_ptr_array_unref (panel_bookmarks.bookmarks);
 
-	io_channel = g_io_channel_new_file (filename, "r", NULL);
-	g_free (filename);
+	panel_bookmarks.bookmarks = bookmarks;
+	panel_bookmarks.mtime      = mtime;
+	panel_bookmarks.mtime_usec = mtime_usec;
+	panel_bookmarks.size       = size;
 
-	if (!io_channel)
-		return;
+	for (l = panel_bookmarks.listeners; l; l = l->next)
+		panel_place_menu_item_queue_update (GTK_WIDGET (l->data),
+						    PANEL_PLACE_DIRTY_SECTION (PANEL_PLACE_SECTION_BOOKMARKS));
+}
+
+/* Runs in a thread: only does thread-safe GIO calls */
+static void
+panel_bookmarks_parse_thread (GTask        *task,
+			      gpointer      source_object,
+			      gpointer      task_data,
+			      GCancellable *cancellable)
+{
+	GPtrArray   *bookmarks;
+	GHashTable  *table;
+	char       **lines;
+	int          i;
+
+	bookmarks = g_ptr_array_new_with_free_func ((GDestroyNotify) panel_bookmark_free);
+	table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 
 	/* We use a hard limit to avoid having users shooting their
 	 * own feet, and to avoid crashing the system if a misbehaving
 	 * application creates a big bookmarks file.
 	 */
-	for (i = 0; i < MAX_BOOKMARK_ITEMS; i++) {
-		char      *contents;
-		gsize      length;
-		gsize      terminator_pos;
-		GIOStatus  status;
+	lines = g_strsplit ((const char *) task_data, "\n", MAX_BOOKMARK_ITEMS + 1);
 
-		status = g_io_channel_read_line (io_channel, &contents, &length, &terminator_pos, NULL);
+	for (i = 0; lines[i] != NULL && i < MAX_BOOKMARK_ITEMS; i++) {
+		PanelBookmark *bookmark;
+		GFile         *file;
+		char          *line;
+		char          *space;
+		char          *display_name;
 
-		if (status != G_IO_STATUS_NORMAL)
+		if (g_cancellable_is_cancelled (cancellable))
 			break;
 
-		if (length == 0)
-			break;
+		line = lines[i];
+
+		if (!line[0] || g_hash_table_lookup (table, line))
+			continue;
 
-		/* Clear the line terminator (\n), if any */
-		if (terminator_pos > 0)
-			contents[terminator_pos] = '\0';
+		g_hash_table_add (table, g_strdup (line));
 
-		lines = g_slist_prepend (lines, contents);
+		space = strchr (line, ' ');
+		if (space)
+			*space = '\0';
+
+		file = g_file_new_for_uri (line);
+
+		bookmark = g_slice_new0 (PanelBookmark);
+		bookmark->uri = g_strdup (line);
+		bookmark->check_exists = !g_str_has_prefix (line, "x-caja-search:") &&
+					 g_file_is_native (file);
+
+		if (space) {
+			bookmark->label = g_strstrip (g_strdup (space + 1));
+			if (!bookmark->label[0]) {
+				g_free (bookmark->label);
+				bookmark->label = NULL;
+			}
+		}
+
+		display_name = g_file_get_parse_name (file);
+		/* Translators: %s is a URI */
+		bookmark->tooltip = g_strdup_printf (_("Open '%s'"), display_name);
+		g_free (display_name);
+		g_object_unref (file);
+
+		g_ptr_array_add (bookmarks, bookmark);
 	}
 
-	g_io_channel_shutdown (io_channel, FALSE, NULL);
-	g_io_channel_unref (io_channel);
+	g_hash_table_destroy (table);
+	g_strfreev (lines);
 
-	if (!lines)
+	if (g_task_return_error_if_cancelled (task)) {
+		g_ptr_array_unref (bookmarks);
 		return;
+	}
 
-	lines = g_slist_reverse (lines);
+	g_task_return_pointer (task, bookmarks,
+			       (GDestroyNotify) g_ptr_array_unref);
+}
 
-	table = g_hash_table_new (g_str_hash, g_str_equal);
-	add_bookmarks = NULL;
+static void
+panel_bookmarks_parse_cb (GObject      *source_object,
+			  GAsyncResult *result,
+			  gpointer      user_data)
+{
+	PanelBookmarksLoad *load = user_data;
+	GPtrArray          *parsed;
+	GPtrArray          *bookmarks;
+	guint               i;
+
+	parsed = g_task_propagate_pointer (G_TASK (result), NULL);
+	if (!parsed) {
+		panel_bookmarks_load_free (load);
+		return;
+	}
 
-	for (l = lines; l; l = l->next) {
-		char *line = (char*) l->data;
+	/* Labels and icons may need the volume monitor and the icon theme,
+	 * which can only be used from the main thread. This is done once
+	 * per change of the file. */
+	bookmarks = g_ptr_array_new_with_free_func ((GDestroyNotify) panel_bookmark_free);
 
-		if (line[0] && !g_hash_table_lookup (table, line)) {
-			GFile    *file;
-			char     *space;
-			char     *label;
-			gboolean  keep;
+	for (i = 0; i < parsed->len; i++) {
+		PanelBookmark *bookmark = g_ptr_array_index (parsed, i);
 
-			g_hash_table_insert (table, line, line);
+		if (!bookmark->label)
+			bookmark->label = panel_util_get_label_for_uri (bookmark->uri);
+		if (!bookmark->label)
+			continue;
 
-			space = strchr (line, ' ');
-			if (space) {
-				*space = '\0';
-				label = g_strdup (space + 1);
-			} else {
-				label = NULL;
-			}
+		bookmark->icon = panel_util_get_icon_for_uri (bookmark->uri);
+		/*FIXME: we should probably get a GIcon if possible, so that we
+		 * have customized icons for cd-rom, eg */
+		if (!bookmark->icon)
+			bookmark->icon = g_strdup (PANEL_ICON_FOLDER);
+
+		g_ptr_array_index (parsed, i) = NULL;
+		g_ptr_array_add (bookmarks, bookmark);
+	}
 
-			keep = FALSE;
+	g_ptr_array_set_free_func (parsed, NULL);
+	for (i = 0; i < parsed->len; i++) {
+		if (g_ptr_array_index (parsed, i))
+			panel_bookmark_free (g_ptr_array_index (parsed, i));
+	}
+	g_ptr_array_unref (parsed);
 
-			if (g_str_has_prefix (line, "x-caja-search:"))
-				keep = TRUE;
+	panel_bookmarks_set (bookmarks, load->mtime, load->mtime_usec, load->size);
+	panel_bookmarks_load_free (load);
+}
 
-			if (!keep) {
-				file = g_file_new_for_uri (line);
-				keep = !g_file_is_native (file) ||
-				       g_file_query_exists (file, NULL);
-				g_object_unref (file);
-			}
+static void
+panel_bookmarks_load_contents_cb (GObject      *source_object,
+				  GAsyncResult *result,
+				  gpointer      user_data)
+{
+	PanelBookmarksLoad *load = user_data;
+	GError             *error;
+	GTask              *task;
+	char               *contents;
 
-			if (!keep) {
-				if (label)
-					g_free (label);
-				continue;
-			}
+	error = NULL;
+	if (!g_file_load_contents_finish (G_FILE (source_object), result,
+					  &contents, NULL, NULL, &error)) {
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			panel_bookmarks_set (g_ptr_array_new (), 0, 0, -1);
+		g_error_free (error);
+		panel_bookmarks_load_free (load);
+		return;
+	}
 
-			bookmark = g_malloc (sizeof (PanelBookmark));
-			bookmark->full_uri = g_strdup (line);
-			bookmark->label = label;
-			add_bookmarks = g_slist_prepend (add_bookmarks, bookmark);
+	task = g_task_new (NULL, load->cancellable,
+			   panel_bookmarks_parse_cb, load);
+	g_task_set_task_data (task, contents, g_free);
+	g_task_run_in_thread (task, panel_bookmarks_parse_thread);
+	g_object_unref (task);
+}
+
+static void
+panel_bookmarks_query_info_cb (GObject      *source_object,
+			       GAsyncResult *result,
+			       gpointer      user_data)
+{
+	PanelBookmarksLoad *load = user_data;
+	GFileInfo          *info;
+	GError             *error;
+
+	error = NULL;
+	info = g_file_query_info_finish (G_FILE (source_object), result, &error);
+	if (!info) {
+		/* No bookmarks file */
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			panel_bookmarks_set (g_ptr_array_new (), 0, 0, -1);
+		g_error_free (error);
+		panel_bookmarks_load_free (load);
+		return;
+	}
+
+	/* Bookmarks saved twice within a second have the same mtime */
+	load->mtime      = g_file_info_get_attribute_uint64 (info,
+							     G_FILE_ATTRIBUTE_TIME_MODIFIED);
+	load->mtime_usec = g_file_info_get_attribute_uint32 (info,
+							     G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+	load->size       = g_file_info_get_size (info);
+	g_object_unref (info);
+
+	if (panel_bookmarks.bookmarks != NULL &&
+	    load->mtime      == panel_bookmarks.mtime &&
+	    load->mtime_usec == panel_bookmarks.mtime_usec &&
+	    load->size       == panel_bookmarks.size) {
+		panel_bookmarks_load_free (load);
+		return;
+	}
+
+	g_file_load_contents_async (load->file, load->cancellable,
+				    panel_bookmarks_load_contents_cb, load);
+}
+
+static void
+panel_bookmarks_reload (void)
+{
+	PanelBookmarksLoad *load;
+	char               *filename;
+
+	if (panel_bookmarks.cancellable) {
+		g_cancellable_cancel (panel_bookmarks.cancellable);
+		g_object_unref (panel_bookmarks.cancellable);
+	}
+	panel_bookmarks.cancellable = g_cancellable_new ();
+
+	filename = g_build_filename (g_get_home_dir (),
+				     BOOKMARKS_FILENAME, NULL);
+
+	load = g_slice_new0 (PanelBookmarksLoad);
+	load->file        = g_file_new_for_path (filename);
+	load->cancellable = g_object_ref (panel_bookmarks.cancellable);
+
+	g_free (filename);
+
+	g_file_query_info_async (load->file,
+				 G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+				 G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+				 G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+				 G_FILE_QUERY_INFO_NONE,
+				 G_PRIORITY_DEFAULT,
+				 load->cancellable,
+				 panel_bookmarks_query_info_cb, load);
+}
+
+static void
+panel_bookmarks_file_changed (GFileMonitor      *handle,
+			      GFile             *file,
+			      GFile             *other_file,
+			      GFileMonitorEvent  event,
+			      gpointer           user_data)
+{
+	panel_bookmarks_reload ();
+}
+
+static void
+panel_bookmarks_add_listener (PanelPlaceMenuItem *place_item)
+{
+	panel_bookmarks.listeners = g_slist_prepend (panel_bookmarks.listeners,
+						     place_item);
+
+	if (panel_bookmarks.monitor == NULL) {
+		GFile  *bookmark;
+		char   *bookmarks_filename;
+		GError *error;
+
+		bookmarks_filename = g_build_filename (g_get_home_dir (),
+						       BOOKMARKS_FILENAME, NULL);
+		bookmark = g_file_new_for_path (bookmarks_filename);
+
+		error = NULL;
+		panel_bookmarks.monitor = g_file_monitor_file (bookmark,
+							       G_FILE_MONITOR_NONE,
+							       NULL,
+							       &error);
+		if (error) {
+			g_warning ("Failed to add file monitor for %s: %s\n",
+				   bookmarks_filename, error->message);
+			g_error_free (error);
+		} else {
+			g_signal_connect (panel_bookmarks.monitor, "changed",
+					  G_CALLBACK (panel_bookmarks_file_changed),
+					  NULL);
 		}
+
+		g_object_unref (bookmark);
+		g_free (bookmarks_filename);
 	}
 
-	g_hash_table_destroy (table);
-	g_slist_foreach (lines, (GFunc) g_free, NULL);
-	g_slist_free (lines);
+	if (panel_bookmarks.bookmarks == NULL &&
+	    panel_bookmarks.cancellable == NULL)
+		panel_bookmarks_reload ();
+}
+
+static void
+panel_bookmarks_remove_listener (PanelPlaceMenuItem *place_item)
+{
+	panel_bookmarks.listeners = g_slist_remove (panel_bookmarks.listeners,
+						    place_item);
+}
+
+/* Local bookmarks that do not exist are not shown; this is cheap enough to
+ * be done each time the menu is shown, which catches folders created or
+ * deleted after the bookmarks file was read. */
+static char *
+panel_bookmarks_get_existing (GPtrArray *bookmarks)
+{
+	GString *existing;
+	guint    i;
+
+	existing = g_string_sized_new (bookmarks->len);
+
+	for (i = 0; i < bookmarks->len; i++) {
+		PanelBookmark *bookmark = g_ptr_array_index (bookmarks, i);
+		gboolean       exists = TRUE;
+
+		if (bookmark->check_exists) {
+			GFile *file;
+
+			file = g_file_new_for_uri (bookmark->uri);
+			exists = g_file_query_exists (file, NULL);
+			g_object_unref (file);
+		}
+
+		g_string_append_c (existing, exists ? '1' : '0');
+	}
+
+	return g_string_free (existing, FALSE);
+}
+
+/* Before the first load completes there is nothing to show: the section is
+ * marked dirty by panel_bookmarks_set(), and rebuilt then. */
+static void
+panel_place_menu_item_append_gtk_bookmarks (PanelPlaceMenuItem *place_item,
+					    GtkWidget          *menu,
+					    guint               max_items_or_submenu)
+{
+	GtkWidget *add_menu;
+	GPtrArray *bookmarks;
+	char      *existing;
+	guint      n_existing;
+	guint      i;
 
-	add_bookmarks = g_slist_reverse (add_bookmarks);
+	g_free (place_item->priv->bookmarks_existing);
+	place_item->priv->bookmarks_existing = NULL;
 
-	if (g_slist_length (add_bookmarks) <= max_items_or_submenu) {
+	if (!panel_bookmarks.bookmarks || panel_bookmarks.bookmarks->len == 0)
+		return;
+
+	bookmarks = g_ptr_array_ref (panel_bookmarks.bookmarks);
+
+	existing = panel_bookmarks_get_existing (bookmarks);
+	place_item->priv->bookmarks_existing = existing;
+
+	n_existing = 0;
+	for (i = 0; i < bookmarks->len; i++) {
+		if (existing[i] == '1')
+			n_existing++;
+	}
+
+	if (n_existing == 0) {
+		g_ptr_array_unref (bookmarks);
+		return;
+	}
+
+	if (n_existing <= max_items_or_submenu) {
 		add_menu = menu;
 	} else {
 		GtkWidget *item;
@@ -481,72 +831,29 @@ panel_place_menu_item_append_gtk_bookmarks (GtkWidget *menu, guint max_items_or_
 		gtk_menu_item_set_submenu (GTK_MENU_ITEM (item), add_menu);
 	}
 
-	for (l = add_bookmarks; l; l = l->next) {
-		char *display_name;
-		char *tooltip;
-		char *label;
-		char *icon;
-		GFile *file;
-		GIcon *gicon;
+	for (i = 0; i < bookmarks->len; i++) {
+		PanelBookmark *bookmark;
+		GIcon         *gicon;
 
-		bookmark = l->data;
-
-		file = g_file_new_for_uri (bookmark->full_uri);
-		display_name = g_file_get_parse_name (file);
-		g_object_unref (file);
-		/* Translators: %s is a URI */
-		tooltip = g_strdup_printf (_("Open '%s'"), display_name);
-		g_free (display_name);
+		if (existing[i] != '1')
+			continue;
 
-		label = NULL;
-		if (bookmark->label) {
-			label = g_strdup (g_strstrip (bookmark->label));
-			if (!label [0]) {
-				g_free (label);
-				label = NULL;
-			}
-		}
+		bookmark = g_ptr_array_index (bookmarks, i);
 
-		if (!label) {
-			label = panel_util_get_label_for_uri (bookmark->full_uri);
-
-			if (!label) {
-				g_free (tooltip);
-				g_free (bookmark->full_uri);
-				if (bookmark->label)
-					g_free (bookmark->label);
-				g_free (bookmark);
-				continue;
-			}
-		}
-
-		icon = panel_util_get_icon_for_uri (bookmark->full_uri);
-		/*FIXME: we should probably get a GIcon if possible, so that we
-		 * have customized icons for cd-rom, eg */
-		if (!icon)
-			icon = g_strdup (PANEL_ICON_FOLDER);
-
-		gicon = g_themed_icon_new_with_default_fallbacks (icon);
+		gicon = g_themed_icon_new_with_default_fallbacks (bookmark->icon);
 
 		//FIXME: drag and drop will be broken for x-caja-search uris
-		panel_menu_items_append_place_item (icon, gicon,
-						    label,
-						    tooltip,
+		panel_menu_items_append_place_item (bookmark->icon, gicon,
+						    bookmark->label,
+						    bookmark->tooltip,
 						    add_menu,
 						    G_CALLBACK (activate_uri),
-						    bookmark->full_uri);
+						    bookmark->uri);
 
-		g_free (icon);
 		g_object_unref (gicon);
-		g_free (tooltip);
-		g_free (label);
-		g_free (bookmark->full_uri);
-		if (bookmark->label)
-			g_free (bookmark->label);
-		g_free (bookmark);
 	}
 
-	g_slist_free (add_bookmarks);
+	g_ptr_array_unref (bookmarks);
 }
 
 static void
@@ -590,7 +897,7 @@ panel_menu_item_rescan_drive (GtkWidget *menuitem,
 				menuitem_to_screen (menuitem));
 }
 
-static void
+static GtkWidget *
 panel_menu_item_append_drive (GtkWidget *menu,
 			      GDrive    *drive)
 {
@@ -624,6 +931,8 @@ panel_menu_item_append_drive (GtkWidget *menu,
 
 	g_signal_connect (G_OBJECT (item), "button_press_event",
 			  G_CALLBACK (menu_dummy_button_press_event), NULL);
+
+	return item;
 }
 
 typedef struct {
@@ -690,7 +999,7 @@ panel_menu_item_mount_volume (GtkWidget *menuitem,
 			volume_mount_cb, mount_data);
 }
 
-static void
+static GtkWidget *
 panel_menu_item_append_volume (GtkWidget *menu,
 			       GVolume   *volume)
 {
@@ -724,16 +1033,19 @@ panel_menu_item_append_volume (GtkWidget *menu,
 
 	g_signal_connect (G_OBJECT (item), "button_press_event",
 			  G_CALLBACK (menu_dummy_button_press_event), NULL);
+
+	return item;
 }
 
-static void
+static GtkWidget *
 panel_menu_item_append_mount (GtkWidget *menu,
 			      GMount    *mount)
 {
-	GFile  *root;
-	GIcon  *icon;
-	char   *display_name;
-	char   *activation_uri;
+	GtkWidget *item;
+	GFile     *root;
+	GIcon     *icon;
+	char      *display_name;
+	char      *activation_uri;
 
 	icon = g_mount_get_icon (mount);
 	display_name = g_mount_get_name (mount);
@@ -742,16 +1054,40 @@ panel_menu_item_append_mount (GtkWidget *menu,
 	activation_uri = g_file_get_uri (root);
 	g_object_unref (root);
 
-	panel_menu_items_append_place_item (NULL, icon,
-					    display_name,
-					    display_name, //FIXME tooltip
-					    menu,
-					    G_CALLBACK (activate_uri),
-					    activation_uri);
+	item = panel_menu_items_append_place_item (NULL, icon,
+						   display_name,
+						   display_name, //FIXME tooltip
+						   menu,
+						   G_CALLBACK (activate_uri),
+						   activation_uri);
 
 	g_object_unref (icon);
 	g_free (display_name);
 	g_free (activation_uri);
+
+	return item;
+}
+
+static void
+panel_place_gio_entry_free (PanelPlaceGioEntry *entry)
+{
+	g_slice_free (PanelPlaceGioEntry, entry);
+}
+
+static void
+panel_place_menu_item_track_gio_item (PanelPlaceMenuItem *place_item,
+				      gpointer            object,
+				      GtkWidget          *item,
+				      PanelPlaceSection   section)
+{
+	PanelPlaceGioEntry *entry;
+
+	entry = g_slice_new (PanelPlaceGioEntry);
+	entry->item    = item;
+	entry->section = section;
+
+	g_hash_table_replace (place_item->priv->gio_items,
+			      g_object_ref (object), entry);
 }
 
 typedef enum {
@@ -908,8 +1244,11 @@ panel_place_menu_item_append_local_gio (PanelPlaceMenuItem *place_item,
 	/* now that we have everything, add the items inline or in a submenu */
 	items = g_slist_reverse (items);
 
+	place_item->priv->section_count[PANEL_PLACE_SECTION_LOCAL] = g_slist_length (items);
+
 	if (g_slist_length (items) <= g_settings_get_uint (place_item->priv->menubar_settings, PANEL_MENU_BAR_MAX_ITEMS_OR_SUBMENU)) {
 		add_menu = menu;
+		place_item->priv->section_submenu[PANEL_PLACE_SECTION_LOCAL] = NULL;
 	} else {
 		GtkWidget  *item;
 
@@ -924,26 +1263,34 @@ panel_place_menu_item_append_local_gio (PanelPlaceMenuItem *place_item,
 
 		add_menu = create_empty_menu ();
 		gtk_menu_item_set_submenu (GTK_MENU_ITEM (item), add_menu);
+		place_item->priv->section_submenu[PANEL_PLACE_SECTION_LOCAL] = add_menu;
 	}
 
 	for (sl = items; sl; sl = sl->next) {
+		GtkWidget *menu_item;
+		gpointer   object;
+
 		item = sl->data;
 		switch (item->type) {
 		case PANEL_GIO_DRIVE:
-			panel_menu_item_append_drive (add_menu, item->u.drive);
-			g_object_unref (item->u.drive);
+			menu_item = panel_menu_item_append_drive (add_menu, item->u.drive);
+			object = item->u.drive;
 			break;
 		case PANEL_GIO_VOLUME:
-			panel_menu_item_append_volume (add_menu, item->u.volume);
-			g_object_unref (item->u.volume);
+			menu_item = panel_menu_item_append_volume (add_menu, item->u.volume);
+			object = item->u.volume;
 			break;
 		case PANEL_GIO_MOUNT:
-			panel_menu_item_append_mount (add_menu, item->u.mount);
-			g_object_unref (item->u.mount);
+			menu_item = panel_menu_item_append_mount (add_menu, item->u.mount);
+			object = item->u.mount;
 			break;
 		default:
 			g_assert_not_reached ();
 		}
+		panel_place_menu_item_track_gio_item (place_item, object,
+						      menu_item,
+						      PANEL_PLACE_SECTION_LOCAL);
+		g_object_unref (object);
 		g_slice_free (PanelGioItem, item);
 	}
 
@@ -995,8 +1342,11 @@ panel_place_menu_item_append_remote_gio (PanelPlaceMenuItem *place_item,
 	}
 	add_mounts = g_slist_reverse (add_mounts);
 
+	place_item->priv->section_count[PANEL_PLACE_SECTION_REMOTE] = g_slist_length (add_mounts);
+
 	if (g_slist_length (add_mounts) <= g_settings_get_uint (place_item->priv->menubar_settings, PANEL_MENU_BAR_MAX_ITEMS_OR_SUBMENU)) {
 		add_menu = menu;
+		place_item->priv->section_submenu[PANEL_PLACE_SECTION_REMOTE] = NULL;
 	} else {
 		GtkWidget  *item;
 
@@ -1011,11 +1361,17 @@ panel_place_menu_item_append_remote_gio (PanelPlaceMenuItem *place_item,
 
 		add_menu = create_empty_menu ();
 		gtk_menu_item_set_submenu (GTK_MENU_ITEM (item), add_menu);
+		place_item->priv->section_submenu[PANEL_PLACE_SECTION_REMOTE] = add_menu;
 	}
 
 	for (sl = add_mounts; sl; sl = sl->next) {
+		GtkWidget *menu_item;
+
 		mount = sl->data;
-		panel_menu_item_append_mount (add_menu, mount);
+		menu_item = panel_menu_item_append_mount (add_menu, mount);
+		panel_place_menu_item_track_gio_item (place_item, mount,
+						      menu_item,
+						      PANEL_PLACE_SECTION_REMOTE);
 		g_object_unref (mount);
 	}
 
@@ -1024,8 +1380,77 @@ panel_place_menu_item_append_remote_gio (PanelPlaceMenuItem *place_item,
 }
 
 
-static GtkWidget *
-panel_place_menu_item_create_menu (PanelPlaceMenuItem *place_item)
+static void
+panel_place_menu_item_build_section (PanelPlaceMenuItem *place_item,
+				     PanelPlaceSection   section)
+{
+	GtkWidget *menu;
+	GList     *children;
+	GList     *l;
+	guint      n_children;
+	int        position;
+
+	menu = place_item->priv->menu;
+
+	children = gtk_container_get_children (GTK_CONTAINER (menu));
+	n_children = g_list_length (children);
+	g_list_free (children);
+
+	switch (section) {
+	case PANEL_PLACE_SECTION_BOOKMARKS:
+		panel_place_menu_item_append_gtk_bookmarks (place_item, menu, g_settings_get_uint (place_item->priv->menubar_settings, PANEL_MENU_BAR_MAX_ITEMS_OR_SUBMENU));
+		break;
+	case PANEL_PLACE_SECTION_LOCAL:
+		panel_place_menu_item_append_local_gio (place_item, menu);
+		break;
+	case PANEL_PLACE_SECTION_REMOTE:
+		panel_place_menu_item_append_remote_gio (place_item, menu);
+		break;
+	default:
+		g_assert_not_reached ();
+	}
+
+	/* The section was appended at the end of the menu: move it back
+	 * right after its anchor item */
+	children = gtk_container_get_children (GTK_CONTAINER (menu));
+	place_item->priv->section_items[section] = g_list_copy (g_list_nth (children, n_children));
+	position = g_list_index (children,
+				 place_item->priv->section_anchor[section]) + 1;
+	g_list_free (children);
+
+	for (l = place_item->priv->section_items[section]; l; l = l->next)
+		gtk_menu_reorder_child (GTK_MENU (menu), l->data, position++);
+}
+
+static gboolean
+panel_place_gio_entry_in_section (gpointer key,
+				  gpointer value,
+				  gpointer user_data)
+{
+	PanelPlaceGioEntry *entry = value;
+
+	return entry->section == GPOINTER_TO_INT (user_data);
+}
+
+static void
+panel_place_menu_item_clear_section (PanelPlaceMenuItem *place_item,
+				     PanelPlaceSection   section)
+{
+	g_list_foreach (place_item->priv->section_items[section],
+			(GFunc) gtk_widget_destroy, NULL);
+	g_list_free (place_item->priv->section_items[section]);
+	place_item->priv->section_items[section] = NULL;
+
+	g_hash_table_foreach_remove (place_item->priv->gio_items,
+				     panel_place_gio_entry_in_section,
+				     GINT_TO_POINTER (section));
+
+	place_item->priv->section_submenu[section] = NULL;
+	place_item->priv->section_count[section] = 0;
+}
+
+static void
+panel_place_menu_item_populate (PanelPlaceMenuItem *place_item)
 {
 	GtkWidget *places_menu;
 	GtkWidget *item;
@@ -1034,19 +1459,19 @@ panel_place_menu_item_create_menu (PanelPlaceMenuItem *place_item)
 	char      *uri;
 	GFile     *file;
 
-	places_menu = panel_create_menu ();
+	places_menu = place_item->priv->menu;
 
 	file = g_file_new_for_path (g_get_home_dir ());
 	uri = g_file_get_uri (file);
 	name = panel_util_get_label_for_uri (uri);
 	g_object_unref (file);
 
-	panel_menu_items_append_place_item (PANEL_ICON_HOME, NULL,
-					    name,
-					    _("Open your personal folder"),
-					    places_menu,
-					    G_CALLBACK (activate_home_uri),
-					    uri);
+	item = panel_menu_items_append_place_item (PANEL_ICON_HOME, NULL,
+						   name,
+						   _("Open your personal folder"),
+						   places_menu,
+						   G_CALLBACK (activate_home_uri),
+						   uri);
 	g_free (name);
 	g_free (uri);
 
@@ -1057,7 +1482,7 @@ panel_place_menu_item_create_menu (PanelPlaceMenuItem *place_item)
 		uri = g_file_get_uri (file);
 		g_object_unref (file);
 
-		panel_menu_items_append_place_item (
+		item = panel_menu_items_append_place_item (
 				PANEL_ICON_DESKTOP, NULL,
 				/* Translators: Desktop is used here as in
 				 * "Desktop Folder" (this is not the Desktop
@@ -1071,7 +1496,9 @@ panel_place_menu_item_create_menu (PanelPlaceMenuItem *place_item)
 		g_free (uri);
 	}
 
-	panel_place_menu_item_append_gtk_bookmarks (places_menu, g_settings_get_uint (place_item->priv->menubar_settings, PANEL_MENU_BAR_MAX_ITEMS_OR_SUBMENU));
+	place_item->priv->section_anchor[PANEL_PLACE_SECTION_BOOKMARKS] = item;
+	panel_place_menu_item_build_section (place_item,
+					     PANEL_PLACE_SECTION_BOOKMARKS);
 	add_menu_separator (places_menu);
 
 	if (place_item->priv->caja_desktop_settings != NULL)
@@ -1081,7 +1508,7 @@ panel_place_menu_item_create_menu (PanelPlaceMenuItem *place_item)
 	if (PANEL_GLIB_STR_EMPTY (gsettings_name))
 		gsettings_name = g_strdup (_("Computer"));
 
-	panel_menu_items_append_place_item (
+	item = panel_menu_items_append_place_item (
 			PANEL_ICON_COMPUTER, NULL,
 			gsettings_name,
 			_("Browse all local and remote disks and folders accessible from this computer"),
@@ -1092,21 +1519,24 @@ panel_place_menu_item_create_menu (PanelPlaceMenuItem *place_item)
 	if (gsettings_name)
 		g_free (gsettings_name);
 
-	panel_place_menu_item_append_local_gio (place_item, places_menu);
+	place_item->priv->section_anchor[PANEL_PLACE_SECTION_LOCAL] = item;
+	panel_place_menu_item_build_section (place_item,
+					     PANEL_PLACE_SECTION_LOCAL);
 	add_menu_separator (places_menu);
 
-	panel_menu_items_append_place_item (
+	item = panel_menu_items_append_place_item (
 			PANEL_ICON_NETWORK, NULL,
 			_("Network"),
 			_("Browse bookmarked and local network locations"),
 			places_menu,
 			G_CALLBACK (activate_uri),
 			"network://");
-	panel_place_menu_item_append_remote_gio (place_item, places_menu);
 
-	if (panel_is_program_in_path ("caja-connect-server") ||
-	    panel_is_program_in_path ("nautilus-connect-server") ||
-	    panel_is_program_in_path ("nemo-connect-server")) {
+	place_item->priv->section_anchor[PANEL_PLACE_SECTION_REMOTE] = item;
+	panel_place_menu_item_build_section (place_item,
+					     PANEL_PLACE_SECTION_REMOTE);
+
+	if (panel_capability_available (PANEL_CAPABILITY_CONNECT_SERVER)) {
 		item = panel_menu_items_create_action_item (PANEL_ACTION_CONNECT_SERVER);
 		if (item != NULL)
 			gtk_menu_shell_append (GTK_MENU_SHELL (places_menu),
@@ -1115,7 +1545,7 @@ panel_place_menu_item_create_menu (PanelPlaceMenuItem *place_item)
 
 	add_menu_separator (places_menu);
 
-	if (panel_is_program_in_path ("mate-search-tool"))
+	if (panel_capability_available (PANEL_CAPABILITY_SEARCH_TOOL))
 		panel_menu_items_append_from_desktop (places_menu,
 						      "mate-search-tool.desktop",
 						      NULL,
@@ -1128,6 +1558,298 @@ panel_place_menu_item_create_menu (PanelPlaceMenuItem *place_item)
 
 	panel_recent_append_documents_menu (places_menu,
 					    place_item->priv->recent_manager);
+}
+
+static PanelPlaceSection
+panel_place_menu_item_get_mount_section (GMount *mount)
+{
+	GVolume  *volume;
+	GFile    *root;
+	gboolean  native;
+
+	volume = g_mount_get_volume (mount);
+	if (volume != NULL) {
+		g_object_unref (volume);
+		return PANEL_PLACE_SECTION_LOCAL;
+	}
+
+	root = g_mount_get_root (mount);
+	native = g_file_is_native (root);
+	g_object_unref (root);
+
+	return native ? PANEL_PLACE_SECTION_LOCAL : PANEL_PLACE_SECTION_REMOTE;
+}
+
+/* Replaces the item shown for old_object (a mount or a volume) with an item
+ * for new_object, at the same position. */
+static void
+panel_place_menu_item_replace_gio_item (PanelPlaceMenuItem *place_item,
+					gpointer            old_object,
+					PanelPlaceGioEntry *entry,
+					gpointer            new_object)
+{
+	PanelPlaceSection  section;
+	GtkWidget         *old_item;
+	GtkWidget         *new_item;
+	GtkWidget         *parent;
+	GList             *children;
+	GList             *l;
+	int                position;
+
+	section  = entry->section;
+	old_item = entry->item;
+
+	parent = gtk_widget_get_parent (old_item);
+	children = gtk_container_get_children (GTK_CONTAINER (parent));
+	position = g_list_index (children, old_item);
+	g_list_free (children);
+
+	if (G_IS_MOUNT (new_object))
+		new_item = panel_menu_item_append_mount (parent,
+							 G_MOUNT (new_object));
+	else
+		new_item = panel_menu_item_append_volume (parent,
+							  G_VOLUME (new_object));
+	gtk_menu_reorder_child (GTK_MENU (parent), new_item, position);
+
+	l = g_list_find (place_item->priv->section_items[section], old_item);
+	if (l)
+		l->data = new_item;
+
+	gtk_widget_destroy (old_item);
+	g_hash_table_remove (place_item->priv->gio_items, old_object);
+
+	panel_place_menu_item_track_gio_item (place_item, new_object,
+					      new_item, section);
+}
+
+static void
+panel_place_menu_item_add_mount_item (PanelPlaceMenuItem *place_item,
+				      GMount             *mount,
+				      PanelPlaceSection   section)
+{
+	GtkWidget *menu;
+	GtkWidget *item;
+	GList     *children;
+	GList     *last;
+	int        position;
+
+	if (place_item->priv->section_submenu[section] != NULL) {
+		item = panel_menu_item_append_mount (place_item->priv->section_submenu[section],
+						     mount);
+	} else {
+		menu = place_item->priv->menu;
+
+		last = g_list_last (place_item->priv->section_items[section]);
+
+		children = gtk_container_get_children (GTK_CONTAINER (menu));
+		position = g_list_index (children,
+					 last ? last->data : place_item->priv->section_anchor[section]) + 1;
+		g_list_free (children);
+
+		item = panel_menu_item_append_mount (menu, mount);
+		gtk_menu_reorder_child (GTK_MENU (menu), item, position);
+
+		place_item->priv->section_items[section] =
+			g_list_append (place_item->priv->section_items[section],
+				       item);
+	}
+
+	place_item->priv->section_count[section]++;
+	panel_place_menu_item_track_gio_item (place_item, mount,
+					      item, section);
+}
+
+static void
+panel_place_menu_item_remove_gio_item (PanelPlaceMenuItem *place_item,
+				       gpointer            object,
+				       PanelPlaceGioEntry *entry)
+{
+	PanelPlaceSection section;
+
+	section = entry->section;
+
+	place_item->priv->section_items[section] =
+		g_list_remove (place_item->priv->section_items[section],
+			       entry->item);
+	gtk_widget_destroy (entry->item);
+	g_hash_table_remove (place_item->priv->gio_items, object);
+
+	if (place_item->priv->section_count[section] > 0)
+		place_item->priv->section_count[section]--;
+}
+
+static void
+panel_place_menu_item_apply_mount_op (PanelPlaceMenuItem *place_item,
+				      PanelPlaceMountOp  *op)
+{
+	PanelPlaceGioEntry *entry;
+	PanelPlaceGioEntry *volume_entry;
+	PanelPlaceSection   section;
+	GVolume            *volume;
+	guint               max_items;
+
+	entry = g_hash_table_lookup (place_item->priv->gio_items, op->mount);
+	if (entry)
+		section = entry->section;
+	else
+		section = panel_place_menu_item_get_mount_section (op->mount);
+
+	/* The whole section will be rebuilt anyway */
+	if (place_item->priv->dirty & PANEL_PLACE_DIRTY_SECTION (section))
+		return;
+
+	max_items = g_settings_get_uint (place_item->priv->menubar_settings,
+					 PANEL_MENU_BAR_MAX_ITEMS_OR_SUBMENU);
+	volume = g_mount_get_volume (op->mount);
+
+	if (op->type == PANEL_PLACE_MOUNT_REMOVED ||
+	    (op->type == PANEL_PLACE_MOUNT_CHANGED &&
+	     volume == NULL && g_mount_is_shadowed (op->mount))) {
+		if (entry == NULL) {
+			/* not shown */
+		} else if (volume != NULL) {
+			/* show the unmounted volume again */
+			panel_place_menu_item_replace_gio_item (place_item,
+								op->mount,
+								entry,
+								volume);
+		} else {
+			panel_place_menu_item_remove_gio_item (place_item,
+							       op->mount,
+							       entry);
+
+			if (place_item->priv->section_submenu[section] != NULL &&
+			    place_item->priv->section_count[section] <= max_items)
+				place_item->priv->dirty |= PANEL_PLACE_DIRTY_SECTION (section);
+		}
+	} else if (entry != NULL) {
+		panel_place_menu_item_replace_gio_item (place_item,
+							op->mount,
+							entry,
+							op->mount);
+	} else if (volume != NULL) {
+		volume_entry = g_hash_table_lookup (place_item->priv->gio_items,
+						    volume);
+		if (volume_entry != NULL)
+			panel_place_menu_item_replace_gio_item (place_item,
+								volume,
+								volume_entry,
+								op->mount);
+		else
+			place_item->priv->dirty |= PANEL_PLACE_DIRTY_SECTION (section);
+	} else if (!g_mount_is_shadowed (op->mount)) {
+		if (place_item->priv->section_submenu[section] == NULL &&
+		    place_item->priv->section_count[section] + 1 > max_items)
+			place_item->priv->dirty |= PANEL_PLACE_DIRTY_SECTION (section);
+		else
+			panel_place_menu_item_add_mount_item (place_item,
+							      op->mount,
+							      section);
+	}
+
+	if (volume != NULL)
+		g_object_unref (volume);
+}
+
+static void
+panel_place_mount_op_free (PanelPlaceMountOp *op)
+{
+	g_object_unref (op->mount);
+	g_slice_free (PanelPlaceMountOp, op);
+}
+
+static void
+panel_place_menu_item_apply_changes (PanelPlaceMenuItem *place_item)
+{
+	PanelPlaceMountOp *op;
+	int                i;
+
+	if (!place_item->priv->dirty &&
+	    g_queue_is_empty (place_item->priv->pending_mounts))
+		return;
+
+	if (place_item->priv->dirty & PANEL_PLACE_DIRTY_ALL) {
+		while ((op = g_queue_pop_head (place_item->priv->pending_mounts)))
+			panel_place_mount_op_free (op);
+
+		gtk_container_foreach (GTK_CONTAINER (place_item->priv->menu),
+				       (GtkCallback) gtk_widget_destroy, NULL);
+
+		for (i = 0; i < PANEL_PLACE_N_SECTIONS; i++) {
+			g_list_free (place_item->priv->section_items[i]);
+			place_item->priv->section_items[i] = NULL;
+			place_item->priv->section_anchor[i] = NULL;
+			place_item->priv->section_submenu[i] = NULL;
+			place_item->priv->section_count[i] = 0;
+		}
+		g_hash_table_remove_all (place_item->priv->gio_items);
+
+		panel_place_menu_item_populate (place_item);
+	} else {
+		while ((op = g_queue_pop_head (place_item->priv->pending_mounts))) {
+			panel_place_menu_item_apply_mount_op (place_item, op);
+			panel_place_mount_op_free (op);
+		}
+
+		for (i = 0; i < PANEL_PLACE_N_SECTIONS; i++) {
+			if (!(place_item->priv->dirty & PANEL_PLACE_DIRTY_SECTION (i)))
+				continue;
+
+			panel_place_menu_item_clear_section (place_item, i);
+			panel_place_menu_item_build_section (place_item, i);
+		}
+	}
+
+	place_item->priv->dirty = 0;
+
+	if (place_item->priv->panel)
+		mate_panel_applet_menu_set_recurse (GTK_MENU (place_item->priv->menu),
+						    "menu_panel",
+						    place_item->priv->panel);
+}
+
+static void
+panel_place_menu_item_check_bookmarks (PanelPlaceMenuItem *place_item)
+{
+	char *existing;
+
+	if (place_item->priv->dirty & (PANEL_PLACE_DIRTY_ALL |
+				       PANEL_PLACE_DIRTY_SECTION (PANEL_PLACE_SECTION_BOOKMARKS)))
+		return;
+
+	if (!panel_bookmarks.bookmarks || !place_item->priv->bookmarks_existing)
+		return;
+
+	existing = panel_bookmarks_get_existing (panel_bookmarks.bookmarks);
+	if (strcmp (existing, place_item->priv->bookmarks_existing) != 0)
+		place_item->priv->dirty |= PANEL_PLACE_DIRTY_SECTION (PANEL_PLACE_SECTION_BOOKMARKS);
+	g_free (existing);
+}
+
+static void
+panel_place_menu_item_menu_show (GtkWidget          *menu,
+				 PanelPlaceMenuItem *place_item)
+{
+	panel_place_menu_item_check_bookmarks (place_item);
+	panel_place_menu_item_apply_changes (place_item);
+}
+
+static GtkWidget *
+panel_place_menu_item_create_menu (PanelPlaceMenuItem *place_item)
+{
+	GtkWidget *places_menu;
+
+	places_menu = panel_create_menu ();
+	place_item->priv->menu = places_menu;
+	place_item->priv->dirty = 0;
+
+	g_signal_connect (places_menu, "show",
+			  G_CALLBACK (panel_place_menu_item_menu_show),
+			  place_item);
+
+	panel_place_menu_item_populate (place_item);
+
 /* Fix any failures of compiz/other wm's to communicate with gtk for transparency */
 	GtkWidget *toplevel = gtk_widget_get_toplevel (places_menu);
 	GdkScreen *screen = gtk_widget_get_screen(GTK_WIDGET(toplevel));
@@ -1137,8 +1859,11 @@ panel_place_menu_item_create_menu (PanelPlaceMenuItem *place_item)
 	return places_menu;
 }
 
+/* Changes are only recorded while the menu is hidden, and applied the next
+ * time it is shown. */
 static void
-panel_place_menu_item_recreate_menu (GtkWidget *widget)
+panel_place_menu_item_queue_update (GtkWidget *widget,
+				    guint      dirty)
 {
 	PanelPlaceMenuItem *place_item;
 
@@ -1147,33 +1872,40 @@ panel_place_menu_item_recreate_menu (GtkWidget *widget)
 
 	place_item = PANEL_PLACE_MENU_ITEM (widget);
 
-	if (place_item->priv->menu) {
-		gtk_widget_destroy (place_item->priv->menu);
-		place_item->priv->menu = panel_place_menu_item_create_menu (place_item);
-		gtk_menu_item_set_submenu (GTK_MENU_ITEM (place_item),
-					   place_item->priv->menu);
-		mate_panel_applet_menu_set_recurse (GTK_MENU (place_item->priv->menu),
-					       "menu_panel",
-					       place_item->priv->panel);
-	}
+	place_item->priv->dirty |= dirty;
+
+	if (place_item->priv->menu &&
+	    gtk_widget_get_visible (place_item->priv->menu))
+		panel_place_menu_item_apply_changes (place_item);
 }
 
 static void
-panel_place_menu_item_key_changed (GSettings   *settings,
-				   gchar       *key,
-				   GtkWidget   *place_item)
+panel_place_menu_item_queue_mount (GtkWidget             *widget,
+				   PanelPlaceMountOpType  type,
+				   GMount                *mount)
 {
-	panel_place_menu_item_recreate_menu (place_item);
+	PanelPlaceMenuItem *place_item;
+	PanelPlaceMountOp  *op;
+
+	if (!GTK_IS_WIDGET (widget))
+		return;
+
+	place_item = PANEL_PLACE_MENU_ITEM (widget);
+
+	op = g_slice_new (PanelPlaceMountOp);
+	op->type  = type;
+	op->mount = g_object_ref (mount);
+	g_queue_push_tail (place_item->priv->pending_mounts, op);
+
+	panel_place_menu_item_queue_update (widget, 0);
 }
 
 static void
-panel_place_menu_item_gtk_bookmarks_changed (GFileMonitor *handle,
-					     GFile        *file,
-					     GFile        *other_file,
-					     GFileMonitorEvent event,
-					     gpointer      user_data)
+panel_place_menu_item_key_changed (GSettings   *settings,
+				   gchar       *key,
+				   GtkWidget   *place_item)
 {
-	panel_place_menu_item_recreate_menu (GTK_WIDGET (user_data));
+	panel_place_menu_item_queue_update (place_item, PANEL_PLACE_DIRTY_ALL);
 }
 
 static void
@@ -1181,7 +1913,8 @@ panel_place_menu_item_drives_changed (GVolumeMonitor *monitor,
 				      GDrive         *drive,
 				      GtkWidget      *place_menu)
 {
-	panel_place_menu_item_recreate_menu (place_menu);
+	panel_place_menu_item_queue_update (place_menu,
+					    PANEL_PLACE_DIRTY_SECTION (PANEL_PLACE_SECTION_LOCAL));
 }
 
 static void
@@ -1189,15 +1922,35 @@ panel_place_menu_item_volumes_changed (GVolumeMonitor *monitor,
 				       GVolume        *volume,
 				       GtkWidget      *place_menu)
 {
-	panel_place_menu_item_recreate_menu (place_menu);
+	panel_place_menu_item_queue_update (place_menu,
+					    PANEL_PLACE_DIRTY_SECTION (PANEL_PLACE_SECTION_LOCAL));
 }
 
 static void
-panel_place_menu_item_mounts_changed (GVolumeMonitor *monitor,
-				      GMount         *mount,
-				      GtkWidget      *place_menu)
+panel_place_menu_item_mount_added (GVolumeMonitor *monitor,
+				   GMount         *mount,
+				   GtkWidget      *place_menu)
 {
-	panel_place_menu_item_recreate_menu (place_menu);
+	panel_place_menu_item_queue_mount (place_menu,
+					   PANEL_PLACE_MOUNT_ADDED, mount);
+}
+
+static void
+panel_place_menu_item_mount_changed (GVolumeMonitor *monitor,
+				     GMount         *mount,
+				     GtkWidget      *place_menu)
+{
+	panel_place_menu_item_queue_mount (place_menu,
+					   PANEL_PLACE_MOUNT_CHANGED, mount);
+}
+
+static void
+panel_place_menu_item_mount_removed (GVolumeMonitor *monitor,
+				     GMount         *mount,
+				     GtkWidget      *place_menu)
+{
+	panel_place_menu_item_queue_mount (place_menu,
+					   PANEL_PLACE_MOUNT_REMOVED, mount);
 }
 
 static void
@@ -1245,6 +1998,8 @@ panel_desktop_menu_item_create_menu (PanelDesktopMenuItem *desktop_item)
 			   "panel-menu-append-callback-data",
 			   desktop_item);
 
+	panel_menu_prewarm (desktop_menu);
+
 	return desktop_menu;
 }
 
@@ -1266,6 +2021,7 @@ static void
 panel_place_menu_item_finalize (GObject *object)
 {
 	PanelPlaceMenuItem *menuitem = (PanelPlaceMenuItem *) object;
+	int                 i;
 
 	if (menuitem->priv->caja_desktop_settings) {
 		g_object_unref (menuitem->priv->caja_desktop_settings);
@@ -1279,11 +2035,7 @@ panel_place_menu_item_finalize (GObject *object)
 	g_object_unref (menuitem->priv->menubar_settings);
 	menuitem->priv->menubar_settings = NULL;
 
-	if (menuitem->priv->bookmarks_monitor != NULL) {
-		g_file_monitor_cancel (menuitem->priv->bookmarks_monitor);
-		g_object_unref (menuitem->priv->bookmarks_monitor);
-	}
-	menuitem->priv->bookmarks_monitor = NULL;
+	panel_bookmarks_remove_listener (menuitem);
 
 	if (menuitem->priv->drive_changed_id)
 		g_signal_handler_disconnect (menuitem->priv->volume_monitor,
@@ -1334,6 +2086,22 @@ panel_place_menu_item_finalize (GObject *object)
 		g_object_unref (menuitem->priv->volume_monitor);
 	menuitem->priv->volume_monitor = NULL;
 
+	g_queue_foreach (menuitem->priv->pending_mounts,
+			 (GFunc) panel_place_mount_op_free, NULL);
+	g_queue_free (menuitem->priv->pending_mounts);
+	menuitem->priv->pending_mounts = NULL;
+
+	for (i = 0; i < PANEL_PLACE_N_SECTIONS; i++) {
+		g_list_free (menuitem->priv->section_items[i]);
+		menuitem->priv->section_items[i] = NULL;
+	}
+
+	g_hash_table_destroy (menuitem->priv->gio_items);
+
+	g_free (menuitem->priv->bookmarks_existing);
+	menuitem->priv->bookmarks_existing = NULL;
+	menuitem->priv->gio_items = NULL;
+
 	G_OBJECT_CLASS (panel_place_menu_item_parent_class)->finalize (object);
 }
 
@@ -1351,10 +2119,6 @@ panel_desktop_menu_item_finalize (GObject *object)
 static void
 panel_place_menu_item_init (PanelPlaceMenuItem *menuitem)
 {
-	GFile *bookmark;
-	char  *bookmarks_filename;
-	GError *error;
-
 	menuitem->priv = PANEL_PLACE_MENU_ITEM_GET_PRIVATE (menuitem);
 
 		menuitem->priv->caja_desktop_settings = NULL;
@@ -1369,29 +2133,13 @@ panel_place_menu_item_init (PanelPlaceMenuItem *menuitem)
 
 	menuitem->priv->recent_manager = gtk_recent_manager_get_default ();
 
-	bookmarks_filename = g_build_filename (g_get_home_dir (),
-					       BOOKMARKS_FILENAME, NULL);
-	bookmark = g_file_new_for_path (bookmarks_filename);
-
-	error = NULL;
-	menuitem->priv->bookmarks_monitor = g_file_monitor_file
-        						(bookmark,
-        						G_FILE_MONITOR_NONE,
-        						NULL,
-        						&error);
-	if (error) {
-		g_warning ("Failed to add file monitor for %s: %s\n",
-			   bookmarks_filename, error->message);
-		g_error_free (error);
-	} else {
-		g_signal_connect (G_OBJECT (menuitem->priv->bookmarks_monitor),
-				  "changed",
-				  (GCallback) panel_place_menu_item_gtk_bookmarks_changed,
-				  menuitem);
-	}
+	menuitem->priv->pending_mounts = g_queue_new ();
+	menuitem->priv->gio_items = g_hash_table_new_full (g_direct_hash,
+							   g_direct_equal,
+							   g_object_unref,
+							   (GDestroyNotify) panel_place_gio_entry_free);
 
-	g_object_unref (bookmark);
-	g_free (bookmarks_filename);
+	panel_bookmarks_add_listener (menuitem);
 
 	menuitem->priv->volume_monitor = g_volume_monitor_get ();
 
@@ -1421,15 +2169,15 @@ panel_place_menu_item_init (PanelPlaceMenuItem *menuitem)
 							     menuitem);
 	menuitem->priv->mount_added_id = g_signal_connect (menuitem->priv->volume_monitor,
 							   "mount-added",
-							   G_CALLBACK (panel_place_menu_item_mounts_changed),
+							   G_CALLBACK (panel_place_menu_item_mount_added),
 							   menuitem);
 	menuitem->priv->mount_changed_id = g_signal_connect (menuitem->priv->volume_monitor,
 							     "mount-changed",
-							     G_CALLBACK (panel_place_menu_item_mounts_changed),
+							     G_CALLBACK (panel_place_menu_item_mount_changed),
 							     menuitem);
 	menuitem->priv->mount_removed_id = g_signal_connect (menuitem->priv->volume_monitor,
 							     "mount-removed",
-							     G_CALLBACK (panel_place_menu_item_mounts_changed),
+							     G_CALLBACK (panel_place_menu_item_mount_removed),
 							     menuitem);
 
 }
@@ -1510,8 +2258,11 @@ panel_desktop_menu_item_new (gboolean use_image,
 
 	menuitem->priv->append_lock_logout = append_lock_logout;
 	if (append_lock_logout)
-		panel_lockdown_notify_add (G_CALLBACK (panel_desktop_menu_item_recreate_menu),
-					   menuitem);
+		panel_lockdown_notify_add_keys (PANEL_LOCKDOWN_LOCKED_DOWN |
+						PANEL_LOCKDOWN_DISABLE_LOCK_SCREEN |
+						PANEL_LOCKDOWN_DISABLE_LOG_OUT,
+						G_CALLBACK (panel_desktop_menu_item_recreate_menu),
+						menuitem);
 
 	menuitem->priv->menu = panel_desktop_menu_item_create_menu (menuitem);
 	gtk_menu_item_set_submenu (GTK_MENU_ITEM (menuitem),
@@ -16,6 +16,8 @@
 #define PANEL_LOCKED_DOWN_KEY         "locked-down"
 #define PANEL_DISABLE_FORCE_QUIT_KEY  "disable-force-quit"
 #define PANEL_DISABLED_APPLETS_KEY    "disabled-applets"
+#define PANEL_APPLET_RESTART_MAX_KEY    "applet-restart-max"
+#define PANEL_APPLET_RESTART_WINDOW_KEY "applet-restart-window"
 
 #define PANEL_TOPLEVEL_SCHEMA                "org.mate.panel.toplevel"
 #define PANEL_TOPLEVEL_NAME_KEY              "name"
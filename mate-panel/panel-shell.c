@@ -31,7 +31,9 @@
 #include <glib/gi18n.h>
 
 #include <libpanel-util/panel-cleanup.h>
+#include <libpanel-util/panel-stats.h>
 
+#include "panel-applet-supervisor.h"
 #include "panel-profile.h"
 #include "panel-session.h"
 
@@ -129,6 +131,8 @@ panel_shell_register (gboolean replace)
 						    G_DBUS_SIGNAL_FLAGS_NONE,
 						    (GDBusSignalCallback)panel_shell_on_name_lost,
 						    NULL, NULL);
+		panel_stats_register_object (dbus_connection);
+		panel_applet_supervisor_register_object (dbus_connection);
 		break;
 	case 2: /* DBUS_REQUEST_NAME_REPLY_IN_QUEUE */
 	case 3: /* DBUS_REQUEST_NAME_REPLY_EXISTS */
@@ -0,0 +1,478 @@
+/*
+ * panel-stats-tool.c: dump the performance statistics of a running panel
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <config.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <gio/gio.h>
+
+#include <libpanel-util/panel-stats.h>
+
+#include "panel-applet-supervisor.h"
+
+#define PANEL_DBUS_SERVICE "org.mate.Panel"
+
+static gboolean json = FALSE;
+static gboolean reset = FALSE;
+static gboolean enable = FALSE;
+static gboolean disable = FALSE;
+static gboolean applets = FALSE;
+static gint     interval = 0;
+static gchar   *dest = NULL;
+
+static const GOptionEntry options[] = {
+	{ "json", 'j', 0, G_OPTION_ARG_NONE, &json, "Print the statistics as JSON", NULL },
+	{ "reset", 'r', 0, G_OPTION_ARG_NONE, &reset, "Reset the statistics after printing them", NULL },
+	{ "enable", 0, 0, G_OPTION_ARG_NONE, &enable, "Start collecting statistics", NULL },
+	{ "disable", 0, 0, G_OPTION_ARG_NONE, &disable, "Stop collecting statistics", NULL },
+	{ "applets", 'a', 0, G_OPTION_ARG_NONE, &applets, "Print the crashes and restarts of the applets instead", NULL },
+	{ "interval", 'i', 0, G_OPTION_ARG_INT, &interval, "Only print what was recorded during the given number of seconds", "SECONDS" },
+	{ "dest", 'd', 0, G_OPTION_ARG_STRING, &dest, "Query another bus name, like an out-of-process applet factory", "NAME" },
+	{ NULL }
+};
+
+typedef struct {
+	const char   *name;
+	const char   *kind;
+	guint64       count;
+	gint64        sum;
+	gint64        min;
+	gint64        max;
+	const guint64 *buckets;
+	gsize         n_buckets;
+	guint64      *interval_buckets;
+} Stat;
+
+static GVariant *
+call_panel (GDBusConnection  *connection,
+	    const char       *method,
+	    GVariant         *parameters,
+	    const char       *reply_type,
+	    GError          **error)
+{
+	return g_dbus_connection_call_sync (connection,
+					    dest ? dest : PANEL_DBUS_SERVICE,
+					    PANEL_STATS_DBUS_PATH,
+					    PANEL_STATS_DBUS_INTERFACE,
+					    method, parameters,
+					    reply_type ? G_VARIANT_TYPE (reply_type) : NULL,
+					    G_DBUS_CALL_FLAGS_NONE,
+					    -1, NULL, error);
+}
+
+/* Returns @str as the contents of a JSON string. D-Bus strings are valid
+ * UTF-8, so only the quotes, the backslashes and the control characters
+ * need to be escaped. */
+static char *
+json_escape (const char *str)
+{
+	GString    *escaped;
+	const char *p;
+
+	escaped = g_string_sized_new (strlen (str));
+
+	for (p = str; *p; p++) {
+		switch (*p) {
+		case '"':
+			g_string_append (escaped, "\\\"");
+			break;
+		case '\\':
+			g_string_append (escaped, "\\\\");
+			break;
+		case '\n':
+			g_string_append (escaped, "\\n");
+			break;
+		case '\t':
+			g_string_append (escaped, "\\t");
+			break;
+		default:
+			if ((guchar) *p < 0x20)
+				g_string_append_printf (escaped, "\\u%04x", (guchar) *p);
+			else
+				g_string_append_c (escaped, *p);
+			break;
+		}
+	}
+
+	return g_string_free (escaped, FALSE);
+}
+
+/* Prints the records of the applet supervisor */
+static int
+print_applets (GDBusConnection *connection)
+{
+	GVariant     *result;
+	GVariantIter *iter;
+	const char   *iid;
+	const char   *last_error;
+	guint         n_crashes, n_restarts, n_recent;
+	gint64        last_exit;
+	gboolean      quarantined;
+	gboolean      first = TRUE;
+	GError       *error = NULL;
+
+	result = g_dbus_connection_call_sync (connection,
+					      PANEL_DBUS_SERVICE,
+					      PANEL_APPLET_SUPERVISOR_DBUS_PATH,
+					      PANEL_APPLET_SUPERVISOR_DBUS_INTERFACE,
+					      "GetStatus", NULL,
+					      G_VARIANT_TYPE ("(a{s(uuusxb)})"),
+					      G_DBUS_CALL_FLAGS_NONE,
+					      -1, NULL, &error);
+	if (!result) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+
+	g_variant_get (result, "(a{s(uuusxb)})", &iter);
+
+	if (json)
+		g_print ("{");
+	else
+		g_print ("%-48s %8s %8s %8s %-11s %s\n",
+			 "iid", "crashes", "recent", "restarts", "state", "last exit");
+
+	while (g_variant_iter_next (iter, "{&s(uuu&sxb)}",
+				    &iid, &n_crashes, &n_restarts, &n_recent,
+				    &last_error, &last_exit, &quarantined)) {
+		if (json) {
+			char *escaped_iid = json_escape (iid);
+			char *escaped_error = json_escape (last_error);
+
+			g_print ("%s\n  \"%s\": { \"crashes\": %u, \"recent\": %u, "
+				 "\"restarts\": %u, \"quarantined\": %s, "
+				 "\"last-exit\": %" G_GINT64_FORMAT ", \"last-load-error\": \"%s\" }",
+				 first ? "" : ",", escaped_iid, n_crashes, n_recent, n_restarts,
+				 quarantined ? "true" : "false", last_exit, escaped_error);
+			g_free (escaped_iid);
+			g_free (escaped_error);
+		} else {
+			GDateTime *time = g_date_time_new_from_unix_local (last_exit);
+			char      *date = g_date_time_format (time, "%F %T");
+
+			g_print ("%-48s %8u %8u %8u %-11s %s%s%s\n",
+				 iid, n_crashes, n_recent, n_restarts,
+				 quarantined ? "quarantined" : "supervised",
+				 date, last_error[0] ? ": " : "", last_error);
+
+			g_free (date);
+			g_date_time_unref (time);
+		}
+
+		first = FALSE;
+	}
+
+	if (json)
+		g_print ("\n}\n");
+
+	g_variant_iter_free (iter);
+	g_variant_unref (result);
+
+	return 0;
+}
+
+/* Upper bound of the bucket under which the given fraction of the values
+ * fall */
+static gint64
+stat_get_percentile (const Stat *stat,
+		     double      fraction)
+{
+	guint64 target;
+	guint64 seen = 0;
+	gsize   i;
+
+	if (stat->count == 0 || stat->n_buckets == 0)
+		return 0;
+
+	target = (guint64) (stat->count * fraction);
+	if (target == 0)
+		target = 1;
+
+	for (i = 0; i < stat->n_buckets; i++) {
+		seen += stat->buckets[i];
+		if (seen >= target)
+			return MIN ((gint64) 1 << (i + 1), stat->max);
+	}
+
+	return stat->max;
+}
+
+/* Leaves what was recorded since the before snapshot. The minimum and
+ * maximum are those of the whole run. */
+static void
+stat_subtract (Stat     *stat,
+	       GVariant *before)
+{
+	GVariant      *value;
+	GVariant      *buckets;
+	const guint64 *before_buckets;
+	const char    *kind;
+	guint64        count;
+	gint64         sum, min, max;
+	gsize          n_buckets;
+	gsize          i;
+
+	value = g_variant_lookup_value (before, stat->name,
+					G_VARIANT_TYPE ("(stxxxat)"));
+	if (!value)
+		return;
+
+	g_variant_get (value, "(&stxxx@at)", &kind, &count, &sum, &min, &max, &buckets);
+
+	stat->count -= MIN (count, stat->count);
+	stat->sum   -= sum;
+
+	before_buckets = g_variant_get_fixed_array (buckets, &n_buckets, sizeof (guint64));
+	if (stat->n_buckets > 0) {
+		stat->interval_buckets = g_memdup (stat->buckets,
+						   stat->n_buckets * sizeof (guint64));
+		for (i = 0; i < MIN (n_buckets, stat->n_buckets); i++)
+			stat->interval_buckets[i] -= MIN (before_buckets[i],
+							  stat->interval_buckets[i]);
+		stat->buckets = stat->interval_buckets;
+	}
+
+	g_variant_unref (buckets);
+	g_variant_unref (value);
+}
+
+static int
+compare_stats (gconstpointer a,
+	       gconstpointer b)
+{
+	const Stat *stat_a = a;
+	const Stat *stat_b = b;
+
+	return strcmp (stat_a->name, stat_b->name);
+}
+
+/* Timers are in nanoseconds, print them in microseconds */
+static double
+stat_scale (const Stat *stat,
+	    gint64      value)
+{
+	if (strcmp (stat->kind, "timer") == 0)
+		return value / 1000.0;
+
+	return value;
+}
+
+static void
+print_table (GArray *stats)
+{
+	guint i;
+
+	g_print ("%-36s %-9s %10s %12s %10s %10s %10s %10s %10s\n",
+		 "name", "kind", "count", "total", "mean", "min", "p50", "p99", "max");
+
+	for (i = 0; i < stats->len; i++) {
+		Stat *stat = &g_array_index (stats, Stat, i);
+
+		if (strcmp (stat->kind, "counter") == 0) {
+			g_print ("%-36s %-9s %10" G_GUINT64_FORMAT " %12" G_GINT64_FORMAT "\n",
+				 stat->name, stat->kind, stat->count, stat->sum);
+			continue;
+		}
+
+		g_print ("%-36s %-9s %10" G_GUINT64_FORMAT " %12.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+			 stat->name, stat->kind, stat->count,
+			 stat_scale (stat, stat->sum),
+			 stat->count ? stat_scale (stat, stat->sum) / stat->count : 0,
+			 stat_scale (stat, stat->min),
+			 stat_scale (stat, stat_get_percentile (stat, 0.5)),
+			 stat_scale (stat, stat_get_percentile (stat, 0.99)),
+			 stat_scale (stat, stat->max));
+	}
+
+	g_print ("\nTimes are in microseconds.\n");
+}
+
+static void
+print_json (GArray   *stats,
+	    gboolean  enabled)
+{
+	guint i;
+
+	g_print ("{\n  \"enabled\": %s,\n  \"stats\": {", enabled ? "true" : "false");
+
+	for (i = 0; i < stats->len; i++) {
+		Stat  *stat = &g_array_index (stats, Stat, i);
+		char  *name;
+		gsize  j;
+
+		name = json_escape (stat->name);
+		g_print ("%s\n    \"%s\": { \"kind\": \"%s\", \"count\": %" G_GUINT64_FORMAT
+			 ", \"sum\": %" G_GINT64_FORMAT,
+			 i ? "," : "", name, stat->kind, stat->count, stat->sum);
+		g_free (name);
+
+		if (stat->n_buckets > 0) {
+			g_print (", \"min\": %" G_GINT64_FORMAT ", \"max\": %" G_GINT64_FORMAT
+				 ", \"buckets\": [",
+				 stat->min, stat->max);
+			for (j = 0; j < stat->n_buckets; j++)
+				g_print ("%s%" G_GUINT64_FORMAT, j ? ", " : "", stat->buckets[j]);
+			g_print ("]");
+		}
+
+		g_print (" }");
+	}
+
+	g_print ("\n  }\n}\n");
+}
+
+int
+main (int argc, char **argv)
+{
+	GOptionContext  *context;
+	GDBusConnection *connection;
+	GVariant        *result;
+	GVariant        *dict;
+	GVariant        *before = NULL;
+	GVariantIter     iter;
+	guint            i;
+	GArray          *stats;
+	gboolean         enabled;
+	GError          *error = NULL;
+	Stat             stat;
+
+	context = g_option_context_new ("- dump the performance statistics of the panel");
+	g_option_context_add_main_entries (context, options, NULL);
+
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		g_option_context_free (context);
+		return 1;
+	}
+
+	g_option_context_free (context);
+
+	connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, &error);
+	if (!connection) {
+		g_printerr ("Cannot connect to the session bus: %s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+
+	if (applets) {
+		int status = print_applets (connection);
+
+		g_object_unref (connection);
+		return status;
+	}
+
+	if (enable || disable) {
+		result = call_panel (connection, "SetEnabled",
+				     g_variant_new ("(b)", enable), NULL, &error);
+		if (!result) {
+			g_printerr ("%s\n", error->message);
+			g_error_free (error);
+			g_object_unref (connection);
+			return 1;
+		}
+		g_variant_unref (result);
+	}
+
+	if (interval > 0) {
+		result = call_panel (connection, "GetStats", NULL,
+				     "(ba{s(stxxxat)})", &error);
+		if (!result) {
+			g_printerr ("%s\n", error->message);
+			g_error_free (error);
+			g_object_unref (connection);
+			return 1;
+		}
+
+		g_variant_get (result, "(b@a{s(stxxxat)})", &enabled, &before);
+		g_variant_unref (result);
+
+		g_usleep ((gulong) interval * G_USEC_PER_SEC);
+	}
+
+	result = call_panel (connection, "GetStats", NULL,
+			     "(ba{s(stxxxat)})", &error);
+	if (!result) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		g_object_unref (connection);
+		return 1;
+	}
+
+	g_variant_get (result, "(b@a{s(stxxxat)})", &enabled, &dict);
+
+	stats = g_array_new (FALSE, FALSE, sizeof (Stat));
+
+	g_variant_iter_init (&iter, dict);
+	while (TRUE) {
+		GVariant *buckets;
+
+		if (!g_variant_iter_next (&iter, "{&s(&stxxx@at)}",
+					  &stat.name, &stat.kind, &stat.count,
+					  &stat.sum, &stat.min, &stat.max, &buckets))
+			break;
+
+		/* The data stays owned by dict */
+		stat.buckets = g_variant_get_fixed_array (buckets, &stat.n_buckets,
+							  sizeof (guint64));
+		stat.interval_buckets = NULL;
+		g_variant_unref (buckets);
+
+		if (before)
+			stat_subtract (&stat, before);
+
+		g_array_append_val (stats, stat);
+	}
+
+	g_array_sort (stats, compare_stats);
+
+	if (json)
+		print_json (stats, enabled);
+	else if (stats->len == 0)
+		g_print (enabled ? "No statistics collected yet.\n" :
+				   "Statistics are disabled: start the panel with --stats or use --enable.\n");
+	else
+		print_table (stats);
+
+	for (i = 0; i < stats->len; i++)
+		g_free (g_array_index (stats, Stat, i).interval_buckets);
+	g_array_free (stats, TRUE);
+	g_variant_unref (dict);
+	g_variant_unref (result);
+	if (before)
+		g_variant_unref (before);
+
+	if (reset) {
+		result = call_panel (connection, "ResetStats", NULL, NULL, &error);
+		if (!result) {
+			g_printerr ("%s\n", error->message);
+			g_error_free (error);
+			g_object_unref (connection);
+			return 1;
+		}
+		g_variant_unref (result);
+	}
+
+	g_object_unref (connection);
+
+	return 0;
+}
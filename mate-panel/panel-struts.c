@@ -23,8 +23,12 @@
 
 #include <config.h>
 
+#include <string.h>
+
 #include "panel-struts.h"
 
+#include <libpanel-util/panel-stats.h>
+
 #include "panel-multiscreen.h"
 #include "panel-xutils.h"
 
@@ -47,9 +51,21 @@ typedef struct {
         int               allocated_strut_end;
 } PanelStrut;
 
+/* What to write in the window hint of a toplevel; all zeros to unset it */
+typedef struct {
+        PanelOrientation  orientation;
+        int               strut_size;
+        int               strut_start;
+        int               strut_end;
+} PanelStrutHint;
 
 static GSList *panel_struts_list = NULL;
 
+/* The toplevels whose window hint is to be written, to the
+ * PanelStrutHint to write */
+static GHashTable *panel_struts_pending_hints = NULL;
+static guint       panel_struts_hints_idle_id = 0;
+
 
 static inline PanelStrut *
 panel_struts_find_strut (PanelToplevel *toplevel)
@@ -187,6 +203,9 @@ panel_struts_allocate_struts (PanelToplevel *toplevel,
 	GSList   *allocated = NULL;
 	GSList   *l;
 	gboolean  toplevel_changed = FALSE;
+	gint64    start;
+
+	start = PANEL_STATS_TIMER_START ();
 
 	for (l = panel_struts_list; l; l = l->next) {
 		PanelStrut   *strut = l->data;
@@ -243,28 +262,25 @@ panel_struts_allocate_struts (PanelToplevel *toplevel,
 
 	g_slist_free (allocated);
 
+	PANEL_STATS_TIMER_STOP ("panel-struts-allocate", start);
+
 	return toplevel_changed;
 }
 
-void
-panel_struts_set_window_hint (PanelToplevel *toplevel)
+static void
+panel_struts_get_window_hint (PanelToplevel  *toplevel,
+			      PanelStrutHint *hint)
 {
-	GtkWidget  *widget;
 	PanelStrut *strut;
 	int         strut_size;
 	int         monitor_x, monitor_y, monitor_width, monitor_height;
 	int         screen_width, screen_height;
 	int         leftmost, rightmost, topmost, bottommost;
 
-	widget = GTK_WIDGET (toplevel);
+	memset (hint, 0, sizeof (PanelStrutHint));
 
-	if (!gtk_widget_get_realized (widget))
-		return;
-
-	if (!(strut = panel_struts_find_strut (toplevel))) {
-		panel_struts_unset_window_hint (toplevel);
+	if (!(strut = panel_struts_find_strut (toplevel)))
 		return;
-	}
 
 	strut_size = strut->allocated_strut_size;
 
@@ -311,20 +327,88 @@ panel_struts_set_window_hint (PanelToplevel *toplevel)
 		break;
 	}
 
-	panel_xutils_set_strut (gtk_widget_get_window (widget),
-				strut->orientation,
-				strut_size,
-				strut->allocated_strut_start,
-				strut->allocated_strut_end);
+	hint->orientation = strut->orientation;
+	hint->strut_size  = strut_size;
+	hint->strut_start = strut->allocated_strut_start;
+	hint->strut_end   = strut->allocated_strut_end;
+}
+
+static gboolean
+panel_struts_write_pending_hints (gpointer data)
+{
+	GHashTable     *pending;
+	GHashTableIter  iter;
+	gpointer        toplevel, value;
+
+	panel_struts_hints_idle_id = 0;
+
+	pending = panel_struts_pending_hints;
+	panel_struts_pending_hints = NULL;
+
+	g_hash_table_iter_init (&iter, pending);
+	while (g_hash_table_iter_next (&iter, &toplevel, &value)) {
+		PanelStrutHint *hint = value;
+
+		if (!gtk_widget_get_realized (toplevel))
+			continue;
+
+		panel_xutils_set_strut (gtk_widget_get_window (toplevel),
+					hint->orientation,
+					hint->strut_size,
+					hint->strut_start,
+					hint->strut_end);
+	}
+
+	g_hash_table_destroy (pending);
+
+	return FALSE;
+}
+
+static void
+panel_strut_hint_free (PanelStrutHint *hint)
+{
+	g_slice_free (PanelStrutHint, hint);
+}
+
+/* The struts change several times while the panels negotiate their size
+ * and position, write them once it is all settled. The hint is computed
+ * now: by the time it is written, an animation may have moved the strut
+ * already. */
+static void
+panel_struts_queue_window_hint (PanelToplevel *toplevel,
+				gboolean       set)
+{
+	PanelStrutHint *hint;
+
+	hint = g_slice_new0 (PanelStrutHint);
+	if (set)
+		panel_struts_get_window_hint (toplevel, hint);
+
+	if (!panel_struts_pending_hints)
+		panel_struts_pending_hints =
+			g_hash_table_new_full (NULL, NULL, g_object_unref,
+					       (GDestroyNotify) panel_strut_hint_free);
+
+	g_hash_table_insert (panel_struts_pending_hints,
+			     g_object_ref (toplevel), hint);
+
+	if (!panel_struts_hints_idle_id)
+		panel_struts_hints_idle_id =
+			g_idle_add_full (GDK_PRIORITY_REDRAW + 10,
+					 panel_struts_write_pending_hints,
+					 NULL, NULL);
 }
 
 void
-panel_struts_unset_window_hint (PanelToplevel *toplevel)
+panel_struts_set_window_hint (PanelToplevel *toplevel)
 {
-	if (!gtk_widget_get_realized (GTK_WIDGET (toplevel)))
-		return;
+	panel_struts_queue_window_hint (toplevel, TRUE);
+}
 
-	panel_xutils_set_strut (gtk_widget_get_window (GTK_WIDGET (toplevel)), 0, 0, 0, 0);
+void
+panel_struts_unset_window_hint (PanelToplevel *toplevel)
+{
+	panel_struts_queue_window_hint (toplevel, FALSE);
 }
 
 static inline int
@@ -22,6 +22,7 @@
 #include <libmate-panel-applet-private/panel-applet-container.h>
 #include <libmate-panel-applet-private/panel-applets-manager-dbus.h>
 
+#include "panel-applet-supervisor.h"
 #include "panel-modules.h"
 
 G_GNUC_UNUSED void on_execute_button_clicked (GtkButton *button, gpointer dummy);
@@ -36,12 +37,18 @@ static char *cli_iid = NULL;
 static char *cli_prefs_path = NULL;
 static char *cli_size = NULL;
 static char *cli_orient = NULL;
+static int   cli_restart_max = 5;
+static int   cli_restart_window = 600;
+static char *cli_factory_command = NULL;
 
 static const GOptionEntry options [] = {
 	{ "iid", 0, 0, G_OPTION_ARG_STRING, &cli_iid, N_("Specify an applet IID to load"), NULL},
 	{ "prefs-path", 0, 0, G_OPTION_ARG_STRING, &cli_prefs_path, N_("Specify a gsettings path in which the applet preferences should be stored"), NULL},
 	{ "size", 0, 0, G_OPTION_ARG_STRING, &cli_size, N_("Specify the initial size of the applet (xx-small, medium, large etc.)"), NULL},
 	{ "orient", 0, 0, G_OPTION_ARG_STRING, &cli_orient, N_("Specify the initial orientation of the applet (top, bottom, left or right)"), NULL},
+	{ "restart-max", 0, 0, G_OPTION_ARG_INT, &cli_restart_max, N_("Specify how many crashes of an applet are restarted automatically within the restart window"), N_("N")},
+	{ "restart-window", 0, 0, G_OPTION_ARG_INT, &cli_restart_window, N_("Specify the period over which crashes are counted"), N_("SECONDS")},
+	{ "factory-command", 0, 0, G_OPTION_ARG_STRING, &cli_factory_command, N_("Specify a command starting the applet factory before each load, for factories that cannot be activated over D-Bus"), N_("COMMAND")},
 	{ NULL}
 };
 
@@ -106,10 +113,90 @@ get_combo_applet_id (GtkWidget *combo_box)
 	return value;
 }
 
+typedef struct {
+	char  *iid;
+	char  *prefs_path;
+	guint  size;
+	guint  orientation;
+} AppletLoad;
+
+static void load_applet_into_window (const char *title,
+				     const char *prefs_path,
+				     guint       size,
+				     guint       orientation);
+
+static void
+applet_load_free (AppletLoad *load)
+{
+	g_free (load->iid);
+	g_free (load->prefs_path);
+	g_slice_free (AppletLoad, load);
+}
+
 static void
-applet_broken_cb (GtkWidget *container,
-		  GtkWidget *window)
+print_applet_status (const char *iid)
 {
+	GVariant     *status;
+	GVariantIter  iter;
+	const char   *key;
+	const char   *error;
+	guint         n_crashes, n_restarts, n_recent;
+	gint64        last_exit;
+	gboolean      quarantined;
+
+	status = panel_applet_supervisor_get_status ();
+
+	g_variant_iter_init (&iter, status);
+	while (g_variant_iter_next (&iter, "{&s(uuu&sxb)}",
+				    &key, &n_crashes, &n_restarts, &n_recent,
+				    &error, &last_exit, &quarantined)) {
+		if (g_strcmp0 (key, iid) != 0)
+			continue;
+
+		g_print ("%s: %u crashes (%u recent), %u restarts%s%s%s\n",
+			 key, n_crashes, n_recent, n_restarts,
+			 quarantined ? ", quarantined" : "",
+			 error[0] ? ", last load failed: " : "", error);
+	}
+
+	g_variant_unref (status);
+}
+
+static gboolean
+restart_applet_timeout (AppletLoad *load)
+{
+	panel_applet_supervisor_applet_restarted (load->iid);
+	load_applet_into_window (load->iid, load->prefs_path,
+				 load->size, load->orientation);
+
+	return FALSE;
+}
+
+static void
+applet_broken_cb (GtkWidget  *container,
+		  GtkWidget  *window)
+{
+	AppletLoad                  *load;
+	PanelAppletSupervisorAction  action;
+	guint                        delay;
+
+	load = g_object_get_data (G_OBJECT (window), "applet-load");
+
+	action = panel_applet_supervisor_applet_exited (load->iid,
+							&delay);
+	print_applet_status (load->iid);
+
+	if (action == PANEL_APPLET_SUPERVISOR_RESTART) {
+		g_print ("Restarting %s in %u ms\n", load->iid, delay);
+		g_timeout_add_full (G_PRIORITY_DEFAULT, delay,
+				    (GSourceFunc) restart_applet_timeout,
+				    load, (GDestroyNotify) applet_load_free);
+		g_object_steal_data (G_OBJECT (window), "applet-load");
+	} else if (cli_iid) {
+		/* Nothing left to test */
+		gtk_main_quit ();
+	}
+
 	gtk_widget_destroy (window);
 }
 
@@ -148,10 +235,27 @@ load_applet_into_window (const char *title,
 	GtkWidget       *container;
 	GtkWidget       *applet_window;
 	GVariantBuilder  builder;
+	AppletLoad      *load;
+	GError          *error = NULL;
+
+	if (cli_factory_command &&
+	    !g_spawn_command_line_async (cli_factory_command, &error)) {
+		g_printerr ("Cannot start the applet factory: %s\n", error->message);
+		g_error_free (error);
+	}
 
 	container = mate_panel_applet_container_new ();
 
 	applet_window = gtk_window_new (GTK_WINDOW_TOPLEVEL);
+
+	load = g_slice_new (AppletLoad);
+	load->iid         = g_strdup (title);
+	load->prefs_path  = g_strdup (prefs_path);
+	load->size        = size;
+	load->orientation = orientation;
+	g_object_set_data_full (G_OBJECT (applet_window), "applet-load",
+				load, (GDestroyNotify) applet_load_free);
+
 	//FIXME: we could set the window icon with the applet icon
 	gtk_window_set_title (GTK_WINDOW (applet_window), title);
 	gtk_container_add (GTK_CONTAINER (applet_window), container);
@@ -264,7 +368,7 @@ static void
 setup_options (void)
 {
 	MatePanelAppletsManager *manager;
-	GList               *applet_list, *l;
+	const GList         *applet_list, *l;
 	int                  i;
 	int                  j;
 	char                *prefs_path = NULL;
@@ -293,7 +397,6 @@ setup_options (void)
 				    COLUMN_ITEM, g_strdup (mate_panel_applet_info_get_iid (info)),
 				    -1);
 	}
-	g_list_free (applet_list);
 	g_object_unref (manager);
 
 	renderer = gtk_cell_renderer_text_new ();
@@ -360,6 +463,9 @@ main (int argc, char **argv)
 
 	panel_modules_ensure_loaded ();
 
+	panel_applet_supervisor_set_policy (MAX (cli_restart_max, 0),
+					    MAX (cli_restart_window, 1));
+
 	if (g_file_test ("../libmate-panel-applet", G_FILE_TEST_IS_DIR)) {
 		applets_dir = g_strdup_printf ("%s:../libmate-panel-applet", MATE_PANEL_APPLETS_DIR);
 		g_setenv ("MATE_PANEL_APPLETS_DIR", applets_dir, FALSE);
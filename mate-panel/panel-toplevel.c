@@ -1523,6 +1523,12 @@ static gboolean panel_toplevel_update_struts(PanelToplevel* toplevel, gboolean e
 	else
 		panel_struts_unregister_strut (toplevel);
 
+	/* The struts in the middle of an animation are of no use to anybody:
+	 * those of its end are written when it starts, and the final ones
+	 * when it is over */
+	if (toplevel->priv->animating && !end_of_animation)
+		return geometry_changed;
+
 	if (toplevel->priv->state == PANEL_STATE_NORMAL ||
 	    toplevel->priv->state == PANEL_STATE_AUTO_HIDDEN ||
 	    toplevel->priv->animating)
@@ -2079,8 +2085,10 @@ panel_toplevel_update_animating_position (PanelToplevel *toplevel)
 		 * have a wrong value in a size request event */
 		toplevel->priv->initial_animation_done = TRUE;
 
+		/* Hidden rather than unmapped, so that a collapsed
+		 * drawer and its applets are not allocated anymore */
 		if (toplevel->priv->attached && panel_toplevel_get_is_hidden (toplevel))
-			gtk_widget_unmap (GTK_WIDGET (toplevel));
+			gtk_widget_hide (GTK_WIDGET (toplevel));
 		else
 			gtk_widget_queue_resize (GTK_WIDGET (toplevel));
 
@@ -2612,6 +2620,14 @@ panel_toplevel_attach_widget_configure (PanelToplevel *toplevel)
 	return FALSE;
 }
 
+static void
+panel_toplevel_attach_widget_show (PanelToplevel *toplevel)
+{
+	/* A collapsed drawer stays hidden until it is opened */
+	if (!panel_toplevel_get_is_hidden (toplevel))
+		gtk_widget_show (GTK_WIDGET (toplevel));
+}
+
 static void
 panel_toplevel_update_attach_orientation (PanelToplevel *toplevel)
 {
@@ -2789,7 +2805,7 @@ panel_toplevel_connect_attached (PanelToplevel *toplevel)
 		G_CALLBACK (panel_toplevel_attach_widget_parent_set), toplevel);
 	signals [i++] = g_signal_connect_swapped (
 		toplevel->priv->attach_widget, "show",
-		G_CALLBACK (gtk_widget_show), toplevel);
+		G_CALLBACK (panel_toplevel_attach_widget_show), toplevel);
 	signals [i++] = g_signal_connect_swapped (
 		toplevel->priv->attach_widget, "hide",
 		G_CALLBACK (gtk_widget_hide), toplevel);
@@ -35,6 +35,7 @@
 #include <libpanel-util/panel-error.h>
 #include <libpanel-util/panel-glib.h>
 #include <libpanel-util/panel-keyfile.h>
+#include <libpanel-util/panel-stats.h>
 #include <libpanel-util/panel-xdg.h>
 
 #include "applet.h"
@@ -147,16 +148,126 @@ panel_pop_window_busy (GtkWidget *window)
 	}
 }
 
+/* Results of g_find_program_in_path(), positive and negative, keyed by
+ * program name. The cache is dropped whenever one of the PATH directories
+ * changes, or when PATH itself is different from the one it was built for.
+ */
+static GHashTable *program_in_path_cache = NULL;
+static GSList     *program_in_path_monitors = NULL;
+static char       *program_in_path_path = NULL;
+static guint       program_in_path_serial = 0;
+
+static void
+panel_program_in_path_cache_invalidate (GFileMonitor      *monitor,
+					GFile             *file,
+					GFile             *other_file,
+					GFileMonitorEvent  event,
+					gpointer           user_data)
+{
+	if (event == G_FILE_MONITOR_EVENT_CHANGED ||
+	    event == G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT)
+		return;
+
+	if (program_in_path_cache)
+		g_hash_table_remove_all (program_in_path_cache);
+	program_in_path_serial++;
+}
+
+static void
+panel_program_in_path_cache_ensure (void)
+{
+	const char  *path;
+	char       **dirs;
+	int          i;
+
+	path = g_getenv ("PATH");
+
+	if (program_in_path_cache &&
+	    g_strcmp0 (path, program_in_path_path) == 0)
+		return;
+
+	if (program_in_path_cache)
+		g_hash_table_remove_all (program_in_path_cache);
+	else
+		program_in_path_cache = g_hash_table_new_full (g_str_hash,
+							       g_str_equal,
+							       g_free,
+							       NULL);
+
+	g_slist_foreach (program_in_path_monitors,
+			 (GFunc) g_file_monitor_cancel, NULL);
+	g_slist_foreach (program_in_path_monitors,
+			 (GFunc) g_object_unref, NULL);
+	g_slist_free (program_in_path_monitors);
+	program_in_path_monitors = NULL;
+
+	g_free (program_in_path_path);
+	program_in_path_path = g_strdup (path);
+	program_in_path_serial++;
+
+	if (!path)
+		return;
+
+	dirs = g_strsplit (path, G_SEARCHPATH_SEPARATOR_S, 0);
+
+	for (i = 0; dirs[i] != NULL; i++) {
+		GFileMonitor *monitor;
+		GFile        *dir;
+
+		if (!g_path_is_absolute (dirs[i]))
+			continue;
+
+		dir = g_file_new_for_path (dirs[i]);
+		monitor = g_file_monitor_directory (dir, G_FILE_MONITOR_NONE,
+						    NULL, NULL);
+		g_object_unref (dir);
+
+		if (!monitor)
+			continue;
+
+		g_signal_connect (monitor, "changed",
+				  G_CALLBACK (panel_program_in_path_cache_invalidate),
+				  NULL);
+		program_in_path_monitors = g_slist_prepend (program_in_path_monitors,
+							    monitor);
+	}
+
+	g_strfreev (dirs);
+}
+
 gboolean
 panel_is_program_in_path (const char *program)
 {
-	char *tmp = g_find_program_in_path (program);
-	if (tmp != NULL) {
-		g_free (tmp);
-		return TRUE;
-	} else {
-		return FALSE;
-	}
+	gpointer  cached;
+	char     *tmp;
+	gboolean  found;
+
+	g_return_val_if_fail (program != NULL, FALSE);
+
+	panel_program_in_path_cache_ensure ();
+
+	if (g_hash_table_lookup_extended (program_in_path_cache, program,
+					  NULL, &cached))
+		return GPOINTER_TO_INT (cached);
+
+	tmp = g_find_program_in_path (program);
+	found = (tmp != NULL);
+	g_free (tmp);
+
+	g_hash_table_insert (program_in_path_cache,
+			     g_strdup (program), GINT_TO_POINTER (found));
+
+	return found;
+}
+
+/* Changes whenever the result of a PATH lookup may have changed, so that
+ * callers keeping resolved programs around know when to drop them. */
+guint
+panel_program_in_path_get_serial (void)
+{
+	panel_program_in_path_cache_ensure ();
+
+	return program_in_path_serial;
 }
 
 static gboolean
@@ -326,96 +437,442 @@ panel_find_icon (GtkIconTheme  *icon_theme,
 	return retval;
 }
 
-GdkPixbuf *
-panel_load_icon (GtkIconTheme  *icon_theme,
-		 const char    *icon_name,
-		 int            size,
-		 int            desired_width,
-		 int            desired_height,
-		 char         **error_msg)
+/* Loaded icons, shared by everything in the panel that loads icons through
+ * panel_load_icon_async(). Keys are built from the icon theme, the icon
+ * name or path and the requested sizes. The least recently used icons are
+ * dropped past PANEL_ICON_CACHE_MAX_ENTRIES, and the whole cache is dropped
+ * whenever an icon theme emits "changed", before any "changed" handler gets
+ * to reload its icons.
+ */
+#define PANEL_ICON_CACHE_MAX_ENTRIES 256
+
+typedef struct {
+	char      *key;
+	GdkPixbuf *pixbuf;
+} PanelIconCacheEntry;
+
+typedef struct {
+	GtkIconTheme *icon_theme;
+	char         *filename;
+	char         *key;
+	int           size;
+	int           desired_width;
+	int           desired_height;
+	guint         generation;
+	GSList       *waiters;
+} PanelIconLoad;
+
+typedef struct {
+	PanelIconLoadedFunc  callback;
+	gpointer             user_data;
+	GCancellable        *cancellable;
+} PanelIconWaiter;
+
+/* key -> link of icon_cache_lru, most recently used first */
+static GHashTable          *icon_cache = NULL;
+static GQueue               icon_cache_lru = G_QUEUE_INIT;
+static GHashTable          *icon_cache_pending = NULL;
+static GHashTable          *icon_cache_themes = NULL;
+static guint                icon_cache_generation = 0;
+
+static void
+panel_icon_cache_entry_free (PanelIconCacheEntry *entry)
+{
+	g_free (entry->key);
+	g_object_unref (entry->pixbuf);
+	g_slice_free (PanelIconCacheEntry, entry);
+}
+
+static GdkPixbuf *
+panel_icon_cache_lookup (const char *key)
+{
+	GList *link;
+
+	link = g_hash_table_lookup (icon_cache, key);
+	if (!link)
+		return NULL;
+
+	g_queue_unlink (&icon_cache_lru, link);
+	g_queue_push_head_link (&icon_cache_lru, link);
+
+	return ((PanelIconCacheEntry *) link->data)->pixbuf;
+}
+
+static void
+panel_icon_cache_insert (const char *key,
+			 GdkPixbuf  *pixbuf)
+{
+	PanelIconCacheEntry *entry;
+
+	if (g_hash_table_lookup (icon_cache, key))
+		return;
+
+	entry = g_slice_new (PanelIconCacheEntry);
+	entry->key = g_strdup (key);
+	entry->pixbuf = g_object_ref (pixbuf);
+
+	g_queue_push_head (&icon_cache_lru, entry);
+	g_hash_table_insert (icon_cache, entry->key, icon_cache_lru.head);
+
+	while (icon_cache_lru.length > PANEL_ICON_CACHE_MAX_ENTRIES) {
+		entry = g_queue_pop_tail (&icon_cache_lru);
+		g_hash_table_remove (icon_cache, entry->key);
+		panel_icon_cache_entry_free (entry);
+		PANEL_STATS_COUNT ("icon-cache-evict");
+	}
+}
+
+static void
+panel_icon_cache_clear (void)
+{
+	if (icon_cache)
+		g_hash_table_remove_all (icon_cache);
+	g_queue_foreach (&icon_cache_lru,
+			 (GFunc) panel_icon_cache_entry_free, NULL);
+	g_queue_clear (&icon_cache_lru);
+	/* loads in flight won't be added to the cache, and new requests
+	 * won't be attached to them */
+	if (icon_cache_pending)
+		g_hash_table_steal_all (icon_cache_pending);
+	icon_cache_generation++;
+}
+
+static gboolean
+panel_icon_cache_theme_changed (GSignalInvocationHint *ihint,
+				guint                  n_param_values,
+				const GValue          *param_values,
+				gpointer               data)
+{
+	panel_icon_cache_clear ();
+
+	return TRUE;
+}
+
+static void
+panel_icon_cache_theme_finalized (gpointer  data,
+				  GObject  *where_the_theme_was)
+{
+	g_hash_table_remove (icon_cache_themes, where_the_theme_was);
+	panel_icon_cache_clear ();
+}
+
+static char *
+panel_icon_cache_key (GtkIconTheme *icon_theme,
+		      const char   *icon_name,
+		      int           size,
+		      int           desired_width,
+		      int           desired_height)
 {
-	GdkPixbuf *retval;
-	char      *file;
-	GError    *error;
+	if (!icon_cache) {
+		/* the entries of icon_cache_lru own the keys and icons */
+		icon_cache = g_hash_table_new (g_str_hash, g_str_equal);
+		icon_cache_pending = g_hash_table_new (g_str_hash, g_str_equal);
+		icon_cache_themes = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+		/* an emission hook runs before the handlers of the RUN_LAST
+		 * "changed" signal, so they will not find stale icons */
+		g_signal_add_emission_hook (g_signal_lookup ("changed", GTK_TYPE_ICON_THEME),
+					    0, panel_icon_cache_theme_changed,
+					    NULL, NULL);
+	}
 
-	g_return_val_if_fail (error_msg == NULL || *error_msg == NULL, NULL);
+	if (!g_hash_table_lookup (icon_cache_themes, icon_theme)) {
+		g_hash_table_insert (icon_cache_themes, icon_theme, icon_theme);
+		g_object_weak_ref (G_OBJECT (icon_theme),
+				   panel_icon_cache_theme_finalized, NULL);
+	}
 
+	return g_strdup_printf ("%p:%d:%d:%d:%s", icon_theme, size,
+				desired_width, desired_height, icon_name);
+}
+
+static void
+panel_icon_load_free (PanelIconLoad *load)
+{
+	g_object_unref (load->icon_theme);
+	g_free (load->filename);
+	g_free (load->key);
+	g_slice_free (PanelIconLoad, load);
+}
+
+static void
+panel_icon_load_thread (GTask        *task,
+			gpointer      source_object,
+			gpointer      task_data,
+			GCancellable *cancellable)
+{
+	PanelIconLoad *load = task_data;
+	GdkPixbuf     *pixbuf;
+	GError        *error = NULL;
+
+	/* GtkIconTheme is not thread-safe, only the decoding is done here */
+	pixbuf = gdk_pixbuf_new_from_file_at_size (load->filename,
+						   load->desired_width,
+						   load->desired_height,
+						   &error);
+	if (pixbuf)
+		g_task_return_pointer (task, pixbuf, g_object_unref);
+	else
+		g_task_return_error (task, error);
+}
+
+static void
+panel_icon_load_deliver (PanelIconLoad *load,
+			 GdkPixbuf     *pixbuf,
+			 const char    *error_msg)
+{
+	GSList *l;
+
+	load->waiters = g_slist_reverse (load->waiters);
+
+	for (l = load->waiters; l; l = l->next) {
+		PanelIconWaiter *waiter = l->data;
+
+		if (!waiter->cancellable ||
+		    !g_cancellable_is_cancelled (waiter->cancellable))
+			waiter->callback (pixbuf, error_msg, waiter->user_data);
+
+		if (waiter->cancellable)
+			g_object_unref (waiter->cancellable);
+		g_slice_free (PanelIconWaiter, waiter);
+	}
+
+	g_slist_free (load->waiters);
+	load->waiters = NULL;
+}
+
+static void
+panel_icon_load_done (GObject      *source_object,
+		      GAsyncResult *result,
+		      gpointer      user_data)
+{
+	PanelIconLoad *load;
+	GdkPixbuf     *pixbuf;
+	GError        *error = NULL;
+
+	load = g_task_get_task_data (G_TASK (result));
+	pixbuf = g_task_propagate_pointer (G_TASK (result), &error);
+
+	if (load->generation == icon_cache_generation) {
+		g_hash_table_remove (icon_cache_pending, load->key);
+
+		if (pixbuf)
+			panel_icon_cache_insert (load->key, pixbuf);
+	}
+
+	panel_icon_load_deliver (load, pixbuf, error ? error->message : NULL);
+
+	if (pixbuf)
+		g_object_unref (pixbuf);
+	g_clear_error (&error);
+}
+
+/**
+ * panel_load_icon_async:
+ *
+ * Loads an icon through the shared icon cache, decoding it in a thread on
+ * a cache miss.
+ * Requests for an icon already being loaded share the load. @callback is
+ * called before this returns if the icon is in the cache, and is not called
+ * at all if @cancellable is cancelled before the icon is loaded.
+ */
+void
+panel_load_icon_async (GtkIconTheme        *icon_theme,
+		       const char          *icon_name,
+		       int                  size,
+		       int                  desired_width,
+		       int                  desired_height,
+		       GCancellable        *cancellable,
+		       PanelIconLoadedFunc  callback,
+		       gpointer             user_data)
+{
+	PanelIconLoad   *load;
+	PanelIconWaiter *waiter;
+	GdkPixbuf       *pixbuf;
+	GTask           *task;
+	char            *key;
+	char            *file;
+
+	g_return_if_fail (GTK_IS_ICON_THEME (icon_theme));
+	g_return_if_fail (icon_name != NULL);
+	g_return_if_fail (callback != NULL);
+
+	key = panel_icon_cache_key (icon_theme, icon_name, size,
+				    desired_width, desired_height);
+
+	pixbuf = panel_icon_cache_lookup (key);
+	if (pixbuf) {
+		PANEL_STATS_COUNT ("icon-cache-hit");
+		g_free (key);
+		callback (pixbuf, NULL, user_data);
+		return;
+	}
+
+	waiter = g_slice_new0 (PanelIconWaiter);
+	waiter->callback = callback;
+	waiter->user_data = user_data;
+	waiter->cancellable = cancellable ? g_object_ref (cancellable) : NULL;
+
+	load = g_hash_table_lookup (icon_cache_pending, key);
+	if (load) {
+		PANEL_STATS_COUNT ("icon-cache-shared");
+		load->waiters = g_slist_prepend (load->waiters, waiter);
+		g_free (key);
+		return;
+	}
+
+	PANEL_STATS_COUNT ("icon-cache-miss");
+
+	/* Looking up the file is cheap and needs the icon theme, so it is
+	 * done here; only the decoding goes to a thread */
 	file = panel_find_icon (icon_theme, icon_name, size);
+
+	load = g_slice_new0 (PanelIconLoad);
+	load->icon_theme = g_object_ref (icon_theme);
+	load->filename = file;
+	load->key = key;
+	load->size = size;
+	load->desired_width = desired_width;
+	load->desired_height = desired_height;
+	load->generation = icon_cache_generation;
+	load->waiters = g_slist_prepend (NULL, waiter);
+
 	if (!file) {
-		if (error_msg)
-			*error_msg = g_strdup_printf (_("Icon '%s' not found"),
-						      icon_name);
+		char *error_msg = g_strdup_printf (_("Icon '%s' not found"),
+						   icon_name);
 
-		return NULL;
+		panel_icon_load_deliver (load, NULL, error_msg);
+		panel_icon_load_free (load);
+		g_free (error_msg);
+		return;
 	}
 
-	error = NULL;
-	retval = gdk_pixbuf_new_from_file_at_size (file,
-						   desired_width,
-						   desired_height,
-						   &error);
-	if (error) {
-		if (error_msg)
-			*error_msg = g_strdup (error->message);
-		g_error_free (error);
+	g_hash_table_insert (icon_cache_pending, load->key, load);
+
+	task = g_task_new (NULL, NULL, panel_icon_load_done, NULL);
+	g_task_set_task_data (task, load, (GDestroyNotify) panel_icon_load_free);
+	g_task_run_in_thread (task, panel_icon_load_thread);
+	g_object_unref (task);
+}
+
+/* For each capability, the programs providing it by order of preference,
+ * with another program they only work along with */
+typedef struct {
+	const char *program;
+	const char *requires;
+} PanelCapabilityCandidate;
+
+static const PanelCapabilityCandidate capability_candidates [PANEL_CAPABILITY_LAST][4] = {
+	[PANEL_CAPABILITY_SCREENSAVER] = {
+		{ "mate-screensaver-command", "mate-screensaver-preferences" },
+		{ "xscreensaver-command", NULL },
+		{ NULL }
+	},
+	[PANEL_CAPABILITY_SCREENSAVER_PREFS] = {
+		{ "mate-screensaver-preferences", "mate-screensaver-command" },
+		{ "xscreensaver-demo", "xscreensaver-command" },
+		{ NULL }
+	},
+	[PANEL_CAPABILITY_CONNECT_SERVER] = {
+		{ "caja-connect-server", NULL },
+		{ "nautilus-connect-server", NULL },
+		{ "nemo-connect-server", NULL },
+		{ NULL }
+	},
+	[PANEL_CAPABILITY_SEARCH_TOOL] = {
+		{ "mate-search-tool", NULL },
+		{ NULL }
+	},
+	[PANEL_CAPABILITY_MENU_EDITOR] = {
+		{ "mozo", NULL },
+		{ "matemenu-simple-editor", NULL },
+		{ NULL }
 	}
+};
 
-	g_free (file);
+static const char *capability_programs [PANEL_CAPABILITY_LAST];
+static guint       capability_serial = 0;
 
-	return retval;
+static void
+panel_capability_resolve_all (void)
+{
+	int i, j;
+
+	for (i = 0; i < PANEL_CAPABILITY_LAST; i++) {
+		const PanelCapabilityCandidate *candidates = capability_candidates [i];
+
+		capability_programs [i] = NULL;
+
+		for (j = 0; candidates [j].program != NULL; j++) {
+			if (!panel_is_program_in_path (candidates [j].program))
+				continue;
+			if (candidates [j].requires &&
+			    !panel_is_program_in_path (candidates [j].requires))
+				continue;
+
+			capability_programs [i] = candidates [j].program;
+			break;
+		}
+	}
+
+	PANEL_STATS_COUNT ("capability-resolve");
 }
 
-static char* panel_lock_screen_action_get_command(const char* action)
+/* Returns the program providing the capability, or NULL if there is
+ * none. Only the first call after a PATH directory changed looks at the
+ * file system. */
+const char *
+panel_capability_get_program (PanelCapability capability)
 {
-	char* command = NULL;
-	gboolean use_gscreensaver = FALSE;
+	guint serial;
 
-	if (panel_is_program_in_path("mate-screensaver-command") && panel_is_program_in_path("mate-screensaver-preferences"))
-	{
-		use_gscreensaver = TRUE;
+	g_return_val_if_fail (capability < PANEL_CAPABILITY_LAST, NULL);
+
+	/* The serial starts at 1 once the PATH cache exists */
+	serial = panel_program_in_path_get_serial ();
+	if (serial != capability_serial) {
+		panel_capability_resolve_all ();
+		capability_serial = serial;
 	}
-	else if (!panel_is_program_in_path("xscreensaver-command"))
-	{
+
+	return capability_programs [capability];
+}
+
+gboolean
+panel_capability_available (PanelCapability capability)
+{
+	return panel_capability_get_program (capability) != NULL;
+}
+
+static char* panel_lock_screen_action_get_command(const char* action)
+{
+	const char *screensaver;
+	const char *prefs;
+
+	screensaver = panel_capability_get_program (PANEL_CAPABILITY_SCREENSAVER);
+	if (!screensaver)
 		return NULL;
-	}
 
 	if (strcmp (action, "prefs") == 0)
 	{
-		if (use_gscreensaver)
-		{
-			command = g_strdup ("mate-screensaver-preferences");
-		}
-		else if (panel_is_program_in_path ("xscreensaver-demo"))
-		{
-			command = g_strdup ("xscreensaver-demo");
-		}
-		else
-		{
-			command = NULL;
-		}
+		prefs = panel_capability_get_program (PANEL_CAPABILITY_SCREENSAVER_PREFS);
+
+		return g_strdup (prefs);
 	}
 	else if (strcmp (action, "activate") == 0 || strcmp(action, "lock") == 0)
 	{
 		/* Neither mate-screensaver or xscreensaver allow root
 		 * to lock the screen */
 		if (geteuid () == 0)
-		{
-			command = NULL;
-		}
+			return NULL;
+
+		if (strcmp (screensaver, "mate-screensaver-command") == 0)
+			return g_strdup_printf("mate-screensaver-command --%s", action);
 		else
-		{
-			if (use_gscreensaver)
-			{
-				command = g_strdup_printf("mate-screensaver-command --%s", action);
-			}
-			else
-			{
-				command = g_strdup_printf("xscreensaver-command -%s", action);
-			}
-		}
+			return g_strdup_printf("xscreensaver-command -%s", action);
 	}
 
-	return command;
+	return NULL;
 }
 
 gboolean
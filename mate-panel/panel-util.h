@@ -18,6 +18,21 @@ void		panel_push_window_busy	(GtkWidget *window);
 void		panel_pop_window_busy	(GtkWidget *window);
 
 gboolean	panel_is_program_in_path (const char *program);
+guint		panel_program_in_path_get_serial (void);
+
+/* Optional programs the panel offers actions for. They are resolved once,
+ * and again only after a PATH directory changed. */
+typedef enum {
+	PANEL_CAPABILITY_SCREENSAVER,
+	PANEL_CAPABILITY_SCREENSAVER_PREFS,
+	PANEL_CAPABILITY_CONNECT_SERVER,
+	PANEL_CAPABILITY_SEARCH_TOOL,
+	PANEL_CAPABILITY_MENU_EDITOR,
+	PANEL_CAPABILITY_LAST
+} PanelCapability;
+
+const char *	panel_capability_get_program (PanelCapability capability);
+gboolean	panel_capability_available   (PanelCapability capability);
 
 gboolean	panel_is_uri_writable	(const char *uri);
 gboolean	panel_uri_exists	(const char *uri);
@@ -31,12 +46,19 @@ GIcon *         panel_gicon_from_icon_name (const char *icon_name);
 char *          panel_find_icon         (GtkIconTheme  *icon_theme,
 					 const char    *icon_name,
 					 int            size);
-GdkPixbuf *     panel_load_icon         (GtkIconTheme  *icon_theme,
-					 const char    *icon_name,
-					 int            size,
-					 int            desired_width,
-					 int            desired_height,
-					 char         **error_msg);
+
+typedef void (* PanelIconLoadedFunc) (GdkPixbuf  *pixbuf,
+				      const char *error_msg,
+				      gpointer    user_data);
+
+void            panel_load_icon_async   (GtkIconTheme        *icon_theme,
+					 const char          *icon_name,
+					 int                  size,
+					 int                  desired_width,
+					 int                  desired_height,
+					 GCancellable        *cancellable,
+					 PanelIconLoadedFunc  callback,
+					 gpointer             user_data);
 
 GFile      *panel_launcher_get_gfile           (const char *location);
 char       *panel_launcher_get_uri             (const char *location);
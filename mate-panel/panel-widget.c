@@ -14,6 +14,7 @@
 #include <gtk/gtkx.h> /* for GTK_IS_SOCKET */
 
 #include <libpanel-util/panel-list.h>
+#include <libpanel-util/panel-stats.h>
 
 #include "applet.h"
 #include "panel-widget.h"
@@ -1405,10 +1406,13 @@ panel_widget_size_allocate(GtkWidget *widget, GtkAllocation *allocation)
 	int i;
 	int old_size;
 	gboolean ltr;
+	gint64 start;
 
 	g_return_if_fail(PANEL_IS_WIDGET(widget));
 	g_return_if_fail(allocation!=NULL);
 
+	start = PANEL_STATS_TIMER_START ();
+
 	panel = PANEL_WIDGET(widget);
 
 	old_size = panel->size;
@@ -1592,6 +1596,8 @@ panel_widget_size_allocate(GtkWidget *widget, GtkAllocation *allocation)
 #if !GTK_CHECK_VERSION(3, 18, 0)
 	panel_widget_set_background_region (panel);
 #endif
+
+	PANEL_STATS_TIMER_STOP ("panel-widget-size-allocate", start);
 }
 
 gboolean
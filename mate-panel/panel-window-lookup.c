@@ -0,0 +1,264 @@
+/*
+ * panel-window-lookup.c: find the managed window under a point
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Walking the window tree to the window with WM_STATE takes a round trip
+ * per window visited, and reparenting window managers nest the clients
+ * deep in decoration windows. Instead, the clients are taken from
+ * _NET_CLIENT_LIST_STACKING beforehand, in a single request, and only the
+ * clicked toplevel is resolved against that list: it is either a client
+ * itself, or a frame whose descendants are matched against the list one
+ * level at a time, without asking for any property.
+ */
+
+#include <config.h>
+
+#include <gdk/gdk.h>
+#include <gdk/gdkx.h>
+#include <X11/Xatom.h>
+
+#include <libpanel-util/panel-stats.h>
+
+#include "panel-window-lookup.h"
+
+/* Frames hold the client a few levels down at most; anything deeper is
+ * left to the tree walk */
+#define MAX_FRAME_DEPTH 4
+
+struct _PanelWindowLookup {
+	Display    *display;
+
+	/* Set of the client windows */
+	GHashTable *clients;
+};
+
+static gulong *
+get_cardinal_list (Display *display,
+		   Window   window,
+		   Atom     property,
+		   Atom     type,
+		   gulong  *n_items)
+{
+	gulong  bytes_after;
+	gulong *prop = NULL;
+	Atom    ret_type = None;
+	int     ret_format;
+
+	*n_items = 0;
+
+	if (XGetWindowProperty (display, window, property,
+				0, G_MAXLONG, False, type,
+				&ret_type, &ret_format, n_items,
+				&bytes_after, (guchar **) &prop) != Success)
+		return NULL;
+
+	if (ret_type != type || ret_format != 32 || *n_items == 0) {
+		if (prop)
+			XFree (prop);
+		*n_items = 0;
+		return NULL;
+	}
+
+	return prop;
+}
+
+PanelWindowLookup *
+panel_window_lookup_new (Display *display,
+			 Window   root)
+{
+	PanelWindowLookup *lookup;
+	Atom               stacking_atom;
+	gulong            *windows;
+	gulong             n_windows;
+	gulong             i;
+	gint64             start;
+
+	start = PANEL_STATS_TIMER_START ();
+
+	stacking_atom = XInternAtom (display, "_NET_CLIENT_LIST_STACKING", False);
+
+	gdk_error_trap_push ();
+	windows = get_cardinal_list (display, root, stacking_atom,
+				     XA_WINDOW, &n_windows);
+	gdk_error_trap_pop_ignored ();
+
+	if (!windows)
+		return NULL;
+
+	lookup = g_slice_new0 (PanelWindowLookup);
+	lookup->display = display;
+	lookup->clients = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	for (i = 0; i < n_windows; i++)
+		g_hash_table_add (lookup->clients, GSIZE_TO_POINTER (windows [i]));
+
+	XFree (windows);
+
+	PANEL_STATS_TIMER_STOP ("force-quit-snapshot", start);
+
+	return lookup;
+}
+
+void
+panel_window_lookup_free (PanelWindowLookup *lookup)
+{
+	if (!lookup)
+		return;
+
+	g_hash_table_destroy (lookup->clients);
+	g_slice_free (PanelWindowLookup, lookup);
+}
+
+static gboolean
+is_client (PanelWindowLookup *lookup,
+	   Window             window)
+{
+	return g_hash_table_contains (lookup->clients, GSIZE_TO_POINTER (window));
+}
+
+/* Looks for a client among the descendants of window, checking all the
+ * children of a window before going down, topmost first */
+static Window
+find_client_below (PanelWindowLookup *lookup,
+		   Window             window,
+		   int                depth)
+{
+	Window  root;
+	Window  parent;
+	Window *kids = NULL;
+	Window  retval = None;
+	guint   nkids;
+	int     i;
+
+	if (depth == 0)
+		return None;
+
+	if (!XQueryTree (lookup->display, window, &root, &parent,
+			 &kids, &nkids))
+		return None;
+
+	for (i = (int) nkids - 1; i >= 0 && retval == None; i--)
+		if (is_client (lookup, kids [i]))
+			retval = kids [i];
+
+	for (i = (int) nkids - 1; i >= 0 && retval == None; i--)
+		retval = find_client_below (lookup, kids [i], depth - 1);
+
+	if (kids)
+		XFree (kids);
+
+	return retval;
+}
+
+Window
+panel_window_lookup_at (PanelWindowLookup *lookup,
+			Window             toplevel)
+{
+	Window window;
+
+	g_return_val_if_fail (lookup != NULL, None);
+
+	if (is_client (lookup, toplevel)) {
+		window = toplevel;
+	} else {
+		gdk_error_trap_push ();
+		window = find_client_below (lookup, toplevel, MAX_FRAME_DEPTH);
+		gdk_error_trap_pop_ignored ();
+	}
+
+	if (window != None)
+		PANEL_STATS_COUNT ("force-quit-lookup-hit");
+	else
+		PANEL_STATS_COUNT ("force-quit-lookup-miss");
+
+	return window;
+}
+
+static gboolean
+wm_state_set (Display *display,
+	      Window   window)
+{
+	static Atom  wm_state_atom = None;
+	gulong       nitems;
+	gulong       bytes_after;
+	gulong      *prop;
+	Atom         ret_type = None;
+	int          ret_format;
+	int          result;
+
+	if (wm_state_atom == None)
+		wm_state_atom = XInternAtom (display, "WM_STATE", FALSE);
+
+	gdk_error_trap_push ();
+	result = XGetWindowProperty (display, window, wm_state_atom,
+				     0, G_MAXLONG, False, wm_state_atom,
+				     &ret_type, &ret_format, &nitems,
+				     &bytes_after, (gpointer) &prop);
+
+	if (gdk_error_trap_pop ())
+		return FALSE;
+
+	if (result != Success)
+		return FALSE;
+
+	XFree (prop);
+
+	if (ret_type != wm_state_atom)
+		return FALSE;
+
+	return TRUE;
+}
+
+Window
+panel_window_lookup_find_managed (Display *display,
+				  Window   window)
+{
+	Window  root;
+	Window  parent;
+	Window *kids = NULL;
+	Window  retval;
+	guint   nkids;
+	int     i, result;
+
+	if (wm_state_set (display, window))
+		return window;
+
+	gdk_error_trap_push ();
+	result = XQueryTree (display, window, &root, &parent, &kids, &nkids);
+	if (gdk_error_trap_pop () || !result)
+		return None;
+
+	retval = None;
+
+	for (i = 0; i < nkids; i++) {
+		if (wm_state_set (display, kids [i])) {
+			retval = kids [i];
+			break;
+		}
+
+		retval = panel_window_lookup_find_managed (display, kids [i]);
+		if (retval != None)
+			break;
+	}
+
+	if (kids)
+		XFree (kids);
+
+	return retval;
+}
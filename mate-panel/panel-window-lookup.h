@@ -0,0 +1,53 @@
+/*
+ * panel-window-lookup.h: find the managed window under a point
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef __PANEL_WINDOW_LOOKUP_H__
+#define __PANEL_WINDOW_LOOKUP_H__
+
+#include <glib.h>
+#include <X11/Xlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct _PanelWindowLookup PanelWindowLookup;
+
+/* Snapshot of the clients of the window manager. Returns NULL if the
+ * window manager does not publish its stacking order. */
+PanelWindowLookup *panel_window_lookup_new    (Display           *display,
+					       Window             root);
+void               panel_window_lookup_free   (PanelWindowLookup *lookup);
+
+/* Returns the client that toplevel, a child of the root window, is or
+ * frames, or None if it is not a client nor the frame of one, like
+ * override-redirect windows. */
+Window             panel_window_lookup_at     (PanelWindowLookup *lookup,
+					       Window             toplevel);
+
+/* Walks down the window tree from window to the first window with
+ * WM_STATE set, the slow way */
+Window             panel_window_lookup_find_managed (Display *display,
+						     Window   window);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PANEL_WINDOW_LOOKUP_H__ */
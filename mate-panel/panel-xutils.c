@@ -32,9 +32,21 @@
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
 
+#include <libpanel-util/panel-stats.h>
+
 static Atom net_wm_strut              = None;
 static Atom net_wm_strut_partial      = None;
 
+/* The struts last written on a window */
+typedef struct {
+	PanelOrientation orientation;
+	guint32          strut;
+	guint32          strut_start;
+	guint32          strut_end;
+} PanelXutilsStrut;
+
+static GQuark strut_quark = 0;
+
 enum {
 	STRUT_LEFT = 0,
 	STRUT_RIGHT = 1,
@@ -61,8 +73,41 @@ panel_xutils_set_strut (GdkWindow        *gdk_window,
 	Window   window;
 	gulong   struts [12] = { 0, };
 
+	PanelXutilsStrut *last;
+
 	g_return_if_fail (GDK_IS_WINDOW (gdk_window));
 
+	if (strut == 0)
+		orientation = strut_start = strut_end = 0;
+
+	/* Each write makes the window manager compute the work area again
+	 * and move the maximized windows around */
+	if (!strut_quark)
+		strut_quark = g_quark_from_static_string ("panel-xutils-strut");
+
+	last = g_object_get_qdata (G_OBJECT (gdk_window), strut_quark);
+	if (last &&
+	    last->orientation == orientation &&
+	    last->strut       == strut &&
+	    last->strut_start == strut_start &&
+	    last->strut_end   == strut_end) {
+		PANEL_STATS_COUNT ("strut-write-skipped");
+		return;
+	}
+
+	if (!last) {
+		last = g_new (PanelXutilsStrut, 1);
+		g_object_set_qdata_full (G_OBJECT (gdk_window), strut_quark,
+					 last, g_free);
+	}
+
+	last->orientation = orientation;
+	last->strut       = strut;
+	last->strut_start = strut_start;
+	last->strut_end   = strut_end;
+
+	PANEL_STATS_COUNT ("strut-write");
+
 	display = GDK_WINDOW_XDISPLAY (gdk_window);
 	window = GDK_WINDOW_XID (gdk_window);
 
@@ -150,6 +150,38 @@ panel_size_change (GtkWidget *widget, gpointer data)
 			      widget);
 }
 
+static void
+hidden_change_foreach (GtkWidget *w,
+		       gpointer   data)
+{
+	AppletInfo *info = g_object_get_data (G_OBJECT (w), "applet_info");
+
+	if (info->type == PANEL_OBJECT_APPLET)
+		mate_panel_applet_frame_change_panel_hidden (
+			MATE_PANEL_APPLET_FRAME (info->widget),
+			GPOINTER_TO_INT (data));
+}
+
+/* Applets stay mapped while their panel is hidden, let them know they can
+ * stop updating */
+static void
+panel_hiding (PanelToplevel *toplevel,
+	      PanelWidget   *panel_widget)
+{
+	gtk_container_foreach (GTK_CONTAINER (panel_widget),
+			       hidden_change_foreach,
+			       GINT_TO_POINTER (TRUE));
+}
+
+static void
+panel_unhiding (PanelToplevel *toplevel,
+		PanelWidget   *panel_widget)
+{
+	gtk_container_foreach (GTK_CONTAINER (panel_widget),
+			       hidden_change_foreach,
+			       GINT_TO_POINTER (FALSE));
+}
+
 void
 back_change (AppletInfo  *info,
 	     PanelWidget *panel)
@@ -1219,8 +1251,9 @@ panel_setup (PanelToplevel *toplevel)
 	
 	g_object_set_data (G_OBJECT (toplevel), "PanelData", pd);
 
-	panel_lockdown_notify_add (G_CALLBACK (panel_recreate_context_menu),
-				   pd);
+	panel_lockdown_notify_add_keys (PANEL_LOCKDOWN_LOCKED_DOWN,
+					G_CALLBACK (panel_recreate_context_menu),
+					pd);
 
 	panel_widget_setup (panel_widget);
 
@@ -1244,6 +1277,10 @@ panel_setup (PanelToplevel *toplevel)
 
 	g_signal_connect_swapped (toplevel, "notify::orientation",
 				  G_CALLBACK (panel_orient_change), panel_widget);
+	g_signal_connect (toplevel, "hiding",
+			  G_CALLBACK (panel_hiding), panel_widget);
+	g_signal_connect (toplevel, "unhiding",
+			  G_CALLBACK (panel_unhiding), panel_widget);
  
 	g_signal_connect (toplevel, "destroy", G_CALLBACK (panel_destroy), pd);
 
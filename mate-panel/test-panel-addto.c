@@ -0,0 +1,208 @@
+/*
+ * test-panel-addto.c: checks the filtering of the Add to Panel dialog
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Two dialogs share the same items, like the dialogs of two panels share
+ * the static items, and are typed into in turn; every row they show is
+ * checked against a plain panel_g_utf8_strstrcase() search.
+ */
+
+#include <config.h>
+#include <string.h>
+
+#include <libpanel-util/panel-glib.h>
+
+#include "panel-addto-private.h"
+
+/* globals, normally defined in main.c */
+GSList *panels = NULL;
+GSList *panel_list = NULL;
+
+static const char *words[] = {
+	"Clock", "Weather", "Workspace", "Switcher", "Window", "List",
+	"Notification", "Area", "Fish", "Wanda", "Show", "Desktop",
+	"Lock", "Screen", "Log", "Out", "Énergie", "Überwachung",
+	"Système", "Çà", "Menu", "Bar", "Drawer", "Separator"
+};
+
+/* Which dialog types what, in order: the narrowing of one dialog must not
+ * be confused by the other one filtering in between */
+static const struct {
+	int         dialog;
+	const char *text;
+} steps[] = {
+	{ 0, "w" },
+	{ 0, "wo" },
+	{ 1, "c" },
+	{ 1, "cl" },
+	{ 0, "wor" },
+	{ 1, "clo" },
+	{ 0, "work" },
+	{ 1, "" },
+	{ 0, "work s" },
+	{ 1, "l" },
+	{ 0, "wor" },
+	{ 1, "lo" },
+	{ 0, "work" }
+};
+
+static PanelAddtoItemInfo *
+make_items (int n_items)
+{
+	PanelAddtoItemInfo *items;
+	GRand              *rand;
+	int                 i;
+
+	items = g_new0 (PanelAddtoItemInfo, n_items);
+	rand = g_rand_new_with_seed (42);
+
+	for (i = 0; i < n_items; i++) {
+		items[i].type = PANEL_ADDTO_APPLET;
+		items[i].name = g_strdup_printf ("%s %s %d",
+						 words[g_rand_int_range (rand, 0, G_N_ELEMENTS (words))],
+						 words[g_rand_int_range (rand, 0, G_N_ELEMENTS (words))],
+						 i);
+		items[i].description = g_strdup_printf ("Shows the %s %s of the %s",
+							words[g_rand_int_range (rand, 0, G_N_ELEMENTS (words))],
+							words[g_rand_int_range (rand, 0, G_N_ELEMENTS (words))],
+							words[g_rand_int_range (rand, 0, G_N_ELEMENTS (words))]);
+		panel_addto_item_info_make_search_keys (&items[i]);
+	}
+
+	g_rand_free (rand);
+
+	return items;
+}
+
+static GtkTreeModel *
+make_model (PanelAddtoItemInfo *items,
+	    int                 n_items)
+{
+	GtkListStore *model;
+	GtkTreeIter   iter;
+	int           i;
+
+	model = gtk_list_store_new (NUMBER_COLUMNS,
+				    G_TYPE_STRING,
+				    G_TYPE_STRING,
+				    G_TYPE_POINTER,
+				    G_TYPE_STRING);
+
+	for (i = 0; i < n_items; i++) {
+		gtk_list_store_append (model, &iter);
+		gtk_list_store_set (model, &iter,
+				    COLUMN_TEXT, items[i].name,
+				    COLUMN_DATA, &items[i],
+				    -1);
+	}
+
+	return GTK_TREE_MODEL (model);
+}
+
+/* Runs the filter on every row, as a refilter does; returns the number of
+ * rows whose visibility is wrong */
+static int
+check_filter (PanelAddtoDialog *dialog,
+	      GtkTreeModel     *model,
+	      int              *n_visible)
+{
+	GtkTreeIter iter;
+	gboolean    valid;
+	int         n_errors = 0;
+
+	*n_visible = 0;
+
+	for (valid = gtk_tree_model_get_iter_first (model, &iter);
+	     valid;
+	     valid = gtk_tree_model_iter_next (model, &iter)) {
+		PanelAddtoItemInfo *data;
+		gboolean            visible;
+		gboolean            expected;
+
+		gtk_tree_model_get (model, &iter, COLUMN_DATA, &data, -1);
+
+		visible = panel_addto_filter_func (model, &iter, dialog);
+		expected = (PANEL_GLIB_STR_EMPTY (dialog->search_text) ||
+			    panel_g_utf8_strstrcase (data->name, dialog->search_text) ||
+			    panel_g_utf8_strstrcase (data->description, dialog->search_text));
+
+		if (visible)
+			(*n_visible)++;
+
+		if (visible != expected) {
+			n_errors++;
+			g_print ("  \"%s\" %s for \"%s\"\n", data->name,
+				 visible ? "shown" : "hidden", dialog->search_text);
+		}
+	}
+
+	return n_errors;
+}
+
+int
+main (int    argc,
+      char **argv)
+{
+	PanelAddtoItemInfo *items;
+	PanelAddtoDialog    dialogs[2];
+	GtkTreeModel       *models[2];
+	int                 n_items = 500;
+	int                 n_errors = 0;
+	int                 i;
+
+	items = make_items (n_items);
+
+	for (i = 0; i < G_N_ELEMENTS (dialogs); i++) {
+		memset (&dialogs[i], 0, sizeof (dialogs[i]));
+		dialogs[i].match_serials = g_hash_table_new (g_direct_hash,
+							     g_direct_equal);
+		models[i] = make_model (items, n_items);
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (steps); i++) {
+		PanelAddtoDialog *dialog = &dialogs[steps[i].dialog];
+		int               n_visible;
+		int               errors;
+
+		panel_addto_set_search_text (dialog, steps[i].text);
+
+		errors = check_filter (dialog, models[steps[i].dialog], &n_visible);
+		n_errors += errors;
+
+		g_print ("dialog %d: %-8s %4d rows shown%s%s\n",
+			 steps[i].dialog, steps[i].text, n_visible,
+			 dialog->search_narrowing ? " (narrowing)" : "",
+			 errors ? ", wrong" : "");
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (dialogs); i++) {
+		g_object_unref (models[i]);
+		g_hash_table_destroy (dialogs[i].match_serials);
+		g_free (dialogs[i].search_text);
+		g_free (dialogs[i].search_key);
+	}
+
+	for (i = 0; i < n_items; i++)
+		panel_addto_dialog_free_item_info (&items[i]);
+	g_free (items);
+
+	g_print ("%s\n", n_errors == 0 ? "PASS" : "FAIL");
+
+	return n_errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,149 @@
+/*
+ * test-panel-lockdown.c: checks that lockdown notifications only reach the
+ * subscribers of the keys that changed
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * The settings live in the memory backend, but the org.mate.panel and
+ * org.mate.lockdown schemas must be installed, or found through
+ * GSETTINGS_SCHEMA_DIR.
+ */
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "panel-lockdown.h"
+#include "panel-schemas.h"
+
+typedef struct {
+	const char        *name;
+	PanelLockdownKeys  keys;
+	guint              n_calls;
+} Subscriber;
+
+static Subscriber subscribers[] = {
+	{ "lock screen",             PANEL_LOCKDOWN_DISABLE_LOCK_SCREEN, 0 },
+	{ "log out",                 PANEL_LOCKDOWN_DISABLE_LOG_OUT, 0 },
+	{ "lock screen and log out", PANEL_LOCKDOWN_DISABLE_LOCK_SCREEN |
+				     PANEL_LOCKDOWN_DISABLE_LOG_OUT, 0 },
+	{ "locked down",             PANEL_LOCKDOWN_LOCKED_DOWN, 0 },
+	{ "everything",              PANEL_LOCKDOWN_ALL, 0 }
+};
+
+static void
+subscriber_notify (Subscriber *subscriber)
+{
+	subscriber->n_calls++;
+}
+
+static void
+run_pending (void)
+{
+	/* Let the settings change and the dispatch idle happen */
+	while (g_main_context_iteration (NULL, FALSE));
+}
+
+static gboolean
+check_calls (const char  *name,
+	     const guint *expected)
+{
+	gboolean ok = TRUE;
+	guint    i;
+
+	g_print ("%s\n", name);
+
+	for (i = 0; i < G_N_ELEMENTS (subscribers); i++) {
+		gboolean this_ok = subscribers[i].n_calls == expected[i];
+
+		g_print ("  %-24s %u call(s), expected %u%s\n",
+			 subscribers[i].name, subscribers[i].n_calls,
+			 expected[i], this_ok ? "" : "  <-- wrong");
+
+		ok &= this_ok;
+		subscribers[i].n_calls = 0;
+	}
+
+	g_print ("  %s\n", ok ? "PASS" : "FAIL");
+
+	return ok;
+}
+
+int
+main (int argc, char **argv)
+{
+	GSettings *lockdown_settings;
+	gboolean   ok = TRUE;
+	guint      i;
+
+	g_setenv ("GSETTINGS_BACKEND", "memory", TRUE);
+
+	panel_lockdown_init ();
+
+	for (i = 0; i < G_N_ELEMENTS (subscribers); i++)
+		panel_lockdown_notify_add_keys (subscribers[i].keys,
+						G_CALLBACK (subscriber_notify),
+						&subscribers[i]);
+
+	lockdown_settings = g_settings_new (LOCKDOWN_SCHEMA);
+	run_pending ();
+
+	g_settings_set_boolean (lockdown_settings,
+				LOCKDOWN_DISABLE_LOCK_SCREEN_KEY,
+				!panel_lockdown_get_disable_lock_screen ());
+	run_pending ();
+	{
+		guint expected[] = { 1, 0, 1, 0, 1 };
+		ok &= check_calls ("Toggling disable-lock-screen", expected);
+	}
+
+	/* Both changes are dispatched together */
+	g_settings_set_boolean (lockdown_settings,
+				LOCKDOWN_DISABLE_LOCK_SCREEN_KEY,
+				!panel_lockdown_get_disable_lock_screen ());
+	g_settings_set_boolean (lockdown_settings,
+				LOCKDOWN_DISABLE_LOG_OUT_KEY,
+				!panel_lockdown_get_disable_log_out ());
+	run_pending ();
+	{
+		guint expected[] = { 1, 1, 1, 0, 1 };
+		ok &= check_calls ("Toggling disable-lock-screen and disable-log-out",
+				   expected);
+	}
+
+	/* A removed subscriber is not called anymore */
+	panel_lockdown_notify_remove (G_CALLBACK (subscriber_notify),
+				      &subscribers[0]);
+	g_settings_set_boolean (lockdown_settings,
+				LOCKDOWN_DISABLE_LOCK_SCREEN_KEY,
+				!panel_lockdown_get_disable_lock_screen ());
+	run_pending ();
+	{
+		guint expected[] = { 0, 0, 1, 0, 1 };
+		ok &= check_calls ("Toggling disable-lock-screen after a removal",
+				   expected);
+	}
+
+	for (i = 1; i < G_N_ELEMENTS (subscribers); i++)
+		panel_lockdown_notify_remove (G_CALLBACK (subscriber_notify),
+					      &subscribers[i]);
+
+	g_object_unref (lockdown_settings);
+	panel_lockdown_finalize ();
+
+	return ok ? 0 : 1;
+}
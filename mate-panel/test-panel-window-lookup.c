@@ -0,0 +1,249 @@
+/*
+ * test-panel-window-lookup.c: compares the two ways Force Quit finds the
+ * clicked window, on a synthetic window tree
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of the
+ * License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/*
+ * Meant to run on an empty X server, for instance under xvfb-run: the
+ * program plays the window manager, with frames holding decoration
+ * windows before the client, like reparenting window managers do.
+ */
+
+#include <stdlib.h>
+
+#include <glib.h>
+#include <gdk/gdk.h>
+#include <gdk/gdkx.h>
+#include <X11/Xatom.h>
+
+#include "panel-window-lookup.h"
+
+#define FRAME_EXTENT 4
+#define TITLE_HEIGHT 24
+
+static int n_clients     = 300;
+static int n_decorations = 6;
+static int decoration_depth = 3;
+static int n_clicks      = 500;
+
+static GOptionEntry entries[] = {
+	{ "clients", 0, 0, G_OPTION_ARG_INT, &n_clients,
+	  "Number of client windows (default: 300)", "N" },
+	{ "decorations", 0, 0, G_OPTION_ARG_INT, &n_decorations,
+	  "Number of decoration windows per frame (default: 6)", "N" },
+	{ "depth", 0, 0, G_OPTION_ARG_INT, &decoration_depth,
+	  "Depth of the decoration windows (default: 3)", "N" },
+	{ "clicks", 0, 0, G_OPTION_ARG_INT, &n_clicks,
+	  "Number of clicks to resolve (default: 500)", "N" },
+	{ NULL }
+};
+
+static Window
+create_window (Display *display,
+	       Window   parent,
+	       int      x,
+	       int      y,
+	       int      width,
+	       int      height)
+{
+	Window window;
+
+	window = XCreateSimpleWindow (display, parent, x, y,
+				      MAX (width, 1), MAX (height, 1),
+				      0, 0, 0);
+	XMapWindow (display, window);
+
+	return window;
+}
+
+static void
+create_decoration (Display *display,
+		   Window   parent,
+		   int      width,
+		   int      depth)
+{
+	Window window;
+
+	window = create_window (display, parent, 0, 0, width, TITLE_HEIGHT);
+
+	if (depth > 1)
+		create_decoration (display, window, width / 2, depth - 1);
+}
+
+static Window
+create_client (Display *display,
+	       Window   root,
+	       GRand   *rand,
+	       int      screen_width,
+	       int      screen_height)
+{
+	Window  frame;
+	Window  inner;
+	Window  client;
+	Atom    wm_state;
+	Atom    frame_extents;
+	gulong  state[2] = { NormalState, None };
+	gulong  extents[4] = { FRAME_EXTENT, FRAME_EXTENT,
+			       TITLE_HEIGHT, FRAME_EXTENT };
+	int     width, height;
+	int     i;
+
+	width  = g_rand_int_range (rand, 100, screen_width / 2);
+	height = g_rand_int_range (rand, 100, screen_height / 2);
+
+	frame = XCreateSimpleWindow (display, root,
+				     g_rand_int_range (rand, 0, screen_width - width),
+				     g_rand_int_range (rand, 0, screen_height - height),
+				     width + 2 * FRAME_EXTENT,
+				     height + TITLE_HEIGHT + FRAME_EXTENT,
+				     0, 0, 0);
+
+	for (i = 0; i < n_decorations; i++)
+		create_decoration (display, frame, width, decoration_depth);
+
+	inner = create_window (display, frame, FRAME_EXTENT, TITLE_HEIGHT,
+			       width, height);
+	client = create_window (display, inner, 0, 0, width, height);
+
+	wm_state = XInternAtom (display, "WM_STATE", False);
+	XChangeProperty (display, client, wm_state, wm_state, 32,
+			 PropModeReplace, (guchar *) state, 2);
+
+	frame_extents = XInternAtom (display, "_NET_FRAME_EXTENTS", False);
+	XChangeProperty (display, client, frame_extents, XA_CARDINAL, 32,
+			 PropModeReplace, (guchar *) extents, 4);
+
+	XMapWindow (display, frame);
+
+	return client;
+}
+
+int
+main (int argc, char **argv)
+{
+	GOptionContext    *context;
+	GError            *error = NULL;
+	Display           *display;
+	Window             root;
+	Window            *clients;
+	PanelWindowLookup *lookup;
+	GRand             *rand;
+	GTimer            *timer;
+	double             snapshot_time;
+	double             walk_time = 0, lookup_time = 0;
+	int                screen_width, screen_height;
+	int                n_resolved = 0, n_mismatches = 0;
+	int                i;
+
+	gdk_init (&argc, &argv);
+
+	context = g_option_context_new ("- compare the Force Quit window lookups");
+	g_option_context_add_main_entries (context, entries, NULL);
+	if (!g_option_context_parse (context, &argc, &argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+	g_option_context_free (context);
+
+	display = GDK_DISPLAY_XDISPLAY (gdk_display_get_default ());
+	root = DefaultRootWindow (display);
+	screen_width  = DisplayWidth  (display, DefaultScreen (display));
+	screen_height = DisplayHeight (display, DefaultScreen (display));
+
+	rand = g_rand_new_with_seed (42);
+
+	/* Created bottom to top, so that is the stacking order */
+	clients = g_new (Window, n_clients);
+	for (i = 0; i < n_clients; i++)
+		clients[i] = create_client (display, root, rand,
+					    screen_width, screen_height);
+
+	XChangeProperty (display, root,
+			 XInternAtom (display, "_NET_CLIENT_LIST_STACKING", False),
+			 XA_WINDOW, 32, PropModeReplace,
+			 (guchar *) clients, n_clients);
+	XSync (display, False);
+
+	timer = g_timer_new ();
+	lookup = panel_window_lookup_new (display, root);
+	snapshot_time = g_timer_elapsed (timer, NULL);
+
+	if (!lookup) {
+		g_printerr ("No client list found on the root window\n");
+		return 1;
+	}
+
+	for (i = 0; i < n_clicks; i++) {
+		Window toplevel;
+		Window walked, looked_up;
+		int    x, y, child_x, child_y;
+
+		x = g_rand_int_range (rand, 0, screen_width);
+		y = g_rand_int_range (rand, 0, screen_height);
+
+		/* The subwindow of the button press */
+		XTranslateCoordinates (display, root, root, x, y,
+				       &child_x, &child_y, &toplevel);
+		if (toplevel == None)
+			continue;
+
+		g_timer_start (timer);
+		walked = panel_window_lookup_find_managed (display, toplevel);
+		walk_time += g_timer_elapsed (timer, NULL);
+
+		g_timer_start (timer);
+		looked_up = panel_window_lookup_at (lookup, toplevel);
+		lookup_time += g_timer_elapsed (timer, NULL);
+
+		n_resolved++;
+		if (walked != looked_up) {
+			n_mismatches++;
+			g_print ("  at %d,%d: tree walk found 0x%lx, lookup 0x%lx\n",
+				 x, y, walked, looked_up);
+		}
+	}
+
+	if (n_resolved > 0) {
+		walk_time   /= n_resolved;
+		lookup_time /= n_resolved;
+	}
+
+	/* Force Quit takes one snapshot per click: that is what the tree
+	 * walk has to be compared with */
+	g_print ("%d clients, %d decoration windows of depth %d per frame\n",
+		 n_clients, n_decorations, decoration_depth);
+	g_print ("  snapshot:          %8.3f ms\n", snapshot_time * 1000);
+	g_print ("  lookup:            %8.3f ms per click\n", lookup_time * 1000);
+	g_print ("  snapshot + lookup: %8.3f ms per click\n",
+		 (snapshot_time + lookup_time) * 1000);
+	g_print ("  tree walk:         %8.3f ms per click\n", walk_time * 1000);
+	g_print ("  %d clicks, %d mismatches\n", n_resolved, n_mismatches);
+
+	if (n_resolved > 0 && snapshot_time + lookup_time > walk_time)
+		g_print ("  WARNING: the snapshot and lookup cost more than the tree walk they replace\n");
+
+	g_print ("  %s\n", n_mismatches == 0 ? "PASS" : "FAIL");
+
+	panel_window_lookup_free (lookup);
+	g_timer_destroy (timer);
+	g_rand_free (rand);
+	g_free (clients);
+
+	return n_mismatches == 0 ? 0 : 1;
+}
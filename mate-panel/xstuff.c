@@ -40,29 +40,67 @@ static gboolean xstuff_display_is_dead = FALSE;
 #define ZOOM_STEPS  14
 #define ZOOM_DELAY 10
 
+/* One popup per screen, hidden between launches and reused */
 typedef struct {
+	GtkWidget *window;
 	int size;
 	int size_start;
 	int size_end;
+	int step;
 	PanelOrientation orientation;
 	double opacity;
 	GdkPixbuf *pixbuf;
-	guint timeout_id;
+	cairo_surface_t *surface;
+	gint64 start_time;
+	guint tick_id;
 } CompositedZoomData;
 
-static gboolean
-zoom_timeout (GtkWidget *window)
+static void
+zoom_data_free (CompositedZoomData *zoom)
 {
-	gtk_widget_queue_draw (window);
-	return TRUE;
+	if (zoom->window)
+		gtk_widget_destroy (zoom->window);
+	if (zoom->surface)
+		cairo_surface_destroy (zoom->surface);
+	if (zoom->pixbuf)
+		g_object_unref (zoom->pixbuf);
+
+	g_slice_free (CompositedZoomData, zoom);
 }
 
 static gboolean
-idle_destroy (gpointer data)
+zoom_tick (GtkWidget     *widget,
+	   GdkFrameClock *frame_clock,
+	   gpointer       user_data)
 {
-	gtk_widget_destroy (GTK_WIDGET (data));
+	CompositedZoomData *zoom = user_data;
+	gint64 frame_time;
+	int step;
 
-	return FALSE;
+	frame_time = gdk_frame_clock_get_frame_time (frame_clock);
+	if (zoom->start_time == 0)
+		zoom->start_time = frame_time;
+
+	/* Keep the pace of one step every ZOOM_DELAY ms whatever the
+	 * refresh rate */
+	step = 1 + (frame_time - zoom->start_time) / (ZOOM_DELAY * 1000);
+	if (step == zoom->step)
+		return G_SOURCE_CONTINUE;
+
+	zoom->step = step;
+	zoom->size = zoom->size_start + step * MAX ((zoom->size_end - zoom->size_start) / ZOOM_STEPS, 1);
+	zoom->opacity = 1.0 - step / ((double) ZOOM_STEPS + 1);
+
+	if (zoom->size >= zoom->size_end) {
+		zoom->tick_id = 0;
+		gtk_widget_hide (widget);
+
+		return G_SOURCE_REMOVE;
+	}
+
+	gtk_widget_queue_draw (widget);
+
+	return G_SOURCE_CONTINUE;
 }
 
 static gboolean
@@ -71,105 +109,126 @@ zoom_draw (GtkWidget *widget,
 	     gpointer        user_data)
 {
 	CompositedZoomData *zoom;
+	int width, height;
+	int x = 0, y = 0;
 
 	zoom = user_data;
 
-	if (zoom->size >= zoom->size_end) {
-		if (zoom->timeout_id)
-			g_source_remove (zoom->timeout_id);
-		zoom->timeout_id = 0;
+	gtk_window_get_size (GTK_WINDOW (widget), &width, &height);
 
-		gtk_widget_hide (widget);
-		g_idle_add (idle_destroy, widget);
+	cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_rgba (cr, 0, 0, 0, 0.0);
+	cairo_paint (cr);
 
-		g_object_unref (zoom->pixbuf);
-		zoom->pixbuf = NULL;
-
-		g_slice_free (CompositedZoomData, zoom);
-	} else {
-		GdkPixbuf *scaled;
-		int width, height;
-		int x = 0, y = 0;
-
-		gtk_window_get_size (GTK_WINDOW (widget), &width, &height);
-
-		zoom->size += MAX ((zoom->size_end - zoom->size_start) / ZOOM_STEPS, 1);
-		zoom->opacity -= 1.0 / ((double) ZOOM_STEPS + 1);
-
-		scaled = gdk_pixbuf_scale_simple (zoom->pixbuf,
-						  zoom->size, zoom->size,
-						  GDK_INTERP_BILINEAR);
-
-		switch (zoom->orientation) {
-		case PANEL_ORIENTATION_TOP:
-			x = (width - gdk_pixbuf_get_width (scaled)) / 2;
-			y = 0;
-			break;
-
-		case PANEL_ORIENTATION_RIGHT:
-			x = width - gdk_pixbuf_get_width (scaled);
-			y = (height - gdk_pixbuf_get_height (scaled)) / 2;
-			break;
-
-		case PANEL_ORIENTATION_BOTTOM:
-			x = (width - gdk_pixbuf_get_width (scaled)) / 2;
-			y = height - gdk_pixbuf_get_height (scaled);
-			break;
-
-		case PANEL_ORIENTATION_LEFT:
-			x = 0;
-			y = (height - gdk_pixbuf_get_height (scaled)) / 2;
-			break;
-		}
+	if (!zoom->surface || zoom->size >= zoom->size_end)
+		return FALSE;
+
+	switch (zoom->orientation) {
+	case PANEL_ORIENTATION_TOP:
+		x = (width - zoom->size) / 2;
+		y = 0;
+		break;
 
-		cairo_set_operator (cr, CAIRO_OPERATOR_SOURCE);
-		cairo_set_source_rgba (cr, 0, 0, 0, 0.0);
-		cairo_rectangle (cr, 0, 0, width, height);
-		cairo_fill (cr);
+	case PANEL_ORIENTATION_RIGHT:
+		x = width - zoom->size;
+		y = (height - zoom->size) / 2;
+		break;
 
-		gdk_cairo_set_source_pixbuf (cr, scaled, x, y);
-		cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
-		cairo_paint_with_alpha (cr, MAX (zoom->opacity, 0));
+	case PANEL_ORIENTATION_BOTTOM:
+		x = (width - zoom->size) / 2;
+		y = height - zoom->size;
+		break;
 
-		g_object_unref (scaled);
+	case PANEL_ORIENTATION_LEFT:
+		x = 0;
+		y = (height - zoom->size) / 2;
+		break;
 	}
 
+	cairo_translate (cr, x, y);
+	cairo_scale (cr,
+		     (double) zoom->size / gdk_pixbuf_get_width (zoom->pixbuf),
+		     (double) zoom->size / gdk_pixbuf_get_height (zoom->pixbuf));
+	cairo_set_source_surface (cr, zoom->surface, 0, 0);
+	cairo_set_operator (cr, CAIRO_OPERATOR_OVER);
+	cairo_paint_with_alpha (cr, MAX (zoom->opacity, 0));
+
 	return FALSE;
 }
 
+static CompositedZoomData *
+get_zoom_data (GdkScreen *gscreen)
+{
+	CompositedZoomData *zoom;
+	GtkWidget *win;
+
+	zoom = g_object_get_data (G_OBJECT (gscreen), "panel-zoom-animation");
+	if (zoom)
+		return zoom;
+
+	zoom = g_slice_new0 (CompositedZoomData);
+
+	win = gtk_window_new (GTK_WINDOW_POPUP);
+
+	gtk_window_set_screen (GTK_WINDOW (win), gscreen);
+	gtk_window_set_keep_above (GTK_WINDOW (win), TRUE);
+	gtk_window_set_decorated (GTK_WINDOW (win), FALSE);
+	gtk_widget_set_app_paintable(win, TRUE);
+	gtk_widget_set_visual (win, gdk_screen_get_rgba_visual (gscreen));
+
+	gtk_window_set_gravity (GTK_WINDOW (win), GDK_GRAVITY_STATIC);
+
+	g_signal_connect (G_OBJECT (win), "draw",
+			 G_CALLBACK (zoom_draw), zoom);
+
+	/* see doc for gtk_widget_set_app_paintable() */
+	gtk_widget_realize (win);
+	gdk_window_set_background_pattern (gtk_widget_get_window (win), NULL);
+
+	zoom->window = win;
+
+	g_object_set_data_full (G_OBJECT (gscreen), "panel-zoom-animation",
+				zoom, (GDestroyNotify) zoom_data_free);
+
+	return zoom;
+}
+
 static void 
 draw_zoom_animation_composited (GdkScreen *gscreen,
 				int x, int y, int w, int h,
 				GdkPixbuf *pixbuf,
 				PanelOrientation orientation)
 {
-	GtkWidget *win;
 	CompositedZoomData *zoom;
 	int wx = 0, wy = 0;
 
 	w += 2;
 	h += 2;
 
-	zoom = g_slice_new (CompositedZoomData);
+	zoom = get_zoom_data (gscreen);
+
+	/* A new launch restarts the animation of the previous one */
 	zoom->size = w;
 	zoom->size_start = w;
 	zoom->size_end = w * ZOOM_FACTOR;
+	zoom->step = 0;
 	zoom->orientation = orientation;
 	zoom->opacity = 1.0;
-	zoom->pixbuf = g_object_ref (pixbuf);
-	zoom->timeout_id = 0;
+	zoom->start_time = 0;
 
-	win = gtk_window_new (GTK_WINDOW_POPUP);
+	/* The icon is scaled by cairo on each frame, convert it once */
+	if (zoom->pixbuf != pixbuf) {
+		if (zoom->surface)
+			cairo_surface_destroy (zoom->surface);
+		if (zoom->pixbuf)
+			g_object_unref (zoom->pixbuf);
 
-	gtk_window_set_screen (GTK_WINDOW (win), gscreen);
-	gtk_window_set_keep_above (GTK_WINDOW (win), TRUE);
-	gtk_window_set_decorated (GTK_WINDOW (win), FALSE);
-	gtk_widget_set_app_paintable(win, TRUE);
-	gtk_widget_set_visual (win, gdk_screen_get_rgba_visual (gscreen));
+		zoom->pixbuf = g_object_ref (pixbuf);
+		zoom->surface = gdk_cairo_surface_create_from_pixbuf (pixbuf, 1, NULL);
+	}
 
-	gtk_window_set_gravity (GTK_WINDOW (win), GDK_GRAVITY_STATIC);
-	gtk_window_set_default_size (GTK_WINDOW (win),
-				     w * ZOOM_FACTOR, h * ZOOM_FACTOR);
+	gtk_window_resize (GTK_WINDOW (zoom->window),
+			   w * ZOOM_FACTOR, h * ZOOM_FACTOR);
 
 	switch (zoom->orientation) {
 	case PANEL_ORIENTATION_TOP:
@@ -193,19 +252,15 @@ draw_zoom_animation_composited (GdkScreen *gscreen,
 		break;
 	}
 
-	gtk_window_move (GTK_WINDOW (win), wx, wy);
-
-	g_signal_connect (G_OBJECT (win), "draw",
-			 G_CALLBACK (zoom_draw), zoom);
+	gtk_window_move (GTK_WINDOW (zoom->window), wx, wy);
 
-	/* see doc for gtk_widget_set_app_paintable() */
-	gtk_widget_realize (win);
-	gdk_window_set_background_pattern (gtk_widget_get_window (win), NULL);
-	gtk_widget_show (win);
+	gtk_widget_show (zoom->window);
+	gtk_widget_queue_draw (zoom->window);
 
-	zoom->timeout_id = g_timeout_add (ZOOM_DELAY,
-					  (GSourceFunc) zoom_timeout,
-					  win);
+	if (!zoom->tick_id)
+		zoom->tick_id = gtk_widget_add_tick_callback (zoom->window,
+							      zoom_tick,
+							      zoom, NULL);
 }
 
 static void 